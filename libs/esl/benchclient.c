@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <esl.h>
+
+/*
+ * Event throughput benchmark.
+ *
+ * benchclient [-s seconds] [-e "plain ALL"] [-l] host[:port[:password]] ...
+ *
+ * Follows every host given on one thread with the non-blocking stream API
+ * and prints events per second.  -l uses esl_recv_event on the first host
+ * instead so the two parsers can be compared on the same load.  Both paths
+ * turn every packet into an esl_event_t so the numbers compare like for like.
+ */
+
+#define MAX_HOSTS 256
+
+typedef struct {
+	char host[256];
+	esl_port_t port;
+	char password[128];
+	esl_stream_t *stream;
+} bench_host_t;
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double cpu_used(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+}
+
+static void parse_host(bench_host_t *hp, const char *arg)
+{
+	char *p, *q;
+
+	snprintf(hp->host, sizeof(hp->host), "%s", arg);
+	hp->port = 8021;
+	snprintf(hp->password, sizeof(hp->password), "ClueCon");
+
+	if ((p = strchr(hp->host, ':'))) {
+		*p++ = '\0';
+		if ((q = strchr(p, ':'))) {
+			*q++ = '\0';
+			snprintf(hp->password, sizeof(hp->password), "%s", q);
+		}
+		hp->port = (esl_port_t) atoi(p);
+	}
+}
+
+static void report(const char *label, uint64_t events, uint64_t bytes, double elapsed, double cpu)
+{
+	printf("%s: %llu events in %.1fs, %.0f events/s, %.2f MB/s, %.2fs cpu, %.2f us cpu/event\n",
+		   label, (unsigned long long) events, elapsed, elapsed > 0 ? events / elapsed : 0,
+		   elapsed > 0 ? bytes / elapsed / (1024 * 1024) : 0, cpu, events ? cpu * 1000000 / events : 0);
+}
+
+static int run_legacy(bench_host_t *hp, const char *events, int seconds)
+{
+	esl_handle_t handle = {{0}};
+	char cmd[512];
+	uint64_t count = 0, bytes = 0;
+	double start, cpu, stop;
+
+	if (esl_connect_timeout(&handle, hp->host, hp->port, NULL, hp->password, 5000) != ESL_SUCCESS) {
+		fprintf(stderr, "%s:%d: %s\n", hp->host, hp->port, handle.err);
+		return 1;
+	}
+
+	snprintf(cmd, sizeof(cmd), "event %s\n\n", events);
+	esl_send_recv(&handle, cmd);
+
+	start = now();
+	cpu = cpu_used();
+	stop = start + seconds;
+
+	while (handle.connected && now() < stop) {
+		if (esl_recv_event_timed(&handle, 1000, 1, NULL) == ESL_SUCCESS && handle.last_event) {
+			const char *cl = esl_event_get_header(handle.last_event, "content-length");
+
+			if (handle.last_ievent) {
+				count++;
+			}
+			bytes += cl ? atol(cl) : 0;
+		}
+	}
+
+	report("legacy", count, bytes, now() - start, cpu_used() - cpu);
+
+	esl_disconnect(&handle);
+
+	return 0;
+}
+
+static int run_stream(bench_host_t *hosts, int nhosts, const char *events, int seconds)
+{
+	struct pollfd pfds[MAX_HOSTS];
+	char cmd[512];
+	uint64_t count = 0, last_count = 0, bytes = 0;
+	double start, cpu, stop, tick;
+	int i, live = 0;
+
+	snprintf(cmd, sizeof(cmd), "event %s", events);
+
+	for (i = 0; i < nhosts; i++) {
+		char err[256] = "";
+
+		if (esl_stream_connect(&hosts[i].stream, hosts[i].host, hosts[i].port, NULL, hosts[i].password, 5000, err, sizeof(err)) != ESL_SUCCESS) {
+			fprintf(stderr, "%s:%d: %s\n", hosts[i].host, hosts[i].port, err);
+			continue;
+		}
+
+		esl_stream_send(hosts[i].stream, cmd);
+		live++;
+	}
+
+	if (!live) {
+		return 1;
+	}
+
+	start = tick = now();
+	cpu = cpu_used();
+	stop = start + seconds;
+
+	while (live && now() < stop) {
+		int n = 0;
+
+		for (i = 0; i < nhosts; i++) {
+			if (!hosts[i].stream) {
+				continue;
+			}
+			pfds[n].fd = esl_stream_socket(hosts[i].stream);
+			pfds[n].events = POLLIN | (esl_stream_pending(hosts[i].stream) ? POLLOUT : 0);
+			pfds[n].revents = 0;
+			n++;
+		}
+
+		if (poll(pfds, n, 1000) < 0) {
+			break;
+		}
+
+		for (i = 0, n = 0; i < nhosts; i++) {
+			esl_frame_t *frame;
+			struct pollfd *pfd;
+
+			if (!hosts[i].stream) {
+				continue;
+			}
+
+			pfd = &pfds[n++];
+
+			if ((pfd->revents & POLLOUT) && esl_stream_flush(hosts[i].stream) == ESL_FAIL) {
+				pfd->revents |= POLLHUP;
+			}
+
+			if ((pfd->revents & (POLLIN | POLLHUP | POLLERR)) && esl_stream_read(hosts[i].stream) != ESL_SUCCESS) {
+				fprintf(stderr, "%s:%d: %s\n", hosts[i].host, hosts[i].port, esl_stream_error(hosts[i].stream));
+				esl_stream_destroy(&hosts[i].stream);
+				live--;
+				continue;
+			}
+
+			while (esl_stream_next_frame(hosts[i].stream, &frame) == ESL_SUCCESS) {
+				esl_event_t *event = NULL;
+				int json = frame->body && !esl_safe_strcasecmp(frame->content_type, "text/event-json");
+				esl_status_t status;
+
+				/* build the same esl_event_t the legacy path gets, so both sides pay for a full decode */
+				if (json) {
+					status = esl_event_create_json(&event, frame->body);
+				} else {
+					status = esl_frame_to_event(frame, &event);
+				}
+
+				if (status == ESL_SUCCESS && event) {
+					if (json || frame->event_header_count) {
+						count++;
+					}
+					esl_event_destroy(&event);
+				}
+				bytes += frame->body_len;
+				esl_frame_destroy(&frame);
+			}
+		}
+
+		if (now() - tick >= 1.0) {
+			tick = now();
+			printf("%llu events/s\n", (unsigned long long) (count - last_count));
+			last_count = count;
+		}
+	}
+
+	for (i = 0; i < nhosts; i++) {
+		esl_stream_destroy(&hosts[i].stream);
+	}
+
+	report("stream", count, bytes, now() - start, cpu_used() - cpu);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	bench_host_t hosts[MAX_HOSTS];
+	const char *events = "plain ALL";
+	int seconds = 10, legacy = 0, nhosts = 0, i;
+
+	memset(hosts, 0, sizeof(hosts));
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			seconds = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+			events = argv[++i];
+		} else if (!strcmp(argv[i], "-l")) {
+			legacy = 1;
+		} else if (*argv[i] == '-') {
+			fprintf(stderr, "usage: %s [-s seconds] [-e \"plain ALL\"] [-l] host[:port[:password]] ...\n", argv[0]);
+			return 1;
+		} else if (nhosts < MAX_HOSTS) {
+			parse_host(&hosts[nhosts++], argv[i]);
+		}
+	}
+
+	if (!nhosts) {
+		parse_host(&hosts[nhosts++], "localhost");
+	}
+
+	if (legacy) {
+		return run_legacy(&hosts[0], events, seconds);
+	}
+
+	return run_stream(hosts, nhosts, events, seconds);
+}
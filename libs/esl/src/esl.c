@@ -1102,6 +1102,12 @@ ESL_DECLARE(esl_status_t) esl_disconnect(esl_handle_t *handle)
 	handle->connected = 0;
 
 	esl_event_safe_destroy(&handle->race_event);
+	while (handle->async_reply) {
+		esl_event_t *ep = handle->async_reply;
+		handle->async_reply = ep->next;
+		ep->next = NULL;
+		esl_event_destroy(&ep);
+	}
 	esl_event_safe_destroy(&handle->last_event);
 	esl_event_safe_destroy(&handle->last_sr_event);
 	esl_event_safe_destroy(&handle->last_ievent);
@@ -1519,15 +1525,15 @@ ESL_DECLARE(esl_status_t) esl_send_recv_timed(esl_handle_t *handle, const char *
 	if (handle->last_sr_event) {
 		char *ct = esl_event_get_header(handle->last_sr_event,"content-type");
 
-		if (strcasecmp(ct, "api/response") && strcasecmp(ct, "command/reply")) {
-			esl_event_t *ep;
+		if ((strcasecmp(ct, "api/response") && strcasecmp(ct, "command/reply")) || esl_event_get_header(handle->last_sr_event, "request-id")) {
+			esl_event_t *ep, **queue = esl_event_get_header(handle->last_sr_event, "request-id") ? &handle->async_reply : &handle->race_event;
 
-			for(ep = handle->race_event; ep && ep->next; ep = ep->next);
+			for(ep = *queue; ep && ep->next; ep = ep->next);
 			
 			if (ep) {
 				ep->next = handle->last_sr_event;
 			} else {
-				handle->race_event = handle->last_sr_event;
+				*queue = handle->last_sr_event;
 			}
 
 			handle->last_sr_event = NULL;
@@ -1559,6 +1565,107 @@ ESL_DECLARE(esl_status_t) esl_send_recv_timed(esl_handle_t *handle, const char *
 }
 
 
+ESL_DECLARE(esl_status_t) esl_api_async(esl_handle_t *handle, const char *cmd, const char *request_id, char *id_buf, esl_size_t id_len)
+{
+	char id[64];
+	char *send_buf;
+	esl_size_t len;
+	esl_status_t status;
+
+	if (!handle || !handle->connected || handle->sock == ESL_SOCK_INVALID || esl_strlen_zero(cmd)) {
+		return ESL_FAIL;
+	}
+
+	esl_mutex_lock(handle->mutex);
+
+	if (esl_strlen_zero(request_id)) {
+		snprintf(id, sizeof(id), "%lu", ++handle->request_id);
+	} else {
+		snprintf(id, sizeof(id), "%s", request_id);
+	}
+
+	if (id_buf && id_len) {
+		snprintf(id_buf, id_len, "%s", id);
+	}
+
+	len = strlen(cmd) + strlen(id) + 32;
+	send_buf = malloc(len);
+	esl_assert(send_buf);
+	snprintf(send_buf, len, "api %s\nRequest-ID: %s\n\n", cmd, id);
+
+	status = esl_send(handle, send_buf);
+	free(send_buf);
+
+	esl_mutex_unlock(handle->mutex);
+
+	return status;
+}
+
+ESL_DECLARE(esl_status_t) esl_api_async_recv(esl_handle_t *handle, uint32_t ms, esl_event_t **reply)
+{
+	esl_event_t *revent = NULL;
+	esl_status_t status = ESL_SUCCESS;
+
+	if (!handle || !reply) {
+		return ESL_FAIL;
+	}
+
+	*reply = NULL;
+
+	esl_mutex_lock(handle->mutex);
+
+	while (!*reply) {
+		if (handle->async_reply) {
+			*reply = handle->async_reply;
+			handle->async_reply = (*reply)->next;
+			(*reply)->next = NULL;
+			break;
+		}
+
+		if (!handle->connected || handle->sock == ESL_SOCK_INVALID) {
+			status = ESL_FAIL;
+			break;
+		}
+
+		revent = NULL;
+
+		/* replies that came in with an earlier read are already buffered, polling the socket for them would just time out */
+		if (esl_buffer_packet_count(handle->packet_buf)) {
+			status = esl_recv_event(handle, 0, &revent);
+		} else {
+			status = esl_recv_event_timed(handle, ms, 0, &revent);
+		}
+
+		if (status != ESL_SUCCESS || !revent) {
+			if (revent) {
+				esl_event_destroy(&revent);
+			}
+			if (status == ESL_SUCCESS) {
+				status = ESL_BREAK;
+			}
+			break;
+		}
+
+		if (esl_event_get_header(revent, "request-id") && !esl_safe_strcasecmp(esl_event_get_header(revent, "content-type"), "api/response")) {
+			*reply = revent;
+		} else {
+			esl_event_t *ep;
+
+			for(ep = handle->race_event; ep && ep->next; ep = ep->next);
+			
+			if (ep) {
+				ep->next = revent;
+			} else {
+				handle->race_event = revent;
+			}
+		}
+	}
+
+	esl_mutex_unlock(handle->mutex);
+
+	return status;
+}
+
 ESL_DECLARE(unsigned int) esl_separate_string_string(char *buf, const char *delim, char **array, unsigned int arraylen)
 {
 	unsigned int count = 0;
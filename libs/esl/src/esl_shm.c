@@ -0,0 +1,508 @@
+/*
+ * Copyright (c) 2010-2012, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "esl_shm.h"
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+/* switch_event_binary_serialize() writes a tpl image of this map */
+#define ESL_SHM_EVENT_MAP "S(iiisss)A(S(ss))"
+#define ESL_TPL_FL_BIGENDIAN (1 << 0)
+
+typedef struct {
+	const unsigned char *p;
+	const unsigned char *e;
+	int swap;
+} tpl_cursor_t;
+
+static int tpl_u32(tpl_cursor_t *tc, uint32_t *val)
+{
+	unsigned char b[4];
+
+	if (tc->e - tc->p < 4) {
+		return 0;
+	}
+
+	memcpy(b, tc->p, 4);
+	tc->p += 4;
+
+	if (tc->swap) {
+		unsigned char t = b[0]; b[0] = b[3]; b[3] = t;
+		t = b[1]; b[1] = b[2]; b[2] = t;
+	}
+
+	memcpy(val, b, 4);
+
+	return 1;
+}
+
+/* strings are a length (strlen + 1, 0 for NULL) followed by the bytes without a terminator */
+static int tpl_str(tpl_cursor_t *tc, char **str)
+{
+	uint32_t slen;
+
+	*str = NULL;
+
+	if (!tpl_u32(tc, &slen)) {
+		return 0;
+	}
+
+	if (!slen) {
+		return 1;
+	}
+
+	if ((uint32_t)(tc->e - tc->p) < slen - 1 || !(*str = malloc(slen))) {
+		return 0;
+	}
+
+	memcpy(*str, tc->p, slen - 1);
+	(*str)[slen - 1] = '\0';
+	tc->p += slen - 1;
+
+	return 1;
+}
+
+ESL_DECLARE(esl_status_t) esl_event_binary_deserialize(esl_event_t **event, const void *data, esl_size_t len)
+{
+	tpl_cursor_t tc;
+	const unsigned char *d = data;
+	esl_event_t *revent = NULL;
+	uint32_t ival, count, i;
+	char *owner = NULL, *subclass = NULL, *body = NULL;
+	unsigned int one = 1;
+	int host_big = *(unsigned char *) &one == 1 ? 0 : 1;
+	const char *ename;
+
+	*event = NULL;
+
+	if (len < 8 + sizeof(ESL_SHM_EVENT_MAP) || memcmp(d, "tpl", 3)) {
+		return ESL_FAIL;
+	}
+
+	tc.swap = ((d[3] & ESL_TPL_FL_BIGENDIAN) ? 1 : 0) != host_big;
+	tc.p = d + 8;
+	tc.e = d + len;
+
+	if (memcmp(tc.p, ESL_SHM_EVENT_MAP, sizeof(ESL_SHM_EVENT_MAP))) {
+		return ESL_FAIL;
+	}
+	tc.p += sizeof(ESL_SHM_EVENT_MAP);
+
+	/* event_id, priority and flags; the id is the switch enum so the name header is used instead */
+	for (i = 0; i < 3; i++) {
+		if (!tpl_u32(&tc, &ival)) {
+			return ESL_FAIL;
+		}
+	}
+
+	if (!tpl_str(&tc, &owner) || !tpl_str(&tc, &subclass) || !tpl_str(&tc, &body) || !tpl_u32(&tc, &count)) {
+		goto fail;
+	}
+
+	esl_event_create(&revent, ESL_EVENT_CLONE);
+	revent->owner = owner;
+	revent->subclass_name = subclass;
+	revent->body = body;
+	owner = subclass = body = NULL;
+
+	for (i = 0; i < count; i++) {
+		char *name, *value;
+
+		if (!tpl_str(&tc, &name)) {
+			goto fail;
+		}
+
+		if (!tpl_str(&tc, &value)) {
+			esl_safe_free(name);
+			goto fail;
+		}
+
+		if (name && value) {
+			esl_event_add_header_string(revent, ESL_STACK_BOTTOM, name, value);
+		}
+
+		esl_safe_free(name);
+		esl_safe_free(value);
+	}
+
+	if ((ename = esl_event_get_header(revent, "event-name"))) {
+		esl_name_event(ename, &revent->event_id);
+	}
+
+	*event = revent;
+
+	return ESL_SUCCESS;
+
+ fail:
+
+	esl_safe_free(owner);
+	esl_safe_free(subclass);
+	esl_safe_free(body);
+
+	if (revent) {
+		esl_event_destroy(&revent);
+	}
+
+	return ESL_FAIL;
+}
+
+#ifndef WIN32
+
+/* must match mod_event_shm.c */
+#define ESL_SHM_MAGIC "FSEVSHM1"
+#define ESL_SHM_VERSION 1
+#define ESL_SHM_STATE_RUNNING 1
+#define ESL_SHM_DEFAULT_PATH "/dev/shm/freeswitch.events"
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t data_size;
+	volatile uint64_t head;
+	volatile uint64_t tail;
+	volatile uint64_t seq;
+	volatile uint64_t dropped;
+	volatile uint64_t epoch;
+	volatile uint32_t state;
+	uint32_t pid;
+	int64_t created;
+} esl_shm_header_t;
+
+typedef struct {
+	uint32_t size;
+	uint32_t len;
+	uint64_t seq;
+} esl_shm_record_t;
+
+#define esl_shm_barrier() __sync_synchronize()
+
+struct esl_shm_reader {
+	char path[512];
+	int fd;
+	ino_t ino;
+	void *map;
+	size_t map_len;
+	esl_shm_header_t *header;
+	const unsigned char *ring;
+	uint64_t cursor;
+	uint64_t epoch;
+	uint64_t next_seq;
+	uint64_t lost;
+	unsigned char *buf;
+	esl_size_t buf_size;
+};
+
+static void shm_detach(esl_shm_reader_t *reader)
+{
+	if (reader->map) {
+		munmap(reader->map, reader->map_len);
+		reader->map = NULL;
+		reader->header = NULL;
+		reader->ring = NULL;
+	}
+
+	if (reader->fd > -1) {
+		close(reader->fd);
+		reader->fd = -1;
+	}
+}
+
+static esl_status_t shm_attach(esl_shm_reader_t *reader, esl_shm_start_t start)
+{
+	struct stat st;
+	esl_shm_header_t *hp;
+
+	if ((reader->fd = open(reader->path, O_RDONLY)) < 0) {
+		return ESL_FAIL;
+	}
+
+	if (fstat(reader->fd, &st) || (size_t) st.st_size < sizeof(*hp)) {
+		goto fail;
+	}
+
+	reader->ino = st.st_ino;
+	reader->map_len = (size_t) st.st_size;
+
+	if ((reader->map = mmap(NULL, reader->map_len, PROT_READ, MAP_SHARED, reader->fd, 0)) == MAP_FAILED) {
+		reader->map = NULL;
+		goto fail;
+	}
+
+	hp = reader->header = (esl_shm_header_t *) reader->map;
+
+	if (memcmp(hp->magic, ESL_SHM_MAGIC, 8) || hp->version != ESL_SHM_VERSION ||
+		(uint64_t) hp->header_size + hp->data_size != (uint64_t) reader->map_len || !hp->data_size) {
+		goto fail;
+	}
+
+	reader->ring = (const unsigned char *) reader->map + hp->header_size;
+	reader->epoch = hp->epoch;
+	esl_shm_barrier();
+	reader->cursor = start == ESL_SHM_FROM_OLDEST ? hp->tail : hp->head;
+	reader->next_seq = 0;
+
+	return ESL_SUCCESS;
+
+ fail:
+
+	shm_detach(reader);
+
+	return ESL_FAIL;
+}
+
+/* the switch restarted: either the same file was reset (new epoch) or it was replaced by one of another size */
+static int shm_check_restart(esl_shm_reader_t *reader)
+{
+	esl_shm_header_t *hp = reader->header;
+	struct stat st;
+
+	if (hp && hp->state == ESL_SHM_STATE_RUNNING && hp->epoch == reader->epoch) {
+		return 0;
+	}
+
+	if (hp && hp->state == ESL_SHM_STATE_RUNNING) {
+		reader->epoch = hp->epoch;
+		esl_shm_barrier();
+		reader->cursor = hp->tail;
+		reader->next_seq = 0;
+		return 1;
+	}
+
+	if (!stat(reader->path, &st) && (!hp || st.st_ino != reader->ino)) {
+		shm_detach(reader);
+		shm_attach(reader, ESL_SHM_FROM_OLDEST);
+		return 1;
+	}
+
+	return 0;
+}
+
+ESL_DECLARE(esl_status_t) esl_shm_reader_open(esl_shm_reader_t **reader, const char *path, esl_shm_start_t start)
+{
+	esl_shm_reader_t *new_reader;
+
+	if (!(new_reader = malloc(sizeof(*new_reader)))) {
+		return ESL_FAIL;
+	}
+	memset(new_reader, 0, sizeof(*new_reader));
+	new_reader->fd = -1;
+
+	snprintf(new_reader->path, sizeof(new_reader->path), "%s", esl_strlen_zero(path) ? ESL_SHM_DEFAULT_PATH : path);
+
+	if (shm_attach(new_reader, start) != ESL_SUCCESS) {
+		free(new_reader);
+		return ESL_FAIL;
+	}
+
+	*reader = new_reader;
+
+	return ESL_SUCCESS;
+}
+
+ESL_DECLARE(void) esl_shm_reader_close(esl_shm_reader_t **reader)
+{
+	esl_shm_reader_t *rp;
+
+	if (!reader || !(rp = *reader)) {
+		return;
+	}
+
+	shm_detach(rp);
+	esl_safe_free(rp->buf);
+	free(rp);
+
+	*reader = NULL;
+}
+
+ESL_DECLARE(esl_status_t) esl_shm_reader_next(esl_shm_reader_t *reader, const void **data, esl_size_t *len)
+{
+	esl_shm_header_t *hp;
+	esl_shm_record_t rec;
+	uint64_t head, off;
+
+	shm_check_restart(reader);
+
+	if (!(hp = reader->header)) {
+		return ESL_BREAK;
+	}
+
+	for (;;) {
+		head = hp->head;
+		esl_shm_barrier();
+
+		if (reader->cursor == head) {
+			return ESL_BREAK;
+		}
+
+		/* lapped by the writer, or the ring was reset under us */
+		if (reader->cursor < hp->tail || reader->cursor > head) {
+			reader->cursor = hp->tail;
+			continue;
+		}
+
+		off = reader->cursor % hp->data_size;
+		memcpy(&rec, reader->ring + off, sizeof(rec));
+
+		if (rec.size < sizeof(rec) || (rec.size & 15) || off + rec.size > hp->data_size || rec.len > rec.size - sizeof(rec)) {
+			esl_shm_barrier();
+			reader->cursor = hp->tail > reader->cursor ? hp->tail : head;
+			continue;
+		}
+
+		if (!rec.len) {
+			reader->cursor += rec.size;
+			continue;
+		}
+
+		if (rec.len > reader->buf_size) {
+			unsigned char *new_buf;
+
+			if (!(new_buf = realloc(reader->buf, rec.len))) {
+				return ESL_FAIL;
+			}
+			reader->buf = new_buf;
+			reader->buf_size = rec.len;
+		}
+
+		memcpy(reader->buf, reader->ring + off + sizeof(rec), rec.len);
+		esl_shm_barrier();
+
+		/* the writer moves tail before it overwrites anything, so this catches a torn copy */
+		if (reader->cursor < hp->tail) {
+			continue;
+		}
+
+		if (reader->next_seq && rec.seq > reader->next_seq) {
+			reader->lost += rec.seq - reader->next_seq;
+		}
+		reader->next_seq = rec.seq + 1;
+		reader->cursor += rec.size;
+
+		*data = reader->buf;
+		*len = rec.len;
+
+		return ESL_SUCCESS;
+	}
+}
+
+ESL_DECLARE(esl_status_t) esl_shm_reader_next_event(esl_shm_reader_t *reader, esl_event_t **event)
+{
+	const void *data;
+	esl_size_t len;
+	esl_status_t status;
+
+	while ((status = esl_shm_reader_next(reader, &data, &len)) == ESL_SUCCESS) {
+		if (esl_event_binary_deserialize(event, data, len) == ESL_SUCCESS) {
+			return ESL_SUCCESS;
+		}
+	}
+
+	return status;
+}
+
+ESL_DECLARE(esl_status_t) esl_shm_reader_wait(esl_shm_reader_t *reader, uint32_t ms)
+{
+	uint32_t waited = 0, step = 1;
+
+	for (;;) {
+		shm_check_restart(reader);
+
+		if (reader->header && reader->cursor != reader->header->head) {
+			return ESL_SUCCESS;
+		}
+
+		if (waited >= ms) {
+			return ESL_BREAK;
+		}
+
+		usleep(step * 1000);
+		waited += step;
+
+		if (step < 10) {
+			step++;
+		}
+	}
+}
+
+ESL_DECLARE(uint64_t) esl_shm_reader_lost(esl_shm_reader_t *reader)
+{
+	return reader->lost;
+}
+
+#else
+
+ESL_DECLARE(esl_status_t) esl_shm_reader_open(esl_shm_reader_t **reader, const char *path, esl_shm_start_t start)
+{
+	return ESL_FAIL;
+}
+
+ESL_DECLARE(void) esl_shm_reader_close(esl_shm_reader_t **reader)
+{
+}
+
+ESL_DECLARE(esl_status_t) esl_shm_reader_next(esl_shm_reader_t *reader, const void **data, esl_size_t *len)
+{
+	return ESL_FAIL;
+}
+
+ESL_DECLARE(esl_status_t) esl_shm_reader_next_event(esl_shm_reader_t *reader, esl_event_t **event)
+{
+	return ESL_FAIL;
+}
+
+ESL_DECLARE(esl_status_t) esl_shm_reader_wait(esl_shm_reader_t *reader, uint32_t ms)
+{
+	return ESL_FAIL;
+}
+
+ESL_DECLARE(uint64_t) esl_shm_reader_lost(esl_shm_reader_t *reader)
+{
+	return 0;
+}
+
+#endif
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
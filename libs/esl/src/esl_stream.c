@@ -0,0 +1,715 @@
+/*
+ * Copyright (c) 2010-2012, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "esl_stream.h"
+#ifndef WIN32
+#define closesocket(x) shutdown(x, 2); close(x)
+#include <fcntl.h>
+#include <errno.h>
+#define esl_stream_errno() errno
+#define esl_stream_would_block(e) ((e) == EAGAIN || (e) == EWOULDBLOCK)
+#define esl_stream_interrupted(e) ((e) == EINTR)
+#else
+#define esl_stream_errno() WSAGetLastError()
+#define esl_stream_would_block(e) ((e) == WSAEWOULDBLOCK)
+#define esl_stream_interrupted(e) ((e) == WSAEINTR)
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define ESL_STREAM_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define ESL_STREAM_SEND_FLAGS 0
+#endif
+
+#define ESL_STREAM_READ_CHUNK 65536
+#define ESL_STREAM_START_LEN (ESL_STREAM_READ_CHUNK * 4)
+/* most one esl_stream_read takes in, so one busy socket cannot starve the others in the caller's loop */
+#define ESL_STREAM_READ_MAX (ESL_STREAM_READ_CHUNK * 16)
+/* largest the receive buffer may grow, which also bounds the largest packet accepted */
+#define ESL_STREAM_MAX_LEN (1024 * 1024 * 64)
+
+struct esl_stream {
+	esl_socket_t sock;
+	/* receive buffer, unparsed data lives in [in_start, in_end) */
+	char *in;
+	esl_size_t in_size;
+	esl_size_t in_start;
+	esl_size_t in_end;
+	/* how far past in_start the header terminator search already got */
+	esl_size_t scan;
+	/* header block length (terminator included) of the packet at in_start, 0 until it is complete */
+	esl_size_t hdr_len;
+	esl_size_t body_len;
+	int event_plain;
+	/* pending output in [out_start, out_end) */
+	char *out;
+	esl_size_t out_size;
+	esl_size_t out_start;
+	esl_size_t out_end;
+	uint64_t bytes;
+	uint64_t frames;
+	char err[256];
+};
+
+static void stream_set_error(esl_stream_t *stream, const char *what, int errnum)
+{
+	char buf[128] = "";
+
+	if (errnum) {
+		if (strerror_r(errnum, buf, sizeof(buf))) {
+			*buf = '\0';
+		}
+	}
+
+	snprintf(stream->err, sizeof(stream->err), "%s%s%s", what, *buf ? ": " : "", buf);
+}
+
+static esl_status_t stream_reserve(esl_stream_t *stream, esl_size_t need)
+{
+	char *new_in;
+	esl_size_t new_size;
+
+	if (stream->in_size - stream->in_end >= need) {
+		return ESL_SUCCESS;
+	}
+
+	/* slide unparsed data to the front before growing */
+	if (stream->in_start) {
+		esl_size_t used = stream->in_end - stream->in_start;
+
+		if (used) {
+			memmove(stream->in, stream->in + stream->in_start, used);
+		}
+		stream->in_start = 0;
+		stream->in_end = used;
+
+		if (stream->in_size - stream->in_end >= need) {
+			return ESL_SUCCESS;
+		}
+	}
+
+	if (stream->in_end + need > ESL_STREAM_MAX_LEN) {
+		return ESL_BREAK;
+	}
+
+	new_size = stream->in_size ? stream->in_size : ESL_STREAM_START_LEN;
+	while (new_size - stream->in_end < need) {
+		new_size *= 2;
+	}
+
+	if (new_size > ESL_STREAM_MAX_LEN) {
+		new_size = ESL_STREAM_MAX_LEN;
+	}
+
+	if (!(new_in = realloc(stream->in, new_size))) {
+		stream_set_error(stream, "Out of memory", 0);
+		return ESL_FAIL;
+	}
+
+	stream->in = new_in;
+	stream->in_size = new_size;
+
+	return ESL_SUCCESS;
+}
+
+static esl_status_t stream_set_nonblocking(esl_socket_t sock)
+{
+#ifdef WIN32
+	u_long arg = 1;
+
+	if (ioctlsocket(sock, FIONBIO, &arg) == SOCKET_ERROR) {
+		return ESL_FAIL;
+	}
+#else
+	int fd_flags = fcntl(sock, F_GETFL, 0);
+
+	if (fd_flags < 0 || fcntl(sock, F_SETFL, fd_flags | O_NONBLOCK)) {
+		return ESL_FAIL;
+	}
+#endif
+
+	return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t) esl_stream_attach(esl_stream_t **stream, esl_handle_t *handle)
+{
+	esl_stream_t *new_stream;
+	esl_size_t buffered = 0;
+
+	if (!handle || !handle->connected || handle->sock == ESL_SOCK_INVALID) {
+		return ESL_FAIL;
+	}
+
+	if (!(new_stream = malloc(sizeof(*new_stream)))) {
+		return ESL_FAIL;
+	}
+	memset(new_stream, 0, sizeof(*new_stream));
+
+	if (handle->packet_buf) {
+		buffered = esl_buffer_inuse(handle->packet_buf);
+	}
+
+	if (stream_reserve(new_stream, buffered > ESL_STREAM_READ_CHUNK ? buffered : ESL_STREAM_READ_CHUNK) != ESL_SUCCESS) {
+		free(new_stream);
+		return ESL_FAIL;
+	}
+
+	if (stream_set_nonblocking(handle->sock) != ESL_SUCCESS) {
+		free(new_stream->in);
+		free(new_stream);
+		return ESL_FAIL;
+	}
+
+	esl_mutex_lock(handle->mutex);
+
+	/* anything read past the auth reply belongs to the stream now */
+	if (buffered) {
+		new_stream->in_end = esl_buffer_read(handle->packet_buf, new_stream->in, buffered);
+	}
+
+	new_stream->sock = handle->sock;
+	handle->sock = ESL_SOCK_INVALID;
+	handle->connected = 0;
+
+	esl_mutex_unlock(handle->mutex);
+
+	*stream = new_stream;
+
+	return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t) esl_stream_connect(esl_stream_t **stream, const char *host, esl_port_t port,
+											 const char *user, const char *password, uint32_t timeout, char *err, esl_size_t errlen)
+{
+	esl_handle_t *handle;
+	esl_status_t status;
+
+	if (!(handle = malloc(sizeof(*handle)))) {
+		return ESL_FAIL;
+	}
+	memset(handle, 0, sizeof(*handle));
+
+	if ((status = esl_connect_timeout(handle, host, port, user, password, timeout)) == ESL_SUCCESS) {
+		status = esl_stream_attach(stream, handle);
+	}
+
+	if (status != ESL_SUCCESS && err && errlen) {
+		snprintf(err, errlen, "%s", *handle->err ? handle->err : "Connection failed");
+	}
+
+	esl_disconnect(handle);
+	free(handle);
+
+	return status;
+}
+
+ESL_DECLARE(void) esl_stream_destroy(esl_stream_t **stream)
+{
+	esl_stream_t *sp;
+
+	if (!stream || !(sp = *stream)) {
+		return;
+	}
+
+	if (sp->sock != ESL_SOCK_INVALID) {
+		closesocket(sp->sock);
+		sp->sock = ESL_SOCK_INVALID;
+	}
+
+	esl_safe_free(sp->in);
+	esl_safe_free(sp->out);
+	free(sp);
+
+	*stream = NULL;
+}
+
+ESL_DECLARE(esl_socket_t) esl_stream_socket(esl_stream_t *stream)
+{
+	return stream->sock;
+}
+
+ESL_DECLARE(const char *) esl_stream_error(esl_stream_t *stream)
+{
+	return stream->err;
+}
+
+ESL_DECLARE(esl_size_t) esl_stream_pending(esl_stream_t *stream)
+{
+	return stream->out_end - stream->out_start;
+}
+
+ESL_DECLARE(void) esl_stream_stats(esl_stream_t *stream, uint64_t *bytes, uint64_t *frames)
+{
+	if (bytes) {
+		*bytes = stream->bytes;
+	}
+
+	if (frames) {
+		*frames = stream->frames;
+	}
+}
+
+ESL_DECLARE(esl_status_t) esl_stream_read(esl_stream_t *stream)
+{
+	esl_size_t got = 0, room;
+	esl_ssize_t r;
+	esl_status_t status;
+	int errnum;
+
+	if (stream->sock == ESL_SOCK_INVALID) {
+		return ESL_DISCONNECTED;
+	}
+
+	while (got < ESL_STREAM_READ_MAX) {
+		if ((status = stream_reserve(stream, ESL_STREAM_READ_CHUNK)) == ESL_BREAK) {
+			/* whatever is buffered has to be taken with esl_stream_next_frame first */
+			if (got) {
+				return ESL_SUCCESS;
+			}
+			stream_set_error(stream, "Packet too large", 0);
+			return ESL_FAIL;
+		}
+
+		if (status != ESL_SUCCESS) {
+			return ESL_FAIL;
+		}
+
+		room = stream->in_size - stream->in_end;
+		if (room > ESL_STREAM_READ_MAX - got) {
+			room = ESL_STREAM_READ_MAX - got;
+		}
+
+		r = recv(stream->sock, stream->in + stream->in_end, (int) room, 0);
+
+		if (r > 0) {
+			stream->in_end += r;
+			stream->bytes += r;
+			got += r;
+			continue;
+		}
+
+		if (r == 0) {
+			stream_set_error(stream, "Connection closed", 0);
+			return ESL_DISCONNECTED;
+		}
+
+		errnum = esl_stream_errno();
+
+		if (esl_stream_interrupted(errnum)) {
+			continue;
+		}
+
+		if (esl_stream_would_block(errnum)) {
+			return ESL_SUCCESS;
+		}
+
+		stream_set_error(stream, "Read error", errnum);
+		return ESL_DISCONNECTED;
+	}
+
+	return ESL_SUCCESS;
+}
+
+/* Header lines look like "Name: value", the block ends with an empty line. */
+static int header_line_is(const char *line, const char *end, const char *name, esl_size_t name_len)
+{
+	return (esl_size_t)(end - line) > name_len && line[name_len] == ':' && !strncasecmp(line, name, name_len);
+}
+
+static esl_size_t count_lines(const char *p, const char *e)
+{
+	esl_size_t n = 1;
+
+	while (p < e && (p = memchr(p, '\n', e - p))) {
+		n++;
+		p++;
+	}
+
+	return n;
+}
+
+/* Split the lines in [p, e) into headers, in place.  Stops at the first empty line and returns where it ended. */
+static char *parse_headers(char *p, char *e, esl_frame_header_t *headers, int *count)
+{
+	int n = 0;
+
+	while (p < e) {
+		char *line = p, *nl, *col, *val;
+
+		if (!(nl = memchr(p, '\n', e - p))) {
+			nl = e;
+		}
+
+		p = nl < e ? nl + 1 : e;
+
+		if (nl > line && *(nl - 1) == '\r') {
+			nl--;
+		}
+
+		if (nl == line) {
+			break;
+		}
+
+		*nl = '\0';
+
+		if (!(col = memchr(line, ':', nl - line))) {
+			continue;
+		}
+
+		*col = '\0';
+		val = col + 1;
+		while (*val == ' ' || *val == '\t') val++;
+
+		if (memchr(val, '%', nl - val)) {
+			esl_url_decode(val);
+		}
+
+		headers[n].name = line;
+		headers[n].value = val;
+		n++;
+	}
+
+	*count = n;
+
+	return p;
+}
+
+static const char *find_header(esl_frame_header_t *headers, int count, const char *name)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!strcasecmp(headers[i].name, name)) {
+			return headers[i].value;
+		}
+	}
+
+	return NULL;
+}
+
+/* Find the end of the header block of the packet at in_start and pull out what is needed to size the frame. */
+static int stream_scan_headers(esl_stream_t *stream)
+{
+	char *base, *e, *p, *line;
+	esl_size_t avail;
+
+	/* stray newlines between packets */
+	while (stream->in_start < stream->in_end && (stream->in[stream->in_start] == '\n' || stream->in[stream->in_start] == '\r')) {
+		stream->in_start++;
+	}
+
+	base = stream->in + stream->in_start;
+	avail = stream->in_end - stream->in_start;
+	e = base + avail;
+	p = base + (stream->scan ? stream->scan - 1 : 0);
+
+	for (;;) {
+		char *pe;
+
+		if (p >= e || !(p = memchr(p, '\n', e - p))) {
+			/* remember where we got, the terminator may be split across reads */
+			stream->scan = avail;
+			return 0;
+		}
+
+		pe = p + 1;
+		if (pe < e && *pe == '\r') pe++;
+
+		if (pe >= e) {
+			stream->scan = p - base;
+			return 0;
+		}
+
+		if (*pe == '\n') {
+			stream->hdr_len = (pe + 1) - base;
+			break;
+		}
+
+		p++;
+	}
+
+	stream->body_len = 0;
+	stream->event_plain = 0;
+
+	for (line = base; line < base + stream->hdr_len; ) {
+		char *nl = memchr(line, '\n', (base + stream->hdr_len) - line);
+
+		if (header_line_is(line, nl, "Content-Length", 14)) {
+			stream->body_len = (esl_size_t) atol(line + 15);
+		} else if (header_line_is(line, nl, "Content-Type", 12)) {
+			char *v = line + 13;
+			while (*v == ' ') v++;
+			stream->event_plain = !strncasecmp(v, "text/event-plain", 16);
+		}
+
+		line = nl + 1;
+	}
+
+	return 1;
+}
+
+ESL_DECLARE(esl_status_t) esl_stream_next_frame(esl_stream_t *stream, esl_frame_t **frame)
+{
+	esl_frame_t *fp;
+	esl_size_t nh, neh = 0, size;
+	char *src, *arena;
+
+	*frame = NULL;
+
+	if (!stream->hdr_len && !stream_scan_headers(stream)) {
+		return ESL_BREAK;
+	}
+
+	if (stream->in_end - stream->in_start < stream->hdr_len + stream->body_len) {
+		return ESL_BREAK;
+	}
+
+	src = stream->in + stream->in_start;
+
+	/* one allocation per packet: frame, header tables, then a copy of the raw bytes */
+	nh = count_lines(src, src + stream->hdr_len);
+	if (stream->event_plain && stream->body_len) {
+		neh = count_lines(src + stream->hdr_len, src + stream->hdr_len + stream->body_len);
+	}
+
+	size = sizeof(*fp) + (nh + neh) * sizeof(esl_frame_header_t) + stream->hdr_len + stream->body_len + 2;
+
+	if (!(fp = malloc(size))) {
+		stream_set_error(stream, "Out of memory", 0);
+		return ESL_FAIL;
+	}
+
+	memset(fp, 0, sizeof(*fp));
+	fp->headers = (esl_frame_header_t *) (fp + 1);
+	fp->event_headers = fp->headers + nh;
+	arena = (char *) (fp->event_headers + neh);
+
+	memcpy(arena, src, stream->hdr_len);
+	arena[stream->hdr_len] = '\0';
+	parse_headers(arena, arena + stream->hdr_len, fp->headers, &fp->header_count);
+	fp->content_type = find_header(fp->headers, fp->header_count, "Content-Type");
+
+	if (stream->body_len) {
+		fp->body = arena + stream->hdr_len + 1;
+		fp->body_len = stream->body_len;
+		memcpy(fp->body, src + stream->hdr_len, stream->body_len);
+		fp->body[fp->body_len] = '\0';
+
+		if (neh) {
+			char *e = fp->body + fp->body_len;
+			char *rest = parse_headers(fp->body, e, fp->event_headers, &fp->event_header_count);
+			const char *cl;
+
+			if (rest < e && (cl = find_header(fp->event_headers, fp->event_header_count, "Content-Length"))) {
+				esl_size_t len = (esl_size_t) atol(cl);
+
+				fp->event_body = rest;
+				fp->event_body_len = len < (esl_size_t)(e - rest) ? len : (esl_size_t)(e - rest);
+				fp->event_body[fp->event_body_len] = '\0';
+			}
+		}
+	}
+
+	stream->in_start += stream->hdr_len + stream->body_len;
+	if (stream->in_start == stream->in_end) {
+		stream->in_start = stream->in_end = 0;
+	}
+	stream->hdr_len = stream->body_len = stream->scan = 0;
+	stream->event_plain = 0;
+	stream->frames++;
+
+	*frame = fp;
+
+	return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t) esl_stream_flush(esl_stream_t *stream)
+{
+	esl_ssize_t r;
+	int errnum;
+
+	while (stream->out_start < stream->out_end) {
+		r = send(stream->sock, stream->out + stream->out_start, (int)(stream->out_end - stream->out_start), ESL_STREAM_SEND_FLAGS);
+
+		if (r > 0) {
+			stream->out_start += r;
+			continue;
+		}
+
+		errnum = esl_stream_errno();
+
+		if (r < 0 && esl_stream_interrupted(errnum)) {
+			continue;
+		}
+
+		if (r < 0 && esl_stream_would_block(errnum)) {
+			return ESL_BREAK;
+		}
+
+		stream_set_error(stream, "Write error", errnum);
+		return ESL_FAIL;
+	}
+
+	stream->out_start = stream->out_end = 0;
+
+	return ESL_SUCCESS;
+}
+
+ESL_DECLARE(esl_status_t) esl_stream_send(esl_stream_t *stream, const char *cmd)
+{
+	esl_size_t len = strlen(cmd), add = 0, need;
+
+	if (stream->sock == ESL_SOCK_INVALID) {
+		return ESL_FAIL;
+	}
+
+	if (len < 2 || cmd[len - 1] != '\n') {
+		add = 2;
+	} else if (cmd[len - 2] != '\n') {
+		add = 1;
+	}
+
+	need = len + add;
+
+	if (stream->out_size - stream->out_end < need) {
+		esl_size_t used = stream->out_end - stream->out_start;
+		esl_size_t new_size = stream->out_size ? stream->out_size : 1024;
+		char *new_out;
+
+		if (stream->out_start) {
+			memmove(stream->out, stream->out + stream->out_start, used);
+			stream->out_start = 0;
+			stream->out_end = used;
+		}
+
+		while (new_size - used < need) {
+			new_size *= 2;
+		}
+
+		if (new_size != stream->out_size) {
+			if (!(new_out = realloc(stream->out, new_size))) {
+				stream_set_error(stream, "Out of memory", 0);
+				return ESL_FAIL;
+			}
+			stream->out = new_out;
+			stream->out_size = new_size;
+		}
+	}
+
+	memcpy(stream->out + stream->out_end, cmd, len);
+	stream->out_end += len;
+	while (add--) {
+		stream->out[stream->out_end++] = '\n';
+	}
+
+	return esl_stream_flush(stream);
+}
+
+ESL_DECLARE(void) esl_frame_destroy(esl_frame_t **frame)
+{
+	if (frame && *frame) {
+		free(*frame);
+		*frame = NULL;
+	}
+}
+
+ESL_DECLARE(const char *) esl_frame_get_header(esl_frame_t *frame, const char *name)
+{
+	return find_header(frame->headers, frame->header_count, name);
+}
+
+ESL_DECLARE(const char *) esl_frame_get_event_header(esl_frame_t *frame, const char *name)
+{
+	return find_header(frame->event_headers, frame->event_header_count, name);
+}
+
+ESL_DECLARE(esl_status_t) esl_frame_to_event(esl_frame_t *frame, esl_event_t **event)
+{
+	esl_event_t *revent = NULL;
+	esl_frame_header_t *headers = frame->headers;
+	int i, count = frame->header_count;
+	const char *body = frame->body;
+	esl_size_t body_len = frame->body_len;
+
+	if (frame->event_header_count) {
+		headers = frame->event_headers;
+		count = frame->event_header_count;
+		body = frame->event_body;
+		body_len = frame->event_body_len;
+	}
+
+	if (esl_event_create(&revent, ESL_EVENT_CLONE) != ESL_SUCCESS) {
+		return ESL_FAIL;
+	}
+
+	if (headers == frame->headers) {
+		revent->event_id = ESL_EVENT_SOCKET_DATA;
+		esl_event_add_header_string(revent, ESL_STACK_BOTTOM, "Event-Name", "SOCKET_DATA");
+	}
+
+	for (i = 0; i < count; i++) {
+		if (headers == frame->event_headers && !strcasecmp(headers[i].name, "event-name")) {
+			esl_name_event(headers[i].value, &revent->event_id);
+		}
+
+		if (!strncmp(headers[i].value, "ARRAY::", 7)) {
+			esl_event_add_array(revent, headers[i].name, headers[i].value);
+		} else {
+			esl_event_add_header_string(revent, ESL_STACK_BOTTOM, headers[i].name, headers[i].value);
+		}
+	}
+
+	if (body) {
+		if (!(revent->body = malloc(body_len + 1))) {
+			esl_event_destroy(&revent);
+			return ESL_FAIL;
+		}
+		memcpy(revent->body, body, body_len);
+		revent->body[body_len] = '\0';
+	}
+
+	*event = revent;
+
+	return ESL_SUCCESS;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -321,6 +321,10 @@ typedef struct {
 	int async_execute;
 	int event_lock;
 	int destroyed;
+	/*! Tagged api replies (Request-ID) received while waiting for something else */
+	esl_event_t *async_reply;
+	/*! Last request id handed out by esl_api_async */
+	unsigned long request_id;
 } esl_handle_t;
 
 #define esl_test_flag(obj, flag) ((obj)->flags & flag)
@@ -370,6 +374,8 @@ ESL_DECLARE(void) esl_global_set_default_logger(int level);
 #include "esl_event.h"
 #include "esl_threadmutex.h"
 #include "esl_config.h"
+#include "esl_stream.h"
+#include "esl_shm.h"
 
 ESL_DECLARE(size_t) esl_url_encode(const char *url, char *buf, size_t len);
 ESL_DECLARE(char *)esl_url_decode(char *s);
@@ -464,6 +470,23 @@ ESL_DECLARE(esl_status_t) esl_recv_event_timed(esl_handle_t *handle, uint32_t ms
 */
 ESL_DECLARE(esl_status_t) esl_send_recv_timed(esl_handle_t *handle, const char *cmd, uint32_t ms);
 #define esl_send_recv(_handle, _cmd) esl_send_recv_timed(_handle, _cmd, 0)
+/*!
+    \brief Queue an api command without waiting for its reply. The server runs it on its worker pool and
+    answers later, possibly out of order, with an api/response carrying the same Request-ID header
+    \param handle Handle to be used
+    \param cmd Api command and arguments (without the leading "api ")
+    \param request_id Request id to use, if NULL or empty one is generated
+    \param[out] id_buf If not NULL, receives the request id that was sent
+    \param id_len Size of id_buf
+*/
+ESL_DECLARE(esl_status_t) esl_api_async(esl_handle_t *handle, const char *cmd, const char *request_id, char *id_buf, esl_size_t id_len);
+/*!
+    \brief Wait for the next reply to a command sent with esl_api_async. Events read in the meantime are queued for esl_recv_event with check_q set
+    \param handle Handle to be used
+    \param ms Maximum time to wait for each packet, 0 waits forever
+    \param[out] reply The api/response; its Request-ID header names the request and its body holds the output. Must be destroyed by the caller
+*/
+ESL_DECLARE(esl_status_t) esl_api_async_recv(esl_handle_t *handle, uint32_t ms, esl_event_t **reply);
 /*!
     \brief Applies a filter to received events
     \param handle Handle to apply the filter to
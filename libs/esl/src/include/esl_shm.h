@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2010-2012, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "esl.h"
+#ifndef ESL_SHM_H
+#define ESL_SHM_H
+/**
+ * @defgroup esl_shm Shared Memory Event Reader
+ * @ingroup esl
+ * Tails the event ring published by mod_event_shm on the same host.
+ * Every reader has its own cursor and never blocks the switch; a reader
+ * that falls more than a ring behind skips ahead and the skipped events
+ * are counted in esl_shm_reader_lost().
+ * @{
+ */
+struct esl_shm_reader;
+typedef struct esl_shm_reader esl_shm_reader_t;
+
+typedef enum {
+	/*! Only events published after the reader attached */
+	ESL_SHM_FROM_NEWEST,
+	/*! Everything still in the ring */
+	ESL_SHM_FROM_OLDEST
+} esl_shm_start_t;
+
+/*! \brief Map the ring file read only
+ * \param reader returned pointer to the new reader
+ * \param path the path configured in event_shm.conf (NULL for /dev/shm/freeswitch.events)
+ * \param start where the cursor begins
+ * \return status
+ */
+ESL_DECLARE(esl_status_t) esl_shm_reader_open(esl_shm_reader_t **reader, const char *path, esl_shm_start_t start);
+
+/*! \brief Unmap the ring and free the reader */
+ESL_DECLARE(void) esl_shm_reader_close(esl_shm_reader_t **reader);
+
+/*! \brief Fetch the next raw record (a switch_event_binary_serialize image)
+ * \param reader the reader
+ * \param data returned pointer to the record, valid until the next call
+ * \param len returned record length
+ * \return ESL_SUCCESS with a record, ESL_BREAK when the reader is caught up
+ */
+ESL_DECLARE(esl_status_t) esl_shm_reader_next(esl_shm_reader_t *reader, const void **data, esl_size_t *len);
+
+/*! \brief Fetch and decode the next event
+ * \return ESL_SUCCESS with an event the caller must destroy, ESL_BREAK when caught up
+ */
+ESL_DECLARE(esl_status_t) esl_shm_reader_next_event(esl_shm_reader_t *reader, esl_event_t **event);
+
+/*! \brief Wait up to ms milliseconds for something to read
+ * \return ESL_SUCCESS when a record is ready, ESL_BREAK on timeout
+ * \note The ring has no wakeup channel, this polls with a short backoff.
+ */
+ESL_DECLARE(esl_status_t) esl_shm_reader_wait(esl_shm_reader_t *reader, uint32_t ms);
+
+/*! \brief Events this reader missed because it fell behind or the switch restarted */
+ESL_DECLARE(uint64_t) esl_shm_reader_lost(esl_shm_reader_t *reader);
+
+/*! \brief Decode a switch_event_binary_serialize image into an event */
+ESL_DECLARE(esl_status_t) esl_event_binary_deserialize(esl_event_t **event, const void *data, esl_size_t len);
+
+/** @} */
+
+#endif
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
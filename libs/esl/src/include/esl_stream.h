@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2010-2012, Anthony Minessale II
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the original author; nor the names of any contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER
+ * OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "esl.h"
+#ifndef ESL_STREAM_H
+#define ESL_STREAM_H
+/**
+ * @defgroup esl_stream Non-blocking Stream Routines
+ * @ingroup esl
+ * A non-blocking reader/writer for an already connected event socket.
+ * The caller owns the poll loop (poll, epoll, kqueue...) and feeds the
+ * stream when its descriptor is readable or writable, so one thread can
+ * follow any number of switches.
+ *
+ * Each complete packet is handed back as an esl_frame_t.  A frame is a
+ * single allocation holding the raw packet bytes plus the header tables;
+ * names and values point into that copy, nothing is allocated per header.
+ * @{
+ */
+struct esl_stream;
+typedef struct esl_stream esl_stream_t;
+
+/*! \brief A header inside a frame, both strings live in the frame arena */
+typedef struct esl_frame_header {
+	char *name;
+	char *value;
+} esl_frame_header_t;
+
+/*! \brief One parsed packet */
+typedef struct esl_frame {
+	/*! Outer (socket level) headers */
+	esl_frame_header_t *headers;
+	int header_count;
+	/*! Packet body, NULL when there is no content-length */
+	char *body;
+	esl_size_t body_len;
+	/*! Headers of a text/event-plain body, if any */
+	esl_frame_header_t *event_headers;
+	int event_header_count;
+	/*! Inner body of a text/event-plain event, if any */
+	char *event_body;
+	esl_size_t event_body_len;
+	/*! Shortcut to the content-type header */
+	const char *content_type;
+} esl_frame_t;
+
+/*! \brief Take over the socket of a connected handle
+ * \param stream returned pointer to the new stream
+ * \param handle a handle connected with esl_connect (any buffered data is moved into the stream)
+ * \return status
+ * \note The handle no longer owns the socket, call esl_disconnect on it to release the rest.
+ */
+ESL_DECLARE(esl_status_t) esl_stream_attach(esl_stream_t **stream, esl_handle_t *handle);
+
+/*! \brief Connect, authenticate and return a non-blocking stream
+ * \param stream returned pointer to the new stream
+ * \param host host to connect to
+ * \param port port to connect to
+ * \param user user name or NULL
+ * \param password password
+ * \param timeout connect timeout in ms, 0 for none
+ * \param err optional buffer receiving the error text on failure
+ * \param errlen size of err
+ * \return status
+ */
+ESL_DECLARE(esl_status_t) esl_stream_connect(esl_stream_t **stream, const char *host, esl_port_t port,
+											 const char *user, const char *password, uint32_t timeout, char *err, esl_size_t errlen);
+
+/*! \brief Close the socket and free the stream */
+ESL_DECLARE(void) esl_stream_destroy(esl_stream_t **stream);
+
+/*! \brief The socket to register with the caller's poll set */
+ESL_DECLARE(esl_socket_t) esl_stream_socket(esl_stream_t *stream);
+
+/*! \brief Read what is available without blocking, up to a fixed amount per call
+ * \return ESL_SUCCESS when data was taken in or none was waiting, ESL_DISCONNECTED on eof or error,
+ *         ESL_FAIL when a single packet does not fit in the receive buffer
+ * \note The socket may still be readable on return, so register it level triggered (poll, or epoll
+ *       without EPOLLET) and take every frame with esl_stream_next_frame before the next read.
+ */
+ESL_DECLARE(esl_status_t) esl_stream_read(esl_stream_t *stream);
+
+/*! \brief Pop the next complete packet
+ * \param stream the stream
+ * \param frame returned frame, free it with esl_frame_destroy
+ * \return ESL_SUCCESS with a frame, ESL_BREAK when no complete packet is buffered
+ */
+ESL_DECLARE(esl_status_t) esl_stream_next_frame(esl_stream_t *stream, esl_frame_t **frame);
+
+/*! \brief Queue a command and try to write it out
+ * \return ESL_SUCCESS when fully written, ESL_BREAK when output is pending, ESL_FAIL on error
+ * \note A missing "\n\n" terminator is added.
+ */
+ESL_DECLARE(esl_status_t) esl_stream_send(esl_stream_t *stream, const char *cmd);
+
+/*! \brief Write out pending output, call when the socket becomes writable
+ * \return ESL_SUCCESS when nothing is left, ESL_BREAK when output is still pending, ESL_FAIL on error
+ */
+ESL_DECLARE(esl_status_t) esl_stream_flush(esl_stream_t *stream);
+
+/*! \brief Bytes of queued output, non zero means the caller should poll for write */
+ESL_DECLARE(esl_size_t) esl_stream_pending(esl_stream_t *stream);
+
+/*! \brief Bytes received and packets parsed since the stream was created */
+ESL_DECLARE(void) esl_stream_stats(esl_stream_t *stream, uint64_t *bytes, uint64_t *frames);
+
+/*! \brief Last error text */
+ESL_DECLARE(const char *) esl_stream_error(esl_stream_t *stream);
+
+/*! \brief Free a frame */
+ESL_DECLARE(void) esl_frame_destroy(esl_frame_t **frame);
+
+/*! \brief Case insensitive lookup of an outer header */
+ESL_DECLARE(const char *) esl_frame_get_header(esl_frame_t *frame, const char *name);
+
+/*! \brief Case insensitive lookup of a header of the inner text/event-plain event */
+ESL_DECLARE(const char *) esl_frame_get_event_header(esl_frame_t *frame, const char *name);
+
+/*! \brief Build a regular esl_event_t from the inner event (or the outer headers when there is none) */
+ESL_DECLARE(esl_status_t) esl_frame_to_event(esl_frame_t *frame, esl_event_t **event);
+
+/** @} */
+
+#endif
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <esl.h>
+
+/*
+  Pipelines a batch of tagged api commands to a stand-in server that answers all of them in a single write, then
+  collects the replies with esl_api_async_recv and a timeout.  Every reply after the first is already buffered on the
+  handle by then, so none of them may wait for the timeout.
+*/
+
+#define COMMANDS 16
+#define RECV_MS 500
+
+static int listen_sock = -1;
+
+static int read_request(int sock, char *buf, size_t len)
+{
+	size_t used = 0;
+	ssize_t r;
+
+	while (used < len - 1 && (r = recv(sock, buf + used, 1, 0)) == 1) {
+		used++;
+		if (used >= 2 && buf[used - 1] == '\n' && buf[used - 2] == '\n') {
+			buf[used] = '\0';
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static void *server_run(void *obj)
+{
+	char req[1024], out[COMMANDS * 128];
+	size_t used = 0;
+	int sock, i;
+
+	if ((sock = accept(listen_sock, NULL, NULL)) < 0) {
+		return NULL;
+	}
+
+	send(sock, "Content-Type: auth/request\n\n", 28, 0);
+	read_request(sock, req, sizeof(req));
+	send(sock, "Content-Type: command/reply\nReply-Text: +OK accepted\n\n", 54, 0);
+
+	for (i = 0; i < COMMANDS; i++) {
+		char *id;
+
+		if (read_request(sock, req, sizeof(req)) || !(id = strstr(req, "Request-ID: "))) {
+			break;
+		}
+
+		id += 12;
+		*strchr(id, '\n') = '\0';
+		used += snprintf(out + used, sizeof(out) - used, "Content-Type: api/response\nRequest-ID: %s\nContent-Length: 3\n\n+OK", id);
+	}
+
+	/* every reply in one segment */
+	send(sock, out, used, 0);
+
+	/* hold the connection open so the client can only be woken by what it already has */
+	read_request(sock, req, sizeof(req));
+	close(sock);
+
+	return NULL;
+}
+
+static long ms_since(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+int main(void)
+{
+	esl_handle_t handle = {{0}};
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	pthread_t server;
+	struct timeval start;
+	int i, got = 0, one = 1;
+	long took;
+
+	listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(listen_sock, (struct sockaddr *) &addr, sizeof(addr)) || listen(listen_sock, 1) ||
+		getsockname(listen_sock, (struct sockaddr *) &addr, &alen)) {
+		printf("FAIL cannot listen\n");
+		return 1;
+	}
+
+	pthread_create(&server, NULL, server_run, NULL);
+
+	if (esl_connect(&handle, "127.0.0.1", ntohs(addr.sin_port), NULL, "ClueCon") != ESL_SUCCESS) {
+		printf("FAIL cannot connect: %s\n", handle.err);
+		return 1;
+	}
+
+	for (i = 0; i < COMMANDS; i++) {
+		esl_api_async(&handle, "status", NULL, NULL, 0);
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < COMMANDS; i++) {
+		esl_event_t *reply = NULL;
+		char want[32];
+
+		if (esl_api_async_recv(&handle, RECV_MS, &reply) != ESL_SUCCESS || !reply) {
+			break;
+		}
+
+		snprintf(want, sizeof(want), "%d", i + 1);
+		if (!esl_safe_strcasecmp(esl_event_get_header(reply, "request-id"), want)) {
+			got++;
+		}
+		esl_event_destroy(&reply);
+	}
+
+	took = ms_since(&start);
+
+	esl_send(&handle, "exit\n\n");
+	esl_disconnect(&handle);
+	pthread_join(server, NULL);
+	close(listen_sock);
+
+	if (got != COMMANDS || took >= RECV_MS) {
+		printf("FAIL %d of %d replies in %ldms\n", got, COMMANDS, took);
+		return 1;
+	}
+
+	printf("PASS %d replies in %ldms\n", got, took);
+
+	return 0;
+}
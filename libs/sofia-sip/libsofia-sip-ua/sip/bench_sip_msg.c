@@ -0,0 +1,451 @@
+/*
+ * This file is part of the Sofia-SIP package
+ *
+ * Copyright (C) 2005 Nokia Corporation.
+ *
+ * Contact: Pekka Pessi <pekka.pessi@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**@internal @IFILE bench_sip_msg.c
+ *
+ * SIP parser and encoder benchmark. This replays a corpus of captured
+ * messages (tport dump format, messages separated with Control-K ('\v')
+ * as with validator) through the parser and, optionally, the encoder.
+ *
+ * Each message is copied into a fresh message buffer before parsing, just
+ * like tport does when it receives a datagram, so the figures include the
+ * msg_t creation and destruction overhead seen on the signaling path.
+ *
+ * The report contains message rate, parse throughput, allocations per
+ * message, the peak heap size of a single message and per-message latency
+ * percentiles. Messages failing to parse or encode during the timed passes
+ * are counted and reported, and left out of the rate and latency figures.
+ *
+ * usage: bench_sip_msg [-e] [-n rounds] [-w warmup] [-q|-Q] file...
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sofia-sip/su_types.h>
+#include <sofia-sip/su_alloc.h>
+#include <sofia-sip/su_alloc_stat.h>
+#include <sofia-sip/su_time.h>
+
+#include <sofia-sip/sip.h>
+#include <sofia-sip/sip_header.h>
+
+#include <sofia-sip/msg_buffer.h>
+
+char const *name = "bench_sip_msg";
+
+typedef unsigned longlong ull;
+
+typedef struct {
+  unsigned o_encode : 1;	/**< Encode each message after parsing */
+  unsigned o_requests : 1;	/**< Only requests */
+  unsigned o_responses : 1;	/**< Only responses */
+  unsigned o_verbose : 1;	/**< Be verbose */
+  unsigned : 0;
+  unsigned o_rounds;		/**< Number of timed passes over corpus */
+  unsigned o_warmup;		/**< Number of untimed passes over corpus */
+  unsigned o_flags;		/**< Message flags */
+} options_t;
+
+typedef struct {
+  char   *b;
+  size_t  size;
+} message_t;
+
+typedef struct {
+  options_t options[1];
+
+  message_t *msgs;		/**< Corpus */
+  size_t     n_msgs, n_alloc;
+  uint64_t   bytes;		/**< Bytes in one pass over corpus */
+
+  uint64_t  *samples;		/**< Latency samples in nanoseconds */
+  size_t     n_samples;
+
+  uint64_t   parsed, errors, enc_bytes;
+  uint64_t   failed;		/**< Failures during timed passes */
+  uint64_t   elapsed;		/**< Timed nanoseconds */
+  uint64_t   bytes_ok;		/**< Bytes successfully processed when timed */
+
+  su_home_stat_t hs[1];		/**< Allocations over one pass */
+  uint64_t   maxrbytes;		/**< Largest peak heap size of one message */
+} context_t;
+
+static msg_mclass_t const *mclass = NULL;
+
+static void usage(void)
+{
+  fprintf(stderr,
+	  "usage: %s [-e] [-v] [-q|-Q] [-n rounds] [-w warmup] file...\n"
+	  "\t-e\talso encode each parsed message\n"
+	  "\t-n\tnumber of timed passes over the corpus (default 100)\n"
+	  "\t-w\tnumber of untimed warmup passes (default 5)\n"
+	  "\t-q\tonly requests, -Q only responses\n",
+	  name);
+  exit(2);
+}
+
+static char *lastpart(char *path)
+{
+  char *p = strrchr(path, '/');
+
+  if (p)
+    return p + 1;
+  else
+    return path;
+}
+
+static int is_sip_start(char const *b)
+{
+  size_t plen = strlen(SIP_VERSION_CURRENT), linelen;
+
+  if (strncmp(b, SIP_VERSION_CURRENT, plen) == 0 && b[plen] == ' ')
+    return 1;			/* status */
+
+  linelen = strcspn(b, "\r\n");
+
+  return linelen > plen + 1 &&
+    b[linelen - plen - 1] == ' ' &&
+    strncmp(b + linelen - plen, SIP_VERSION_CURRENT, plen) == 0;
+}
+
+/** Split a dump into messages and add them to the corpus */
+static int load_corpus(context_t *ctx, char const *path)
+{
+  options_t *o = ctx->options;
+  FILE *f;
+  char *data, *b, *end;
+  long size;
+
+  if (!(f = fopen(path, "rb"))) {
+    perror(path);
+    return -1;
+  }
+
+  if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0) {
+    perror(path); fclose(f);
+    return -1;
+  }
+  rewind(f);
+
+  if (!(data = malloc(size + 1))) {
+    perror("malloc"); exit(1);
+  }
+
+  if (size && fread(data, 1, size, f) != (size_t)size) {
+    perror(path); fclose(f); free(data);
+    return -1;
+  }
+  fclose(f);
+
+  data[size] = '\0';
+
+  for (b = data, end = data + size; b < end; ) {
+    size_t msize;
+    int is_response;
+
+    /* Skip to the start line of next message */
+    while (b < end && *b && !is_sip_start(b)) {
+      b += strcspn(b, "\r\n\v");
+      b += strspn(b, "\r\n\v");
+    }
+
+    if (b >= end || !*b)
+      break;
+
+    msize = strcspn(b, "\v");
+    is_response = strncmp(b, SIP_VERSION_CURRENT,
+			  strlen(SIP_VERSION_CURRENT)) == 0;
+
+    if (!(o->o_requests && is_response) &&
+	!(o->o_responses && !is_response)) {
+      if (ctx->n_msgs == ctx->n_alloc) {
+	ctx->n_alloc = ctx->n_alloc ? 2 * ctx->n_alloc : 64;
+	ctx->msgs = realloc(ctx->msgs, ctx->n_alloc * sizeof *ctx->msgs);
+	if (!ctx->msgs) {
+	  perror("realloc"); exit(1);
+	}
+      }
+
+      ctx->msgs[ctx->n_msgs].b = b;
+      ctx->msgs[ctx->n_msgs].size = msize;
+      ctx->n_msgs++;
+      ctx->bytes += msize;
+    }
+
+    b += msize;
+    if (b < end)
+      *b++ = '\0';
+  }
+
+  return 0;
+}
+
+/** Parse (and optionally encode) one message.
+ *
+ * @retval 0 when successful
+ * @retval -1 upon a parsing or encoding error
+ */
+static int bench_one(context_t *ctx, message_t const *m, su_home_stat_t *hs)
+{
+  options_t *o = ctx->options;
+  msg_t *msg;
+  char *b;
+  int retval = 0;
+
+  msg = msg_create(mclass, o->o_flags);
+  if (msg == NULL) {
+    perror("msg_create"); exit(1);
+  }
+
+  if (hs)
+    su_home_init_stats(msg_home(msg));
+
+  b = msg_buf_alloc(msg, m->size + 1);
+  if (b == NULL) {
+    perror("msg_buf_alloc"); exit(1);
+  }
+  memcpy(b, m->b, m->size + 1);
+  msg_buf_commit(msg, m->size, 1);
+
+  /* A corpus entry is a whole message, so an incomplete one is an error */
+  if (msg_extract(msg) <= 0)
+    retval = -1;
+  else if (o->o_encode) {
+    size_t len = 0;
+    char *s = msg_as_string(msg_home(msg), msg, NULL, 0, &len);
+
+    if (s == NULL)
+      retval = -1;
+    else
+      ctx->enc_bytes += len;
+  }
+
+  if (hs) {
+    su_home_stat_t mhs[1];
+    su_home_get_stats(msg_home(msg), 1, mhs, sizeof(mhs));
+    su_home_stat_add(hs, mhs);
+    if (mhs->hs_allocs.hsa_maxrbytes > ctx->maxrbytes)
+      ctx->maxrbytes = mhs->hs_allocs.hsa_maxrbytes;
+  }
+
+  msg_destroy(msg);
+
+  return retval;
+}
+
+static int cmp_u64(void const *a, void const *b)
+{
+  uint64_t x = *(uint64_t const *)a, y = *(uint64_t const *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(uint64_t const *sorted, size_t n, double p)
+{
+  size_t i;
+
+  if (n == 0)
+    return 0;
+
+  i = (size_t)(p / 100.0 * (n - 1) + 0.5);
+  if (i >= n)
+    i = n - 1;
+
+  return sorted[i];
+}
+
+static void run(context_t *ctx)
+{
+  options_t *o = ctx->options;
+  size_t i, N = ctx->n_msgs;
+  unsigned round;
+
+  /* Memory statistics from a separate pass, they would skew the timing */
+  for (i = 0; i < N; i++) {
+    if (bench_one(ctx, &ctx->msgs[i], ctx->hs) < 0) {
+      fprintf(stderr, "%s: parsing error in message "MOD_ZU": %.*s\n",
+	      name, i, (int)strcspn(ctx->msgs[i].b, "\r\n"), ctx->msgs[i].b);
+      ctx->errors++;
+    }
+  }
+
+  for (round = 0; round < o->o_warmup; round++)
+    for (i = 0; i < N; i++)
+      bench_one(ctx, &ctx->msgs[i], NULL);
+
+  ctx->samples = malloc(sizeof *ctx->samples * N * (o->o_rounds ? o->o_rounds : 1));
+  if (!ctx->samples) {
+    perror("malloc"); exit(1);
+  }
+
+  ctx->enc_bytes = 0;
+
+  for (round = 0; round < o->o_rounds; round++) {
+    for (i = 0; i < N; i++) {
+      uint64_t t0, t1;
+      int error;
+
+      t0 = su_nanocounter();
+      error = bench_one(ctx, &ctx->msgs[i], NULL);
+      t1 = su_nanocounter();
+
+      if (error < 0) {
+	/* Failing early is cheap, do not let it count as a fast message */
+	ctx->failed++;
+	continue;
+      }
+
+      ctx->samples[ctx->n_samples++] = t1 - t0;
+      ctx->elapsed += t1 - t0;
+      ctx->bytes_ok += ctx->msgs[i].size;
+      ctx->parsed++;
+    }
+  }
+}
+
+static void report(context_t *ctx)
+{
+  options_t *o = ctx->options;
+  su_home_stat_t const *hs = ctx->hs;
+  uint64_t *s = ctx->samples;
+  size_t n = ctx->n_samples;
+  double dur = ctx->elapsed * 1E-9;
+  uint64_t N = ctx->n_msgs;
+
+  printf("corpus: "LLU" messages, "LLU" bytes (mean size "LLU"), "
+	 LLU" errors\n",
+	 (ull)N, (ull)ctx->bytes, (ull)(N ? ctx->bytes / N : 0),
+	 (ull)ctx->errors);
+
+  if (ctx->failed)
+    printf("failed: "LLU" messages failed to %s during timed passes\n",
+	   (ull)ctx->failed, o->o_encode ? "parse or encode" : "parse");
+
+  if (!n || dur <= 0)
+    return;
+
+  printf("%s: "LLU" messages in %g seconds (%.0f msg/sec, %.1f Mb/s)\n",
+	 o->o_encode ? "parse+encode" : "parse",
+	 (ull)n, dur, (double)n / dur,
+	 (double)ctx->bytes_ok * 8 / dur / 1e6);
+
+  if (o->o_encode)
+    printf("encode: "LLU" bytes per pass\n",
+	   (ull)(ctx->enc_bytes / (o->o_rounds ? o->o_rounds : 1)));
+
+  if (N)
+    printf("allocations: %.1f allocs/msg, %.0f bytes/msg, "
+	   "peak heap "LLU" bytes\n",
+	   (double)hs->hs_allocs.hsa_number / N,
+	   (double)hs->hs_allocs.hsa_bytes / N,
+	   (ull)ctx->maxrbytes);
+
+  qsort(s, n, sizeof *s, cmp_u64);
+
+  printf("latency (ns): min "LLU" p50 "LLU" p90 "LLU" p99 "LLU
+	 " p99.9 "LLU" max "LLU"\n",
+	 (ull)s[0],
+	 (ull)percentile(s, n, 50.0),
+	 (ull)percentile(s, n, 90.0),
+	 (ull)percentile(s, n, 99.0),
+	 (ull)percentile(s, n, 99.9),
+	 (ull)s[n - 1]);
+}
+
+int main(int argc, char *argv[])
+{
+  context_t ctx[1];
+  options_t *o = ctx->options;
+
+  memset(ctx, 0, sizeof ctx);
+
+  name = lastpart(argv[0]);  /* Set our name */
+
+  o->o_rounds = 100;
+  o->o_warmup = 5;
+
+  for (; argv[1]; argv++) {
+    if (argv[1][0] == 0)
+      usage();
+    else if (argv[1][0] != '-')
+      break;
+    else if (argv[1][1] == 0) {
+      argv++; break;
+    }
+    else if (strcmp(argv[1], "-e") == 0)
+      o->o_encode = 1;
+    else if (strcmp(argv[1], "-v") == 0)
+      o->o_verbose = 1;
+    else if (strcmp(argv[1], "-q") == 0)
+      o->o_requests = 1;
+    else if (strcmp(argv[1], "-Q") == 0)
+      o->o_responses = 1;
+    else if (strcmp(argv[1], "-n") == 0 && argv[2])
+      o->o_rounds = strtoul(argv[2], NULL, 10), argv++;
+    else if (strcmp(argv[1], "-w") == 0 && argv[2])
+      o->o_warmup = strtoul(argv[2], NULL, 10), argv++;
+    else
+      usage();
+  }
+
+  if ((o->o_requests && o->o_responses) || !argv[1])
+    usage();
+
+  if (!mclass)
+    mclass = sip_default_mclass();
+
+  for (; argv[1]; argv++)
+    if (load_corpus(ctx, argv[1]) < 0)
+      exit(1);
+
+  if (ctx->n_msgs == 0) {
+    fprintf(stderr, "%s: no messages in corpus\n", name);
+    exit(1);
+  }
+
+  if (o->o_verbose)
+    printf("%s: "MOD_ZU" messages, %u rounds, %u warmup rounds\n",
+	   name, ctx->n_msgs, o->o_rounds, o->o_warmup);
+
+  run(ctx);
+  report(ctx);
+
+  free(ctx->samples);
+  free(ctx->msgs);
+
+  exit(ctx->errors || ctx->failed ? 1 : 0);
+}
@@ -1998,9 +1998,151 @@ aes_inv_final_round(v128_t *state, const v128_t *round_key) {
 #endif  /* CPU type */
 
 
+#ifdef SRTP_AES_NI
+
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#define AES_NI_TARGET __attribute__((target("aes,sse2")))
+
+/* -1 until cpuid has been checked, then 0 or 1 */
+static int aes_ni_state = -1;
+
+static int
+aes_ni_supported(void) {
+  unsigned int eax, ebx, ecx, edx;
+
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return 0;
+
+  return (ecx & bit_AES) && (edx & bit_SSE2);
+}
+
+int
+aes_ni_enabled(void) {
+  if (aes_ni_state < 0)
+    aes_ni_state = aes_ni_supported();
+
+  return aes_ni_state;
+}
+
+int
+aes_ni_set_enabled(int on) {
+  aes_ni_state = on && aes_ni_supported();
+
+  return aes_ni_state;
+}
+
+static AES_NI_TARGET void
+aes_ni_encrypt(v128_t *plaintext, const aes_expanded_key_t *exp_key) {
+  const __m128i *rk = (const __m128i *)exp_key->round;
+  __m128i m;
+  int i;
+
+  m = _mm_loadu_si128((const __m128i *)plaintext);
+  m = _mm_xor_si128(m, _mm_loadu_si128(&rk[0]));
+  for (i = 1; i < exp_key->num_rounds; i++)
+    m = _mm_aesenc_si128(m, _mm_loadu_si128(&rk[i]));
+  m = _mm_aesenclast_si128(m, _mm_loadu_si128(&rk[exp_key->num_rounds]));
+  _mm_storeu_si128((__m128i *)plaintext, m);
+}
+
+/*
+ * the block counter lives big-endian in octets 14 and 15, which is
+ * the eighth 16-bit lane of an xmm register
+ */
+#define AES_NI_CTR(base, ctr) \
+  _mm_insert_epi16((base), (int)((((ctr) & 0xff) << 8) | (((ctr) >> 8) & 0xff)), 7)
+
+AES_NI_TARGET void
+aes_ni_icm_encrypt(v128_t *counter, const aes_expanded_key_t *exp_key,
+		   uint8_t *buf, unsigned int num_blocks) {
+  const __m128i *key = (const __m128i *)exp_key->round;
+  __m128i rk[15];
+  __m128i base, b0, b1, b2, b3;
+  unsigned int ctr;
+  int i, nr = exp_key->num_rounds;
+
+  for (i = 0; i <= nr; i++)
+    rk[i] = _mm_loadu_si128(&key[i]);
+
+  base = _mm_loadu_si128((const __m128i *)counter);
+  ctr = ((unsigned int)counter->v8[14] << 8) | counter->v8[15];
+
+  /* four blocks at a time keeps the AES unit's pipeline busy */
+  while (num_blocks >= 4) {
+    b0 = _mm_xor_si128(AES_NI_CTR(base, ctr), rk[0]);
+    b1 = _mm_xor_si128(AES_NI_CTR(base, ctr + 1), rk[0]);
+    b2 = _mm_xor_si128(AES_NI_CTR(base, ctr + 2), rk[0]);
+    b3 = _mm_xor_si128(AES_NI_CTR(base, ctr + 3), rk[0]);
+
+    for (i = 1; i < nr; i++) {
+      b0 = _mm_aesenc_si128(b0, rk[i]);
+      b1 = _mm_aesenc_si128(b1, rk[i]);
+      b2 = _mm_aesenc_si128(b2, rk[i]);
+      b3 = _mm_aesenc_si128(b3, rk[i]);
+    }
+
+    b0 = _mm_aesenclast_si128(b0, rk[nr]);
+    b1 = _mm_aesenclast_si128(b1, rk[nr]);
+    b2 = _mm_aesenclast_si128(b2, rk[nr]);
+    b3 = _mm_aesenclast_si128(b3, rk[nr]);
+
+    _mm_storeu_si128((__m128i *)buf,
+		     _mm_xor_si128(b0, _mm_loadu_si128((const __m128i *)buf)));
+    _mm_storeu_si128((__m128i *)(buf + 16),
+		     _mm_xor_si128(b1, _mm_loadu_si128((const __m128i *)(buf + 16))));
+    _mm_storeu_si128((__m128i *)(buf + 32),
+		     _mm_xor_si128(b2, _mm_loadu_si128((const __m128i *)(buf + 32))));
+    _mm_storeu_si128((__m128i *)(buf + 48),
+		     _mm_xor_si128(b3, _mm_loadu_si128((const __m128i *)(buf + 48))));
+
+    buf += 64;
+    ctr += 4;
+    num_blocks -= 4;
+  }
+
+  while (num_blocks--) {
+    b0 = _mm_xor_si128(AES_NI_CTR(base, ctr), rk[0]);
+    for (i = 1; i < nr; i++)
+      b0 = _mm_aesenc_si128(b0, rk[i]);
+    b0 = _mm_aesenclast_si128(b0, rk[nr]);
+
+    _mm_storeu_si128((__m128i *)buf,
+		     _mm_xor_si128(b0, _mm_loadu_si128((const __m128i *)buf)));
+    buf += 16;
+    ctr++;
+  }
+
+  counter->v8[14] = (uint8_t)(ctr >> 8);
+  counter->v8[15] = (uint8_t)ctr;
+}
+
+#else /* !SRTP_AES_NI */
+
+int
+aes_ni_enabled(void) {
+  return 0;
+}
+
+int
+aes_ni_set_enabled(int on) {
+  return 0;
+}
+
+#endif /* SRTP_AES_NI */
+
 void
 aes_encrypt(v128_t *plaintext, const aes_expanded_key_t *exp_key) {
 
+#ifdef SRTP_AES_NI
+  if (aes_ni_enabled()) {
+    aes_ni_encrypt(plaintext, exp_key);
+    return;
+  }
+#endif
+
   /* add in the subkey */
   v128_xor_eq(plaintext, &exp_key->round[0]);
 
@@ -377,8 +377,19 @@ aes_icm_encrypt_ismacryp(aes_icm_ctx_t *c,
 
   }
   
+  i = 0;
+
+#ifdef SRTP_AES_NI
+  /* with AES-NI the whole blocks are done in one go */
+  if (!forIsmacryp && aes_ni_enabled()) {
+    i = bytes_to_encr/sizeof(v128_t);
+    aes_ni_icm_encrypt(&c->counter, &c->expanded_key, buf, i);
+    buf += i * sizeof(v128_t);
+  }
+#endif
+
   /* now loop over entire 16-byte blocks of keystream */
-  for (i=0; i < (bytes_to_encr/sizeof(v128_t)); i++) {
+  for (; i < (bytes_to_encr/sizeof(v128_t)); i++) {
 
     /* fill buffer with new keystream */
     aes_icm_advance_ismacryp(c, (uint8_t)forIsmacryp);
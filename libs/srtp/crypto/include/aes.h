@@ -75,6 +75,51 @@ aes_encrypt(v128_t *plaintext, const aes_expanded_key_t *exp_key);
 void
 aes_decrypt(v128_t *plaintext, const aes_expanded_key_t *exp_key);
 
+/*
+ * AES-NI support
+ *
+ * on x86 processors that implement the AES instruction set, the
+ * encryption direction (which is all that the counter mode cipher
+ * needs) is done with AESENC/AESENCLAST instead of the table driven
+ * implementation.  the choice is made at run time with cpuid, so the
+ * same binary runs on older processors.  the round keys produced by
+ * aes_expand_encryption_key() are used as is.
+ */
+
+#if !defined(SRTP_NO_AES_NI) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SRTP_AES_NI 1
+#endif
+
+/*
+ * aes_ni_enabled() returns 1 if AES-NI is used, 0 otherwise
+ */
+
+int
+aes_ni_enabled(void);
+
+/*
+ * aes_ni_set_enabled(on) turns the AES-NI path on or off (it can
+ * only be turned on if the processor supports it) and returns the
+ * resulting state.  this is meant for benchmarks and self-tests.
+ */
+
+int
+aes_ni_set_enabled(int on);
+
+#ifdef SRTP_AES_NI
+/*
+ * aes_ni_icm_encrypt(counter, key, buf, num_blocks) exors num_blocks
+ * sixteen-octet blocks of AES counter mode keystream into buf,
+ * starting at counter.  the 16-bit block counter in the last two
+ * octets of counter is advanced past the blocks that were used.
+ */
+
+void
+aes_ni_icm_encrypt(v128_t *counter, const aes_expanded_key_t *exp_key,
+		   uint8_t *buf, unsigned int num_blocks);
+#endif
+
 #if 0
 /*
  * internal functions 
@@ -49,6 +49,7 @@
 #include <unistd.h>          /* for getopt() */
 #include "cipher.h"
 #include "aes_icm.h"
+#include "aes.h"
 #include "null_cipher.h"
 
 #define PRINT_DEBUG 0
@@ -56,6 +57,9 @@
 void
 cipher_driver_test_throughput(cipher_t *c);
 
+void
+cipher_driver_test_aes_throughput(cipher_t *c);
+
 err_status_t
 cipher_driver_self_test(cipher_type_t *ct);
 
@@ -185,6 +189,14 @@ main(int argc, char *argv[]) {
     cipher_driver_self_test(&null_cipher);
     cipher_driver_self_test(&aes_icm);
     cipher_driver_self_test(&aes_cbc);
+
+    /* make sure the table driven code is still checked on AES-NI hosts */
+    if (aes_ni_enabled()) {
+      aes_ni_set_enabled(0);
+      printf("without AES-NI: ");
+      cipher_driver_self_test(&aes_icm);
+      aes_ni_set_enabled(1);
+    }
   }
 
   /* do timing and/or buffer_test on null_cipher */
@@ -215,7 +227,7 @@ main(int argc, char *argv[]) {
     check_status(status);
 
     if (do_timing_test)
-      cipher_driver_test_throughput(c);
+      cipher_driver_test_aes_throughput(c);
     
     if (do_validation) {
       status = cipher_driver_test_buffering(c);
@@ -236,7 +248,7 @@ main(int argc, char *argv[]) {
     check_status(status);
 
     if (do_timing_test)
-      cipher_driver_test_throughput(c);
+      cipher_driver_test_aes_throughput(c);
     
     if (do_validation) {
       status = cipher_driver_test_buffering(c);
@@ -264,6 +276,27 @@ cipher_driver_test_throughput(cipher_t *c) {
 
 }
 
+/*
+ * cipher_driver_test_aes_throughput(c) times an AES based cipher with
+ * the table driven implementation and, if the processor has it, with
+ * AES-NI, so that the two can be compared
+ */
+
+void
+cipher_driver_test_aes_throughput(cipher_t *c) {
+
+  if (aes_ni_enabled()) {
+    printf("using AES-NI\n");
+    cipher_driver_test_throughput(c);
+    aes_ni_set_enabled(0);
+    printf("without AES-NI\n");
+    cipher_driver_test_throughput(c);
+    aes_ni_set_enabled(1);
+  } else {
+    cipher_driver_test_throughput(c);
+  }
+}
+
 err_status_t
 cipher_driver_self_test(cipher_type_t *ct) {
   err_status_t status;
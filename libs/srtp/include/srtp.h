@@ -368,6 +368,54 @@ srtp_protect(srtp_t ctx, void *rtp_hdr, int *len_ptr);
 err_status_t
 srtp_unprotect(srtp_t ctx, void *srtp_hdr, int *len_ptr);
 
+/**
+ * @brief srtp_protect_batch() applies srtp_protect() to several RTP
+ * packets.
+ *
+ * The function call srtp_protect_batch(ctx, rtp_hdr, len, count,
+ * status) protects the count packets rtp_hdr[0] .. rtp_hdr[count-1],
+ * whose lengths are len[0] .. len[count-1], exactly as the same
+ * number of calls to srtp_protect() would.  It is a convenience
+ * wrapper that calls srtp_protect() once per packet; no work is
+ * shared between the packets.
+ *
+ * @param ctx is the session context to use for all of the packets.
+ *
+ * @param rtp_hdr is an array of count pointers to RTP packets, each
+ * of which must satisfy the requirements of srtp_protect().
+ *
+ * @param len is an array of count packet lengths, which are updated
+ * as srtp_protect() would update them.
+ *
+ * @param count is the number of packets.
+ *
+ * @param status is NULL, or an array of count elements which is set
+ * to the result of each packet.
+ *
+ * @return
+ *    - err_status_ok            if all of the packets were protected.
+ *    - [other]                  the first error that was encountered;
+ *                               the remaining packets are still
+ *                               processed.
+ */
+
+err_status_t
+srtp_protect_batch(srtp_t ctx, void **rtp_hdr, int *len, int count,
+		   err_status_t *status);
+
+/**
+ * @brief srtp_unprotect_batch() applies srtp_unprotect() to several
+ * SRTP packets.
+ *
+ * This is the receive side counterpart of srtp_protect_batch(); the
+ * parameters and return value have the same meaning, with each packet
+ * handled as srtp_unprotect() would handle it.
+ */
+
+err_status_t
+srtp_unprotect_batch(srtp_t ctx, void **srtp_hdr, int *len, int count,
+		     err_status_t *status);
+
 
 /**
  * @brief srtp_create() allocates and initializes an SRTP session.
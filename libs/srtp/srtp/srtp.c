@@ -1353,6 +1353,42 @@ srtp_dealloc(srtp_t session) {
   return err_status_ok;
 }
 
+err_status_t
+srtp_protect_batch(srtp_t ctx, void **rtp_hdr, int *len, int count,
+		   err_status_t *status) {
+  err_status_t first = err_status_ok;
+  err_status_t stat;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    stat = srtp_protect(ctx, rtp_hdr[i], &len[i]);
+    if (status)
+      status[i] = stat;
+    if (stat && first == err_status_ok)
+      first = stat;
+  }
+
+  return first;
+}
+
+err_status_t
+srtp_unprotect_batch(srtp_t ctx, void **srtp_hdr, int *len, int count,
+		     err_status_t *status) {
+  err_status_t first = err_status_ok;
+  err_status_t stat;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    stat = srtp_unprotect(ctx, srtp_hdr[i], &len[i]);
+    if (status)
+      status[i] = stat;
+    if (stat && first == err_status_ok)
+      first = stat;
+  }
+
+  return first;
+}
+
 
 err_status_t
 srtp_add_stream(srtp_t session, 
@@ -83,6 +83,15 @@ srtp_rejections_per_second(int msg_len_octets, const srtp_policy_t *policy);
 void
 srtp_do_timing(const srtp_policy_t *policy);
 
+#define SRTP_BATCH_SIZE 16   /* packets per srtp_*protect_batch() call */
+
+void
+srtp_do_batch_timing(const srtp_policy_t *policy);
+
+void
+srtp_batch_bits_per_second(int msg_len_octets, const srtp_policy_t *policy,
+			   double *protect_bps, double *unprotect_bps);
+
 void
 srtp_do_rejection_timing(const srtp_policy_t *policy);
 
@@ -108,8 +117,9 @@ extern uint8_t test_key[30];
 
 void
 usage(char *prog_name) {
-  printf("usage: %s [ -t ][ -c ][ -v ][-d <debug_module> ]* [ -l ]\n"
+  printf("usage: %s [ -t ][ -b ][ -c ][ -v ][-d <debug_module> ]* [ -l ]\n"
          "  -t         run timing test\n"
+         "  -b         run batch protect/unprotect timing test\n"
 	 "  -r         run rejection timing test\n"
          "  -c         run codec timing test\n"
          "  -v         run validation tests\n"
@@ -146,6 +156,7 @@ int
 main (int argc, char *argv[]) {
   int q;
   unsigned do_timing_test    = 0;
+  unsigned do_batch_timing   = 0;
   unsigned do_rejection_test = 0;
   unsigned do_codec_timing   = 0;
   unsigned do_validation     = 0;
@@ -180,13 +191,16 @@ main (int argc, char *argv[]) {
 
   /* process input arguments */
   while (1) {
-    q = getopt_s(argc, argv, "trcvld:");
+    q = getopt_s(argc, argv, "tbrcvld:");
     if (q == -1) 
       break;
     switch (q) {
     case 't':
       do_timing_test = 1;
       break;
+    case 'b':
+      do_batch_timing = 1;
+      break;
     case 'r':
       do_rejection_test = 1;
       break;
@@ -212,7 +226,7 @@ main (int argc, char *argv[]) {
   }
 
   if (!do_validation && !do_timing_test && !do_codec_timing 
-      && !do_list_mods && !do_rejection_test)
+      && !do_list_mods && !do_rejection_test && !do_batch_timing)
     usage(argv[0]);
 
   if (do_list_mods) {
@@ -324,6 +338,17 @@ main (int argc, char *argv[]) {
     }
   }
 
+  if (do_batch_timing) {
+    const srtp_policy_t **policy = policy_array;
+    
+    /* loop over policies, run batch timing test for each */
+    while (*policy != NULL) {
+      srtp_print_policy(*policy);
+      srtp_do_batch_timing(*policy);
+      policy++;
+    }
+  }
+
   if (do_rejection_test) {
     const srtp_policy_t **policy = policy_array;
     
@@ -463,6 +488,31 @@ srtp_do_timing(const srtp_policy_t *policy) {
 
 }
 
+void
+srtp_do_batch_timing(const srtp_policy_t *policy) {
+  int len;
+  double protect_bps, unprotect_bps;
+
+  /*
+   * same gnuplot friendly format as srtp_do_timing(), with one
+   * column for each direction
+   */
+  
+  printf("# testing srtp batch throughput (%d packets per call):\r\n",
+	 SRTP_BATCH_SIZE);
+  printf("# mesg length (octets)\tprotect (Mb/s)\tunprotect (Mb/s)\r\n");
+  
+  for (len=16; len <= 2048; len *= 2) {
+    srtp_batch_bits_per_second(len, policy, &protect_bps, &unprotect_bps);
+    printf("%d\t\t\t%f\t%f\r\n", len, 
+	   protect_bps / 1.0E6, unprotect_bps / 1.0E6);
+  }
+  
+  /* these extra linefeeds let gnuplot know that a dataset is done */
+  printf("\r\n\r\n");  
+
+}
+
 void
 srtp_do_rejection_timing(const srtp_policy_t *policy) {
   int len;
@@ -555,6 +605,105 @@ srtp_bits_per_second(int msg_len_octets, const srtp_policy_t *policy) {
                   num_trials * CLOCKS_PER_SEC / timer;   
 }
 
+/*
+ * srtp_batch_bits_per_second() pushes bursts of SRTP_BATCH_SIZE
+ * packets through srtp_protect_batch() on a sender and then through
+ * srtp_unprotect_batch() on a matching receiver, and reports the
+ * throughput of each direction
+ */
+
+void
+srtp_batch_bits_per_second(int msg_len_octets, const srtp_policy_t *policy,
+			   double *protect_bps, double *unprotect_bps) {
+  srtp_t sender, rcvr;
+  srtp_policy_t rcvr_policy;
+  srtp_hdr_t *mesg[SRTP_BATCH_SIZE];
+  void *pkt[SRTP_BATCH_SIZE];
+  int len[SRTP_BATCH_SIZE];
+  clock_t protect_time = 0, unprotect_time = 0, timer;
+  int num_batches = 100000 / SRTP_BATCH_SIZE;
+  uint16_t seq = 0x1234;
+  uint32_t ssrc;
+  err_status_t status;
+  int i, j;
+
+  *protect_bps = *unprotect_bps = 0.0;
+
+  memcpy(&rcvr_policy, policy, sizeof(srtp_policy_t));
+  if (policy->ssrc.type == ssrc_any_outbound)
+    rcvr_policy.ssrc.type = ssrc_any_inbound;
+
+  status = srtp_create(&sender, policy);
+  if (status) {
+    printf("error: srtp_create() failed with error code %d\n", status);
+    exit(1);
+  }
+  status = srtp_create(&rcvr, &rcvr_policy);
+  if (status) {
+    printf("error: srtp_create() failed with error code %d\n", status);
+    exit(1);
+  }
+
+  if (policy->ssrc.type != ssrc_specific) {
+    ssrc = 0xdeadbeef;
+  } else {
+    ssrc = policy->ssrc.value;
+  }
+
+  for (j=0; j < SRTP_BATCH_SIZE; j++) {
+    mesg[j] = srtp_create_test_packet(msg_len_octets, ssrc);
+    if (mesg[j] == NULL) {
+      while (j--)
+	free(mesg[j]);
+      return;   /* indicate failure by leaving the rates at zero */
+    }
+    pkt[j] = mesg[j];
+  }
+  
+  for (i=0; i < num_batches; i++) {
+    for (j=0; j < SRTP_BATCH_SIZE; j++) {
+      mesg[j]->seq = htons(seq++);
+      len[j] = msg_len_octets + 12;  /* add in rtp header length */
+    }
+
+    timer = clock();
+    status = srtp_protect_batch(sender, pkt, len, SRTP_BATCH_SIZE, NULL);
+    protect_time += clock() - timer;
+    if (status) {
+      printf("error: srtp_protect_batch() failed with error code %d\n",
+	     status);
+      exit(1);
+    }
+
+    timer = clock();
+    status = srtp_unprotect_batch(rcvr, pkt, len, SRTP_BATCH_SIZE, NULL);
+    unprotect_time += clock() - timer;
+    if (status) {
+      printf("error: srtp_unprotect_batch() failed with error code %d\n",
+	     status);
+      exit(1);
+    }
+  }
+
+  for (j=0; j < SRTP_BATCH_SIZE; j++)
+    free(mesg[j]);
+
+  status = srtp_dealloc(sender);
+  if (!status)
+    status = srtp_dealloc(rcvr);
+  if (status) {
+    printf("error: srtp_dealloc() failed with error code %d\n", status);
+    exit(1);
+  }
+
+  if (protect_time)
+    *protect_bps = (double) (msg_len_octets) * 8 * num_batches *
+                   SRTP_BATCH_SIZE * CLOCKS_PER_SEC / protect_time;
+  if (unprotect_time)
+    *unprotect_bps = (double) (msg_len_octets) * 8 * num_batches *
+                     SRTP_BATCH_SIZE * CLOCKS_PER_SEC / unprotect_time;
+}
+
 double
 srtp_rejections_per_second(int msg_len_octets, const srtp_policy_t *policy) {
   srtp_ctx_t *srtp;
@@ -48,26 +48,19 @@
 
 static int stfu_log_level = 7;
 
-struct stfu_queue {
-	struct stfu_frame *array;
-	struct stfu_frame int_frame;
-	uint32_t real_array_size;
-	uint32_t array_size;
-	uint32_t array_len;	
-	uint32_t wr_len;
-    uint32_t last_index;
-    int32_t last_jitter;
-};
-typedef struct stfu_queue stfu_queue_t;
-
+/*
+ * Frames live in a single ring of ring_size (a power of two) slots.  A
+ * frame's slot is its packet number, ts / samples_per_packet, masked to
+ * the ring, so storing a frame and looking up the next one to play are
+ * both a single index operation.  Slots that hold nothing playable are
+ * marked was_read.
+ */
 struct stfu_instance {
-	struct stfu_queue a_queue;
-	struct stfu_queue b_queue;
-	struct stfu_queue c_queue;
-	struct stfu_queue *in_queue;
-	struct stfu_queue *out_queue;
-	struct stfu_queue *old_queue;
-    struct stfu_frame *last_frame;
+    struct stfu_frame *ring;
+    uint32_t ring_size;
+    uint32_t ring_mask;
+    struct stfu_frame int_frame;
+    uint32_t fill_count;
 	uint32_t cur_ts;
 	uint16_t cur_seq;
 	uint32_t last_wr_ts;
@@ -88,6 +81,7 @@ struct stfu_instance {
     uint32_t period_packet_in_count;
     uint32_t period_packet_out_count;
     uint32_t period_missing_count;
+    uint32_t period_late_count;
 
     uint32_t period_need_range;
     uint32_t period_need_range_avg;
@@ -99,6 +93,10 @@ struct stfu_instance {
     uint32_t session_packet_in_count;
     uint32_t session_packet_out_count;
 
+    uint32_t session_late_count;
+    uint32_t session_drop_count;
+    uint32_t session_reset_count;
+
     uint32_t sync_out;
     uint32_t sync_in;
 
@@ -114,6 +112,14 @@ struct stfu_instance {
     
     uint32_t period_time;
     uint32_t decrement_time;
+
+    /* inter-arrival jitter (RFC 3550 6.4.1), in samples scaled by 16 */
+    uint32_t jitter;
+    uint32_t last_arrival_ts;
+    uint32_t last_arrival_rtp_ts;
+
+    /* frames to skip to bring the latency down after a shrink */
+    uint32_t drop_pending;
     
     uint32_t plc_len;
     uint32_t plc_pt;
@@ -163,36 +169,96 @@ void stfu_global_set_default_logger(int level)
 }
 
 
+static inline uint32_t stfu_n_slot(stfu_instance_t *i, uint32_t ts)
+{
+    return (ts / i->samples_per_packet) & i->ring_mask;
+}
 
-static stfu_status_t stfu_n_resize_aqueue(stfu_queue_t *queue, uint32_t qlen)
+/* the unread frame with exactly this timestamp, if it is in the ring */
+static inline stfu_frame_t *stfu_n_peek(stfu_instance_t *i, uint32_t ts)
 {
-    unsigned char *m;
+    stfu_frame_t *frame = &i->ring[stfu_n_slot(i, ts)];
+
+    if (!frame->was_read && frame->ts == ts) {
+        return frame;
+    }
+
+    return NULL;
+}
+
+static stfu_status_t stfu_n_resize_ring(stfu_instance_t *i, uint32_t qlen)
+{
+    stfu_frame_t *ring, *frame;
+    uint32_t size = 4, x;
+
+    /* room for the playout depth plus as much again for late and reordered packets */
+    while (size < qlen * 2 + 2) {
+        size <<= 1;
+    }
 
-    if (qlen <= queue->real_array_size) {
-        queue->array_size = qlen;
-        if (queue->array_len > qlen) {
-            queue->array_len = qlen;
+    if (size <= i->ring_size) {
+        return STFU_IT_WORKED;
+    }
+
+    ring = calloc(size, sizeof(struct stfu_frame));
+    if (!ring) {
+        return STFU_IT_FAILED;
+    }
+
+    for (x = 0; x < size; x++) {
+        ring[x].was_read = 1;
+    }
+
+    for (x = 0; x < i->ring_size; x++) {
+        frame = &i->ring[x];
+        if (!frame->was_read && i->samples_per_packet) {
+            memcpy(&ring[(frame->ts / i->samples_per_packet) & (size - 1)], frame, sizeof(*frame));
         }
-    } else {
-        m = realloc(queue->array, qlen * sizeof(struct stfu_frame));
-        assert(m);
-        memset(m + queue->array_size * sizeof(struct stfu_frame), 0, (qlen * sizeof(struct stfu_frame)) - (queue->array_size * sizeof(struct stfu_frame)));
-        queue->array = (struct stfu_frame *) m;
-        queue->real_array_size = queue->array_size = qlen;
     }
 
+    free(i->ring);
+    i->ring = ring;
+    i->ring_size = size;
+    i->ring_mask = size - 1;
+
 	return STFU_IT_WORKED;
 }
 
-static void stfu_n_init_aqueue(stfu_queue_t *queue, uint32_t qlen)
+/* the playout depth the measured jitter asks for, 0 if there is no measurement yet */
+static uint32_t stfu_n_jitter_qlen(stfu_instance_t *i)
 {
+    uint32_t jitter = i->jitter >> 4;
+
+    if (!i->samples_per_packet || !i->last_arrival_ts) {
+        return 0;
+    }
+
+    return ((3 * jitter) + i->samples_per_packet - 1) / i->samples_per_packet + 1;
+}
+
+static void stfu_n_update_jitter(stfu_instance_t *i, uint32_t ts, uint32_t timer_ts)
+{
+    int32_t d;
+
+    if (!ts || !timer_ts) {
+        return;
+    }
 
-	queue->array = calloc(qlen, sizeof(struct stfu_frame));
-	assert(queue->array != NULL);
-	memset(queue->array, 0, sizeof(struct stfu_frame) * qlen);	
-	queue->real_array_size = queue->array_size = qlen;
-	queue->int_frame.plc = 1;
-    memset(queue->int_frame.data, 255, sizeof(queue->int_frame.data));
+    if (i->last_arrival_ts && ts != i->last_arrival_rtp_ts) {
+        d = (int32_t)(timer_ts - i->last_arrival_ts) - (int32_t)(ts - i->last_arrival_rtp_ts);
+
+        if (d < 0) {
+            d = -d;
+        }
+
+        /* a second or more is a discontinuity, not jitter */
+        if ((uint32_t) d < i->samples_per_second) {
+            i->jitter += d - ((i->jitter + 8) >> 4);
+        }
+    }
+
+    i->last_arrival_ts = timer_ts;
+    i->last_arrival_rtp_ts = ts;
 }
 
 
@@ -210,9 +276,7 @@ void stfu_n_destroy(stfu_instance_t **i)
 		ii = *i;
 		*i = NULL;
         if (ii->name) free(ii->name);
-		free(ii->a_queue.array);
-		free(ii->b_queue.array);
-		free(ii->c_queue.array);
+		free(ii->ring);
 		free(ii);
 	}
 }
@@ -240,11 +304,25 @@ void stfu_n_report(stfu_instance_t *i, stfu_report_t *r)
 	r->consecutive_bad_count = i->consecutive_bad_count;
 }
 
+void stfu_n_get_stats(stfu_instance_t *i, stfu_stats_t *s)
+{
+    stfu_assert(i);
+    s->qlen = i->qlen;
+    s->most_qlen = i->most_qlen;
+    s->jitter_ms = (uint32_t)(((uint64_t)(i->jitter >> 4) * 1000) / i->samples_per_second);
+    s->packet_in_count = i->session_packet_in_count;
+    s->packet_out_count = i->session_packet_out_count;
+    s->missing_count = i->session_missing_count;
+    s->late_count = i->session_late_count;
+    s->drop_count = i->session_drop_count;
+    s->reset_count = i->session_reset_count;
+}
+
 stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen) 
 {
     stfu_status_t s;
 
-    if (i->qlen == i->max_qlen) {
+    if (qlen > i->qlen && i->qlen == i->max_qlen) {
         return STFU_IT_FAILED;
     }
     
@@ -256,17 +334,17 @@ stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen)
         }
     }
 
-    if ((s = stfu_n_resize_aqueue(&i->a_queue, qlen)) == STFU_IT_WORKED) {
-        s = stfu_n_resize_aqueue(&i->b_queue, qlen);
-        s = stfu_n_resize_aqueue(&i->c_queue, qlen);
-
+    if ((s = stfu_n_resize_ring(i, qlen)) == STFU_IT_WORKED) {
         if (qlen > i->most_qlen) {
             i->most_qlen = qlen;
         }
 
+        if (qlen < i->qlen) {
+            i->drop_pending += i->qlen - qlen;
+        }
+
         i->qlen = qlen;
         i->max_plc = 5;
-        i->last_frame = NULL;
     }
     
     return s;
@@ -285,11 +363,16 @@ stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_
     i->qlen = qlen;
     i->max_qlen = max_qlen;
     i->orig_qlen = qlen;
+    i->most_qlen = qlen;
     i->samples_per_packet = samples_per_packet;
 
-	stfu_n_init_aqueue(&i->a_queue, qlen);
-	stfu_n_init_aqueue(&i->b_queue, qlen);
-	stfu_n_init_aqueue(&i->c_queue, qlen);
+    if (stfu_n_resize_ring(i, qlen) != STFU_IT_WORKED) {
+        free(i);
+        return NULL;
+    }
+
+	i->int_frame.plc = 1;
+    memset(i->int_frame.data, 255, sizeof(i->int_frame.data));
 
     i->max_drift = (int32_t)(max_drift_ms * (samples_per_second / 1000) * -1);
 
@@ -297,17 +380,14 @@ stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_
         i->drift_max_dropped = (samples_per_second * 2) / samples_per_packet;
     }
 
-	i->in_queue = &i->a_queue;
-	i->out_queue = &i->b_queue;
-	i->old_queue = &i->c_queue;
     i->name = strdup("none");
     
     i->max_plc = i->qlen / 2;
 
     i->samples_per_second = samples_per_second ? samples_per_second : 8000;
     
-    i->period_time = ((i->samples_per_second * 20) / i->samples_per_packet);
-    i->decrement_time = ((i->samples_per_second * 15) / i->samples_per_packet);
+    i->period_time = ((i->samples_per_second * 20) / least1(i->samples_per_packet));
+    i->decrement_time = ((i->samples_per_second * 15) / least1(i->samples_per_packet));
 
 	return i;
 }
@@ -330,6 +410,7 @@ static void stfu_n_reset_counters(stfu_instance_t *i)
     i->period_packet_in_count = 0;
     i->period_packet_out_count = 0;
     i->period_missing_count = 0;
+    i->period_late_count = 0;
 
     i->period_need_range = 0;
     i->period_need_range_avg = 0;
@@ -341,22 +422,20 @@ static void stfu_n_reset_counters(stfu_instance_t *i)
 
 void stfu_n_reset(stfu_instance_t *i)
 {
+    uint32_t x;
+
     if (stfu_log != null_logger && i->debug) {
         stfu_log(STFU_LOG_EMERG, "%s RESET\n", i->name);
     }
 
     i->ready = 0;
-	i->in_queue = &i->a_queue;
-	i->out_queue = &i->b_queue;
-	i->old_queue = &i->c_queue;
-
-	i->in_queue->array_len = 0;
-	i->out_queue->array_len = 0;
-	i->out_queue->wr_len = 0;
-	i->last_frame = NULL;
-    i->in_queue->last_jitter = 0;
-    i->out_queue->last_jitter = 0;
+    i->fill_count = 0;
+    i->drop_pending = 0;
+    i->session_reset_count++;
 
+    for (x = 0; x < i->ring_size; x++) {
+        i->ring[x].was_read = 1;
+    }
 
     stfu_n_reset_counters(i);
     stfu_n_sync(i, 1);
@@ -367,7 +446,8 @@ void stfu_n_reset(stfu_instance_t *i)
 	i->last_rd_ts = 0;
 	i->miss_count = 0;	
     i->packet_count = 0;
-
+    i->last_arrival_ts = 0;
+    i->last_arrival_rtp_ts = 0;
 
 }
 
@@ -385,30 +465,11 @@ stfu_status_t stfu_n_sync(stfu_instance_t *i, uint32_t packets)
 }
 
 
-static void stfu_n_swap(stfu_instance_t *i)
-{
-    stfu_queue_t *last_in = i->in_queue, *last_out = i->out_queue, *last_old = i->old_queue;
-    
-    i->ready = 1;
-    
-    i->in_queue = last_old;
-    i->out_queue = last_in;
-    i->old_queue = last_out;
-
-    i->in_queue->array_len = 0;
-    i->out_queue->wr_len = 0;
-    i->last_frame = NULL;
-    i->miss_count = 0;
-    i->in_queue->last_index = 0;
-    i->out_queue->last_index = 0;
-    i->out_queue->last_jitter = 0;
-}
-
 stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uint32_t pt, void *data, size_t datalen, uint32_t timer_ts, int last)
 {
-	uint32_t index = 0;
 	stfu_frame_t *frame;
 	size_t cplen = 0;
+    uint32_t jitter_qlen;
     int good_ts = 0;
 
     if (!i->samples_per_packet && ts && i->last_rd_ts) {
@@ -420,6 +481,8 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uin
                 if (i->max_drift && i->samples_per_packet) {
                     i->drift_max_dropped = (i->samples_per_second * 2) / i->samples_per_packet;
                 }
+                i->period_time = ((i->samples_per_second * 20) / i->samples_per_packet);
+                i->decrement_time = ((i->samples_per_second * 15) / i->samples_per_packet);
             }
         } else {
             i->same_ts = 0;
@@ -432,6 +495,17 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uin
             return STFU_IT_FAILED;
         }
     }
+
+    if (last) {
+        /* no more input, let the reader drain what is there */
+        i->ready = 1;
+		return STFU_IM_DONE;
+	}
+
+    if (!i->samples_per_packet) {
+        i->last_rd_ts = ts;
+        return STFU_IT_FAILED;
+    }
  
     if (timer_ts) {
         if (ts && !i->ts_offset) {
@@ -450,6 +524,7 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uin
             if (i->ts_drift < i->max_drift) {
                 if (++i->drift_dropped_packets < i->drift_max_dropped) {
                     stfu_log(STFU_LOG_EMERG, "%s TOO LATE !!! %u \n\n\n", i->name, ts);
+                    i->session_late_count++;
                     return STFU_ITS_TOO_LATE;
                 }
             } else {
@@ -472,14 +547,15 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uin
                 if (stfu_log != null_logger && i->debug) {
                     stfu_log(STFU_LOG_EMERG, "%s TOO LATE !!! %u \n\n\n", i->name, ts);
                 }
-                if (i->in_queue->array_len < i->in_queue->array_size) {
-                    i->in_queue->array_len++;
-                }
+                i->session_late_count++;
+                i->period_late_count++;
                 return STFU_ITS_TOO_LATE;
             }
         }
     }
 
+    stfu_n_update_jitter(i, ts, timer_ts);
+
     if (good_ts) {
         i->period_clean_count++;
         i->session_clean_count++;
@@ -490,14 +566,28 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uin
 
     i->period_need_range_avg = i->period_need_range / least1(i->period_missing_count);
 
-    if (i->period_missing_count > i->qlen * 2) {
+    jitter_qlen = stfu_n_jitter_qlen(i);
+
+    /*
+     * with arrival times to go on, only packets that turned up after their
+     * turn say the buffer is too short; without them every miss has to count
+     * since lost and late look the same
+     */
+    if ((i->last_arrival_ts && i->period_late_count > 1) || (!i->last_arrival_ts && i->period_missing_count > i->qlen * 2)) {
         if (stfu_log != null_logger && i->debug) {
             stfu_log(STFU_LOG_EMERG, "%s resize %u %u\n", i->name, i->qlen, i->qlen + 1);
         }
         stfu_n_resize(i, i->qlen + 1);
         stfu_n_reset_counters(i);
+    } else if (jitter_qlen > i->qlen && (!i->max_qlen || i->qlen < i->max_qlen)) {
+        if (stfu_log != null_logger && i->debug) {
+            stfu_log(STFU_LOG_EMERG, "%s jitter resize %u %u (%u)\n", i->name, i->qlen, jitter_qlen, i->jitter >> 4);
+        }
+        stfu_n_resize(i, jitter_qlen);
+        stfu_n_reset_counters(i);
     } else {
-        if (i->qlen > i->orig_qlen && (i->consecutive_good_count > i->decrement_time || i->period_clean_count > i->decrement_time)) {
+        if (i->qlen > i->orig_qlen && i->qlen > jitter_qlen &&
+            (i->consecutive_good_count > i->decrement_time || i->period_clean_count > i->decrement_time)) {
             stfu_n_resize(i, i->qlen - 1);
             stfu_n_reset_counters(i);
             stfu_n_sync(i, i->qlen);
@@ -518,13 +608,9 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uin
     i->diff_total += i->diff;
 
     if ((i->period_packet_in_count > i->period_time)) {
-        //uint32_t avg;
-
-        //avg = i->diff_total / least1(i->period_packet_in_count);
-
         i->period_packet_in_count = 0;
 
-        if (i->period_missing_count == 0 && i->qlen > i->orig_qlen) {
+        if (i->period_missing_count == 0 && i->qlen > i->orig_qlen && i->qlen > jitter_qlen) {
             stfu_n_resize(i, i->qlen - 1);
             stfu_n_sync(i, i->qlen);
         }
@@ -536,28 +622,25 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uin
     
 
     if (stfu_log != null_logger && i->debug) {
-        stfu_log(STFU_LOG_EMERG, "I: %s %u/%u i=%u/%u - g:%u/%u c:%u/%u b:%u - %u:%u - %u %d %u %u %d %d %d/%d\n", i->name,
+        stfu_log(STFU_LOG_EMERG, "I: %s %u/%u i=%u/%u - g:%u/%u c:%u/%u b:%u - %u:%u - %u %d %u %u %d %d %d/%d j:%u\n", i->name,
                  i->qlen, i->max_qlen, i->period_packet_in_count, i->period_time, i->consecutive_good_count, 
                  i->decrement_time, i->period_clean_count, i->decrement_time, i->consecutive_bad_count,
                  ts, ts / i->samples_per_packet, 
                  i->period_missing_count, i->period_need_range_avg,
-                 i->last_wr_ts, ts, i->diff, i->diff_total / least1(i->period_packet_in_count), i->ts_drift, i->max_drift);
+                 i->last_wr_ts, ts, i->diff, i->diff_total / least1(i->period_packet_in_count), i->ts_drift, i->max_drift,
+                 i->jitter >> 4);
     }
 
-	if (last || i->in_queue->array_len == i->in_queue->array_size) {
-        stfu_n_swap(i);
-    }
+	frame = &i->ring[stfu_n_slot(i, ts)];
 
-	if (last) {
-		return STFU_IM_DONE;
-	}
-
-    index = i->in_queue->array_len++;
-    assert(index < i->in_queue->array_size);
-	frame = &i->in_queue->array[index];
+    if (!frame->was_read) {
+        if (frame->ts == ts) {
+            /* duplicate, keep the copy we already have */
+            return STFU_IT_WORKED;
+        }
 
-	if (i->in_queue->array_len == i->in_queue->array_size) {
-        stfu_n_swap(i);
+        /* the reader is a whole ring behind, this frame was never going to play */
+        i->session_drop_count++;
     }
 
 	if ((cplen = datalen) > sizeof(frame->data)) {
@@ -575,35 +658,50 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint16_t seq, uin
 	frame->dlen = cplen;
 	frame->was_read = 0;	
 
+    if (!i->ready && ++i->fill_count >= i->qlen) {
+        i->ready = 1;
+    }
+
 	return STFU_IT_WORKED;
 }
 
-static int stfu_n_find_any_frame(stfu_instance_t *in, stfu_queue_t *queue, stfu_frame_t **r_frame)
+/* the oldest unread frame, only needed when (re)starting playout */
+static stfu_frame_t *stfu_n_oldest_frame(stfu_instance_t *in)
 {
     uint32_t i = 0;
-    stfu_frame_t *frame = NULL;
+    stfu_frame_t *frame = NULL, *oldest = NULL;
+
+    for (i = 0; i < in->ring_size; i++) {
+        frame = &in->ring[i];
+        if (!frame->was_read && (!oldest || (int32_t)(frame->ts - oldest->ts) < 0)) {
+            oldest = frame;
+        }
+    }
 
+    return oldest;
+}
+
+static void stfu_n_take_frame(stfu_instance_t *in, stfu_frame_t *frame)
+{
+    frame->was_read = 1;
+    in->period_packet_out_count++;
+    in->session_packet_out_count++;
+}
+
+static int stfu_n_find_any_frame(stfu_instance_t *in, stfu_frame_t **r_frame)
+{
     stfu_assert(r_frame);
     
-    *r_frame = NULL;
-
-    for(i = 0; i < queue->real_array_size; i++) {
-        frame = &queue->array[i];
-        if (!frame->was_read) {
-            *r_frame = frame;
-            queue->last_index = i;
-            frame->was_read = 1;
-            in->period_packet_out_count++;
-            in->session_packet_out_count++;
-            return 1;
-        }
+    if ((*r_frame = stfu_n_oldest_frame(in))) {
+        stfu_n_take_frame(in, *r_frame);
+        return 1;
     }
 
     return 0;    
 }
 
 
-static int stfu_n_find_frame(stfu_instance_t *in, stfu_queue_t *queue, uint32_t min_ts, uint32_t max_ts, stfu_frame_t **r_frame)
+static int stfu_n_find_frame(stfu_instance_t *in, uint32_t min_ts, uint32_t max_ts, stfu_frame_t **r_frame)
 {
     uint32_t i = 0;
     stfu_frame_t *frame = NULL;
@@ -612,27 +710,47 @@ static int stfu_n_find_frame(stfu_instance_t *in, stfu_queue_t *queue, uint32_t
         *r_frame = NULL;
     }
 
-    for(i = 0; i < queue->array_size; i++) {
-        frame = &queue->array[i];
-        
-        if (frame->ts == max_ts || (frame->ts > min_ts && frame->ts < max_ts)) {
-            if (r_frame) {
-                *r_frame = frame;
-                queue->last_index = i;
-                frame->was_read = 1;
-                in->period_packet_out_count++;
-                in->session_packet_out_count++;
+    /* the expected case, the frame that is due is sitting in its slot */
+    if (!(frame = stfu_n_peek(in, max_ts))) {
+
+        /* timestamps that are not a whole number of packets apart need a look around */
+        for(i = 0; i < in->ring_size; i++) {
+            frame = &in->ring[i];
+            if (!frame->was_read && frame->ts > min_ts && frame->ts < max_ts) {
+                break;
             }
-            return 1;
+        }
+
+        if (i == in->ring_size) {
+            return 0;
         }
     }
 
-    return 0;
+    if (r_frame) {
+        *r_frame = frame;
+        stfu_n_take_frame(in, frame);
+    }
+
+    return 1;
+}
+
+static void stfu_n_dump(stfu_instance_t *i)
+{
+    uint32_t y;
+    stfu_frame_t *frame;
+
+    stfu_log(STFU_LOG_EMERG, "%s ", i->name);
+    for(y = 0; y < i->ring_size; y++) {
+        if ((y % 5) == 0) stfu_log(STFU_LOG_EMERG, "\n%s ", i->name);
+        frame = &i->ring[y];
+        stfu_log(STFU_LOG_EMERG, "%u:%u%s\t", frame->ts, frame->ts / i->samples_per_packet, frame->was_read ? "" : "*");
+    }
+    stfu_log(STFU_LOG_EMERG, "\n%s\n\n\n", i->name);
 }
 
 stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 {
-	stfu_frame_t *rframe = NULL;
+	stfu_frame_t *rframe = NULL, *next;
     int found = 0;
 
 	if (!i->samples_per_packet) {
@@ -648,37 +766,28 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
 
     if (i->cur_ts == 0 && i->last_wr_ts < 1000) {
-        uint32_t x = 0;
-        for (x = 0; x < i->out_queue->array_len; x++) {
-            if (!i->out_queue->array[x].was_read) {
-                i->cur_ts = i->out_queue->array[x].ts;
-                i->cur_seq = i->out_queue->array[x].seq;
-                break;
-            }
-            if (i->cur_ts == 0) {
-                if (stfu_log != null_logger && i->debug) {
-                    stfu_log(STFU_LOG_EMERG, "%s JITTERBUFFER ERROR: PUNTING\n", i->name);
-                    return NULL;
-                }
+        if ((rframe = stfu_n_oldest_frame(i))) {
+            i->cur_ts = rframe->ts;
+            i->cur_seq = rframe->seq;
+        } else {
+            if (stfu_log != null_logger && i->debug) {
+                stfu_log(STFU_LOG_EMERG, "%s JITTERBUFFER ERROR: PUNTING\n", i->name);
             }
+            return NULL;
         }
     } else {
         i->cur_ts = i->cur_ts + i->samples_per_packet;
         i->cur_seq++;
     }
     
-    found = stfu_n_find_frame(i, i->out_queue, i->last_wr_ts, i->cur_ts, &rframe);
-
-    if (found) {
-        if (i->out_queue->array_len) {
-            i->out_queue->array_len--;
-        }
-    } else {
-        found = stfu_n_find_frame(i, i->in_queue, i->last_wr_ts, i->cur_ts, &rframe);
-
-        if (!found) {
-            found = stfu_n_find_frame(i, i->old_queue, i->last_wr_ts, i->cur_ts, &rframe);
-        }
+    found = stfu_n_find_frame(i, i->last_wr_ts, i->cur_ts, &rframe);
+
+    if (found && i->drop_pending && (next = stfu_n_peek(i, rframe->ts + i->samples_per_packet))) {
+        /* the buffer was shrunk, play the next frame instead of this one to catch up */
+        stfu_n_take_frame(i, next);
+        rframe = next;
+        i->drop_pending--;
+        i->session_drop_count++;
     }
 
     if (found) {
@@ -688,7 +797,7 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
     if (i->sync_out) {
         if (!found) {
-            if ((found = stfu_n_find_any_frame(i, i->out_queue, &rframe))) {
+            if ((found = stfu_n_find_any_frame(i, &rframe))) {
                 i->cur_ts = rframe->ts;
                 i->cur_seq = rframe->seq;
             }
@@ -710,9 +819,6 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
 
     if (!found && i->samples_per_packet) {
-        uint32_t y;
-        stfu_frame_t *frame = NULL;
-
         int32_t delay = i->last_rd_ts - i->cur_ts;
         uint32_t need  = abs(i->last_rd_ts - i->cur_ts) / i->samples_per_packet;
 
@@ -730,23 +836,8 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
             i->packet_count = 0;
         }
 
-        if (stfu_log != null_logger && i->debug) {        
-            stfu_log(STFU_LOG_EMERG, "%s ", i->name);
-            for(y = 0; y < i->out_queue->array_size; y++) {
-                if ((y % 5) == 0) stfu_log(STFU_LOG_EMERG, "\n%s ", i->name);
-                frame = &i->out_queue->array[y];
-                stfu_log(STFU_LOG_EMERG, "%u:%u\t", frame->ts, frame->ts / i->samples_per_packet);
-            }
-            stfu_log(STFU_LOG_EMERG, "\n%s ", i->name);
-
-
-            for(y = 0; y < i->in_queue->array_size; y++) {
-                if ((y % 5) == 0) stfu_log(STFU_LOG_EMERG, "\n%s ", i->name);
-                frame = &i->in_queue->array[y];
-                stfu_log(STFU_LOG_EMERG, "%u:%u\t", frame->ts, frame->ts / i->samples_per_packet);
-            }
-            stfu_log(STFU_LOG_EMERG, "\n%s\n\n\n", i->name);
-
+        if (stfu_log != null_logger && i->debug) {
+            stfu_n_dump(i);
         }
 
         if (delay < 0) {
@@ -772,8 +863,6 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
     }
 
     if (found) {
-        i->last_frame = rframe;
-        i->out_queue->wr_len++;
         i->last_wr_ts = rframe->ts;
 
         i->miss_count = 0;
@@ -785,7 +874,7 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
     } else {
         i->last_wr_ts = i->cur_ts;
-        rframe = &i->out_queue->int_frame;
+        rframe = &i->int_frame;
         rframe->dlen = i->plc_len;
         rframe->pt = i->plc_pt;
         rframe->ts = i->cur_ts;
@@ -808,45 +897,42 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
 STFU_DECLARE(int32_t) stfu_n_copy_next_frame(stfu_instance_t *jb, uint32_t timestamp, uint16_t seq, uint16_t distance, stfu_frame_t *next_frame)
 {
-	uint32_t i = 0, j = 0;
-#ifdef WIN32
-#pragma warning (disable:4204)
-#endif
-	stfu_queue_t *queues[] = { jb->out_queue, jb->in_queue, jb->old_queue};
-#ifdef WIN32
-#pragma warning (default:4204)
-#endif
-	stfu_queue_t *queue = NULL;
-	stfu_frame_t *frame = NULL;
-
+	uint32_t i = 0;
+	stfu_frame_t *frame = NULL, *best = NULL;
 	uint32_t target_ts = 0;
 
 #ifdef WIN32
 	UNREFERENCED_PARAMETER(seq);
 #endif
-	if (!next_frame) return 0;
+	if (!next_frame || !jb->samples_per_packet) return 0;
 
 	target_ts = timestamp + (distance - 1) * jb->samples_per_packet;
 
-	for (i = 0; i < sizeof(queues)/sizeof(queues[0]); i++) {
-		queue = queues[i];
+	/* normally the frame right after target_ts is there to be had directly */
+	if (!(best = stfu_n_peek(jb, target_ts + jb->samples_per_packet))) {
+		for (i = 0; i < jb->ring_size; i++) {
+			frame = &jb->ring[i];
 
-		if (!queue) continue;
+			if (frame->was_read || (int32_t)(frame->ts - target_ts) <= 0) {
+				continue;
+			}
 
-		for(j = 0; j < queue->array_size; j++) {
-			frame = &queue->array[j];
-			/* FIXME: ts rollover happened? bad luck */
-			if (frame->ts > target_ts) {
-				memcpy(next_frame, frame, sizeof(stfu_frame_t));
-				return 1;
+			if (!best || (int32_t)(frame->ts - best->ts) < 0) {
+				best = frame;
 			}
 		}
 	}
 
+	if (best) {
+		memcpy(next_frame, best, sizeof(stfu_frame_t));
+		return 1;
+	}
+
 	return 0;
 }
 
 
+
 #ifdef WIN32
 #ifndef vsnprintf
 #define vsnprintf _vsnprintf
@@ -183,9 +183,23 @@ typedef struct {
 	uint32_t consecutive_bad_count;
 } stfu_report_t;
 
+typedef struct {
+	uint32_t qlen;
+	uint32_t most_qlen;
+	uint32_t jitter_ms;
+	uint32_t packet_in_count;
+	uint32_t packet_out_count;
+	uint32_t missing_count;
+	uint32_t late_count;
+	uint32_t drop_count;
+	uint32_t reset_count;
+} stfu_stats_t;
+
 typedef void (*stfu_n_call_me_t)(stfu_instance_t *i, void *);
 
 void stfu_n_report(stfu_instance_t *i, stfu_report_t *r);
+/*! Fills in the playout statistics gathered since the instance was created */
+void stfu_n_get_stats(stfu_instance_t *i, stfu_stats_t *s);
 void stfu_n_destroy(stfu_instance_t **i);
 stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_per_packet, uint32_t samples_per_second, uint32_t max_drift_ms);
 stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen);
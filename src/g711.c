@@ -88,5 +88,25 @@ uint8_t ulaw_to_alaw(uint8_t ulaw)
 	return ulaw_to_alaw_table[ulaw];
 }
 
+/*- End of function --------------------------------------------------------*/
+
+void alaw_to_ulaw_block(uint8_t *ulaw, const uint8_t *alaw, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		ulaw[i] = alaw_to_ulaw_table[alaw[i]];
+}
+
+/*- End of function --------------------------------------------------------*/
+
+void ulaw_to_alaw_block(uint8_t *alaw, const uint8_t *ulaw, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		alaw[i] = ulaw_to_alaw_table[ulaw[i]];
+}
+
 /*- End of function --------------------------------------------------------*/
 /*- End of file ------------------------------------------------------------*/
@@ -335,6 +335,20 @@ extern "C" {
 */
 	uint8_t ulaw_to_alaw(uint8_t ulaw);
 
+/*! \brief Transcode a block of A-law samples to u-law.
+    \param ulaw The u-law output buffer.
+    \param alaw The A-law samples.
+    \param len The number of samples.
+*/
+	void alaw_to_ulaw_block(uint8_t *ulaw, const uint8_t *alaw, int len);
+
+/*! \brief Transcode a block of u-law samples to A-law.
+    \param alaw The A-law output buffer.
+    \param ulaw The u-law samples.
+    \param len The number of samples.
+*/
+	void ulaw_to_alaw_block(uint8_t *alaw, const uint8_t *ulaw, int len);
+
 #ifdef __cplusplus
 }
 #endif
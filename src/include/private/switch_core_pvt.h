@@ -104,6 +104,15 @@ typedef enum {
 } switch_session_flag_t;
 
 
+/* linear audio of one direction of a session, written once per frame and read by every bug at its own position */
+typedef struct switch_media_bug_ring {
+	switch_mutex_t *mutex;
+	uint8_t *data;
+	switch_size_t size;
+	/* total bytes ever written, positions are absolute offsets in this stream */
+	uint64_t head;
+} switch_media_bug_ring_t;
+
 struct switch_core_session {
 	switch_memory_pool_t *pool;
 	switch_thread_t *thread;
@@ -130,6 +139,12 @@ struct switch_core_session {
 	switch_audio_resampler_t *read_resampler;
 	switch_audio_resampler_t *write_resampler;
 
+	const switch_codec_implementation_t *write_transcode_from;
+	const switch_codec_implementation_t *write_transcode_to;
+	switch_core_codec_transcode_func_t write_transcode;
+	switch_buffer_t *write_repack_buffer;
+	uint32_t write_repack_unit;
+
 	switch_mutex_t *mutex;
 	switch_mutex_t *resample_mutex;
 	switch_mutex_t *codec_read_mutex;
@@ -151,6 +166,8 @@ struct switch_core_session {
 	switch_queue_t *private_event_queue;
 	switch_queue_t *private_event_queue_pri;
 	switch_thread_rwlock_t *bug_rwlock;
+	switch_media_bug_ring_t *bug_read_ring;
+	switch_media_bug_ring_t *bug_write_ring;
 	switch_media_bug_t *bugs;
 	switch_app_log_t *app_log;
 	uint32_t stack_count;
@@ -181,8 +198,10 @@ struct switch_core_session {
 };
 
 struct switch_media_bug {
-	switch_buffer_t *raw_write_buffer;
+	/* private copy of the read stream, only for bugs that demux it */
 	switch_buffer_t *raw_read_buffer;
+	uint64_t read_pos;
+	uint64_t write_pos;
 	switch_frame_t *read_replace_frame_in;
 	switch_frame_t *read_replace_frame_out;
 	switch_frame_t *write_replace_frame_in;
@@ -304,5 +323,17 @@ void switch_core_sqldb_stop(void);
 void switch_core_session_init(switch_memory_pool_t *pool);
 void switch_core_session_uninit(void);
 void switch_core_state_machine_init(switch_memory_pool_t *pool);
+void switch_core_file_init(switch_memory_pool_t *pool);
+void switch_core_file_shutdown(void);
+void switch_core_codec_pool_init(switch_memory_pool_t *pool);
+void switch_core_codec_transcoder_init(switch_memory_pool_t *pool);
+void switch_core_codec_offload_init(switch_memory_pool_t *pool);
+void switch_core_codec_offload_shutdown(void);
+void switch_core_resample_init(switch_memory_pool_t *pool);
+void switch_ivr_record_merge_init(switch_memory_pool_t *pool);
+void switch_ivr_record_merge_shutdown(void);
+void switch_core_media_bug_ring_write(switch_core_session_t *session, switch_media_bug_ring_t *ring, const void *data, switch_size_t len, int write_stream);
+void switch_core_media_bug_ring_skip(switch_media_bug_ring_t *ring, uint64_t *pos);
+void switch_core_media_bug_ring_destroy(switch_media_bug_ring_t *ring);
 switch_memory_pool_t *switch_core_memory_init(void);
 void switch_core_memory_stop(void);
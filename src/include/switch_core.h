@@ -363,6 +363,22 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_transfer_callback(switch_c
 */
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(_In_ switch_media_bug_t *bug, _In_ switch_frame_t *frame, switch_bool_t fill);
 
+/*!
+  \brief Read whatever audio of one direction is pending on the bug, without mixing in the other one
+  \param bug the bug to read from
+  \param frame the frame to write the data to
+  \param write_stream SWITCH_TRUE for the write direction, SWITCH_FALSE for the read direction
+  \return SWITCH_STATUS_SUCCESS when audio was read
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read_stream(_In_ switch_media_bug_t *bug, _In_ switch_frame_t *frame, switch_bool_t write_stream);
+
+/*!
+  \brief Hand one frame of the read direction to a bug, the core read path calls this with the bug read mutex held
+  \param bug the bug to feed
+  \param frame the frame read from the channel, after any read replace
+*/
+SWITCH_DECLARE(void) switch_core_media_bug_feed_read(_In_ switch_media_bug_t *bug, _In_ const switch_frame_t *frame);
+
 /*!
   \brief Flush the read and write buffers for the bug
   \param bug the bug to flush the read and write buffers on
@@ -1555,6 +1571,88 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_copy(switch_codec_t *codec, sw
 SWITCH_DECLARE(switch_status_t) switch_core_codec_parse_fmtp(const char *codec_name, const char *fmtp, uint32_t rate, switch_codec_fmtp_t *codec_fmtp);
 SWITCH_DECLARE(switch_status_t) switch_core_codec_reset(switch_codec_t *codec);
 
+/*!
+  \brief Destroy every idle instance held in the codec pool
+*/
+SWITCH_DECLARE(void) switch_core_codec_pool_flush(void);
+
+/*!
+  \brief Set the number of idle codec instances kept for reuse by codecs initialized with SWITCH_CODEC_FLAG_POOLED
+  \param max the limit (0 disables pooling and flushes the pool)
+*/
+SWITCH_DECLARE(void) switch_core_codec_pool_set_size(uint32_t max);
+
+/*!
+  \brief Write the codec pool occupancy plus per codec init cost and hit rate to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_core_codec_pool_status(switch_stream_handle_t *stream);
+
+/*!
+  \brief Register a function converting one encoding straight into another without going through linear audio
+  \param from_iananame the IANA name of the source encoding
+  \param to_iananame the IANA name of the destination encoding
+  \param rate the sample rate both encodings run at
+  \param func the converter (it must handle any whole number of frames)
+  \return SWITCH_STATUS_SUCCESS if the converter was registered
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_codec_add_transcoder(const char *from_iananame, const char *to_iananame, uint32_t rate,
+																 switch_core_codec_transcode_func_t func);
+
+/*!
+  \brief Remove a converter registered with switch_core_codec_add_transcoder
+*/
+SWITCH_DECLARE(void) switch_core_codec_remove_transcoder(const char *from_iananame, const char *to_iananame, uint32_t rate);
+
+/*!
+  \brief Find a direct converter between two implementations
+  \param from the implementation the data is encoded with
+  \param to the implementation the data is wanted in
+  \return the converter or NULL when the pair has to go through linear audio
+*/
+SWITCH_DECLARE(switch_core_codec_transcode_func_t) switch_core_codec_find_transcoder(const switch_codec_implementation_t *from,
+																					 const switch_codec_implementation_t *to);
+
+/*!
+  \brief Prepare a job for switch_core_codec_offload_submit
+  \param job the job to prepare
+  \param pool the pool its lock and condition come from
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_codec_offload_job_init(switch_codec_offload_job_t *job, switch_memory_pool_t *pool);
+
+/*!
+  \brief Hand an encode or decode to the worker its codec belongs to without waiting for it
+  \param job the job, it and its buffers must stay valid until switch_core_codec_offload_wait returns
+  \return SWITCH_STATUS_SUCCESS once the job is queued or, when the codec is not offloaded or its worker is backed up, done
+  \note several jobs for different codecs can be submitted before waiting on any of them
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_codec_offload_submit(switch_codec_offload_job_t *job);
+
+/*!
+  \brief Wait for a submitted job to finish
+  \param job the job
+  \return the codec's return value
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_codec_offload_wait(switch_codec_offload_job_t *job);
+
+/*!
+  \brief Set which codecs (comma separated IANA names) run on the offload workers, codecs set up afterwards pick it up
+*/
+SWITCH_DECLARE(void) switch_core_codec_offload_set_codecs(const char *codecs);
+
+/*!
+  \brief Start the codec offload workers
+  \param threads the number of workers, each pinned to a core in turn (0 leaves offload off)
+  \param max_queue frames a worker may have waiting before further frames run inline (0 keeps the current value)
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_codec_offload_start(uint32_t threads, uint32_t max_queue);
+
+/*!
+  \brief Write the offload worker queues and the per codec encode and decode cpu time to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_core_codec_offload_status(switch_stream_handle_t *stream);
+
 /*! 
   \brief Encode data using a codec handle
   \param codec the codec handle to use
@@ -1828,6 +1926,71 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(_In_ switch_file_handle_t
 
 SWITCH_DECLARE(switch_status_t) switch_core_file_truncate(switch_file_handle_t *fh, int64_t offset);
 
+/*!
+  \brief Set the total amount of decoded audio kept in the shared cache of decoded files
+  \param bytes the size of the cache (0 to disable it)
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_set_size(switch_size_t bytes);
+
+/*!
+  \brief Set the largest decoded file that will be kept in the shared cache of decoded files
+  \param bytes the size of the largest entry
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_set_max_file_size(switch_size_t bytes);
+
+/*!
+  \brief Switch a handle served from the file cache to frames pre-encoded with a codec, encoding them on first use
+  \param fh the file handle opened for reading
+  \param codec the codec the frames will be written with
+  \return SWITCH_STATUS_SUCCESS if the handle now returns encoded frames (SWITCH_FILE_NATIVE is set)
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_file_cache_encode(switch_file_handle_t *fh, switch_codec_t *codec);
+
+/*!
+  \brief Read the next pre-encoded frame from a handle set up with switch_core_file_cache_encode
+  \param fh the file handle to read from
+  \param data the buffer to read the frame to
+  \param datalen the size of the buffer, set to the size of the frame
+  \param samples set to the number of samples in the frame
+  \return SWITCH_STATUS_SUCCESS if a frame was read, a paused handle returns encoded silence
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_file_cache_read_encoded(switch_file_handle_t *fh, void *data, switch_size_t *datalen, uint32_t *samples);
+
+/*!
+  \brief Switch a handle set up with switch_core_file_cache_encode back to decoded audio at the same position
+  \param fh the file handle
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_decode(switch_file_handle_t *fh);
+
+/*!
+  \brief Drop every entry from the shared cache of decoded files, entries in use are freed when closed
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_flush(void);
+
+/*!
+  \brief Write the usage counters of the shared cache of decoded files to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_status(switch_stream_handle_t *stream);
+
+/*!
+  \brief Set the number of threads writing files opened with SWITCH_FILE_WRITE_ASYNC
+  \param writers the number of writer threads (0 makes those files write synchronously)
+*/
+SWITCH_DECLARE(void) switch_core_file_async_set_writers(uint32_t writers);
+
+/*!
+  \brief Set how much audio a file opened with SWITCH_FILE_WRITE_ASYNC may buffer before writes become synchronous
+  \param bytes the size of the buffer of each file
+*/
+SWITCH_DECLARE(void) switch_core_file_async_set_buffer_size(switch_size_t bytes);
+
+/*!
+  \brief Write the counters of the asynchronous file writers to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_core_file_async_status(switch_stream_handle_t *stream);
+
 
 ///\}
 
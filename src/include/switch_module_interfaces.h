@@ -288,6 +288,8 @@ struct switch_file_interface {
 	switch_status_t (*file_get_string) (switch_file_handle_t *fh, switch_audio_col_t col, const char **string);
 	/*! list of supported file extensions */
 	char **extens;
+	/*! reads only depend on the path and rate, so the core may decode a file once and share the audio */
+	switch_bool_t cacheable;
 	switch_thread_rwlock_t *rwlock;
 	int refs;
 	switch_mutex_t *reflock;
@@ -353,6 +355,12 @@ struct switch_file_handle {
 	const char *prefix;
 	int max_samples;
 	switch_event_t *params;
+	/*! shared pre-decoded audio when the file is served from the core file cache */
+	switch_file_cache_entry_t *cache_entry;
+	/*! pre-encoded frames of the cached audio when it is played without transcoding */
+	switch_file_cache_encoded_t *cache_encoded;
+	/*! buffered writes handed to the core writer threads (SWITCH_FILE_WRITE_ASYNC) */
+	switch_file_async_t *async;
 };
 
 /*! \brief Abstract interface to an asr module */
@@ -623,6 +631,36 @@ struct switch_codec {
 	struct switch_codec *next;
 	switch_core_session_t *session;
 	switch_frame_t *cur_frame;
+	/*! the codec pool slot this handle returns to when destroyed */
+	switch_codec_pool_slot_t *pool_slot;
+	/*! how many times the pooled handle has been reset and handed out again */
+	uint32_t pool_uses;
+	/*! offload worker and cpu accounting state, set up on first use while offload is running */
+	switch_codec_offload_t *offload;
+};
+
+/*! a single encode or decode handed to the codec offload workers */
+struct switch_codec_offload_job {
+	/*! the codec handle to run */
+	switch_codec_t *codec;
+	/*! the codec handle of the last codec used */
+	switch_codec_t *other_codec;
+	/*! SWITCH_TRUE to encode, SWITCH_FALSE to decode */
+	switch_bool_t encode;
+	/*! the data to convert */
+	void *in_data;
+	uint32_t in_data_len;
+	uint32_t in_rate;
+	/*! the buffer for the result, out_data_len holds its size going in and the result length coming out */
+	void *out_data;
+	uint32_t out_data_len;
+	uint32_t out_rate;
+	unsigned int flag;
+	/*! the codec's return value once the job is done */
+	switch_status_t status;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	int done;
 };
 
 /*! \brief A table of settings and callbacks that define a paticular implementation of a codec */
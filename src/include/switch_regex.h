@@ -50,6 +50,23 @@ SWITCH_DECLARE(int) switch_regex_copy_substring(const char *subject, int *ovecto
 SWITCH_DECLARE(void) switch_regex_free(void *data);
 
 SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expression, switch_regex_t **new_re, int *ovector, uint32_t olen);
+
+/*!
+ \brief Compile an expression the way switch_regex_perform would, so it can be run many times with switch_regex_exec
+ \param expression The regular expression, optionally in /expression/flags form
+ \return The compiled expression or NULL on error, free it with switch_regex_free
+*/
+SWITCH_DECLARE(switch_regex_t *) switch_regex_compile_expression(const char *expression);
+
+/*!
+ \brief Run an expression compiled by switch_regex_compile_expression against a string
+ \param re The compiled expression
+ \param field The string to find a match in
+ \param ovector Vector of integers for substring information
+ \param olen Number of elements in ovector
+ \return The match count, 0 if there was no match
+*/
+SWITCH_DECLARE(int) switch_regex_exec(switch_regex_t *re, const char *field, int *ovector, uint32_t olen);
 SWITCH_DECLARE(void) switch_perform_substitution(switch_regex_t *re, int match_count, const char *data, const char *field_data,
 												 char *substituted, switch_size_t len, int *ovector);
 
@@ -67,6 +67,8 @@ SWITCH_BEGIN_EXTERN_C
 	uint32_t to_len;
 	/*! the total size of the to buffer */
 	uint32_t to_size;
+	/*! integer ratio resampler used instead of the speex one */
+	void *fast;
 
 } switch_audio_resampler_t;
 
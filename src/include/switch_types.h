@@ -576,6 +576,14 @@ typedef struct {
 	switch_size_t cng_packet_count;
 	switch_size_t flush_packet_count;
 	switch_size_t largest_jb_size;
+	switch_size_t jb_size;
+	switch_size_t jb_jitter_ms;
+	switch_size_t jb_late_packet_count;
+	switch_size_t jb_missing_packet_count;
+	switch_size_t jb_drop_packet_count;
+	switch_size_t jb_reset_count;
+	switch_size_t nack_packet_count;
+	switch_size_t retransmit_packet_count;
 } switch_rtp_numbers_t;
 
 
@@ -1416,6 +1424,7 @@ SWITCH_CODEC_FLAG_SILENCE =			(1 <<  4) - Silence
 SWITCH_CODEC_FLAG_FREE_POOL =		(1 <<  5) - Free codec's pool on destruction
 SWITCH_CODEC_FLAG_AAL2 =			(1 <<  6) - USE AAL2 Bitpacking
 SWITCH_CODEC_FLAG_PASSTHROUGH =		(1 <<  7) - Passthrough only
+SWITCH_CODEC_FLAG_POOLED =			(1 <<  9) - Reuse an idle instance from the codec pool when possible
 </pre>
 */
 typedef enum {
@@ -1427,7 +1436,8 @@ typedef enum {
 	SWITCH_CODEC_FLAG_FREE_POOL = (1 << 5),
 	SWITCH_CODEC_FLAG_AAL2 = (1 << 6),
 	SWITCH_CODEC_FLAG_PASSTHROUGH = (1 << 7),
-	SWITCH_CODEC_FLAG_READY = (1 << 8)
+	SWITCH_CODEC_FLAG_READY = (1 << 8),
+	SWITCH_CODEC_FLAG_POOLED = (1 << 9)
 } switch_codec_flag_enum_t;
 typedef uint32_t switch_codec_flag_t;
 
@@ -1602,7 +1612,9 @@ typedef enum {
 	SWITCH_FILE_BUFFER_DONE = (1 << 14),
 	SWITCH_FILE_WRITE_APPEND = (1 << 15),
 	SWITCH_FILE_WRITE_OVER = (1 << 16),
-	SWITCH_FILE_NOMUX = (1 << 17)
+	SWITCH_FILE_NOMUX = (1 << 17),
+	SWITCH_FILE_NO_CACHE = (1 << 18),
+	SWITCH_FILE_WRITE_ASYNC = (1 << 19)
 } switch_file_flag_enum_t;
 typedef uint32_t switch_file_flag_t;
 
@@ -1921,6 +1933,9 @@ typedef struct switch_rtcp_frame switch_rtcp_frame_t;
 typedef struct switch_channel switch_channel_t;
 typedef struct switch_sql_queue_manager switch_sql_queue_manager_t;
 typedef struct switch_file_handle switch_file_handle_t;
+typedef struct switch_file_cache_entry switch_file_cache_entry_t;
+typedef struct switch_file_cache_encoded switch_file_cache_encoded_t;
+typedef struct switch_file_async switch_file_async_t;
 typedef struct switch_core_session switch_core_session_t;
 typedef struct switch_caller_profile switch_caller_profile_t;
 typedef struct switch_caller_extension switch_caller_extension_t;
@@ -1928,6 +1943,9 @@ typedef struct switch_caller_application switch_caller_application_t;
 typedef struct switch_state_handler_table switch_state_handler_table_t;
 typedef struct switch_timer switch_timer_t;
 typedef struct switch_codec switch_codec_t;
+typedef struct switch_codec_pool_slot switch_codec_pool_slot_t;
+typedef struct switch_codec_offload switch_codec_offload_t;
+typedef struct switch_codec_offload_job switch_codec_offload_job_t;
 typedef struct switch_core_thread_session switch_core_thread_session_t;
 typedef struct switch_codec_implementation switch_codec_implementation_t;
 typedef struct switch_buffer switch_buffer_t;
@@ -1999,6 +2017,7 @@ typedef switch_status_t (*switch_core_codec_decode_func_t) (switch_codec_t *code
 typedef switch_status_t (*switch_core_codec_init_func_t) (switch_codec_t *, switch_codec_flag_t, const switch_codec_settings_t *codec_settings);
 typedef switch_status_t (*switch_core_codec_fmtp_parse_func_t) (const char *fmtp, switch_codec_fmtp_t *codec_fmtp);
 typedef switch_status_t (*switch_core_codec_destroy_func_t) (switch_codec_t *);
+typedef switch_status_t (*switch_core_codec_transcode_func_t) (const void *in_data, uint32_t in_data_len, void *out_data, uint32_t *out_data_len);
 
 
 typedef switch_status_t (*switch_chat_application_function_t) (switch_event_t *, const char *);
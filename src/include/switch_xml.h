@@ -387,6 +387,25 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user_in_domain(_In_z_ const ch
 SWITCH_DECLARE(switch_status_t) switch_xml_locate_user_merged(const char *key, const char *user_name, const char *domain_name,
 															  const char *ip, switch_xml_t *user, switch_event_t *params);
 SWITCH_DECLARE(uint32_t) switch_xml_clear_user_cache(const char *key, const char *user_name, const char *domain_name);
+
+///\brief choose which sections have their fetch results cached and which request params tell lookups apart
+///\param spec section:param,param;section:param... (a section with no params is keyed on tag, key name and value only)
+///\return SWITCH_STATUS_SUCCESS when the list was replaced
+SWITCH_DECLARE(switch_status_t) switch_xml_fetch_cache_set_keys(const char *spec);
+
+///\brief set how long fetch results are cached
+///\param ttl seconds an answer is kept when it carries no cache-ttl attribute (0 only caches answers that do)
+///\param negative_ttl seconds a "not found" is kept when it carries no cache-ttl attribute
+///\param max_entries the most entries kept (0 keeps the current limit)
+SWITCH_DECLARE(void) switch_xml_fetch_cache_set_ttl(uint32_t ttl, uint32_t negative_ttl, uint32_t max_entries);
+
+///\brief drop cached fetch results
+///\param section the section to drop or NULL for all of them
+///\return the number of entries dropped
+SWITCH_DECLARE(uint32_t) switch_xml_fetch_cache_flush(const char *section);
+
+///\brief write the fetch cache size, hit counts and keyed sections to a stream
+SWITCH_DECLARE(void) switch_xml_fetch_cache_status(switch_stream_handle_t *stream);
 SWITCH_DECLARE(void) switch_xml_merge_user(switch_xml_t user, switch_xml_t domain, switch_xml_t group);
 
 SWITCH_DECLARE(switch_xml_t) switch_xml_dup(switch_xml_t xml);
@@ -408,6 +408,8 @@ typedef enum {
 
 static struct {
 	switch_hash_t *queue_hash;
+	switch_hash_t *agent_hash;
+	switch_hash_t *tier_heap_hash;
 	int debug;
 	char *odbc_dsn;
 	char *dbname;
@@ -737,6 +739,509 @@ static cc_queue_t *get_queue(const char *queue_name)
 	return queue;
 }
 
+/*
+ * In memory agents and tiers.
+ *
+ * The agents and tiers tables are only written to, dispatch reads this copy
+ * instead.  Every tier of a logged in agent sits in a binary heap per queue
+ * ordered the way the queue strategy wants its agents offered, so finding
+ * the next agent for a member is a walk down the top of that heap instead
+ * of a join.  All of it is protected by globals.mutex, which already
+ * serializes the db, so the copy and the tables are updated in the same order.
+ */
+typedef enum {
+	CC_TIER_ORDER_POSITION_LAST_OFFERED = 0,
+	CC_TIER_ORDER_LAST_OFFERED,
+	CC_TIER_ORDER_TALK_TIME,
+	CC_TIER_ORDER_CALLS_ANSWERED,
+	CC_TIER_ORDER_POSITION,
+	CC_TIER_ORDER_RANDOM
+} cc_tier_order_t;
+
+typedef struct cc_agent cc_agent_t;
+typedef struct cc_tier cc_tier_t;
+typedef struct cc_tier_heap cc_tier_heap_t;
+
+struct cc_agent {
+	char *name;
+	char *type;
+	char *contact;
+	char *uuid;
+	cc_agent_status_t status;
+	cc_agent_state_t state;
+	int max_no_answer;
+	int wrap_up_time;
+	int reject_delay_time;
+	int busy_delay_time;
+	int no_answer_delay_time;
+	int no_answer_count;
+	int calls_answered;
+	switch_time_t talk_time;
+	switch_time_t last_bridge_start;
+	switch_time_t last_bridge_end;
+	switch_time_t last_offered_call;
+	switch_time_t last_status_change;
+	switch_time_t ready_time;
+	cc_tier_t *tiers;
+};
+
+struct cc_tier {
+	cc_tier_heap_t *heap;
+	cc_agent_t *agent;
+	cc_tier_state_t state;
+	int level;
+	int position;
+	uint32_t random_key;
+	/* -1 while the agent is logged out */
+	int32_t heap_index;
+	/* next tier of the same agent */
+	cc_tier_t *next;
+};
+
+struct cc_tier_heap {
+	char *queue_name;
+	cc_tier_order_t order;
+	cc_tier_t **tiers;
+	uint32_t count;
+	uint32_t alloc;
+	/* scratch heap of indexes used to visit the tiers in order */
+	uint32_t *walk;
+	uint32_t walk_count;
+	uint32_t walk_alloc;
+	/* tier of the agent offered a call last, for round-robin */
+	cc_tier_t *last_offered;
+};
+
+#define CC_CMP(_a, _b) if ((_a) != (_b)) return (_a) < (_b) ? -1 : 1
+
+static cc_tier_order_t cc_tier_order(const char *strategy)
+{
+	if (zstr(strategy)) {
+		return CC_TIER_ORDER_POSITION_LAST_OFFERED;
+	} else if (!strcasecmp(strategy, "longest-idle-agent")) {
+		return CC_TIER_ORDER_LAST_OFFERED;
+	} else if (!strcasecmp(strategy, "agent-with-least-talk-time")) {
+		return CC_TIER_ORDER_TALK_TIME;
+	} else if (!strcasecmp(strategy, "agent-with-fewest-calls")) {
+		return CC_TIER_ORDER_CALLS_ANSWERED;
+	} else if (!strcasecmp(strategy, "ring-all")) {
+		return CC_TIER_ORDER_POSITION;
+	} else if (!strcasecmp(strategy, "random")) {
+		return CC_TIER_ORDER_RANDOM;
+	}
+
+	/* top-down, round-robin, sequentially-by-agent-order and anything unknown */
+	return CC_TIER_ORDER_POSITION_LAST_OFFERED;
+}
+
+static int cc_tier_cmp(cc_tier_order_t order, cc_tier_t *a, cc_tier_t *b)
+{
+	CC_CMP(a->level, b->level);
+
+	switch (order) {
+	case CC_TIER_ORDER_LAST_OFFERED:
+		CC_CMP(a->agent->last_offered_call, b->agent->last_offered_call);
+		CC_CMP(a->position, b->position);
+		break;
+	case CC_TIER_ORDER_TALK_TIME:
+		CC_CMP(a->agent->talk_time, b->agent->talk_time);
+		CC_CMP(a->position, b->position);
+		break;
+	case CC_TIER_ORDER_CALLS_ANSWERED:
+		CC_CMP(a->agent->calls_answered, b->agent->calls_answered);
+		CC_CMP(a->position, b->position);
+		break;
+	case CC_TIER_ORDER_POSITION:
+		CC_CMP(a->position, b->position);
+		break;
+	case CC_TIER_ORDER_RANDOM:
+		CC_CMP(a->random_key, b->random_key);
+		break;
+	default:
+		CC_CMP(a->position, b->position);
+		CC_CMP(a->agent->last_offered_call, b->agent->last_offered_call);
+		break;
+	}
+
+	return 0;
+}
+
+static void cc_tier_heap_swap(cc_tier_heap_t *heap, uint32_t i, uint32_t j)
+{
+	cc_tier_t *tmp = heap->tiers[i];
+
+	heap->tiers[i] = heap->tiers[j];
+	heap->tiers[j] = tmp;
+	heap->tiers[i]->heap_index = i;
+	heap->tiers[j]->heap_index = j;
+}
+
+static void cc_tier_heap_up(cc_tier_heap_t *heap, uint32_t i)
+{
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (cc_tier_cmp(heap->order, heap->tiers[i], heap->tiers[parent]) >= 0) {
+			break;
+		}
+		cc_tier_heap_swap(heap, i, parent);
+		i = parent;
+	}
+}
+
+static void cc_tier_heap_down(cc_tier_heap_t *heap, uint32_t i)
+{
+	for (;;) {
+		uint32_t l = 2 * i + 1, r = l + 1, min = i;
+
+		if (l < heap->count && cc_tier_cmp(heap->order, heap->tiers[l], heap->tiers[min]) < 0) {
+			min = l;
+		}
+		if (r < heap->count && cc_tier_cmp(heap->order, heap->tiers[r], heap->tiers[min]) < 0) {
+			min = r;
+		}
+		if (min == i) {
+			break;
+		}
+		cc_tier_heap_swap(heap, i, min);
+		i = min;
+	}
+}
+
+static void cc_tier_heap_insert(cc_tier_t *tier)
+{
+	cc_tier_heap_t *heap = tier->heap;
+
+	if (heap->count == heap->alloc) {
+		heap->alloc = heap->alloc ? heap->alloc * 2 : 16;
+		heap->tiers = realloc(heap->tiers, heap->alloc * sizeof(*heap->tiers));
+		switch_assert(heap->tiers);
+	}
+
+	heap->tiers[heap->count] = tier;
+	tier->heap_index = heap->count++;
+	cc_tier_heap_up(heap, tier->heap_index);
+}
+
+static void cc_tier_heap_remove(cc_tier_t *tier)
+{
+	cc_tier_heap_t *heap = tier->heap;
+	uint32_t i = tier->heap_index, last = --heap->count;
+
+	if (i != last) {
+		cc_tier_t *moved = heap->tiers[last];
+
+		heap->tiers[i] = moved;
+		moved->heap_index = i;
+		cc_tier_heap_up(heap, i);
+		cc_tier_heap_down(heap, moved->heap_index);
+	}
+
+	tier->heap_index = -1;
+}
+
+static void cc_tier_heap_set_order(cc_tier_heap_t *heap, cc_tier_order_t order)
+{
+	uint32_t i;
+
+	if (heap->order == order) {
+		return;
+	}
+
+	heap->order = order;
+	for (i = heap->count / 2; i > 0; i--) {
+		cc_tier_heap_down(heap, i - 1);
+	}
+}
+
+static cc_tier_heap_t *cc_tier_heap_get(const char *queue_name, switch_bool_t create)
+{
+	cc_tier_heap_t *heap;
+
+	if (!(heap = switch_core_hash_find(globals.tier_heap_hash, queue_name)) && create) {
+		switch_zmalloc(heap, sizeof(*heap));
+		heap->queue_name = strdup(queue_name);
+		switch_core_hash_insert(globals.tier_heap_hash, heap->queue_name, heap);
+	}
+
+	return heap;
+}
+
+static void cc_tier_heap_walk_push(cc_tier_heap_t *heap, uint32_t index)
+{
+	uint32_t i = heap->walk_count++;
+
+	heap->walk[i] = index;
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2, tmp;
+
+		if (cc_tier_cmp(heap->order, heap->tiers[heap->walk[i]], heap->tiers[heap->walk[parent]]) >= 0) {
+			break;
+		}
+		tmp = heap->walk[i];
+		heap->walk[i] = heap->walk[parent];
+		heap->walk[parent] = tmp;
+		i = parent;
+	}
+}
+
+/*!
+ * \brief Start visiting the tiers of a queue from the best one
+ * The heap itself is left alone, the next tier is always the smallest
+ * child not visited yet so stopping early costs nothing.
+ */
+static void cc_tier_heap_walk_start(cc_tier_heap_t *heap)
+{
+	if (heap->walk_alloc < heap->count) {
+		heap->walk_alloc = heap->alloc;
+		heap->walk = realloc(heap->walk, heap->walk_alloc * sizeof(*heap->walk));
+		switch_assert(heap->walk);
+	}
+
+	heap->walk_count = 0;
+	if (heap->count) {
+		cc_tier_heap_walk_push(heap, 0);
+	}
+}
+
+static cc_tier_t *cc_tier_heap_walk_next(cc_tier_heap_t *heap)
+{
+	uint32_t index, l, i = 0;
+
+	if (!heap->walk_count) {
+		return NULL;
+	}
+
+	index = heap->walk[0];
+	heap->walk[0] = heap->walk[--heap->walk_count];
+
+	for (;;) {
+		uint32_t cl = 2 * i + 1, cr = cl + 1, min = i, tmp;
+
+		if (cl < heap->walk_count && cc_tier_cmp(heap->order, heap->tiers[heap->walk[cl]], heap->tiers[heap->walk[min]]) < 0) {
+			min = cl;
+		}
+		if (cr < heap->walk_count && cc_tier_cmp(heap->order, heap->tiers[heap->walk[cr]], heap->tiers[heap->walk[min]]) < 0) {
+			min = cr;
+		}
+		if (min == i) {
+			break;
+		}
+		tmp = heap->walk[i];
+		heap->walk[i] = heap->walk[min];
+		heap->walk[min] = tmp;
+		i = min;
+	}
+
+	if ((l = 2 * index + 1) < heap->count) {
+		cc_tier_heap_walk_push(heap, l);
+	}
+	if (l + 1 < heap->count) {
+		cc_tier_heap_walk_push(heap, l + 1);
+	}
+
+	return heap->tiers[index];
+}
+
+static switch_bool_t cc_agent_logged_in(cc_agent_t *agent)
+{
+	return (agent->status == CC_AGENT_STATUS_AVAILABLE || agent->status == CC_AGENT_STATUS_ON_BREAK ||
+			agent->status == CC_AGENT_STATUS_AVAILABLE_ON_DEMAND) ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/*!
+ * \brief Put the tiers of an agent back in place after its status or one of the sort keys changed
+ */
+static void cc_agent_resort(cc_agent_t *agent)
+{
+	cc_tier_t *tier;
+	switch_bool_t logged_in = cc_agent_logged_in(agent);
+
+	for (tier = agent->tiers; tier; tier = tier->next) {
+		if (!logged_in) {
+			if (tier->heap_index >= 0) {
+				cc_tier_heap_remove(tier);
+			}
+		} else if (tier->heap_index < 0) {
+			cc_tier_heap_insert(tier);
+		} else {
+			cc_tier_heap_up(tier->heap, tier->heap_index);
+			cc_tier_heap_down(tier->heap, tier->heap_index);
+		}
+	}
+}
+
+static void cc_set_string(char **dst, const char *src)
+{
+	switch_safe_free(*dst);
+	*dst = src ? strdup(src) : NULL;
+}
+
+static cc_agent_t *cc_agent_find(const char *name)
+{
+	return switch_core_hash_find(globals.agent_hash, name);
+}
+
+static cc_agent_t *cc_agent_cache_add(const char *name, const char *type)
+{
+	cc_agent_t *agent;
+
+	switch_zmalloc(agent, sizeof(*agent));
+	agent->name = strdup(name);
+	agent->type = strdup(type);
+	agent->status = CC_AGENT_STATUS_LOGGED_OUT;
+	agent->state = CC_AGENT_STATE_WAITING;
+	switch_core_hash_insert(globals.agent_hash, agent->name, agent);
+
+	return agent;
+}
+
+static cc_tier_t *cc_tier_find(cc_agent_t *agent, const char *queue_name)
+{
+	cc_tier_t *tier;
+
+	for (tier = agent->tiers; tier; tier = tier->next) {
+		if (!strcmp(tier->heap->queue_name, queue_name)) {
+			break;
+		}
+	}
+
+	return tier;
+}
+
+static cc_tier_t *cc_tier_cache_add(cc_agent_t *agent, const char *queue_name, cc_tier_state_t state, int level, int position)
+{
+	cc_tier_t *tier;
+
+	switch_zmalloc(tier, sizeof(*tier));
+	tier->heap = cc_tier_heap_get(queue_name, SWITCH_TRUE);
+	tier->agent = agent;
+	tier->state = state;
+	tier->level = level;
+	tier->position = position;
+	tier->random_key = rand();
+	tier->heap_index = -1;
+	tier->next = agent->tiers;
+	agent->tiers = tier;
+
+	if (cc_agent_logged_in(agent)) {
+		cc_tier_heap_insert(tier);
+	}
+
+	return tier;
+}
+
+static void cc_tier_cache_del(cc_tier_t *tier)
+{
+	cc_tier_t **tp;
+
+	for (tp = &tier->agent->tiers; *tp; tp = &(*tp)->next) {
+		if (*tp == tier) {
+			*tp = tier->next;
+			break;
+		}
+	}
+
+	if (tier->heap_index >= 0) {
+		cc_tier_heap_remove(tier);
+	}
+	if (tier->heap->last_offered == tier) {
+		tier->heap->last_offered = NULL;
+	}
+
+	free(tier);
+}
+
+static void cc_agent_cache_del(cc_agent_t *agent)
+{
+	while (agent->tiers) {
+		cc_tier_cache_del(agent->tiers);
+	}
+
+	switch_core_hash_delete(globals.agent_hash, agent->name);
+
+	switch_safe_free(agent->name);
+	switch_safe_free(agent->type);
+	switch_safe_free(agent->contact);
+	switch_safe_free(agent->uuid);
+	free(agent);
+}
+
+#define cc_atol(_s) (zstr(_s) ? 0 : atol(_s))
+
+static int cc_agent_cache_load_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	cc_agent_t *agent;
+
+	if (zstr(argv[0]) || cc_agent_find(argv[0])) {
+		return 0;
+	}
+
+	agent = cc_agent_cache_add(argv[0], switch_str_nil(argv[1]));
+	cc_set_string(&agent->contact, argv[2]);
+	cc_set_string(&agent->uuid, argv[3]);
+	agent->status = cc_agent_str2status(switch_str_nil(argv[4]));
+	agent->state = cc_agent_str2state(switch_str_nil(argv[5]));
+	agent->max_no_answer = cc_atol(argv[6]);
+	agent->wrap_up_time = cc_atol(argv[7]);
+	agent->reject_delay_time = cc_atol(argv[8]);
+	agent->busy_delay_time = cc_atol(argv[9]);
+	agent->no_answer_delay_time = cc_atol(argv[10]);
+	agent->no_answer_count = cc_atol(argv[11]);
+	agent->calls_answered = cc_atol(argv[12]);
+	agent->talk_time = cc_atol(argv[13]);
+	agent->last_bridge_start = cc_atol(argv[14]);
+	agent->last_bridge_end = cc_atol(argv[15]);
+	agent->last_offered_call = cc_atol(argv[16]);
+	agent->last_status_change = cc_atol(argv[17]);
+	agent->ready_time = cc_atol(argv[18]);
+
+	return 0;
+}
+
+static int cc_tier_cache_load_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	cc_agent_t *agent;
+	cc_tier_t *tier;
+
+	if (zstr(argv[0]) || zstr(argv[1]) || !(agent = cc_agent_find(argv[1])) || cc_tier_find(agent, argv[0])) {
+		return 0;
+	}
+
+	tier = cc_tier_cache_add(agent, argv[0], cc_tier_str2state(switch_str_nil(argv[2])), cc_atol(argv[3]), cc_atol(argv[4]));
+
+	if (agent->last_offered_call > 0 && (!tier->heap->last_offered || tier->heap->last_offered->agent->last_offered_call < agent->last_offered_call)) {
+		tier->heap->last_offered = tier;
+	}
+
+	return 0;
+}
+
+static void cc_cache_destroy(void)
+{
+	switch_hash_index_t *hi;
+	void *val = NULL;
+	const void *key;
+	switch_ssize_t keylen;
+
+	while ((hi = switch_hash_first(NULL, globals.agent_hash))) {
+		switch_hash_this(hi, &key, &keylen, &val);
+		cc_agent_cache_del((cc_agent_t *) val);
+	}
+
+	while ((hi = switch_hash_first(NULL, globals.tier_heap_hash))) {
+		cc_tier_heap_t *heap;
+
+		switch_hash_this(hi, &key, &keylen, &val);
+		heap = (cc_tier_heap_t *) val;
+		switch_core_hash_delete(globals.tier_heap_hash, heap->queue_name);
+		switch_safe_free(heap->tiers);
+		switch_safe_free(heap->walk);
+		switch_safe_free(heap->queue_name);
+		free(heap);
+	}
+}
+
 struct call_helper {
 	const char *member_uuid;
 	const char *member_session_uuid;
@@ -757,7 +1262,10 @@ struct call_helper {
 	int reject_delay_time;
 	int busy_delay_time;
 	int no_answer_delay_time;
+	int tier_level;
+	int tier_position;
 
+	struct call_helper *next;
 	switch_memory_pool_t *pool;
 };
 
@@ -799,14 +1307,10 @@ cc_status_t cc_agent_add(const char *agent, const char *type)
 	cc_status_t result = CC_STATUS_SUCCESS;
 	char *sql;
 
+	switch_mutex_lock(globals.mutex);
 	if (!strcasecmp(type, CC_AGENT_TYPE_CALLBACK) || !strcasecmp(type, CC_AGENT_TYPE_UUID_STANDBY)) {
-		char res[256] = "";
 		/* Check to see if agent already exist */
-		sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-
-		if (atoi(res) != 0) {
+		if (cc_agent_find(agent)) {
 			result = CC_STATUS_AGENT_ALREADY_EXIST;
 			goto done;
 		}
@@ -817,17 +1321,21 @@ cc_status_t cc_agent_add(const char *agent, const char *type)
 				agent, type, cc_agent_status2str(CC_AGENT_STATUS_LOGGED_OUT), cc_agent_state2str(CC_AGENT_STATE_WAITING));
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+
+		cc_agent_cache_add(agent, type);
 	} else {
 		result = CC_STATUS_AGENT_INVALID_TYPE;
 		goto done;
 	}
 done:		
+	switch_mutex_unlock(globals.mutex);
 	return result;
 }
 
 cc_status_t cc_agent_del(const char *agent)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
+	cc_agent_t *cached;
 
 	char *sql;
 
@@ -835,7 +1343,14 @@ cc_status_t cc_agent_del(const char *agent)
 	sql = switch_mprintf("DELETE FROM agents WHERE name = '%q';"
 			"DELETE FROM tiers WHERE agent = '%q';",
 			agent, agent);
+
+	switch_mutex_lock(globals.mutex);
 	cc_execute_sql(NULL, sql, NULL);
+	if ((cached = cc_agent_find(agent))) {
+		cc_agent_cache_del(cached);
+	}
+	switch_mutex_unlock(globals.mutex);
+
 	switch_safe_free(sql);
 	return result;
 }
@@ -843,45 +1358,42 @@ cc_status_t cc_agent_del(const char *agent)
 cc_status_t cc_agent_get(const char *key, const char *agent, char *ret_result, size_t ret_result_size)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
-	char *sql;
+	cc_agent_t *cached;
 	switch_event_t *event;
-	char res[256];
+	char res[256] = "";
 
+	switch_mutex_lock(globals.mutex);
 	/* Check to see if agent already exists */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
-
-	if (atoi(res) == 0) {
+	if (!(cached = cc_agent_find(agent))) {
 		result = CC_STATUS_AGENT_NOT_FOUND;
+	} else if (!strcasecmp(key, "status")) {
+		switch_snprintf(res, sizeof(res), "%s", cc_agent_status2str(cached->status));
+	} else if (!strcasecmp(key, "state")) {
+		switch_snprintf(res, sizeof(res), "%s", cc_agent_state2str(cached->state));
+	} else if (!strcasecmp(key, "uuid")) {
+		switch_snprintf(res, sizeof(res), "%s", switch_str_nil(cached->uuid));
+	} else {
+		result = CC_STATUS_INVALID_KEY;
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	if (result != CC_STATUS_SUCCESS) {
 		goto done;
 	}
 
-	if (!strcasecmp(key, "status") || !strcasecmp(key, "state") || !strcasecmp(key, "uuid") ) { 
-		/* Check to see if agent already exists */
-		sql = switch_mprintf("SELECT %q FROM agents WHERE name = '%q'", key, agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-		switch_snprintf(ret_result, ret_result_size, "%s", res);
-		result = CC_STATUS_SUCCESS;
+	switch_snprintf(ret_result, ret_result_size, "%s", res);
 
-		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
-			char tmpname[256];
-			if (!strcasecmp(key, "uuid")) {
-				switch_snprintf(tmpname, sizeof(tmpname), "CC-Agent-UUID");	
-			} else {
-				switch_snprintf(tmpname, sizeof(tmpname), "CC-Agent-%c%s", (char) switch_toupper(key[0]), key+1);
-			}
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-%s-get", key);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, tmpname, res);
-			switch_event_fire(&event);
+	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
+		char tmpname[256];
+		if (!strcasecmp(key, "uuid")) {
+			switch_snprintf(tmpname, sizeof(tmpname), "CC-Agent-UUID");	
+		} else {
+			switch_snprintf(tmpname, sizeof(tmpname), "CC-Agent-%c%s", (char) switch_toupper(key[0]), key+1);
 		}
-
-	} else {
-		result = CC_STATUS_INVALID_KEY;
-		goto done;
-
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "CC-Agent", agent);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "CC-Action", "agent-%s-get", key);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, tmpname, res);
+		switch_event_fire(&event);
 	}
 
 done:   
@@ -896,43 +1408,50 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
 	char *sql;
-	char res[256];
+	char res[256] = "";
 	switch_event_t *event;
+	cc_agent_t *cached;
 
-	/* Check to see if agent already exist */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
+	switch_mutex_lock(globals.mutex);
 
-	if (atoi(res) == 0) {
+	/* Check to see if agent already exist */
+	if (!(cached = cc_agent_find(agent))) {
 		result = CC_STATUS_AGENT_NOT_FOUND;
 		goto done;
 	}
 
 	if (!strcasecmp(key, "status")) {
-		if (cc_agent_str2status(value) != CC_AGENT_STATUS_UNKNOWN) {
+		cc_agent_status_t status = cc_agent_str2status(value);
+
+		if (status != CC_AGENT_STATUS_UNKNOWN) {
 			/* Reset values on available only */
-			if (cc_agent_str2status(value) == CC_AGENT_STATUS_AVAILABLE) {
+			if (status == CC_AGENT_STATUS_AVAILABLE) {
 				sql = switch_mprintf("UPDATE agents SET status = '%q', last_status_change = '%" SWITCH_TIME_T_FMT "', talk_time = 0, calls_answered = 0, no_answer_count = 0"
 						" WHERE name = '%q' AND NOT status = '%q'",
 						value, local_epoch_time_now(NULL),
 						agent, value);
+				if (cached->status != status) {
+					cached->last_status_change = local_epoch_time_now(NULL);
+					cached->talk_time = 0;
+					cached->calls_answered = 0;
+					cached->no_answer_count = 0;
+				}
 			} else {
 				sql = switch_mprintf("UPDATE agents SET status = '%q', last_status_change = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q'",
 						value, local_epoch_time_now(NULL), agent);
+				cached->last_status_change = local_epoch_time_now(NULL);
 			}
 			cc_execute_sql(NULL, sql, NULL);
 			switch_safe_free(sql);
 
+			cached->status = status;
+			cc_agent_resort(cached);
 
 			/* Used to stop any active callback */
-			if (cc_agent_str2status(value) != CC_AGENT_STATUS_AVAILABLE) {
+			if (status != CC_AGENT_STATUS_AVAILABLE) {
 				sql = switch_mprintf("SELECT uuid FROM members WHERE serving_agent = '%q' AND serving_system = 'single_box' AND NOT state = 'Answered'", agent);
 				cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
 				switch_safe_free(sql);
-				if (!switch_strlen_zero(res)) {
-					switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", res, SWITCH_CAUSE_ORIGINATOR_CANCEL);
-				}
 			}
 
 
@@ -950,16 +1469,29 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 			goto done;
 		}
 	} else if (!strcasecmp(key, "state")) {
-		if (cc_agent_str2state(value) != CC_AGENT_STATE_UNKNOWN) {
-			if (cc_agent_str2state(value) != CC_AGENT_STATE_RECEIVING) {
+		cc_agent_state_t state = cc_agent_str2state(value);
+
+		if (state != CC_AGENT_STATE_UNKNOWN) {
+			if (state != CC_AGENT_STATE_RECEIVING) {
 				sql = switch_mprintf("UPDATE agents SET state = '%q' WHERE name = '%q'", value, agent);
 			} else {
+				cc_tier_t *tier;
+
 				sql = switch_mprintf("UPDATE agents SET state = '%q', last_offered_call = '%" SWITCH_TIME_T_FMT "' WHERE name = '%q'",
 						value, local_epoch_time_now(NULL), agent);
+
+				cached->last_offered_call = local_epoch_time_now(NULL);
+				for (tier = cached->tiers; tier; tier = tier->next) {
+					tier->random_key = rand();
+					tier->heap->last_offered = tier;
+				}
 			}
 			cc_execute_sql(NULL, sql, NULL);
 			switch_safe_free(sql);
 
+			cached->state = state;
+			cc_agent_resort(cached);
+
 			result = CC_STATUS_SUCCESS;
 
 			if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, CALLCENTER_EVENT) == SWITCH_STATUS_SUCCESS) {
@@ -977,36 +1509,42 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 		sql = switch_mprintf("UPDATE agents SET uuid = '%q', system = 'single_box' WHERE name = '%q'", value, agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cc_set_string(&cached->uuid, value);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "contact")) {
 		sql = switch_mprintf("UPDATE agents SET contact = '%q', system = 'single_box' WHERE name = '%q'", value, agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cc_set_string(&cached->contact, value);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "ready_time")) {
 		sql = switch_mprintf("UPDATE agents SET ready_time = '%ld', system = 'single_box' WHERE name = '%q'", atol(value), agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cached->ready_time = atol(value);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "busy_delay_time")) {
 		sql = switch_mprintf("UPDATE agents SET busy_delay_time = '%ld', system = 'single_box' WHERE name = '%q'", atol(value), agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cached->busy_delay_time = atol(value);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "reject_delay_time")) {
 		sql = switch_mprintf("UPDATE agents SET reject_delay_time = '%ld', system = 'single_box' WHERE name = '%q'", atol(value), agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cached->reject_delay_time = atol(value);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "no_answer_delay_time")) {
 		sql = switch_mprintf("UPDATE agents SET no_answer_delay_time = '%ld', system = 'single_box' WHERE name = '%q'", atol(value), agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cached->no_answer_delay_time = atol(value);
 
 		result = CC_STATUS_SUCCESS;
 	} else if (!strcasecmp(key, "type")) {
@@ -1018,6 +1556,7 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 		sql = switch_mprintf("UPDATE agents SET type = '%q' WHERE name = '%q'", value, agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cc_set_string(&cached->type, value);
 
 		result = CC_STATUS_SUCCESS;
 
@@ -1025,6 +1564,7 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 		sql = switch_mprintf("UPDATE agents SET max_no_answer = '%d', system = 'single_box' WHERE name = '%q'", atoi(value), agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cached->max_no_answer = atoi(value);
 
 		result = CC_STATUS_SUCCESS;
 
@@ -1032,6 +1572,7 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 		sql = switch_mprintf("UPDATE agents SET wrap_up_time = '%d', system = 'single_box' WHERE name = '%q'", atoi(value), agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		cached->wrap_up_time = atoi(value);
 
 		result = CC_STATUS_SUCCESS;
 
@@ -1042,18 +1583,163 @@ cc_status_t cc_agent_update(const char *key, const char *value, const char *agen
 	}
 
 done:
+	switch_mutex_unlock(globals.mutex);
+
 	if (result == CC_STATUS_SUCCESS) {
+		if (!switch_strlen_zero(res)) {
+			switch_core_session_hupall_matching_var("cc_member_pre_answer_uuid", res, SWITCH_CAUSE_ORIGINATOR_CANCEL);
+		}
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Updated Agent %s set %s = %s\n", agent, key, value);
 	}
 
 	return result;
 }
 
+/*!
+ * \brief Persist and cache the counters touched when an agent answers
+ */
+static void cc_agent_bridge_start(struct call_helper *h, const char *agent_uuid)
+{
+	char *sql;
+	cc_agent_t *cached;
+	switch_time_t now = local_epoch_time_now(NULL);
+
+	sql = switch_mprintf("UPDATE agents SET uuid = '%q', last_bridge_start = '%" SWITCH_TIME_T_FMT "', calls_answered = calls_answered + 1, no_answer_count = 0"
+			" WHERE name = '%q' AND system = '%q'",
+			agent_uuid, now,
+			h->agent_name, h->agent_system);
+
+	switch_mutex_lock(globals.mutex);
+	cc_execute_sql(NULL, sql, NULL);
+	if ((cached = cc_agent_find(h->agent_name))) {
+		cc_set_string(&cached->uuid, agent_uuid);
+		cached->last_bridge_start = now;
+		cached->calls_answered++;
+		cached->no_answer_count = 0;
+		cc_agent_resort(cached);
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	switch_safe_free(sql);
+}
+
+static void cc_agent_bridge_end(struct call_helper *h)
+{
+	char *sql;
+	cc_agent_t *cached;
+	switch_time_t now = local_epoch_time_now(NULL);
+	/* Do not remove uuid of the agent if we are a standby agent */
+	switch_bool_t clear_uuid = strcasecmp(h->agent_type, CC_AGENT_TYPE_UUID_STANDBY) ? SWITCH_TRUE : SWITCH_FALSE;
+
+	sql = switch_mprintf("UPDATE agents SET %s last_bridge_end = %" SWITCH_TIME_T_FMT ", talk_time = talk_time + (%" SWITCH_TIME_T_FMT "-last_bridge_start) WHERE name = '%q' AND system = '%q';"
+			, (clear_uuid ? "uuid = '',":""), now, now, h->agent_name, h->agent_system);
+
+	switch_mutex_lock(globals.mutex);
+	cc_execute_sql(NULL, sql, NULL);
+	if ((cached = cc_agent_find(h->agent_name))) {
+		if (clear_uuid) {
+			cc_set_string(&cached->uuid, "");
+		}
+		cached->last_bridge_end = now;
+		cached->talk_time += now - cached->last_bridge_start;
+		cc_agent_resort(cached);
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	switch_safe_free(sql);
+}
+
+static void cc_agent_no_answer(struct call_helper *h)
+{
+	char *sql;
+	cc_agent_t *cached;
+
+	sql = switch_mprintf("UPDATE agents SET no_answer_count = no_answer_count + 1 WHERE name = '%q' AND system = '%q';",
+			h->agent_name, h->agent_system);
+
+	switch_mutex_lock(globals.mutex);
+	cc_execute_sql(NULL, sql, NULL);
+	if ((cached = cc_agent_find(h->agent_name))) {
+		cached->no_answer_count++;
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	switch_safe_free(sql);
+}
+
+/*!
+ * \brief Mark the agent as offered in one queue and standby in every other queue it is ready in
+ */
+static void cc_agent_tiers_offering(struct call_helper *h)
+{
+	char *sql;
+	cc_agent_t *cached;
+
+	sql = switch_mprintf(
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q';"
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q';",
+			cc_tier_state2str(CC_TIER_STATE_OFFERING), h->agent_name, h->queue_name,
+			cc_tier_state2str(CC_TIER_STATE_STANDBY), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_READY));
+
+	switch_mutex_lock(globals.mutex);
+	cc_execute_sql(NULL, sql, NULL);
+	if ((cached = cc_agent_find(h->agent_name))) {
+		cc_tier_t *tier;
+
+		for (tier = cached->tiers; tier; tier = tier->next) {
+			if (!strcmp(tier->heap->queue_name, h->queue_name)) {
+				tier->state = CC_TIER_STATE_OFFERING;
+			} else if (tier->state == CC_TIER_STATE_READY) {
+				tier->state = CC_TIER_STATE_STANDBY;
+			}
+		}
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	switch_safe_free(sql);
+}
+
+/*!
+ * \brief Make the agent available again in every queue once the offer is over
+ */
+static void cc_agent_tiers_release(struct call_helper *h, cc_tier_state_t tiers_state)
+{
+	char *sql;
+	cc_agent_t *cached;
+
+	sql = switch_mprintf(
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q' AND (state = '%q' OR state = '%q' OR state = '%q');"
+			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q'"
+			, cc_tier_state2str(tiers_state), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), cc_tier_state2str(CC_TIER_STATE_STANDBY), cc_tier_state2str(CC_TIER_STATE_OFFERING),
+			cc_tier_state2str(CC_TIER_STATE_READY), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_STANDBY));
+
+	switch_mutex_lock(globals.mutex);
+	cc_execute_sql(NULL, sql, NULL);
+	if ((cached = cc_agent_find(h->agent_name))) {
+		cc_tier_t *tier;
+
+		for (tier = cached->tiers; tier; tier = tier->next) {
+			if (!strcmp(tier->heap->queue_name, h->queue_name)) {
+				if (tier->state == CC_TIER_STATE_ACTIVE_INBOUND || tier->state == CC_TIER_STATE_STANDBY || tier->state == CC_TIER_STATE_OFFERING) {
+					tier->state = tiers_state;
+				}
+			} else if (tier->state == CC_TIER_STATE_STANDBY) {
+				tier->state = CC_TIER_STATE_READY;
+			}
+		}
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	switch_safe_free(sql);
+}
+
 cc_status_t cc_tier_add(const char *queue_name, const char *agent, const char *state, int level, int position)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
 	char *sql;
 	cc_queue_t *queue = NULL;
+	cc_agent_t *cached = NULL;
+
 	if (!(queue = get_queue(queue_name))) {
 		result = CC_STATUS_QUEUE_NOT_FOUND;
 		goto done;
@@ -1061,26 +1747,18 @@ cc_status_t cc_tier_add(const char *queue_name, const char *agent, const char *s
 		queue_rwunlock(queue);
 	}
 
+	switch_mutex_lock(globals.mutex);
 	if (cc_tier_str2state(state) != CC_TIER_STATE_UNKNOWN) {
-		char res[256] = "";
 		/* Check to see if agent already exist */
-		sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-
-		if (atoi(res) == 0) {
+		if (!(cached = cc_agent_find(agent))) {
 			result = CC_STATUS_AGENT_NOT_FOUND;
-			goto done;
+			goto unlock;
 		}
 
 		/* Check to see if tier already exist */
-		sql = switch_mprintf("SELECT count(*) FROM tiers WHERE agent = '%q' AND queue = '%q'", agent, queue_name);
-		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-		switch_safe_free(sql);
-
-		if (atoi(res) != 0) {
+		if (cc_tier_find(cached, queue_name)) {
 			result = CC_STATUS_TIER_ALREADY_EXIST;
-			goto done;
+			goto unlock;
 		}
 
 		/* Add Agent in tier */
@@ -1090,13 +1768,17 @@ cc_status_t cc_tier_add(const char *queue_name, const char *agent, const char *s
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
 
+		cc_tier_cache_add(cached, queue_name, cc_tier_str2state(state), level, position);
+
 		result = CC_STATUS_SUCCESS;
 	} else {
 		result = CC_STATUS_TIER_INVALID_STATE;
-		goto done;
+		goto unlock;
 
 	}
 
+unlock:
+	switch_mutex_unlock(globals.mutex);
 done:		
 	return result;
 }
@@ -1105,29 +1787,18 @@ cc_status_t cc_tier_update(const char *key, const char *value, const char *queue
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
 	char *sql;
-	char res[256];
 	cc_queue_t *queue = NULL;
+	cc_agent_t *cached = NULL;
+	cc_tier_t *tier = NULL;
 
-	/* Check to see if tier already exist */
-	sql = switch_mprintf("SELECT count(*) FROM tiers WHERE agent = '%q' AND queue = '%q'", agent, queue_name);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
+	switch_mutex_lock(globals.mutex);
 
-	if (atoi(res) == 0) {
+	/* Check to see if tier already exist */
+	if (!(cached = cc_agent_find(agent)) || !(tier = cc_tier_find(cached, queue_name))) {
 		result = CC_STATUS_TIER_NOT_FOUND;
 		goto done;
 	}
 
-	/* Check to see if agent already exist */
-	sql = switch_mprintf("SELECT count(*) FROM agents WHERE name = '%q'", agent);
-	cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
-	switch_safe_free(sql);
-
-	if (atoi(res) == 0) {
-		result = CC_STATUS_AGENT_NOT_FOUND;
-		goto done;
-	}
-
 	if (!(queue = get_queue(queue_name))) {
 		result = CC_STATUS_QUEUE_NOT_FOUND;
 		goto done;
@@ -1140,6 +1811,7 @@ cc_status_t cc_tier_update(const char *key, const char *value, const char *queue
 			sql = switch_mprintf("UPDATE tiers SET state = '%q' WHERE queue = '%q' AND agent = '%q'", value, queue_name, agent);
 			cc_execute_sql(NULL, sql, NULL);
 			switch_safe_free(sql);
+			tier->state = cc_tier_str2state(value);
 			result = CC_STATUS_SUCCESS;
 		} else {
 			result = CC_STATUS_TIER_INVALID_STATE;
@@ -1149,6 +1821,8 @@ cc_status_t cc_tier_update(const char *key, const char *value, const char *queue
 		sql = switch_mprintf("UPDATE tiers SET level = '%d' WHERE queue = '%q' AND agent = '%q'", atoi(value), queue_name, agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		tier->level = atoi(value);
+		cc_agent_resort(cached);
 
 		result = CC_STATUS_SUCCESS;
 
@@ -1156,6 +1830,8 @@ cc_status_t cc_tier_update(const char *key, const char *value, const char *queue
 		sql = switch_mprintf("UPDATE tiers SET position = '%d' WHERE queue = '%q' AND agent = '%q'", atoi(value), queue_name, agent);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
+		tier->position = atoi(value);
+		cc_agent_resort(cached);
 
 		result = CC_STATUS_SUCCESS;
 	} else {
@@ -1163,6 +1839,8 @@ cc_status_t cc_tier_update(const char *key, const char *value, const char *queue
 		goto done;
 	}	
 done:
+	switch_mutex_unlock(globals.mutex);
+
 	if (result == CC_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Updated tier: Agent %s in Queue %s set %s = %s\n", agent, queue_name, key, value);
 	}
@@ -1173,10 +1851,19 @@ cc_status_t cc_tier_del(const char *queue_name, const char *agent)
 {
 	cc_status_t result = CC_STATUS_SUCCESS;
 	char *sql;
+	cc_agent_t *cached;
+	cc_tier_t *tier;
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleted tier Agent %s in Queue %s\n", agent, queue_name);
 	sql = switch_mprintf("DELETE FROM tiers WHERE queue = '%q' AND agent = '%q';", queue_name, agent);
+
+	switch_mutex_lock(globals.mutex);
 	cc_execute_sql(NULL, sql, NULL);
+	if ((cached = cc_agent_find(agent)) && (tier = cc_tier_find(cached, queue_name))) {
+		cc_tier_cache_del(tier);
+	}
+	switch_mutex_unlock(globals.mutex);
+
 	switch_safe_free(sql);
 
 	result = CC_STATUS_SUCCESS;
@@ -1304,6 +1991,16 @@ static switch_status_t load_config(void)
 	cc_execute_sql(NULL, sql, NULL);
 	switch_safe_free(sql);
 
+	/* Loading agents and tiers into memory, the tables are only written to from now on */
+	sql = switch_mprintf("SELECT name, type, contact, uuid, status, state, max_no_answer, wrap_up_time, reject_delay_time, busy_delay_time, no_answer_delay_time,"
+						 " no_answer_count, calls_answered, talk_time, last_bridge_start, last_bridge_end, last_offered_call, last_status_change, ready_time FROM agents");
+	cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, cc_agent_cache_load_callback, NULL /* Call back variables */);
+	switch_safe_free(sql);
+
+	sql = switch_mprintf("SELECT queue, agent, state, level, position FROM tiers");
+	cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, cc_tier_cache_load_callback, NULL /* Call back variables */);
+	switch_safe_free(sql);
+
 	/* Loading queue into memory struct */
 	if ((x_queues = switch_xml_child(cfg, "queues"))) {
 		for (x_queue = switch_xml_child(x_queues, "queue"); x_queue; x_queue = x_queue->next) {
@@ -1610,12 +2307,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 		switch_channel_set_variable_printf(member_channel, "cc_queue_answered_epoch", "%" SWITCH_TIME_T_FMT, local_epoch_time_now(NULL)); 
 
 		/* Set UUID of the Agent channel */
-		sql = switch_mprintf("UPDATE agents SET uuid = '%q', last_bridge_start = '%" SWITCH_TIME_T_FMT "', calls_answered = calls_answered + 1, no_answer_count = 0"
-				" WHERE name = '%q' AND system = '%q'",
-				agent_uuid, local_epoch_time_now(NULL),
-				h->agent_name, h->agent_system);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_agent_bridge_start(h, agent_uuid);
 
 		/* Change the agents Status in the tiers */
 		cc_tier_update("state", cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), h->queue_name, h->agent_name);
@@ -1673,11 +2365,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 		switch_channel_set_variable_printf(member_channel, "cc_queue_terminated_epoch", "%" SWITCH_TIME_T_FMT, local_epoch_time_now(NULL));
 
 		/* Update Agents Items */
-		/* Do not remove uuid of the agent if we are a standby agent */
-		sql = switch_mprintf("UPDATE agents SET %s last_bridge_end = %" SWITCH_TIME_T_FMT ", talk_time = talk_time + (%" SWITCH_TIME_T_FMT "-last_bridge_start) WHERE name = '%q' AND system = '%q';"
-				, (strcasecmp(h->agent_type, CC_AGENT_TYPE_UUID_STANDBY)?"uuid = '',":""), local_epoch_time_now(NULL), local_epoch_time_now(NULL), h->agent_name, h->agent_system);
-		cc_execute_sql(NULL, sql, NULL);
-		switch_safe_free(sql);
+		cc_agent_bridge_end(h);
 
 		/* Remove the member entry from the db (Could become optional to support latter processing) */
 		sql = switch_mprintf("DELETE FROM members WHERE system = 'single_box' AND uuid = '%q'", h->member_uuid);
@@ -1742,10 +2430,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 				tiers_state = CC_TIER_STATE_NO_ANSWER;
 
 				/* Update Agent NO Answer count */
-				sql = switch_mprintf("UPDATE agents SET no_answer_count = no_answer_count + 1 WHERE name = '%q' AND system = '%q';",
-						h->agent_name, h->agent_system);
-				cc_execute_sql(NULL, sql, NULL);
-				switch_safe_free(sql);
+				cc_agent_no_answer(h);
 
 				/* Put Agent on break because he didn't answer often */
 				if (h->max_no_answer > 0 && (h->no_answer_count + 1) >= h->max_no_answer) {
@@ -1785,13 +2470,7 @@ static void *SWITCH_THREAD_FUNC outbound_agent_thread_run(switch_thread_t *threa
 
 done:
 	/* Make Agent Available Again */
-	sql = switch_mprintf(
-			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q' AND (state = '%q' OR state = '%q' OR state = '%q');"
-			"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q'"
-			, cc_tier_state2str(tiers_state), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_ACTIVE_INBOUND), cc_tier_state2str(CC_TIER_STATE_STANDBY), cc_tier_state2str(CC_TIER_STATE_OFFERING),
-			cc_tier_state2str(CC_TIER_STATE_READY), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_STANDBY));
-	cc_execute_sql(NULL, sql, NULL);
-	switch_safe_free(sql);
+	cc_agent_tiers_release(h, tiers_state);
 
 	/* If we are in Status Available On Demand, set state to Idle so we do not receive another call until state manually changed to Waiting */
 	if (!strcasecmp(cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND), h->agent_status)) {
@@ -1835,32 +2514,24 @@ struct agent_callback {
 
 	int tier;
 	int tier_agent_available;
+
+	/* agents to offer the member to, in order */
+	struct call_helper *helpers;
+	struct call_helper **helpers_tail;
 };
 typedef struct agent_callback agent_callback_t;
 
-static int agents_callback(void *pArg, int argc, char **argv, char **columnNames)
+/*!
+ * \brief Check if the agent behind a tier can be offered the member
+ * Agents that can are queued on cbt->helpers.  Returns 1 when no further
+ * agent should be looked at.  Caller holds globals.mutex.
+ */
+static int cc_tier_pick(agent_callback_t *cbt, cc_tier_t *tier)
 {
-	agent_callback_t *cbt = (agent_callback_t *) pArg;
-	char *sql = NULL;
-	char res[256];
-	const char *agent_system = argv[0];
-	const char *agent_name = argv[1];
-	const char *agent_status = argv[2];
-	const char *agent_originate_string = argv[3];
-	const char *agent_no_answer_count = argv[4];
-	const char *agent_max_no_answer = argv[5];
-	const char *agent_reject_delay_time = argv[6];
-	const char *agent_busy_delay_time = argv[7];
-	const char *agent_no_answer_delay_time = argv[8];
-	const char *agent_tier_state = argv[9];
-	const char *agent_last_bridge_end = argv[10];
-	const char *agent_wrap_up_time = argv[11];
-	const char *agent_state = argv[12];
-	const char *agent_ready_time = argv[13];
-	const char *agent_tier_position = argv[14];
-	const char *agent_tier_level = argv[15];
-	const char *agent_type = argv[16];
-	const char *agent_uuid = argv[17];
+	cc_agent_t *agent = tier->agent;
+	switch_time_t now = local_epoch_time_now(NULL);
+	switch_memory_pool_t *pool;
+	struct call_helper *h;
 
 	switch_bool_t contact_agent = SWITCH_TRUE;
 
@@ -1868,17 +2539,17 @@ static int agents_callback(void *pArg, int argc, char **argv, char **columnNames
 
 	/* Check if we switch to a different tier, if so, check if we should continue further for that member */
 
-	if (cbt->tier_rules_apply == SWITCH_TRUE && atoi(agent_tier_level) > cbt->tier) {
+	if (cbt->tier_rules_apply == SWITCH_TRUE && tier->level > cbt->tier) {
 		/* Continue if no agent was logged in in the previous tier and noagent = true */
 		if (cbt->tier_rule_no_agent_no_wait == SWITCH_TRUE && cbt->tier_agent_available == 0) {
-			cbt->tier = atoi(agent_tier_level);
+			cbt->tier = tier->level;
 			/* Multiple the tier level by the tier wait time */
-		} else if (cbt->tier_rule_wait_multiply_level == SWITCH_TRUE && (long) local_epoch_time_now(NULL) - atol(cbt->member_joined_epoch) >= atoi(agent_tier_level) * cbt->tier_rule_wait_second) {
-			cbt->tier = atoi(agent_tier_level);
+		} else if (cbt->tier_rule_wait_multiply_level == SWITCH_TRUE && (long) now - atol(cbt->member_joined_epoch) >= tier->level * cbt->tier_rule_wait_second) {
+			cbt->tier = tier->level;
 			cbt->tier_agent_available = 0;
 			/* Just check if joined is bigger than next tier wait time */
-		} else if (cbt->tier_rule_wait_multiply_level == SWITCH_FALSE && (long) local_epoch_time_now(NULL) - atol(cbt->member_joined_epoch) >= cbt->tier_rule_wait_second) {
-			cbt->tier = atoi(agent_tier_level);
+		} else if (cbt->tier_rule_wait_multiply_level == SWITCH_FALSE && (long) now - atol(cbt->member_joined_epoch) >= cbt->tier_rule_wait_second) {
+			cbt->tier = tier->level;
 			cbt->tier_agent_available = 0;
 		} else {
 			/* We are not allowed to continue to the next tier of agent */
@@ -1888,19 +2559,19 @@ static int agents_callback(void *pArg, int argc, char **argv, char **columnNames
 	cbt->tier_agent_available++;
 
 	/* If Agent is not in a acceptable tier state, continue */
-	if (! (!strcasecmp(agent_tier_state, cc_tier_state2str(CC_TIER_STATE_NO_ANSWER)) || !strcasecmp(agent_tier_state, cc_tier_state2str(CC_TIER_STATE_READY)))) {
+	if (!(tier->state == CC_TIER_STATE_NO_ANSWER || tier->state == CC_TIER_STATE_READY)) {
 		contact_agent = SWITCH_FALSE;
 	}
-	if (! (!strcasecmp(agent_state, cc_agent_state2str(CC_AGENT_STATE_WAITING)))) {
+	if (agent->state != CC_AGENT_STATE_WAITING) {
 		contact_agent = SWITCH_FALSE;
 	}
-	if (! (atol(agent_last_bridge_end) < ((long) local_epoch_time_now(NULL) - atol(agent_wrap_up_time)))) {
+	if (!(agent->last_bridge_end < now - agent->wrap_up_time)) {
 		contact_agent = SWITCH_FALSE;
 	}
-	if (! (atol(agent_ready_time) <= (long) local_epoch_time_now(NULL))) {
+	if (!(agent->ready_time <= now)) {
 		contact_agent = SWITCH_FALSE;
 	}
-	if (! (strcasecmp(agent_status, cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK)))) {
+	if (agent->status == CC_AGENT_STATUS_ON_BREAK) {
 		contact_agent = SWITCH_FALSE;
 	}
 
@@ -1908,14 +2579,49 @@ static int agents_callback(void *pArg, int argc, char **argv, char **columnNames
 		return 0; /* Continue to next Agent */
 	}
 
-	/* If agent isn't on this box */
-	if (strcasecmp(agent_system,"single_box" /* SELF */)) {
-		if (!strcasecmp(cbt->strategy, "ring-all")) {
-			return 1; /* Abort finding agent for member if we found a match but for a different Server */
-		} else {
-			return 0; /* Skip this Agents only, so we can ring the other one */
-		}
+	switch_core_new_memory_pool(&pool);
+	h = switch_core_alloc(pool, sizeof(*h));
+	h->pool = pool;
+	h->member_uuid = switch_core_strdup(h->pool, cbt->member_uuid);
+	h->member_session_uuid = switch_core_strdup(h->pool, cbt->member_session_uuid);
+	h->queue_strategy = switch_core_strdup(h->pool, cbt->strategy);
+	h->originate_string = switch_core_strdup(h->pool, agent->contact);
+	h->agent_name = switch_core_strdup(h->pool, agent->name);
+	h->agent_system = switch_core_strdup(h->pool, "single_box");
+	h->agent_status = switch_core_strdup(h->pool, cc_agent_status2str(agent->status));
+	h->agent_type = switch_core_strdup(h->pool, agent->type);
+	h->agent_uuid = switch_core_strdup(h->pool, agent->uuid);
+	h->member_joined_epoch = switch_core_strdup(h->pool, cbt->member_joined_epoch); 
+	h->member_cid_name = switch_core_strdup(h->pool, cbt->member_cid_name);
+	h->member_cid_number = switch_core_strdup(h->pool, cbt->member_cid_number);
+	h->queue_name = switch_core_strdup(h->pool, cbt->queue_name);
+	h->record_template = switch_core_strdup(h->pool, cbt->record_template);
+	h->no_answer_count = agent->no_answer_count;
+	h->max_no_answer = agent->max_no_answer;
+	h->reject_delay_time = agent->reject_delay_time;
+	h->busy_delay_time = agent->busy_delay_time;
+	h->no_answer_delay_time = agent->no_answer_delay_time;
+	h->tier_level = tier->level;
+	h->tier_position = tier->position;
+
+	*cbt->helpers_tail = h;
+	cbt->helpers_tail = &h->next;
+
+	if (!strcasecmp(cbt->strategy,"ring-all")) {
+		return 0;
+	} else {
+		return 1;
 	}
+}
+
+/*!
+ * \brief Claim the member for a picked agent and start ringing it
+ * Returns 1 when no further agent should be offered the member.
+ */
+static int cc_agent_offer(agent_callback_t *cbt, struct call_helper *h)
+{
+	char *sql = NULL;
+	char res[256] = "";
 
 	if (!strcasecmp(cbt->strategy,"ring-all")) {
 		/* Check if member is a ring-all mode */
@@ -1927,70 +2633,40 @@ static int agents_callback(void *pArg, int argc, char **argv, char **columnNames
 		/* Map the Agent to the member */
 		sql = switch_mprintf("UPDATE members SET serving_agent = '%q', serving_system = 'single_box', state = '%q'"
 				" WHERE state = '%q' AND uuid = '%q' AND system = 'single_box'", 
-				agent_name, cc_member_state2str(CC_MEMBER_STATE_TRYING),
+				h->agent_name, cc_member_state2str(CC_MEMBER_STATE_TRYING),
 				cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt->member_uuid);
 		cc_execute_sql(NULL, sql, NULL);
 		switch_safe_free(sql);
 
 		/* Check if we won the race to get the member to our selected agent (Used for Multi system purposes) */
 		sql = switch_mprintf("SELECT count(*) FROM members WHERE serving_agent = '%q' AND serving_system = 'single_box' AND uuid = '%q' AND system = 'single_box'",
-				agent_name, cbt->member_uuid);
+				h->agent_name, cbt->member_uuid);
 		cc_execute_sql2str(NULL, NULL, sql, res, sizeof(res));
 		switch_safe_free(sql);
 	}
 
 	switch (atoi(res)) {
 		case 0: /* Ok, someone else took it, or user hanged up already */
+			switch_core_destroy_memory_pool(&h->pool);
 			return 1;
 			/* We default to default even if more entry is returned... Should never happen	anyway */
 		default: /* Go ahead, start thread to try to bridge these 2 caller */
 			{
 				switch_thread_t *thread;
 				switch_threadattr_t *thd_attr = NULL;
-				switch_memory_pool_t *pool;
-				struct call_helper *h;
-
-				switch_core_new_memory_pool(&pool);
-				h = switch_core_alloc(pool, sizeof(*h));
-				h->pool = pool;
-				h->member_uuid = switch_core_strdup(h->pool, cbt->member_uuid);
-				h->member_session_uuid = switch_core_strdup(h->pool, cbt->member_session_uuid);
-				h->queue_strategy = switch_core_strdup(h->pool, cbt->strategy);
-				h->originate_string = switch_core_strdup(h->pool, agent_originate_string);
-				h->agent_name = switch_core_strdup(h->pool, agent_name);
-				h->agent_system = switch_core_strdup(h->pool, "single_box");
-				h->agent_status = switch_core_strdup(h->pool, agent_status);
-				h->agent_type = switch_core_strdup(h->pool, agent_type);
-				h->agent_uuid = switch_core_strdup(h->pool, agent_uuid);
-				h->member_joined_epoch = switch_core_strdup(h->pool, cbt->member_joined_epoch); 
-				h->member_cid_name = switch_core_strdup(h->pool, cbt->member_cid_name);
-				h->member_cid_number = switch_core_strdup(h->pool, cbt->member_cid_number);
-				h->queue_name = switch_core_strdup(h->pool, cbt->queue_name);
-				h->record_template = switch_core_strdup(h->pool, cbt->record_template);
-				h->no_answer_count = atoi(agent_no_answer_count);
-				h->max_no_answer = atoi(agent_max_no_answer);
-				h->reject_delay_time = atoi(agent_reject_delay_time);
-				h->busy_delay_time = atoi(agent_busy_delay_time);
-				h->no_answer_delay_time = atoi(agent_no_answer_delay_time);
 
 				if (!strcasecmp(cbt->strategy, "top-down")) {
 					switch_core_session_t *member_session = switch_core_session_locate(cbt->member_session_uuid);
 					if (member_session) {
 						switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
-						switch_channel_set_variable(member_channel, "cc_last_agent_tier_position", agent_tier_position);
-						switch_channel_set_variable(member_channel, "cc_last_agent_tier_level", agent_tier_level);
+						switch_channel_set_variable_printf(member_channel, "cc_last_agent_tier_position", "%d", h->tier_position);
+						switch_channel_set_variable_printf(member_channel, "cc_last_agent_tier_level", "%d", h->tier_level);
 						switch_core_session_rwunlock(member_session);
 					}
 				}
 				cc_agent_update("state", cc_agent_state2str(CC_AGENT_STATE_RECEIVING), h->agent_name);
 
-				sql = switch_mprintf(
-						"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND queue = '%q';"
-						"UPDATE tiers SET state = '%q' WHERE agent = '%q' AND NOT queue = '%q' AND state = '%q';",
-						cc_tier_state2str(CC_TIER_STATE_OFFERING), h->agent_name, h->queue_name,
-						cc_tier_state2str(CC_TIER_STATE_STANDBY), h->agent_name, h->queue_name, cc_tier_state2str(CC_TIER_STATE_READY));
-				cc_execute_sql(NULL, sql, NULL);
-				switch_safe_free(sql);
+				cc_agent_tiers_offering(h);
 
 				switch_threadattr_create(&thd_attr, h->pool);
 				switch_threadattr_detach_set(thd_attr, 1);
@@ -2012,7 +2688,6 @@ static int members_callback(void *pArg, int argc, char **argv, char **columnName
 {
 	cc_queue_t *queue = NULL;
 	char *sql = NULL;
-	char *sql_order_by = NULL;
 	char *queue_name = NULL;
 	char *queue_strategy = NULL;
 	char *queue_record_template = NULL;
@@ -2024,6 +2699,10 @@ static int members_callback(void *pArg, int argc, char **argv, char **columnName
 	agent_callback_t cbt;
 	const char *member_state = NULL;
 	const char *member_abandoned_epoch = NULL;
+	cc_tier_heap_t *heap = NULL;
+	struct call_helper *h = NULL;
+	switch_bool_t after_last = SWITCH_FALSE;
+	int level = 0, position = 0;
 	memset(&cbt, 0, sizeof(cbt));
 
 	cbt.queue_name = argv[0];
@@ -2087,11 +2766,12 @@ static int members_callback(void *pArg, int argc, char **argv, char **columnName
 	cbt.strategy = queue_strategy;
 	cbt.record_template = queue_record_template;
 	cbt.agent_found = SWITCH_FALSE;
+	cbt.helpers = NULL;
+	cbt.helpers_tail = &cbt.helpers;
 
-	if (!strcasecmp(queue->strategy, "top-down")) {
+	if (!strcasecmp(queue_strategy, "top-down")) {
 		/* WARNING this use channel variable to help dispatch... might need to be reviewed to save it in DB to make this multi server prooft in the future */
 		switch_core_session_t *member_session = switch_core_session_locate(cbt.member_session_uuid);
-		int position = 0, level = 0;
 		const char *last_agent_tier_position, *last_agent_tier_level;
 		if (member_session) {
 			switch_channel_t *member_channel = switch_core_session_get_channel(member_session);
@@ -2104,80 +2784,54 @@ static int members_callback(void *pArg, int argc, char **argv, char **columnName
 			}
 			switch_core_session_rwunlock(member_session);
 		}
+		after_last = SWITCH_TRUE;
+	} else if (!strcasecmp(queue_strategy, "ring-all")) {
+		sql = switch_mprintf("UPDATE members SET state = '%q' WHERE state = '%q' AND uuid = '%q' AND system = 'single_box'",
+				cc_member_state2str(CC_MEMBER_STATE_TRYING), cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt.member_uuid);
+		cc_execute_sql(NULL, sql, NULL);
+		switch_safe_free(sql);
+	}
 
-		sql = switch_mprintf("SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, agents.last_offered_call as agents_last_offered_call, 1 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" AND tiers.position > %d"
-				" AND tiers.level = %d"
-				" UNION "
-				"SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, agents.last_offered_call as agents_last_offered_call, 2 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" ORDER BY dyn_order asc, tiers_level, tiers_position, agents_last_offered_call",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				position,
-				level,
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND)
-				);
-	} else if (!strcasecmp(queue->strategy, "round-robin")) {
-		sql = switch_mprintf("SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, agents.last_offered_call as agents_last_offered_call, 1 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" AND tiers.position > (SELECT tiers.position FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent) WHERE tiers.queue = '%q' AND agents.last_offered_call > 0 ORDER BY agents.last_offered_call DESC LIMIT 1)"
-				" AND tiers.level = (SELECT tiers.level FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent) WHERE tiers.queue = '%q' AND agents.last_offered_call > 0 ORDER BY agents.last_offered_call DESC LIMIT 1)"
-				" UNION "
-				"SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position as tiers_position, tiers.level as tiers_level, agents.type, agents.uuid, agents.last_offered_call as agents_last_offered_call, 2 as dyn_order FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" ORDER BY dyn_order asc, tiers_level, tiers_position, agents_last_offered_call",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				queue_name,
-				queue_name,
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND)
-				);
+	switch_mutex_lock(globals.mutex);
+	if ((heap = cc_tier_heap_get(queue_name, SWITCH_FALSE))) {
+		int pass = 0, stop = 0;
 
-	} else {
+		cc_tier_heap_set_order(heap, cc_tier_order(queue_strategy));
 
-		if (!strcasecmp(queue->strategy, "longest-idle-agent")) {
-			sql_order_by = switch_mprintf("level, agents.last_offered_call, position");
-		} else if (!strcasecmp(queue_strategy, "agent-with-least-talk-time")) {
-			sql_order_by = switch_mprintf("level, agents.talk_time, position");
-		} else if (!strcasecmp(queue_strategy, "agent-with-fewest-calls")) {
-			sql_order_by = switch_mprintf("level, agents.calls_answered, position");
-		} else if (!strcasecmp(queue_strategy, "ring-all")) {
-			sql = switch_mprintf("UPDATE members SET state = '%q' WHERE state = '%q' AND uuid = '%q' AND system = 'single_box'",
-					cc_member_state2str(CC_MEMBER_STATE_TRYING), cc_member_state2str(CC_MEMBER_STATE_WAITING), cbt.member_uuid);
-			cc_execute_sql(NULL, sql, NULL);
-			switch_safe_free(sql);
-			sql_order_by = switch_mprintf("level, position");
-		} else if(!strcasecmp(queue_strategy, "random")) {
-			sql_order_by = switch_mprintf("level, random()");
-		} else if(!strcasecmp(queue_strategy, "sequentially-by-agent-order")) {
-			sql_order_by = switch_mprintf("level, position, agents.last_offered_call"); /* Default to last_offered_call, let add new strategy if needing it differently */
-		} else {
-			/* If the strategy doesn't exist, just fallback to the following */
-			sql_order_by = switch_mprintf("level, position, agents.last_offered_call");
+		/* round-robin carries on after the last agent offered a call in this queue */
+		if (!strcasecmp(queue_strategy, "round-robin") && heap->last_offered) {
+			level = heap->last_offered->level;
+			position = heap->last_offered->position;
+			after_last = SWITCH_TRUE;
 		}
 
-		sql = switch_mprintf("SELECT system, name, status, contact, no_answer_count, max_no_answer, reject_delay_time, busy_delay_time, no_answer_delay_time, tiers.state, agents.last_bridge_end, agents.wrap_up_time, agents.state, agents.ready_time, tiers.position, tiers.level, agents.type, agents.uuid FROM agents LEFT JOIN tiers ON (agents.name = tiers.agent)"
-				" WHERE tiers.queue = '%q'"
-				" AND (agents.status = '%q' OR agents.status = '%q' OR agents.status = '%q')"
-				" ORDER BY %q",
-				queue_name,
-				cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE), cc_agent_status2str(CC_AGENT_STATUS_ON_BREAK), cc_agent_status2str(CC_AGENT_STATUS_AVAILABLE_ON_DEMAND),
-				sql_order_by);
-		switch_safe_free(sql_order_by);
+		/* First pass only looks at the agents after the last one in the same level, the second at everyone */
+		for (pass = after_last ? 0 : 1; pass < 2 && !stop; pass++) {
+			cc_tier_t *tier;
 
+			cc_tier_heap_walk_start(heap);
+			while (!stop && (tier = cc_tier_heap_walk_next(heap))) {
+				if (pass == 0 && (tier->level != level || tier->position <= position)) {
+					continue;
+				}
+				stop = cc_tier_pick(&cbt, tier);
+			}
+		}
 	}
+	switch_mutex_unlock(globals.mutex);
 
-	cc_execute_sql_callback(NULL /* queue */, NULL /* mutex */, sql, agents_callback, &cbt /* Call back variables */);
+	while ((h = cbt.helpers)) {
+		cbt.helpers = h->next;
+		if (cc_agent_offer(&cbt, h)) {
+			break;
+		}
+	}
 
-	switch_safe_free(sql);
+	/* Agents we did not get to */
+	while ((h = cbt.helpers)) {
+		cbt.helpers = h->next;
+		switch_core_destroy_memory_pool(&h->pool);
+	}
 
 	/* We update a field in the queue struct so we can kick caller out if waiting for too long with no agent */
 	if (!cbt.queue_name || !(queue = get_queue(cbt.queue_name))) {
@@ -3168,6 +3822,8 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_callcenter_load)
 	globals.pool = pool;
 
 	switch_core_hash_init(&globals.queue_hash, globals.pool);
+	switch_core_hash_init_case(&globals.agent_hash, globals.pool, SWITCH_TRUE);
+	switch_core_hash_init_case(&globals.tier_heap_hash, globals.pool, SWITCH_TRUE);
 	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, globals.pool);
 
 	if ((status = load_config()) != SWITCH_STATUS_SUCCESS) {
@@ -3265,6 +3921,8 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_callcenter_shutdown)
 		queue = NULL;
 	}
 
+	cc_cache_destroy();
+
 	switch_safe_free(globals.odbc_dsn);
 	switch_safe_free(globals.dbname);
 	switch_mutex_unlock(globals.mutex);
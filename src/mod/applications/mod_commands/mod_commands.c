@@ -2069,7 +2069,7 @@ SWITCH_STANDARD_API(status_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-#define CTL_SYNTAX "[recover|send_sighup|hupall|pause [inbound|outbound]|resume [inbound|outbound]|shutdown [cancel|elegant|asap|now|restart]|sps|sps_peak_reset|sync_clock|sync_clock_when_idle|reclaim_mem|max_sessions|min_dtmf_duration [num]|max_dtmf_duration [num]|default_dtmf_duration [num]|min_idle_cpu|loglevel [level]|debug_level [level]]"
+#define CTL_SYNTAX "[recover|send_sighup|hupall|pause [inbound|outbound]|resume [inbound|outbound]|shutdown [cancel|elegant|asap|now|restart]|sps|sps_peak_reset|sync_clock|sync_clock_when_idle|reclaim_mem|file_cache [flush]|file_writer|codec_pool [flush]|codec_offload|xml_fetch_cache [flush [section]]|max_sessions|min_dtmf_duration [num]|max_dtmf_duration [num]|default_dtmf_duration [num]|min_idle_cpu|loglevel [level]|debug_level [level]]"
 SWITCH_STANDARD_API(ctl_function)
 {
 	int argc;
@@ -2098,6 +2098,31 @@ SWITCH_STANDARD_API(ctl_function)
 		} else if (!strcasecmp(argv[0], "flush_db_handles")) {
 			switch_core_session_ctl(SCSC_FLUSH_DB_HANDLES, NULL);
 			stream->write_function(stream, "+OK\n");
+		} else if (!strcasecmp(argv[0], "file_writer")) {
+			switch_core_file_async_status(stream);
+		} else if (!strcasecmp(argv[0], "codec_pool")) {
+			if (argc > 1 && !strcasecmp(argv[1], "flush")) {
+				switch_core_codec_pool_flush();
+				stream->write_function(stream, "+OK\n");
+			} else {
+				switch_core_codec_pool_status(stream);
+			}
+		} else if (!strcasecmp(argv[0], "xml_fetch_cache")) {
+			if (argc > 1 && !strcasecmp(argv[1], "flush")) {
+				uint32_t r = switch_xml_fetch_cache_flush(argc > 2 ? argv[2] : NULL);
+				stream->write_function(stream, "+OK cleared %u entr%s\n", r, r == 1 ? "y" : "ies");
+			} else {
+				switch_xml_fetch_cache_status(stream);
+			}
+		} else if (!strcasecmp(argv[0], "codec_offload")) {
+			switch_core_codec_offload_status(stream);
+		} else if (!strcasecmp(argv[0], "file_cache")) {
+			if (argc > 1 && !strcasecmp(argv[1], "flush")) {
+				switch_core_file_cache_flush();
+				stream->write_function(stream, "+OK\n");
+			} else {
+				switch_core_file_cache_status(stream);
+			}
 		} else if (!strcasecmp(argv[0], "pause")) {
 			switch_session_ctl_t command = SCSC_PAUSE_ALL;
 			arg = 1;
@@ -6209,6 +6234,14 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	switch_console_set_complete("add fsctl sps");
 	switch_console_set_complete("add fsctl sync_clock");
 	switch_console_set_complete("add fsctl flush_db_handles");
+	switch_console_set_complete("add fsctl file_cache");
+	switch_console_set_complete("add fsctl file_cache flush");
+	switch_console_set_complete("add fsctl file_writer");
+	switch_console_set_complete("add fsctl codec_pool");
+	switch_console_set_complete("add fsctl codec_pool flush");
+	switch_console_set_complete("add fsctl codec_offload");
+	switch_console_set_complete("add fsctl xml_fetch_cache");
+	switch_console_set_complete("add fsctl xml_fetch_cache flush");
 	switch_console_set_complete("add fsctl min_idle_cpu");
 	switch_console_set_complete("add fsctl send_sighup");
 	switch_console_set_complete("add load ::console::list_available_modules");
@@ -600,6 +600,11 @@ static struct {
 	char *inner_post_trans_execute;	
 	switch_sql_queue_manager_t *qm;
 	int allow_transcoding;
+	switch_queue_t *node_wake;
+	switch_mutex_t *outbound_mutex;
+	switch_hash_t *outbound_hash;
+	switch_hash_t *outbound_heap_hash;
+	int outbound_cache;
 } globals;
 
 
@@ -926,6 +931,502 @@ static int node_idle_consumers(fifo_node_t *node)
 
 }
 
+/*
+  Local copy of the fifo_outbound rows so the node thread can pick members without a query.
+  Rows sharing a uuid are chained and every update is keyed on the uuid like the sql it shadows.
+  Each fifo keeps a heap of the members with a free slot, ordered the way the old select was.
+  Not used with odbc-dsn, the table may be shared with other boxes then.
+*/
+
+typedef struct fifo_outbound_heap fifo_outbound_heap_t;
+typedef struct fifo_outbound_member fifo_outbound_member_t;
+
+struct fifo_outbound_member {
+	char *uuid;
+	char *fifo_name;
+	char *originate_string;
+	char *hostname;
+	int simo_count;
+	int use_count;
+	int ring_count;
+	int timeout;
+	int lag;
+	long next_avail;
+	long expires;
+	int is_static;
+	int taking_calls;
+	int outbound_call_count;
+	int outbound_fail_count;
+	int heap_index;
+	fifo_outbound_heap_t *heap;
+	fifo_outbound_member_t *next;
+};
+
+struct fifo_outbound_heap {
+	fifo_outbound_member_t **members;
+	int count;
+	int size;
+};
+
+typedef enum {
+	OUTBOUND_RING_START,
+	OUTBOUND_RING_CANCEL,
+	OUTBOUND_DIAL_FAIL,
+	OUTBOUND_USE_START,
+	OUTBOUND_USE_STOP,
+	OUTBOUND_USE_DONE
+} outbound_update_t;
+
+static void fifo_wake_node_thread(void)
+{
+	if (globals.node_wake) {
+		switch_queue_trypush(globals.node_wake, &marker);
+	}
+}
+
+static int outbound_member_cmp(fifo_outbound_member_t *a, fifo_outbound_member_t *b)
+{
+	if (a->next_avail != b->next_avail) {
+		return a->next_avail < b->next_avail ? -1 : 1;
+	}
+
+	if (a->outbound_fail_count != b->outbound_fail_count) {
+		return a->outbound_fail_count < b->outbound_fail_count ? -1 : 1;
+	}
+
+	if (a->outbound_call_count != b->outbound_call_count) {
+		return a->outbound_call_count < b->outbound_call_count ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static void outbound_heap_set(fifo_outbound_heap_t *heap, int i, fifo_outbound_member_t *member)
+{
+	heap->members[i] = member;
+	member->heap_index = i;
+}
+
+static void outbound_heap_up(fifo_outbound_heap_t *heap, int i)
+{
+	fifo_outbound_member_t *member = heap->members[i];
+
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+
+		if (outbound_member_cmp(member, heap->members[parent]) >= 0) {
+			break;
+		}
+
+		outbound_heap_set(heap, i, heap->members[parent]);
+		i = parent;
+	}
+
+	outbound_heap_set(heap, i, member);
+}
+
+static void outbound_heap_down(fifo_outbound_heap_t *heap, int i)
+{
+	fifo_outbound_member_t *member = heap->members[i];
+
+	for (;;) {
+		int child = i * 2 + 1;
+
+		if (child >= heap->count) {
+			break;
+		}
+
+		if (child + 1 < heap->count && outbound_member_cmp(heap->members[child + 1], heap->members[child]) < 0) {
+			child++;
+		}
+
+		if (outbound_member_cmp(heap->members[child], member) >= 0) {
+			break;
+		}
+
+		outbound_heap_set(heap, i, heap->members[child]);
+		i = child;
+	}
+
+	outbound_heap_set(heap, i, member);
+}
+
+static void outbound_heap_insert(fifo_outbound_heap_t *heap, fifo_outbound_member_t *member)
+{
+	if (heap->count == heap->size) {
+		heap->size = heap->size ? heap->size * 2 : 16;
+		heap->members = realloc(heap->members, heap->size * sizeof(*heap->members));
+		switch_assert(heap->members);
+	}
+
+	outbound_heap_set(heap, heap->count++, member);
+	outbound_heap_up(heap, member->heap_index);
+}
+
+static void outbound_heap_remove(fifo_outbound_heap_t *heap, fifo_outbound_member_t *member)
+{
+	int i = member->heap_index;
+	fifo_outbound_member_t *last;
+
+	if (i < 0) {
+		return;
+	}
+
+	member->heap_index = -1;
+	last = heap->members[--heap->count];
+
+	if (i < heap->count) {
+		outbound_heap_set(heap, i, last);
+		outbound_heap_up(heap, i);
+		outbound_heap_down(heap, last->heap_index);
+	}
+}
+
+/* Same test as the where clause of the old select minus the next_avail part */
+static void outbound_member_place(fifo_outbound_member_t *member)
+{
+	outbound_heap_remove(member->heap, member);
+
+	if (member->taking_calls == 1 && member->use_count + member->ring_count < member->simo_count) {
+		outbound_heap_insert(member->heap, member);
+	}
+}
+
+/* Caller holds globals.outbound_mutex and calls outbound_member_place() once the counters are filled in */
+static fifo_outbound_member_t *outbound_member_add(const char *uuid, const char *fifo_name, const char *originate_string, const char *hostname)
+{
+	fifo_outbound_member_t *member;
+	fifo_outbound_heap_t *heap;
+
+	if (!(heap = switch_core_hash_find(globals.outbound_heap_hash, fifo_name))) {
+		switch_zmalloc(heap, sizeof(*heap));
+		switch_core_hash_insert(globals.outbound_heap_hash, fifo_name, heap);
+	}
+
+	switch_zmalloc(member, sizeof(*member));
+	member->uuid = strdup(uuid);
+	member->fifo_name = strdup(fifo_name);
+	member->originate_string = strdup(originate_string);
+	member->hostname = strdup(hostname);
+	member->taking_calls = 1;
+	member->simo_count = 1;
+	member->heap_index = -1;
+	member->heap = heap;
+	member->next = switch_core_hash_find(globals.outbound_hash, uuid);
+	switch_core_hash_insert(globals.outbound_hash, uuid, member);
+
+	return member;
+}
+
+static void outbound_member_insert(const char *uuid, const char *fifo_name, const char *originate_string, int simo_count,
+								   int timeout, int lag, long expires, int is_static, int taking_calls)
+{
+	fifo_outbound_member_t *member;
+
+	if (!globals.outbound_cache) {
+		return;
+	}
+
+	switch_mutex_lock(globals.outbound_mutex);
+	member = outbound_member_add(uuid, fifo_name, originate_string, globals.hostname);
+	member->simo_count = simo_count;
+	member->timeout = timeout;
+	member->lag = lag;
+	member->expires = expires;
+	member->is_static = is_static;
+	member->taking_calls = taking_calls;
+	outbound_member_place(member);
+	switch_mutex_unlock(globals.outbound_mutex);
+}
+
+static void outbound_member_free(fifo_outbound_member_t *member)
+{
+	outbound_heap_remove(member->heap, member);
+	switch_safe_free(member->uuid);
+	switch_safe_free(member->fifo_name);
+	switch_safe_free(member->originate_string);
+	switch_safe_free(member->hostname);
+	free(member);
+}
+
+/* Drop the rows for uuid, optionally only the ones in fifo_name, on hostname or the static ones */
+static void outbound_member_del(const char *uuid, const char *fifo_name, const char *hostname, switch_bool_t static_only)
+{
+	fifo_outbound_member_t *head, *member, **mp;
+
+	if (!globals.outbound_cache) {
+		return;
+	}
+
+	switch_mutex_lock(globals.outbound_mutex);
+
+	head = switch_core_hash_find(globals.outbound_hash, uuid);
+
+	for (mp = &head; (member = *mp);) {
+		if ((fifo_name && strcmp(member->fifo_name, fifo_name)) || (hostname && strcmp(member->hostname, hostname)) ||
+			(static_only && !member->is_static)) {
+			mp = &member->next;
+			continue;
+		}
+
+		*mp = member->next;
+		outbound_member_free(member);
+	}
+
+	if (head) {
+		switch_core_hash_insert(globals.outbound_hash, uuid, head);
+	} else {
+		switch_core_hash_delete(globals.outbound_hash, uuid);
+	}
+
+	switch_mutex_unlock(globals.outbound_mutex);
+}
+
+/* Mirrors "delete from fifo_outbound where [static=1 and] hostname='...'" on reload */
+static void outbound_member_purge(switch_bool_t all)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+	char **uuids = NULL;
+	int i, count = 0, size = 0;
+
+	if (!globals.outbound_cache) {
+		return;
+	}
+
+	switch_mutex_lock(globals.outbound_mutex);
+
+	for (hi = switch_hash_first(NULL, globals.outbound_hash); hi; hi = switch_hash_next(hi)) {
+		switch_hash_this(hi, &var, NULL, &val);
+
+		if (count == size) {
+			size = size ? size * 2 : 64;
+			uuids = realloc(uuids, size * sizeof(*uuids));
+			switch_assert(uuids);
+		}
+
+		uuids[count++] = strdup((const char *) var);
+	}
+
+	for (i = 0; i < count; i++) {
+		outbound_member_del(uuids[i], NULL, globals.hostname, !all);
+		free(uuids[i]);
+	}
+
+	switch_mutex_unlock(globals.outbound_mutex);
+
+	switch_safe_free(uuids);
+}
+
+static void outbound_member_update(const char *uuid, outbound_update_t what)
+{
+	fifo_outbound_member_t *member;
+	long now = (long) switch_epoch_time_now(NULL);
+
+	if (!globals.outbound_cache || zstr(uuid)) {
+		return;
+	}
+
+	switch_mutex_lock(globals.outbound_mutex);
+
+	for (member = switch_core_hash_find(globals.outbound_hash, uuid); member; member = member->next) {
+		switch (what) {
+		case OUTBOUND_RING_START:
+			member->ring_count++;
+			break;
+		case OUTBOUND_RING_CANCEL:
+			if (member->ring_count > 0) {
+				member->ring_count--;
+			}
+			break;
+		case OUTBOUND_DIAL_FAIL:
+			member->outbound_fail_count++;
+			member->next_avail = now + member->lag + 1;
+			break;
+		case OUTBOUND_USE_START:
+			member->use_count++;
+			member->outbound_fail_count = 0;
+			break;
+		case OUTBOUND_USE_STOP:
+		case OUTBOUND_USE_DONE:
+			if (member->use_count > 0) {
+				member->use_count--;
+				member->next_avail = now + member->lag + 1;
+				if (what == OUTBOUND_USE_DONE) {
+					member->outbound_call_count++;
+				}
+			}
+			break;
+		}
+
+		outbound_member_place(member);
+	}
+
+	switch_mutex_unlock(globals.outbound_mutex);
+}
+
+static int outbound_member_load_callback(void *pArg, int argc, char **argv, char **columnNames)
+{
+	fifo_outbound_member_t *member;
+
+	if (zstr(argv[0]) || zstr(argv[1])) {
+		return 0;
+	}
+
+	member = outbound_member_add(argv[0], argv[1], switch_str_nil(argv[2]), switch_str_nil(argv[12]));
+	member->simo_count = switch_safe_atoi(argv[3], 0);
+	member->use_count = switch_safe_atoi(argv[4], 0);
+	member->timeout = switch_safe_atoi(argv[5], 0);
+	member->lag = switch_safe_atoi(argv[6], 0);
+	member->next_avail = argv[7] ? atol(argv[7]) : 0;
+	member->expires = argv[8] ? atol(argv[8]) : 0;
+	member->is_static = switch_safe_atoi(argv[9], 0);
+	member->outbound_call_count = switch_safe_atoi(argv[10], 0);
+	member->outbound_fail_count = switch_safe_atoi(argv[11], 0);
+	member->taking_calls = switch_safe_atoi(argv[13], 1);
+	member->ring_count = switch_safe_atoi(argv[14], 0);
+	outbound_member_place(member);
+
+	return 0;
+}
+
+static void outbound_member_load(void)
+{
+	char *sql = "select uuid, fifo_name, originate_string, simo_count, use_count, timeout, lag, "
+		"next_avail, expires, static, outbound_call_count, outbound_fail_count, hostname, taking_calls, ring_count "
+		"from fifo_outbound";
+
+	switch_mutex_lock(globals.outbound_mutex);
+	fifo_execute_sql_callback(globals.sql_mutex, sql, outbound_member_load_callback, NULL);
+	switch_mutex_unlock(globals.outbound_mutex);
+}
+
+static void outbound_member_destroy(void)
+{
+	switch_hash_index_t *hi;
+	void *val;
+
+	if (!globals.outbound_hash) {
+		return;
+	}
+
+	for (hi = switch_hash_first(NULL, globals.outbound_hash); hi; hi = switch_hash_next(hi)) {
+		fifo_outbound_member_t *member, *next;
+
+		switch_hash_this(hi, NULL, NULL, &val);
+
+		for (member = (fifo_outbound_member_t *) val; member; member = next) {
+			next = member->next;
+			outbound_member_free(member);
+		}
+	}
+
+	for (hi = switch_hash_first(NULL, globals.outbound_heap_hash); hi; hi = switch_hash_next(hi)) {
+		fifo_outbound_heap_t *heap;
+
+		switch_hash_this(hi, NULL, NULL, &val);
+		heap = (fifo_outbound_heap_t *) val;
+		switch_safe_free(heap->members);
+		free(heap);
+	}
+
+	switch_core_hash_destroy(&globals.outbound_hash);
+	switch_core_hash_destroy(&globals.outbound_heap_hash);
+}
+
+/* Hand a member to one of the place_call callbacks as if it were a row of the old select */
+static int outbound_member_offer(fifo_outbound_member_t *member, switch_core_db_callback_func_t callback, void *pArg)
+{
+	static char *columns[] = { "uuid", "fifo_name", "originate_string", "simo_count", "use_count", "timeout", "lag",
+							   "next_avail", "expires", "static", "outbound_call_count", "outbound_fail_count", "hostname" };
+	char simo_count[16], use_count[16], timeout[16], lag[16], next_avail[32], expires[32], is_static[16], call_count[16], fail_count[16];
+	char *argv[13];
+
+	switch_snprintf(simo_count, sizeof(simo_count), "%d", member->simo_count);
+	switch_snprintf(use_count, sizeof(use_count), "%d", member->use_count);
+	switch_snprintf(timeout, sizeof(timeout), "%d", member->timeout);
+	switch_snprintf(lag, sizeof(lag), "%d", member->lag);
+	switch_snprintf(next_avail, sizeof(next_avail), "%ld", member->next_avail);
+	switch_snprintf(expires, sizeof(expires), "%ld", member->expires);
+	switch_snprintf(is_static, sizeof(is_static), "%d", member->is_static);
+	switch_snprintf(call_count, sizeof(call_count), "%d", member->outbound_call_count);
+	switch_snprintf(fail_count, sizeof(fail_count), "%d", member->outbound_fail_count);
+
+	argv[0] = member->uuid;
+	argv[1] = member->fifo_name;
+	argv[2] = member->originate_string;
+	argv[3] = simo_count;
+	argv[4] = use_count;
+	argv[5] = timeout;
+	argv[6] = lag;
+	argv[7] = next_avail;
+	argv[8] = expires;
+	argv[9] = is_static;
+	argv[10] = call_count;
+	argv[11] = fail_count;
+	argv[12] = member->hostname;
+
+	return callback(pArg, 13, argv, columns);
+}
+
+/*
+  Offer the members of node that are available now, best first, until the callback has enough.
+  Each one offered is counted as ringing until the dialing thread lets go of it.
+  Returns when it is worth looking at this node again or 0 if it has no members with a free slot.
+*/
+static long outbound_member_walk(fifo_node_t *node, switch_bool_t skip_busy, switch_core_db_callback_func_t callback, void *pArg)
+{
+	fifo_outbound_heap_t *heap;
+	fifo_outbound_member_t *member, **held = NULL;
+	int i, held_count = 0, offered = 0, done = 0;
+	long now = (long) switch_epoch_time_now(NULL), next = 0;
+
+	switch_mutex_lock(globals.outbound_mutex);
+
+	if (!(heap = switch_core_hash_find(globals.outbound_heap_hash, node->name)) || !heap->count) {
+		goto end;
+	}
+
+	switch_zmalloc(held, heap->count * sizeof(*held));
+
+	while (!done && heap->count && (member = heap->members[0])->next_avail <= now) {
+		outbound_heap_remove(heap, member);
+
+		if (skip_busy && (check_consumer_outbound_call(member->uuid) || check_bridge_call(member->uuid))) {
+			held[held_count++] = member;
+			continue;
+		}
+
+		held[held_count++] = held[offered];
+		held[offered++] = member;
+		done = outbound_member_offer(member, callback, pArg) != 0;
+	}
+
+	for (i = 0; i < offered; i++) {
+		outbound_member_update(held[i]->uuid, OUTBOUND_RING_START);
+	}
+
+	for (i = 0; i < held_count; i++) {
+		if (held[i]->heap_index < 0) {
+			outbound_member_place(held[i]);
+		}
+	}
+
+	if (heap->count) {
+		member = heap->members[0];
+		next = member->next_avail > now ? member->next_avail : now + 1;
+	}
+
+  end:
+
+	switch_mutex_unlock(globals.outbound_mutex);
+
+	switch_safe_free(held);
+
+	return next;
+}
+
 struct call_helper {
 	char *uuid;
 	char *node_name;
@@ -1260,6 +1761,7 @@ static void *SWITCH_THREAD_FUNC ringall_thread_run(switch_thread_t *thread, void
 		struct call_helper *h = cbh->rows[i];
 
 		if (check_consumer_outbound_call(h->uuid) || check_bridge_call(h->uuid)) {
+			outbound_member_update(h->uuid, OUTBOUND_RING_CANCEL);
 			continue;
 		}
 
@@ -1468,6 +1970,7 @@ static void *SWITCH_THREAD_FUNC ringall_thread_run(switch_thread_t *thread, void
 											   "next_avail=%ld + lag + 1 where uuid='%q' and ring_count > 0",
 											   (long) switch_epoch_time_now(NULL), h->uuid);
 					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					outbound_member_update(h->uuid, OUTBOUND_DIAL_FAIL);
 
 				}
 			}
@@ -1543,8 +2046,11 @@ static void *SWITCH_THREAD_FUNC ringall_thread_run(switch_thread_t *thread, void
 	for (i = 0; i < cbh->rowcount; i++) {
 		struct call_helper *h = cbh->rows[i];
 		del_consumer_outbound_call(h->uuid);
+		outbound_member_update(h->uuid, OUTBOUND_RING_CANCEL);
 	}
 
+	fifo_wake_node_thread();
+
 	switch_safe_free(originate_string);
 	switch_safe_free(uuid_list);
 
@@ -1598,7 +2104,6 @@ static void *SWITCH_THREAD_FUNC o_thread_run(switch_thread_t *thread, void *obj)
 
 	if (node) {
 		switch_mutex_lock(node->update_mutex);
-		node->ring_consumer_count++;
 		node->busy = 0;
 		switch_mutex_unlock(node->update_mutex);
 	}
@@ -1645,6 +2150,7 @@ static void *SWITCH_THREAD_FUNC o_thread_run(switch_thread_t *thread, void *obj)
 							 "outbound_fail_count=outbound_fail_count+1, next_avail=%ld + lag + 1 where uuid='%q'",
 							 (long) switch_epoch_time_now(NULL), h->uuid);
 		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		outbound_member_update(h->uuid, OUTBOUND_DIAL_FAIL);
 
 		if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, FIFO_EVENT) == SWITCH_STATUS_SUCCESS) {
 			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "FIFO-Name", node->name);
@@ -1701,6 +2207,8 @@ static void *SWITCH_THREAD_FUNC o_thread_run(switch_thread_t *thread, void *obj)
 		switch_mutex_unlock(node->update_mutex);
 		switch_thread_rwlock_unlock(node->rwlock);
 	}
+	outbound_member_update(h->uuid, OUTBOUND_RING_CANCEL);
+	fifo_wake_node_thread();
 	switch_core_destroy_memory_pool(&h->pool);
 
 	switch_mutex_lock(globals.mutex);
@@ -1764,32 +2272,47 @@ static int place_call_enterprise_callback(void *pArg, int argc, char **argv, cha
 	return *need ? 0 : -1;
 }
 
-static void find_consumers(fifo_node_t *node)
+/* Returns when the node thread should come back to this node, 0 if only an event can change anything */
+static long find_consumers(fifo_node_t *node)
 {
-	char *sql;
-
-
-	sql = switch_mprintf("select uuid, fifo_name, originate_string, simo_count, use_count, timeout, lag, "
-						 "next_avail, expires, static, outbound_call_count, outbound_fail_count, hostname "
-						 "from fifo_outbound "
-						 "where taking_calls = 1 and (fifo_name = '%q') and ((use_count+ring_count) < simo_count) and (next_avail = 0 or next_avail <= %ld) "
-						 "order by next_avail, outbound_fail_count, outbound_call_count",
-						 node->name, (long) switch_epoch_time_now(NULL)
-						 );
+	char *sql = NULL;
+	long next = 0;
 
+	if (!globals.outbound_cache) {
+		sql = switch_mprintf("select uuid, fifo_name, originate_string, simo_count, use_count, timeout, lag, "
+							 "next_avail, expires, static, outbound_call_count, outbound_fail_count, hostname "
+							 "from fifo_outbound "
+							 "where taking_calls = 1 and (fifo_name = '%q') and ((use_count+ring_count) < simo_count) and (next_avail = 0 or next_avail <= %ld) "
+							 "order by next_avail, outbound_fail_count, outbound_call_count",
+							 node->name, (long) switch_epoch_time_now(NULL)
+							 );
+	}
 
 
 	switch(node->outbound_strategy) {
 	case NODE_STRATEGY_ENTERPRISE:
 		{
 			int need = node_caller_count(node);
+			int placed;
 
 			if (node->outbound_per_cycle && node->outbound_per_cycle < need) {
 				need = node->outbound_per_cycle;
 			}
 
-			fifo_execute_sql_callback(globals.sql_mutex, sql, place_call_enterprise_callback, &need);
+			placed = need;
+
+			if (sql) {
+				fifo_execute_sql_callback(globals.sql_mutex, sql, place_call_enterprise_callback, &need);
+			} else {
+				next = outbound_member_walk(node, SWITCH_FALSE, place_call_enterprise_callback, &need);
+			}
 
+			/* counted here rather than in o_thread_run so the next pass already sees them */
+			if ((placed -= need) > 0) {
+				switch_mutex_lock(node->update_mutex);
+				node->ring_consumer_count += placed;
+				switch_mutex_unlock(node->update_mutex);
+			}
 		}
 		break;
 	case NODE_STRATEGY_RINGALL:
@@ -1808,9 +2331,17 @@ static void find_consumers(fifo_node_t *node)
 				cbh->need = node->outbound_per_cycle;
 			}
 
-			fifo_execute_sql_callback(globals.sql_mutex, sql, place_call_ringall_callback, cbh);
+			if (sql) {
+				fifo_execute_sql_callback(globals.sql_mutex, sql, place_call_ringall_callback, cbh);
+			} else {
+				next = outbound_member_walk(node, SWITCH_TRUE, place_call_ringall_callback, cbh);
+			}
 
 			if (cbh->rowcount) {
+				switch_mutex_lock(node->update_mutex);
+				node->ring_consumer_count = 1;
+				switch_mutex_unlock(node->update_mutex);
+
 				switch_threadattr_create(&thd_attr, cbh->pool);
 				switch_threadattr_detach_set(thd_attr, 1);
 				switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
@@ -1827,100 +2358,115 @@ static void find_consumers(fifo_node_t *node)
 
 
 	switch_safe_free(sql);
+
+	return next;
 }
 
+/* How long the node thread sleeps when nothing asks for it, it still has to reap removed nodes */
+#define NODE_THREAD_MAX_WAIT 5
+
 static void *SWITCH_THREAD_FUNC node_thread_run(switch_thread_t *thread, void *obj)
 {
 	fifo_node_t *node, *last, *this_node;
-	int cur_priority = 1;
+	int cur_priority;
+	void *pop_wake;
 
 	globals.node_thread_running = 1;
 
 	while (globals.node_thread_running == 1) {
-		int ppl_waiting, consumer_total, idle_consumers, found = 0;
+		int ppl_waiting, consumer_total, idle_consumers;
+		long now = (long) switch_epoch_time_now(NULL), wake_at = now + NODE_THREAD_MAX_WAIT, next;
 
 		switch_mutex_lock(globals.mutex);
 
-		if (globals.debug) switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Trying priority: %d\n", cur_priority);
+		for (cur_priority = 1; cur_priority <= 10; cur_priority++) {
+			if (globals.debug) switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Trying priority: %d\n", cur_priority);
 
-		last = NULL;
-		node = globals.nodes;
+			last = NULL;
+			node = globals.nodes;
 
-		while(node) {
-			int x = 0;
-			switch_event_t *pop;
+			while(node) {
+				int x = 0;
+				switch_event_t *pop;
 
-			this_node = node;
-			node = node->next;
+				this_node = node;
+				node = node->next;
 
-			if (this_node->ready == 0) {
-				for (x = 0; x < MAX_PRI; x++) {
-					while (fifo_queue_pop(this_node->fifo_list[x], &pop, 2) == SWITCH_STATUS_SUCCESS) {
-						const char *caller_uuid = switch_event_get_header(pop, "unique-id");
-						switch_ivr_kill_uuid(caller_uuid, SWITCH_CAUSE_MANAGER_REQUEST);
-						switch_event_destroy(&pop);
+				if (this_node->ready == 0) {
+					for (x = 0; x < MAX_PRI; x++) {
+						while (fifo_queue_pop(this_node->fifo_list[x], &pop, 2) == SWITCH_STATUS_SUCCESS) {
+							const char *caller_uuid = switch_event_get_header(pop, "unique-id");
+							switch_ivr_kill_uuid(caller_uuid, SWITCH_CAUSE_MANAGER_REQUEST);
+							switch_event_destroy(&pop);
+						}
 					}
+
 				}
 
-			}
 
+				if (this_node->ready == 0 && switch_thread_rwlock_trywrlock(this_node->rwlock) == SWITCH_STATUS_SUCCESS) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "%s removed.\n", this_node->name);
 
-			if (this_node->ready == 0 && switch_thread_rwlock_trywrlock(this_node->rwlock) == SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "%s removed.\n", this_node->name);
+					for (x = 0; x < MAX_PRI; x++) {
+						while (fifo_queue_pop(this_node->fifo_list[x], &pop, 2) == SWITCH_STATUS_SUCCESS) {
+							switch_event_destroy(&pop);
+						}
+					}
 
-				for (x = 0; x < MAX_PRI; x++) {
-					while (fifo_queue_pop(this_node->fifo_list[x], &pop, 2) == SWITCH_STATUS_SUCCESS) {
-						switch_event_destroy(&pop);
+					if (last) {
+						last->next = this_node->next;
+					} else {
+						globals.nodes = this_node->next;
 					}
-				}
 
-				if (last) {
-					last->next = this_node->next;
-				} else {
-					globals.nodes = this_node->next;
+					switch_core_hash_destroy(&this_node->consumer_hash);
+					switch_mutex_unlock(this_node->mutex);
+					switch_mutex_unlock(this_node->update_mutex);
+					switch_thread_rwlock_unlock(this_node->rwlock);
+					switch_core_destroy_memory_pool(&this_node->pool);
+					continue;
 				}
 
-				switch_core_hash_destroy(&this_node->consumer_hash);
-				switch_mutex_unlock(this_node->mutex);
-				switch_mutex_unlock(this_node->update_mutex);
-				switch_thread_rwlock_unlock(this_node->rwlock);
-				switch_core_destroy_memory_pool(&this_node->pool);
-				continue;
-			}
+				last = this_node;
 
-			last = this_node;
+				if (this_node->outbound_priority == 0) this_node->outbound_priority = 5;
 
-			if (this_node->outbound_priority == 0) this_node->outbound_priority = 5;
+				if (this_node->has_outbound && !this_node->busy && this_node->outbound_priority == cur_priority) {
+					ppl_waiting = node_caller_count(this_node);
+					consumer_total = this_node->consumer_count;
+					idle_consumers = node_idle_consumers(this_node);
 
-			if (this_node->has_outbound && !this_node->busy && this_node->outbound_priority == cur_priority) {
-				ppl_waiting = node_caller_count(this_node);
-				consumer_total = this_node->consumer_count;
-				idle_consumers = node_idle_consumers(this_node);
+					if (globals.debug) {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
+										  "%s waiting %d consumer_total %d idle_consumers %d ring_consumers %d pri %d\n",
+										  this_node->name, ppl_waiting, consumer_total, idle_consumers, this_node->ring_consumer_count, this_node->outbound_priority);
+					}
 
-				if (globals.debug) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG,
-									  "%s waiting %d consumer_total %d idle_consumers %d ring_consumers %d pri %d\n",
-									  this_node->name, ppl_waiting, consumer_total, idle_consumers, this_node->ring_consumer_count, this_node->outbound_priority);
-				}
 
+					if ((ppl_waiting - this_node->ring_consumer_count > 0) && (!consumer_total || !idle_consumers)) {
+						if ((next = find_consumers(this_node)) && next < wake_at) {
+							wake_at = next;
+						}
 
-				if ((ppl_waiting - this_node->ring_consumer_count > 0) && (!consumer_total || !idle_consumers)) {
-					found++;
-					find_consumers(this_node);
-					switch_yield(1000000);
+						if (!globals.outbound_cache) {
+							/* give the queued sql a chance to land before the table is read again */
+							switch_yield(1000000);
+						}
+					}
 				}
 			}
 		}
-	
 
-		if (++cur_priority > 10) {
-			cur_priority = 1;
+		switch_mutex_unlock(globals.mutex);
+
+		if (!globals.outbound_cache) {
+			wake_at = now + 1;
 		}
 
-		switch_mutex_unlock(globals.mutex);
+		now = (long) switch_epoch_time_now(NULL);
 
-		if (cur_priority == 1) {
-			switch_yield(1000000);
+		if (wake_at > now) {
+			switch_queue_pop_timeout(globals.node_wake, &pop_wake, (switch_interval_time_t) (wake_at - now) * 1000000);
 		}
 	}
 
@@ -1933,6 +2479,8 @@ static void start_node_thread(switch_memory_pool_t *pool)
 {
 	switch_threadattr_t *thd_attr = NULL;
 
+	switch_queue_create(&globals.node_wake, 1, pool);
+
 	switch_threadattr_create(&thd_attr, pool);
 	//switch_threadattr_detach_set(thd_attr, 1);
 	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
@@ -1944,6 +2492,7 @@ static int stop_node_thread(void)
 	switch_status_t st = SWITCH_STATUS_SUCCESS;
 
 	globals.node_thread_running = -1;
+	fifo_wake_node_thread();
 	switch_thread_join(&st, globals.node_thread);
 
 	return 0;
@@ -2082,6 +2631,8 @@ static uint32_t fifo_add_outbound(const char *node_name, const char *url, uint32
 
 	switch_thread_rwlock_unlock(node->rwlock);
 
+	fifo_wake_node_thread();
+
 	return i;
 
 }
@@ -2152,6 +2703,8 @@ static void dec_use_count(switch_core_session_t *session, switch_bool_t send_eve
 		sql = switch_mprintf("update fifo_outbound set use_count=use_count-1, stop_time=%ld, next_avail=%ld + lag + 1 where use_count > 0 and uuid='%q'",
 							 now, now, outbound_id);
 		fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+		outbound_member_update(outbound_id, OUTBOUND_USE_STOP);
+		fifo_wake_node_thread();
 	}
 
 	if (send_event) {
@@ -2219,6 +2772,7 @@ SWITCH_STANDARD_APP(fifo_track_call_function)
 	sql = switch_mprintf("update fifo_outbound set stop_time=0,start_time=%ld,outbound_fail_count=0,use_count=use_count+1,%s=%s+1,%s=%s+1 where uuid='%q'",
 						 (long) switch_epoch_time_now(NULL), col1, col1, col2, col2, data);
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	outbound_member_update(data, OUTBOUND_USE_START);
 
 
 	if (switch_channel_direction(channel) == SWITCH_CALL_DIRECTION_INBOUND) {
@@ -2475,6 +3029,7 @@ SWITCH_STANDARD_APP(fifo_function)
 		fifo_queue_push(node->fifo_list[p], call_event);
 		fifo_caller_add(node, session);
 		in_table = 1;
+		fifo_wake_node_thread();
 
 		call_event = NULL;
 		switch_snprintf(tmp, sizeof(tmp), "%d", fifo_queue_size(node->fifo_list[p]));
@@ -3047,6 +3602,9 @@ SWITCH_STANDARD_APP(fifo_function)
 					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "FIFO-Action", "bridge-consumer-start");
 					switch_event_fire(&event);
 				}
+
+				/* one less idle consumer, the node may need outbound members now */
+				fifo_wake_node_thread();
 				if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, FIFO_EVENT) == SWITCH_STATUS_SUCCESS) {
 					switch_channel_event_set_data(other_channel, event);
 					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "FIFO-Name", argv[0]);
@@ -3063,6 +3621,7 @@ SWITCH_STANDARD_APP(fifo_function)
 
 
 					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					outbound_member_update(outbound_id, OUTBOUND_USE_START);
 				}
 
 				add_bridge_call(switch_core_session_get_uuid(other_session));
@@ -3113,8 +3672,10 @@ SWITCH_STANDARD_APP(fifo_function)
 										 now, now, outbound_id);
 
 					fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+					outbound_member_update(outbound_id, OUTBOUND_USE_DONE);
 
 					del_bridge_call(outbound_id);
+					fifo_wake_node_thread();
 
 				}
 
@@ -3268,6 +3829,7 @@ SWITCH_STANDARD_APP(fifo_function)
 				node->consumer_count--;
 				switch_mutex_unlock(node->mutex);
 			}
+			fifo_wake_node_thread();
 		}
 
 		if (outbound_id && switch_channel_up(channel)) {
@@ -4094,6 +4656,8 @@ static switch_status_t load_config(int reload, int del_all)
 	}
 
 	if (!reload) {
+		globals.outbound_cache = zstr(globals.odbc_dsn);
+
 		switch_sql_queue_manager_init_name("fifo",
 										   &globals.qm,
 										   2,
@@ -4143,6 +4707,12 @@ static switch_status_t load_config(int reload, int del_all)
 
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
 
+	if (reload) {
+		outbound_member_purge(del_all);
+	} else if (globals.outbound_cache) {
+		outbound_member_load();
+	}
+
 	if (!(node = switch_core_hash_find(globals.fifo_hash, MANUAL_QUEUE_NAME))) {
 		node = create_node(MANUAL_QUEUE_NAME, 0, globals.sql_mutex);
 		node->ready = 2;
@@ -4295,6 +4865,7 @@ static switch_status_t load_config(int reload, int del_all)
 
 				switch_assert(sql);
 				fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_FALSE);
+				outbound_member_insert(digest, node->name, member->txt, simo_i, timeout_i, lag_i, 0, 1, taking_calls_i);
 				free(name_dup);
 				node->has_outbound = 1;
 				node->member_count++;
@@ -4325,7 +4896,7 @@ static switch_status_t load_config(int reload, int del_all)
 		switch_mutex_unlock(globals.mutex);
 	}
 
-
+	fifo_wake_node_thread();
 
 	return status;
 }
@@ -4350,6 +4921,7 @@ static void fifo_member_add(char *fifo_name, char *originate_string, int simo_co
 	sql = switch_mprintf("delete from fifo_outbound where fifo_name='%q' and uuid = '%q'", fifo_name, digest);
 	switch_assert(sql);
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	outbound_member_del(digest, fifo_name, NULL, SWITCH_FALSE);
 
 
 	switch_mutex_lock(globals.mutex);
@@ -4372,6 +4944,7 @@ static void fifo_member_add(char *fifo_name, char *originate_string, int simo_co
 						 (long)switch_epoch_time_now(NULL));
 	switch_assert(sql);
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	outbound_member_insert(digest, fifo_name, originate_string, simo_count, timeout, lag, (long) expires, 0, taking_calls);
 	free(name_dup);
 
     cbt.buf = outbound_count; 
@@ -4385,6 +4958,8 @@ static void fifo_member_add(char *fifo_name, char *originate_string, int simo_co
         node->has_outbound = 0;
     }
     switch_safe_free(sql);
+
+	fifo_wake_node_thread();
 }
 
 static void fifo_member_del(char *fifo_name, char *originate_string)
@@ -4407,6 +4982,7 @@ static void fifo_member_del(char *fifo_name, char *originate_string)
 	sql = switch_mprintf("delete from fifo_outbound where fifo_name='%q' and uuid = '%q' and hostname='%q'", fifo_name, digest, globals.hostname);
 	switch_assert(sql);
 	fifo_execute_sql_queued(&sql, SWITCH_TRUE, SWITCH_TRUE);
+	outbound_member_del(digest, fifo_name, globals.hostname, SWITCH_FALSE);
 
 	switch_mutex_lock(globals.mutex);
 	if (!(node = switch_core_hash_find(globals.fifo_hash, fifo_name))) {
@@ -4426,6 +5002,8 @@ static void fifo_member_del(char *fifo_name, char *originate_string)
         node->has_outbound = 0;
 	}
 	switch_safe_free(sql);
+
+	fifo_wake_node_thread();
 }
 
 #define FIFO_MEMBER_API_SYNTAX "[add <fifo_name> <originate_string> [<simo_count>] [<timeout>] [<lag>] [<expires>] [<taking_calls>] | del <fifo_name> <originate_string>]"
@@ -4544,12 +5122,17 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_fifo_load)
 	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, globals.pool);
 	switch_mutex_init(&globals.sql_mutex, SWITCH_MUTEX_NESTED, globals.pool);
 
+	switch_core_hash_init(&globals.outbound_hash, globals.pool);
+	switch_core_hash_init(&globals.outbound_heap_hash, globals.pool);
+	switch_mutex_init(&globals.outbound_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+
 	globals.running = 1;
 
 	if ((status = load_config(0, 1)) != SWITCH_STATUS_SUCCESS) {
 		switch_event_unbind(&globals.node);
 		switch_event_free_subclass(FIFO_EVENT);
 		switch_core_hash_destroy(&globals.fifo_hash);
+		outbound_member_destroy();
 		return status;
 	}
 
@@ -4624,6 +5207,7 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_fifo_shutdown)
 	}
 
 	switch_core_hash_destroy(&globals.fifo_hash);
+	outbound_member_destroy();
 	memset(&globals, 0, sizeof(globals));
 	switch_mutex_unlock(mutex);
 
@@ -0,0 +1,479 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2012, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ *
+ *
+ * mod_event_shm.c -- Shared Memory Event Bus
+ *
+ * Events are serialized with switch_event_binary_serialize() and appended to
+ * a ring inside a memory mapped file.  There is one writer (this module) and
+ * any number of local readers, each keeping its own cursor; a reader that
+ * falls behind by more than the ring size loses the oldest events instead of
+ * slowing the switch down.  libs/esl/src/esl_shm.c is the reader side and
+ * must agree with the layout below.
+ *
+ */
+#include <switch.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+SWITCH_MODULE_LOAD_FUNCTION(mod_event_shm_load);
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_shm_shutdown);
+SWITCH_MODULE_DEFINITION(mod_event_shm, mod_event_shm_load, mod_event_shm_shutdown, NULL);
+
+#define EVENT_SHM_MAGIC "FSEVSHM1"
+#define EVENT_SHM_VERSION 1
+#define EVENT_SHM_HEADER_SIZE 4096
+#define EVENT_SHM_ALIGN 16
+
+#if defined(__GNUC__)
+#define event_shm_barrier() __sync_synchronize()
+#else
+#error "mod_event_shm needs a memory barrier for this compiler"
+#endif
+
+/* lives at offset 0 of the file, the ring starts at header_size */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t data_size;
+	/* byte positions only ever grow, the offset in the ring is pos % data_size */
+	volatile uint64_t head;
+	volatile uint64_t tail;
+	volatile uint64_t seq;
+	volatile uint64_t dropped;
+	/* bumped every time the ring is reset so readers can resync */
+	volatile uint64_t epoch;
+	volatile uint32_t state;
+	uint32_t pid;
+	int64_t created;
+} event_shm_header_t;
+
+/* every record starts on a 16 byte boundary; len 0 marks padding up to the end of the ring */
+typedef struct {
+	uint32_t size;
+	uint32_t len;
+	uint64_t seq;
+} event_shm_record_t;
+
+#define EVENT_SHM_STATE_CLOSED 0
+#define EVENT_SHM_STATE_RUNNING 1
+
+static struct {
+	char *path;
+	char *bindings;
+	uint32_t size_mb;
+	int file_mode;
+	int fd;
+	switch_size_t map_len;
+	event_shm_header_t *header;
+	unsigned char *ring;
+	switch_mutex_t *mutex;
+	int running;
+	uint64_t bytes;
+	uint64_t overwritten;
+} globals;
+
+SWITCH_DECLARE_GLOBAL_STRING_FUNC(set_global_path, globals.path);
+SWITCH_DECLARE_GLOBAL_STRING_FUNC(set_global_bindings, globals.bindings);
+
+static switch_status_t load_config(void)
+{
+	char *cf = "event_shm.conf";
+	switch_xml_t cfg, xml, settings, param;
+
+	globals.size_mb = 32;
+	globals.file_mode = 0600;
+
+	if (!(xml = switch_xml_open_cfg(cf, &cfg, NULL))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Open of %s failed, using defaults\n", cf);
+	} else {
+		if ((settings = switch_xml_child(cfg, "settings"))) {
+			for (param = switch_xml_child(settings, "param"); param; param = param->next) {
+				char *var = (char *) switch_xml_attr_soft(param, "name");
+				char *val = (char *) switch_xml_attr_soft(param, "value");
+
+				if (!strcasecmp(var, "path")) {
+					set_global_path(val);
+				} else if (!strcasecmp(var, "bindings")) {
+					set_global_bindings(val);
+				} else if (!strcasecmp(var, "size-mb")) {
+					int size = atoi(val);
+					if (size > 0 && size <= 4096) {
+						globals.size_mb = (uint32_t) size;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Invalid size-mb '%s', using %u\n", val, globals.size_mb);
+					}
+				} else if (!strcasecmp(var, "file-mode")) {
+					globals.file_mode = (int) strtol(val, NULL, 8) & 0666;
+				}
+			}
+		}
+
+		switch_xml_free(xml);
+	}
+
+	if (zstr(globals.path)) {
+		char *path;
+
+		if (switch_directory_exists("/dev/shm", NULL) == SWITCH_STATUS_SUCCESS) {
+			path = strdup("/dev/shm/freeswitch.events");
+		} else {
+			path = switch_mprintf("%s%sfreeswitch.events", SWITCH_GLOBAL_dirs.run_dir, SWITCH_PATH_SEPARATOR);
+		}
+		switch_safe_free(globals.path);
+		globals.path = path;
+	}
+
+	if (zstr(globals.bindings)) {
+		set_global_bindings("all");
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t ring_open(void)
+{
+	switch_size_t data_size = (switch_size_t) globals.size_mb * 1024 * 1024;
+	switch_size_t map_len = EVENT_SHM_HEADER_SIZE + data_size;
+	uint64_t epoch = 0;
+	struct stat st;
+	void *map;
+	int fd;
+
+	/* the path usually sits in a world writable directory, don't follow a link or write into someone else's file */
+	if ((fd = open(globals.path, O_RDWR | O_CREAT | O_NOFOLLOW, globals.file_mode)) < 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't open %s: %s\n", globals.path, strerror(errno));
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Refusing %s, it is not a regular file owned by this user\n", globals.path);
+		close(fd);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* a leftover ring of another size may still be mapped by readers, never shrink it under them */
+	if (st.st_size && (switch_size_t) st.st_size != map_len) {
+		event_shm_header_t old;
+
+		if (read(fd, &old, sizeof(old)) == sizeof(old) && !memcmp(old.magic, EVENT_SHM_MAGIC, 8)) {
+			old.state = EVENT_SHM_STATE_CLOSED;
+			if (pwrite(fd, &old, sizeof(old), 0) != sizeof(old)) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Can't close old ring %s\n", globals.path);
+			}
+			epoch = old.epoch;
+		}
+
+		close(fd);
+		unlink(globals.path);
+
+		if ((fd = open(globals.path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, globals.file_mode)) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't create %s: %s\n", globals.path, strerror(errno));
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	/* open() applies the umask, the mode is part of the config so set it for real */
+	fchmod(fd, globals.file_mode);
+
+	if (ftruncate(fd, map_len)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't size %s: %s\n", globals.path, strerror(errno));
+		close(fd);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if ((map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't map %s: %s\n", globals.path, strerror(errno));
+		close(fd);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	globals.fd = fd;
+	globals.map_len = map_len;
+	globals.header = (event_shm_header_t *) map;
+	globals.ring = (unsigned char *) map + EVENT_SHM_HEADER_SIZE;
+
+	if (!memcmp(globals.header->magic, EVENT_SHM_MAGIC, 8) && globals.header->epoch > epoch) {
+		epoch = globals.header->epoch;
+	}
+
+	/* readers still attached to this file see the epoch change and start over at the new tail */
+	globals.header->state = EVENT_SHM_STATE_CLOSED;
+	event_shm_barrier();
+
+	globals.header->version = EVENT_SHM_VERSION;
+	globals.header->header_size = EVENT_SHM_HEADER_SIZE;
+	globals.header->data_size = data_size;
+	globals.header->head = globals.header->tail = 0;
+	globals.header->seq = 0;
+	globals.header->dropped = 0;
+	globals.header->pid = (uint32_t) getpid();
+	globals.header->created = (int64_t) switch_epoch_time_now(NULL);
+	memcpy(globals.header->magic, EVENT_SHM_MAGIC, 8);
+	globals.header->epoch = epoch + 1;
+	event_shm_barrier();
+	globals.header->state = EVENT_SHM_STATE_RUNNING;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void ring_close(void)
+{
+	if (!globals.header) {
+		return;
+	}
+
+	globals.header->state = EVENT_SHM_STATE_CLOSED;
+	event_shm_barrier();
+
+	munmap((void *) globals.header, globals.map_len);
+	close(globals.fd);
+	globals.header = NULL;
+	globals.ring = NULL;
+}
+
+/* make room for len bytes at head by retiring the oldest records, then tell the readers before anything is overwritten */
+static void ring_reserve(uint64_t len)
+{
+	event_shm_header_t *hp = globals.header;
+	uint64_t tail = hp->tail;
+
+	if (hp->head + len - tail <= hp->data_size) {
+		return;
+	}
+
+	while (hp->head + len - tail > hp->data_size) {
+		event_shm_record_t *rec = (event_shm_record_t *) (globals.ring + (tail % hp->data_size));
+
+		if (rec->len) {
+			globals.overwritten++;
+		}
+		tail += rec->size;
+	}
+
+	hp->tail = tail;
+	event_shm_barrier();
+}
+
+static void ring_write(const void *data, uint32_t len)
+{
+	event_shm_header_t *hp = globals.header;
+	uint64_t size = (sizeof(event_shm_record_t) + len + EVENT_SHM_ALIGN - 1) & ~((uint64_t) EVENT_SHM_ALIGN - 1);
+	uint64_t off = hp->head % hp->data_size;
+	uint64_t advance = size;
+	event_shm_record_t *rec;
+
+	if (size > hp->data_size / 2) {
+		hp->dropped++;
+		return;
+	}
+
+	if (off + size > hp->data_size) {
+		/* records never wrap, pad out the end of the ring and start over at 0 */
+		uint64_t pad = hp->data_size - off;
+
+		ring_reserve(pad + size);
+		rec = (event_shm_record_t *) (globals.ring + off);
+		rec->size = (uint32_t) pad;
+		rec->len = 0;
+		rec->seq = 0;
+		off = 0;
+		advance += pad;
+	} else {
+		ring_reserve(size);
+	}
+
+	rec = (event_shm_record_t *) (globals.ring + off);
+	rec->size = (uint32_t) size;
+	rec->len = len;
+	rec->seq = hp->seq + 1;
+	memcpy(rec + 1, data, len);
+
+	event_shm_barrier();
+	hp->seq++;
+	hp->head += advance;
+	globals.bytes += len;
+}
+
+static void event_handler(switch_event_t *event)
+{
+	void *data = NULL;
+	switch_size_t len = 0;
+
+	if (!globals.running) {
+		return;
+	}
+
+	if (switch_event_binary_serialize(event, &data, &len) != SWITCH_STATUS_SUCCESS || !data) {
+		return;
+	}
+
+	switch_mutex_lock(globals.mutex);
+	if (globals.header) {
+		ring_write(data, (uint32_t) len);
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	free(data);
+}
+
+static switch_status_t bind_events(const char *modname)
+{
+	char *bindings = strdup(globals.bindings);
+	char *cur, *next;
+	int custom = 0, count = 0;
+
+	for (cur = bindings; cur; cur = next) {
+		switch_event_types_t type;
+
+		if ((next = strchr(cur, ' '))) {
+			*next++ = '\0';
+		}
+
+		if (zstr(cur)) {
+			continue;
+		}
+
+		if (custom) {
+			if (switch_event_bind(modname, SWITCH_EVENT_CUSTOM, cur, event_handler, NULL) == SWITCH_STATUS_SUCCESS) {
+				count++;
+			}
+		} else if (switch_name_event(cur, &type) == SWITCH_STATUS_SUCCESS) {
+			if (type == SWITCH_EVENT_CUSTOM) {
+				custom++;
+			} else if (switch_event_bind(modname, type, SWITCH_EVENT_SUBCLASS_ANY, event_handler, NULL) == SWITCH_STATUS_SUCCESS) {
+				count++;
+			}
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Unknown event binding '%s'\n", cur);
+		}
+	}
+
+	free(bindings);
+
+	if (!count) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "No Bindings\n");
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_STANDARD_API(event_shm_status_function)
+{
+	event_shm_header_t *hp;
+
+	switch_mutex_lock(globals.mutex);
+
+	if (!(hp = globals.header)) {
+		stream->write_function(stream, "-ERR ring not open\n");
+	} else {
+		uint64_t used = hp->head - hp->tail;
+
+		stream->write_function(stream, "path: %s\n", globals.path);
+		stream->write_function(stream, "epoch: %" SWITCH_UINT64_T_FMT "\n", (uint64_t) hp->epoch);
+		stream->write_function(stream, "size: %" SWITCH_UINT64_T_FMT "\n", (uint64_t) hp->data_size);
+		stream->write_function(stream, "used: %" SWITCH_UINT64_T_FMT " (%d%%)\n", used, (int) (used * 100 / hp->data_size));
+		stream->write_function(stream, "events: %" SWITCH_UINT64_T_FMT "\n", (uint64_t) hp->seq);
+		stream->write_function(stream, "event-bytes: %" SWITCH_UINT64_T_FMT "\n", globals.bytes);
+		stream->write_function(stream, "overwritten: %" SWITCH_UINT64_T_FMT "\n", globals.overwritten);
+		stream->write_function(stream, "dropped: %" SWITCH_UINT64_T_FMT "\n", (uint64_t) hp->dropped);
+	}
+
+	switch_mutex_unlock(globals.mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_MODULE_LOAD_FUNCTION(mod_event_shm_load)
+{
+	switch_api_interface_t *api_interface;
+
+	memset(&globals, 0, sizeof(globals));
+	globals.fd = -1;
+
+	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, pool);
+
+	load_config();
+
+	if (ring_open() != SWITCH_STATUS_SUCCESS) {
+		switch_safe_free(globals.path);
+		switch_safe_free(globals.bindings);
+		return SWITCH_STATUS_GENERR;
+	}
+
+	if (bind_events(modname) != SWITCH_STATUS_SUCCESS) {
+		switch_event_unbind_callback(event_handler);
+		ring_close();
+		switch_safe_free(globals.path);
+		switch_safe_free(globals.bindings);
+		return SWITCH_STATUS_GENERR;
+	}
+
+	globals.running = 1;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Publishing events to %s (%u MB)\n", globals.path, globals.size_mb);
+
+	/* connect my internal structure to the blank pointer passed to me */
+	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
+
+	SWITCH_ADD_API(api_interface, "event_shm_status", "Show shared memory event bus status", event_shm_status_function, "");
+
+	/* indicate that the module should continue to be loaded */
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_shm_shutdown)
+{
+	globals.running = 0;
+	switch_event_unbind_callback(event_handler);
+
+	switch_mutex_lock(globals.mutex);
+	ring_close();
+	switch_mutex_unlock(globals.mutex);
+
+	switch_safe_free(globals.path);
+	switch_safe_free(globals.bindings);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:t
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4 noet:
+ */
@@ -30,9 +30,15 @@
  *
  */
 #include <switch.h>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
 #define CMD_BUFLEN 1024 * 1000
 #define MAX_QUEUE_LEN 25000
 #define MAX_MISSED 500
+#define MAX_OUT_IOV 128
+#define MAX_OUT_EVENTS 1000
+#define SLOW_CONSUMER_EVENT "event_socket::slow_consumer"
 SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_socket_shutdown);
 SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime);
@@ -66,6 +72,24 @@ typedef enum {
 	EVENT_FORMAT_JSON
 } event_format_t;
 
+/* a piece of serialized output waiting to be written */
+typedef struct listener_chunk {
+	char *data;
+	switch_size_t len;
+	int owned;
+	struct listener_chunk *next;
+} listener_chunk_t;
+
+/* one filter line, compiled when the filter set changes instead of on every event */
+typedef struct listener_filter {
+	char *name;
+	unsigned long hash;
+	char *value;
+	int pos;
+	int regex;
+	switch_regex_t *re;
+} listener_filter_t;
+
 struct listener {
 	switch_socket_t *sock;
 	switch_queue_t *event_queue;
@@ -97,6 +121,30 @@ struct listener {
 	time_t linger_timeout;
 	struct listener *next;
 	switch_pollfd_t *pollfd;
+	switch_mutex_t *send_mutex;
+	int api_inflight;
+	/* signalled under flag_mutex whenever a queued api job finishes */
+	switch_thread_cond_t *api_cond;
+	listener_filter_t *filter_rules;
+	int filter_count;
+	int indexed;
+	/* the hashed index buckets the listener is filed in, so taking it out needs no search */
+	struct listener_bucket *session_bucket;
+	struct listener_bucket **subclass_buckets;
+	int subclass_bucket_count;
+	int subclass_bucket_alloc;
+	listener_chunk_t *out_head;
+	listener_chunk_t *out_tail;
+	switch_size_t out_offset;
+	switch_size_t out_bytes;
+	int out_congested;
+	int drop_notified;
+	uint64_t stat_events;
+	uint64_t stat_bytes;
+	uint64_t stat_writes;
+	uint64_t stat_dropped;
+	uint64_t stat_congested;
+	switch_size_t stat_peak;
 };
 
 typedef struct listener listener_t;
@@ -114,6 +162,22 @@ static struct {
 	uint8_t ready;
 } listen_list;
 
+/* listeners by what they subscribed to, so an event only visits the listeners that want it */
+typedef struct listener_bucket {
+	char *key;
+	listener_t **listeners;
+	int count;
+	int alloc;
+} listener_bucket_t;
+
+static struct {
+	listener_bucket_t types[SWITCH_EVENT_ALL + 1];
+	switch_hash_t *subclasses;
+	switch_hash_t *sessions;
+	int session_count;
+	int stateful;
+} listen_index;
+
 #define MAX_ACL 100
 
 static struct {
@@ -127,8 +191,24 @@ static struct {
 	uint32_t acl_count;
 	uint32_t id;
 	int nat_map;
+	int api_workers;
+	int api_queue_size;
+	int api_max_inflight;
+	switch_size_t out_high;
+	switch_size_t out_low;
 } prefs;
 
+#define MAX_API_WORKERS 64
+
+/* Worker threads for api commands sent with a Request-ID header, bgapi keeps a thread per job */
+static struct {
+	switch_memory_pool_t *pool;
+	switch_queue_t *queue;
+	switch_thread_t *threads[MAX_API_WORKERS];
+	int count;
+	int running;
+} api_pool;
+
 
 static const char *format2str(event_format_t format)
 {
@@ -147,6 +227,7 @@ static const char *format2str(event_format_t format)
 static void remove_listener(listener_t *listener);
 static void kill_listener(listener_t *l, const char *message);
 static void kill_all_listeners(void);
+static void api_pool_stop(void);
 
 static uint32_t next_id(void)
 {
@@ -191,6 +272,520 @@ static switch_status_t socket_logger(const switch_log_node_t *node, switch_log_l
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static void listener_out_append(listener_t *listener, char *data, switch_size_t len, int owned)
+{
+	listener_chunk_t *chunk;
+
+	switch_zmalloc(chunk, sizeof(*chunk));
+	chunk->data = data;
+	chunk->len = len;
+	chunk->owned = owned;
+
+	if (listener->out_tail) {
+		listener->out_tail->next = chunk;
+	} else {
+		listener->out_head = chunk;
+	}
+	listener->out_tail = chunk;
+
+	listener->out_bytes += len;
+	if (listener->out_bytes > listener->stat_peak) {
+		listener->stat_peak = listener->out_bytes;
+	}
+}
+
+static void listener_out_consume(listener_t *listener, switch_size_t bytes)
+{
+	listener->out_bytes -= bytes;
+
+	while (bytes && listener->out_head) {
+		listener_chunk_t *chunk = listener->out_head;
+		switch_size_t left = chunk->len - listener->out_offset;
+
+		if (bytes < left) {
+			listener->out_offset += bytes;
+			break;
+		}
+
+		bytes -= left;
+		listener->out_offset = 0;
+
+		if (!(listener->out_head = chunk->next)) {
+			listener->out_tail = NULL;
+		}
+
+		if (chunk->owned) {
+			free(chunk->data);
+		}
+		free(chunk);
+	}
+}
+
+static void listener_out_free(listener_t *listener)
+{
+	listener_out_consume(listener, listener->out_bytes);
+	listener->out_head = listener->out_tail = NULL;
+	listener->out_offset = 0;
+	listener->out_bytes = 0;
+}
+
+/*
+  Write as much pending output as possible with one gather write per MAX_OUT_IOV chunks.  Without block it returns
+  SWITCH_STATUS_BREAK as soon as the socket would block, with block it waits until everything is out so a direct write
+  can follow without splitting a frame.  Call with send_mutex held.
+*/
+static switch_status_t listener_flush_output(listener_t *listener, switch_bool_t block)
+{
+	switch_os_socket_t fd = 0;
+	int to_count = 0;
+
+	if (!listener->out_head) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!listener->sock || switch_os_sock_get(&fd, listener->sock) != SWITCH_STATUS_SUCCESS) {
+		listener_out_free(listener);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	while (listener->out_head) {
+		listener_chunk_t *chunk;
+		int n = 0, again = 0;
+#ifdef WIN32
+		WSABUF iov[MAX_OUT_IOV];
+		DWORD sent = 0;
+		long wrote = -1;
+
+		for (chunk = listener->out_head; chunk && n < MAX_OUT_IOV; chunk = chunk->next, n++) {
+			iov[n].buf = chunk->data + (n ? 0 : listener->out_offset);
+			iov[n].len = (ULONG) (chunk->len - (n ? 0 : listener->out_offset));
+		}
+
+		if (WSASend(fd, iov, n, &sent, 0, NULL, NULL) == 0) {
+			wrote = (long) sent;
+		} else {
+			again = WSAGetLastError() == WSAEWOULDBLOCK;
+		}
+#else
+		struct iovec iov[MAX_OUT_IOV];
+		ssize_t wrote;
+
+		for (chunk = listener->out_head; chunk && n < MAX_OUT_IOV; chunk = chunk->next, n++) {
+			iov[n].iov_base = chunk->data + (n ? 0 : listener->out_offset);
+			iov[n].iov_len = chunk->len - (n ? 0 : listener->out_offset);
+		}
+
+		if ((wrote = writev(fd, iov, n)) < 0) {
+			again = (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+		}
+#endif
+
+		if (wrote > 0) {
+			listener->stat_writes++;
+			listener->stat_bytes += wrote;
+			listener_out_consume(listener, (switch_size_t) wrote);
+			to_count = 0;
+			continue;
+		}
+
+		if (!again) {
+			listener_out_free(listener);
+			return SWITCH_STATUS_FALSE;
+		}
+
+		if (!block) {
+			return SWITCH_STATUS_BREAK;
+		}
+
+		/* same patience as switch_socket_send() */
+		if (++to_count > 60000) {
+			listener_out_free(listener);
+			return SWITCH_STATUS_FALSE;
+		}
+
+		switch_yield(10000);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void fire_slow_consumer(listener_t *listener, const char *state)
+{
+	switch_event_t *event;
+
+	if (switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, SLOW_CONSUMER_EVENT) != SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Slow-Consumer-State", state);
+	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Remote-IP", listener->remote_ip);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Remote-Port", "%d", (int) listener->remote_port);
+	if (listener->session) {
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Controlled-Session-UUID", switch_core_session_get_uuid(listener->session));
+	}
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Output-Buffer-Bytes", "%" SWITCH_SIZE_T_FMT, listener->out_bytes);
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Event-Queue-Size", "%u", switch_queue_size(listener->event_queue));
+	switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Events-Dropped", "%" SWITCH_UINT64_T_FMT, listener->stat_dropped);
+	switch_event_fire(&event);
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(listener->session), SWITCH_LOG_WARNING, "Listener %s:%d is %s, %" SWITCH_SIZE_T_FMT
+					  " bytes buffered, %u events queued\n", listener->remote_ip, (int) listener->remote_port, state, listener->out_bytes,
+					  switch_queue_size(listener->event_queue));
+}
+
+/* runs on the listener thread, events from here never wait on a listener */
+static void listener_check_watermarks(listener_t *listener)
+{
+	if (!listener->out_congested && listener->out_bytes >= prefs.out_high) {
+		listener->out_congested = 1;
+		listener->stat_congested++;
+		fire_slow_consumer(listener, "congested");
+	} else if (listener->out_congested && listener->out_bytes <= prefs.out_low) {
+		listener->out_congested = 0;
+		fire_slow_consumer(listener, "recovered");
+	}
+
+	if (listener->lost_events && !listener->drop_notified) {
+		listener->drop_notified = 1;
+		fire_slow_consumer(listener, "dropping");
+	} else if (!listener->lost_events && listener->drop_notified) {
+		listener->drop_notified = 0;
+	}
+}
+
+static void listener_free_filters(listener_t *listener)
+{
+	int i;
+
+	for (i = 0; i < listener->filter_count; i++) {
+		switch_safe_free(listener->filter_rules[i].name);
+		switch_safe_free(listener->filter_rules[i].value);
+		switch_regex_safe_free(listener->filter_rules[i].re);
+	}
+
+	switch_safe_free(listener->filter_rules);
+	listener->filter_count = 0;
+}
+
+/* call with filter_mutex held whenever listener->filters changes */
+static void listener_compile_filters(listener_t *listener)
+{
+	switch_event_header_t *hp;
+	int count = 0;
+
+	listener_free_filters(listener);
+
+	if (!listener->filters) {
+		return;
+	}
+
+	for (hp = listener->filters->headers; hp; hp = hp->next) {
+		count++;
+	}
+
+	if (!count) {
+		return;
+	}
+
+	switch_zmalloc(listener->filter_rules, count * sizeof(listener_filter_t));
+
+	for (hp = listener->filters->headers; hp; hp = hp->next) {
+		listener_filter_t *filter = &listener->filter_rules[listener->filter_count++];
+		const char *comp_to = hp->value;
+		switch_ssize_t hlen = -1;
+		int pos = 1;
+
+		while (comp_to && *comp_to) {
+			if (*comp_to == '+') {
+				pos = 1;
+			} else if (*comp_to == '-') {
+				pos = 0;
+			} else if (*comp_to != ' ') {
+				break;
+			}
+			comp_to++;
+		}
+
+		filter->name = strdup(hp->name);
+		filter->hash = switch_ci_hashfunc_default(hp->name, &hlen);
+		filter->value = strdup(switch_str_nil(comp_to));
+		filter->pos = pos;
+
+		if (*hp->value == '/') {
+			filter->regex = 1;
+			filter->re = switch_regex_compile_expression(filter->value);
+		}
+	}
+}
+
+static const char *filter_header_value(switch_event_t *event, listener_filter_t *filter)
+{
+	switch_event_header_t *hp;
+
+	for (hp = event->headers; hp; hp = hp->next) {
+		if ((!hp->hash || filter->hash == hp->hash) && !strcasecmp(hp->name, filter->name)) {
+			return hp->value;
+		}
+	}
+
+	if (!strcmp(filter->name, "_body")) {
+		return event->body;
+	}
+
+	return NULL;
+}
+
+static int listener_filter_match(listener_t *l, switch_event_t *event)
+{
+	int send = 0, i;
+
+	for (i = 0; i < l->filter_count; i++) {
+		listener_filter_t *filter = &l->filter_rules[i];
+		const char *hval;
+		int cmp = 0;
+
+		if (send && filter->pos) {
+			continue;
+		}
+
+		if (!(hval = filter_header_value(event, filter))) {
+			continue;
+		}
+
+		if (filter->regex) {
+			int ovector[30];
+			cmp = !!switch_regex_exec(filter->re, hval, ovector, sizeof(ovector) / sizeof(ovector[0]));
+		} else {
+			cmp = !strcasecmp(hval, filter->value);
+		}
+
+		if (cmp) {
+			if (filter->pos) {
+				send = 1;
+			} else {
+				send = 0;
+				break;
+			}
+		}
+	}
+
+	return send;
+}
+
+static void bucket_add(listener_bucket_t *bucket, listener_t *listener)
+{
+	if (bucket->count == bucket->alloc) {
+		listener_t **tmp;
+
+		bucket->alloc = bucket->alloc ? bucket->alloc * 2 : 8;
+		tmp = realloc(bucket->listeners, bucket->alloc * sizeof(listener_t *));
+		switch_assert(tmp);
+		bucket->listeners = tmp;
+	}
+
+	bucket->listeners[bucket->count++] = listener;
+}
+
+static void bucket_remove(listener_bucket_t *bucket, listener_t *listener)
+{
+	int i;
+
+	for (i = 0; i < bucket->count; i++) {
+		if (bucket->listeners[i] == listener) {
+			bucket->listeners[i] = bucket->listeners[--bucket->count];
+			break;
+		}
+	}
+}
+
+static listener_bucket_t *index_hash_add(switch_hash_t *hash, const char *key, listener_t *listener)
+{
+	listener_bucket_t *bucket;
+
+	if (!(bucket = switch_core_hash_find(hash, key))) {
+		switch_zmalloc(bucket, sizeof(*bucket));
+		bucket->key = strdup(key);
+		switch_core_hash_insert(hash, key, bucket);
+	}
+
+	bucket_add(bucket, listener);
+
+	return bucket;
+}
+
+static void index_bucket_free(listener_bucket_t *bucket)
+{
+	switch_safe_free(bucket->key);
+	switch_safe_free(bucket->listeners);
+	free(bucket);
+}
+
+/* a bucket stays around while any listener is in it, so the one a listener remembers is still valid here */
+static void index_hash_remove(switch_hash_t *hash, listener_bucket_t *bucket, listener_t *listener)
+{
+	bucket_remove(bucket, listener);
+
+	if (!bucket->count) {
+		switch_core_hash_delete(hash, bucket->key);
+		index_bucket_free(bucket);
+	}
+}
+
+/* the index helpers below expect globals.listener_mutex to be held */
+static void listener_index_remove(listener_t *listener)
+{
+	int x;
+
+	for (x = 0; x <= SWITCH_EVENT_ALL; x++) {
+		bucket_remove(&listen_index.types[x], listener);
+	}
+
+	for (x = 0; x < listener->subclass_bucket_count; x++) {
+		index_hash_remove(listen_index.subclasses, listener->subclass_buckets[x], listener);
+	}
+	listener->subclass_bucket_count = 0;
+
+	if (listener->session_bucket) {
+		index_hash_remove(listen_index.sessions, listener->session_bucket, listener);
+		listener->session_bucket = NULL;
+		listen_index.session_count--;
+	}
+}
+
+static void listener_index_add(listener_t *listener)
+{
+	int x;
+
+	if (switch_test_flag(listener, LFLAG_MYEVENTS) && listener->session) {
+		/* only events about its own session can get through, so file it under the uuid */
+		listener->session_bucket = index_hash_add(listen_index.sessions, switch_core_session_get_uuid(listener->session), listener);
+		listen_index.session_count++;
+		return;
+	}
+
+	if (listener->event_list[SWITCH_EVENT_ALL]) {
+		bucket_add(&listen_index.types[SWITCH_EVENT_ALL], listener);
+		return;
+	}
+
+	for (x = 0; x < SWITCH_EVENT_ALL; x++) {
+		if (listener->event_list[x]) {
+			bucket_add(&listen_index.types[x], listener);
+		}
+	}
+
+	if (listener->event_list[SWITCH_EVENT_CUSTOM] && listener->event_hash) {
+		switch_hash_index_t *hi;
+		const void *var;
+
+		for (hi = switch_core_hash_first(listener->event_hash); hi; hi = switch_core_hash_next(hi)) {
+			switch_core_hash_this(hi, &var, NULL, NULL);
+
+			if (listener->subclass_bucket_count == listener->subclass_bucket_alloc) {
+				listener_bucket_t **tmp;
+
+				listener->subclass_bucket_alloc = listener->subclass_bucket_alloc ? listener->subclass_bucket_alloc * 2 : 4;
+				tmp = realloc(listener->subclass_buckets, listener->subclass_bucket_alloc * sizeof(listener_bucket_t *));
+				switch_assert(tmp);
+				listener->subclass_buckets = tmp;
+			}
+
+			listener->subclass_buckets[listener->subclass_bucket_count++] = index_hash_add(listen_index.subclasses, (const char *) var, listener);
+		}
+	}
+}
+
+/* a session changed its uuid, move whoever listens to its events over to the new one before the CHANNEL_UUID event goes out */
+static void listener_index_rename(const char *old_uuid, const char *new_uuid)
+{
+	listener_bucket_t *bucket, *to;
+	int i;
+
+	if (zstr(old_uuid) || zstr(new_uuid) || !(bucket = switch_core_hash_find(listen_index.sessions, old_uuid))) {
+		return;
+	}
+
+	switch_core_hash_delete(listen_index.sessions, bucket->key);
+
+	if ((to = switch_core_hash_find(listen_index.sessions, new_uuid))) {
+		for (i = 0; i < bucket->count; i++) {
+			bucket_add(to, bucket->listeners[i]);
+			bucket->listeners[i]->session_bucket = to;
+		}
+		index_bucket_free(bucket);
+	} else {
+		switch_safe_free(bucket->key);
+		bucket->key = strdup(new_uuid);
+		switch_core_hash_insert(listen_index.sessions, bucket->key, bucket);
+	}
+}
+
+/* refile a listener after its subscriptions changed */
+static void listener_index_update(listener_t *listener)
+{
+	switch_mutex_lock(globals.listener_mutex);
+	if (listener->indexed) {
+		listener_index_remove(listener);
+		listener_index_add(listener);
+	}
+	switch_mutex_unlock(globals.listener_mutex);
+}
+
+static void listener_unindex(listener_t *listener)
+{
+	switch_mutex_lock(globals.listener_mutex);
+	if (listener->indexed) {
+		listener_index_remove(listener);
+		if (switch_test_flag(listener, LFLAG_STATEFUL)) {
+			listen_index.stateful--;
+		}
+		listener->indexed = 0;
+		switch_safe_free(listener->subclass_buckets);
+		listener->subclass_bucket_alloc = 0;
+	}
+	switch_mutex_unlock(globals.listener_mutex);
+}
+
+static void listen_index_destroy(void)
+{
+	int x;
+
+	for (x = 0; x <= SWITCH_EVENT_ALL; x++) {
+		switch_safe_free(listen_index.types[x].listeners);
+		listen_index.types[x].count = listen_index.types[x].alloc = 0;
+	}
+
+	while (listen_index.subclasses && switch_core_hash_first(listen_index.subclasses)) {
+		switch_hash_index_t *hi = switch_core_hash_first(listen_index.subclasses);
+		void *val;
+		listener_bucket_t *bucket;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		bucket = (listener_bucket_t *) val;
+		switch_core_hash_delete(listen_index.subclasses, bucket->key);
+		index_bucket_free(bucket);
+	}
+
+	while (listen_index.sessions && switch_core_hash_first(listen_index.sessions)) {
+		switch_hash_index_t *hi = switch_core_hash_first(listen_index.sessions);
+		void *val;
+		listener_bucket_t *bucket;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		bucket = (listener_bucket_t *) val;
+		switch_core_hash_delete(listen_index.sessions, bucket->key);
+		index_bucket_free(bucket);
+	}
+
+	if (listen_index.subclasses) {
+		switch_core_hash_destroy(&listen_index.subclasses);
+	}
+
+	if (listen_index.sessions) {
+		switch_core_hash_destroy(&listen_index.sessions);
+	}
+}
+
 static void flush_listener(listener_t *listener, switch_bool_t flush_log, switch_bool_t flush_events)
 {
 	void *pop;
@@ -232,6 +827,8 @@ static switch_status_t expire_listener(listener_t ** listener)
 
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Stateful Listener %u has expired\n", l->id);
 
+	listener_unindex(l);
+
 	flush_listener(*listener, SWITCH_TRUE, SWITCH_TRUE);
 	switch_core_hash_destroy(&l->event_hash);
 
@@ -248,6 +845,7 @@ static switch_status_t expire_listener(listener_t ** listener)
 	if (l->filters) {
 		switch_event_destroy(&l->filters);
 	}
+	listener_free_filters(l);
 
 	switch_mutex_unlock(l->filter_mutex);
 	switch_thread_rwlock_unlock(l->rwlock);
@@ -257,135 +855,133 @@ static switch_status_t expire_listener(listener_t ** listener)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-static void event_handler(switch_event_t *event)
+static switch_bool_t listener_wants(listener_t *l, switch_event_t *event)
 {
-	switch_event_t *clone = NULL;
-	listener_t *l, *lp, *last = NULL;
-	time_t now = switch_epoch_time_now(NULL);
-
-	switch_assert(event != NULL);
+	if (l->event_list[SWITCH_EVENT_ALL]) {
+		return SWITCH_TRUE;
+	}
 
-	if (!listen_list.ready) {
-		return;
+	if (l->event_list[event->event_id]) {
+		if (event->event_id != SWITCH_EVENT_CUSTOM || !event->subclass_name || (switch_core_hash_find(l->event_hash, event->subclass_name))) {
+			return SWITCH_TRUE;
+		}
 	}
 
-	lp = listen_list.listeners;
+	return SWITCH_FALSE;
+}
 
-	switch_mutex_lock(globals.listener_mutex);
-	while (lp) {
-		int send = 0;
+static void event_dispatch(listener_t *l, switch_event_t *event)
+{
+	switch_event_t *clone = NULL;
+	int send = 1;
 
-		l = lp;
-		lp = lp->next;
+	if (l->expire_time || !switch_test_flag(l, LFLAG_EVENTS)) {
+		return;
+	}
 
-		if (switch_test_flag(l, LFLAG_STATEFUL) && (l->expire_time || (l->timeout && now - l->last_flush > l->timeout))) {
-			if (expire_listener(&l) == SWITCH_STATUS_SUCCESS) {
-				if (last) {
-					last->next = lp;
-				} else {
-					listen_list.listeners = lp;
-				}
-				continue;
-			}
-		}
+	switch_mutex_lock(l->filter_mutex);
+	if (l->filter_count) {
+		send = listener_filter_match(l, event);
+	}
+	switch_mutex_unlock(l->filter_mutex);
 
-		if (l->expire_time || !switch_test_flag(l, LFLAG_EVENTS)) {
-			last = l;
-			continue;
+	if (send && switch_test_flag(l, LFLAG_MYEVENTS)) {
+		char *uuid = switch_event_get_header(event, "unique-id");
+		if (!uuid || (l->session && strcmp(uuid, switch_core_session_get_uuid(l->session)))) {
+			send = 0;
 		}
+	}
 
-		if (l->event_list[SWITCH_EVENT_ALL]) {
-			send = 1;
-		} else if ((l->event_list[event->event_id])) {
-			if (event->event_id != SWITCH_EVENT_CUSTOM || !event->subclass_name || (switch_core_hash_find(l->event_hash, event->subclass_name))) {
-				send = 1;
+	if (send) {
+		if (switch_event_dup(&clone, event) == SWITCH_STATUS_SUCCESS) {
+			if (switch_queue_trypush(l->event_queue, clone) == SWITCH_STATUS_SUCCESS) {
+				if (l->lost_events) {
+					int le = l->lost_events;
+					l->lost_events = 0;
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Lost %d events!\n", le);
+				}
+			} else {
+				l->stat_dropped++;
+				if (++l->lost_events > MAX_MISSED) {
+					kill_listener(l, NULL);
+				}
+				switch_event_destroy(&clone);
 			}
+		} else {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_ERROR, "Memory Error!\n");
 		}
+	}
+}
 
-		if (send) {
-			switch_mutex_lock(l->filter_mutex);
+static void event_handler(switch_event_t *event)
+{
+	listener_t *l, *lp, *last = NULL;
+	listener_bucket_t *bucket;
+	time_t now = switch_epoch_time_now(NULL);
+	int i;
 
-			if (l->filters && l->filters->headers) {
-				switch_event_header_t *hp;
-				const char *hval;
+	switch_assert(event != NULL);
 
-				send = 0;
-				
-				for (hp = l->filters->headers; hp; hp = hp->next) {
-					if ((hval = switch_event_get_header(event, hp->name))) {
-						const char *comp_to = hp->value;
-						int pos = 1, cmp = 0;
-
-						while (comp_to && *comp_to) {
-							if (*comp_to == '+') {
-								pos = 1;
-							} else if (*comp_to == '-') {
-								pos = 0;
-							} else if (*comp_to != ' ') {
-								break;
-							}
-							comp_to++;
-						}
+	if (!listen_list.ready) {
+		return;
+	}
 
-						if (send && pos) {
-							continue;
-						}
+	switch_mutex_lock(globals.listener_mutex);
 
-						if (!comp_to) {
-							continue;
-						}
+	/* only event_sink listeners expire, skip the walk when there are none */
+	if (listen_index.stateful) {
+		lp = listen_list.listeners;
 
-						if (*hp->value == '/') {
-							switch_regex_t *re = NULL;
-							int ovector[30];
-							cmp = !!switch_regex_perform(hval, comp_to, &re, ovector, sizeof(ovector) / sizeof(ovector[0]));
-							switch_regex_safe_free(re);
-						} else {
-							cmp = !strcasecmp(hval, comp_to);
-						}
+		while (lp) {
+			l = lp;
+			lp = lp->next;
 
-						if (cmp) {
-							if (pos) {
-								send = 1;
-							} else {
-								send = 0;
-								break;
-							}
-						}
+			if (switch_test_flag(l, LFLAG_STATEFUL) && (l->expire_time || (l->timeout && now - l->last_flush > l->timeout))) {
+				if (expire_listener(&l) == SWITCH_STATUS_SUCCESS) {
+					if (last) {
+						last->next = lp;
+					} else {
+						listen_list.listeners = lp;
 					}
+					continue;
 				}
 			}
 
-			switch_mutex_unlock(l->filter_mutex);
+			last = l;
 		}
+	}
 
-		if (send && switch_test_flag(l, LFLAG_MYEVENTS)) {
-			char *uuid = switch_event_get_header(event, "unique-id");
-			if (!uuid || (l->session && strcmp(uuid, switch_core_session_get_uuid(l->session)))) {
-				send = 0;
-			}
+	bucket = &listen_index.types[SWITCH_EVENT_ALL];
+	for (i = 0; i < bucket->count; i++) {
+		event_dispatch(bucket->listeners[i], event);
+	}
+
+	if (event->event_id == SWITCH_EVENT_CUSTOM && event->subclass_name) {
+		bucket = switch_core_hash_find(listen_index.subclasses, event->subclass_name);
+	} else {
+		bucket = &listen_index.types[event->event_id];
+	}
+
+	for (i = 0; bucket && i < bucket->count; i++) {
+		event_dispatch(bucket->listeners[i], event);
+	}
+
+	if (listen_index.session_count) {
+		const char *uuid = switch_event_get_header(event, "unique-id");
+
+		if (event->event_id == SWITCH_EVENT_CHANNEL_UUID) {
+			listener_index_rename(switch_event_get_header(event, "old-unique-id"), uuid);
 		}
 
-		if (send) {
-			if (switch_event_dup(&clone, event) == SWITCH_STATUS_SUCCESS) {
-				if (switch_queue_trypush(l->event_queue, clone) == SWITCH_STATUS_SUCCESS) {
-					if (l->lost_events) {
-						int le = l->lost_events;
-						l->lost_events = 0;
-						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_CRIT, "Lost %d events!\n", le);
-					}
-				} else {
-					if (++l->lost_events > MAX_MISSED) {
-						kill_listener(l, NULL);
-					}
-					switch_event_destroy(&clone);
+		if (uuid && (bucket = switch_core_hash_find(listen_index.sessions, uuid))) {
+			for (i = 0; i < bucket->count; i++) {
+				if (listener_wants(bucket->listeners[i], event)) {
+					event_dispatch(bucket->listeners[i], event);
 				}
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(l->session), SWITCH_LOG_ERROR, "Memory Error!\n");
 			}
 		}
-		last = l;
 	}
+
 	switch_mutex_unlock(globals.listener_mutex);
 }
 
@@ -469,7 +1065,9 @@ SWITCH_STANDARD_APP(socket_function)
 	switch_socket_create_pollset(&listener->pollfd, listener->sock, SWITCH_POLLIN | SWITCH_POLLERR, listener->pool);
 
 	switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+	switch_thread_cond_create(&listener->api_cond, listener->pool);
 	switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+	switch_mutex_init(&listener->send_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 
 	switch_core_hash_init(&listener->event_hash, listener->pool);
 	switch_set_flag(listener, LFLAG_AUTHED);
@@ -544,6 +1142,13 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_event_socket_shutdown)
 	}
 
 	switch_event_unbind(&globals.node);
+	switch_event_free_subclass(SLOW_CONSUMER_EVENT);
+
+	api_pool_stop();
+
+	switch_mutex_lock(globals.listener_mutex);
+	listen_index_destroy();
+	switch_mutex_unlock(globals.listener_mutex);
 
 	switch_safe_free(prefs.ip);
 	switch_safe_free(prefs.password);
@@ -557,6 +1162,11 @@ static void add_listener(listener_t *listener)
 	switch_mutex_lock(globals.listener_mutex);
 	listener->next = listen_list.listeners;
 	listen_list.listeners = listener;
+	listener->indexed = 1;
+	if (switch_test_flag(listener, LFLAG_STATEFUL)) {
+		listen_index.stateful++;
+	}
+	listener_index_add(listener);
 	switch_mutex_unlock(globals.listener_mutex);
 }
 
@@ -565,6 +1175,7 @@ static void remove_listener(listener_t *listener)
 	listener_t *l, *last = NULL;
 
 	switch_mutex_lock(globals.listener_mutex);
+	listener_unindex(listener);
 	for (l = listen_list.listeners; l; l = l->next) {
 		if (l == listener) {
 			if (last) {
@@ -600,12 +1211,15 @@ static void send_disconnect(listener_t *listener, const char *message)
 
 	if (!listener->sock) return;
 
+	switch_mutex_lock(listener->send_mutex);
+	listener_flush_output(listener, SWITCH_TRUE);
 	len = strlen(disco_buf);
 	switch_socket_send(listener->sock, disco_buf, &len);
 	if (len > 0) {
 		len = mlen;
 		switch_socket_send(listener->sock, message, &len);
 	}
+	switch_mutex_unlock(listener->send_mutex);
 }
 
 static void kill_listener(listener_t *l, const char *message)
@@ -670,6 +1284,37 @@ static void xmlize_listener(listener_t *listener, switch_stream_handle_t *stream
 	stream->write_function(stream, " </listener>\n");
 }
 
+SWITCH_STANDARD_API(event_socket_status_function)
+{
+	listener_t *l;
+
+	stream->write_function(stream, "%-22s %-36s %10s %12s %10s %8s %10s %10s %10s %s\n",
+						   "remote", "session", "events", "bytes", "writes", "dropped", "buffered", "peak", "queued", "state");
+
+	switch_mutex_lock(globals.listener_mutex);
+	for (l = listen_list.listeners; l; l = l->next) {
+		char remote[80];
+
+		if (switch_test_flag(l, LFLAG_STATEFUL)) {
+			switch_snprintf(remote, sizeof(remote), "event_sink:%u", l->id);
+		} else {
+			switch_snprintf(remote, sizeof(remote), "%s:%d", l->remote_ip, (int) l->remote_port);
+		}
+
+		stream->write_function(stream, "%-22s %-36s %10" SWITCH_UINT64_T_FMT " %12" SWITCH_UINT64_T_FMT " %10" SWITCH_UINT64_T_FMT
+							   " %8" SWITCH_UINT64_T_FMT " %10" SWITCH_SIZE_T_FMT " %10" SWITCH_SIZE_T_FMT " %10u %s\n",
+							   remote, l->session ? switch_core_session_get_uuid(l->session) : "-",
+							   l->stat_events, l->stat_bytes, l->stat_writes, l->stat_dropped, l->out_bytes, l->stat_peak,
+							   switch_queue_size(l->event_queue), l->out_congested ? "congested" : (l->lost_events ? "dropping" : "ok"));
+	}
+	switch_mutex_unlock(globals.listener_mutex);
+
+	stream->write_function(stream, "output-high-watermark: %" SWITCH_SIZE_T_FMT " output-low-watermark: %" SWITCH_SIZE_T_FMT "\n",
+						   prefs.out_high, prefs.out_low);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(event_sink_function)
 {
 	char *http = NULL;
@@ -754,6 +1399,7 @@ SWITCH_STANDARD_API(event_sink_function)
 
 	  filter_end:
 
+		listener_compile_filters(listener);
 		switch_mutex_unlock(listener->filter_mutex);
 
 	} else if (!strcasecmp(wcmd, "stop-logging")) {
@@ -826,7 +1472,9 @@ SWITCH_STANDARD_API(event_sink_function)
 		listener->pool = pool;
 		listener->format = EVENT_FORMAT_PLAIN;
 		switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+		switch_thread_cond_create(&listener->api_cond, listener->pool);
 		switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+		switch_mutex_init(&listener->send_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 
 
 		switch_core_hash_init(&listener->event_hash, listener->pool);
@@ -1073,8 +1721,18 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
 	memset(&listen_list, 0, sizeof(listen_list));
 	switch_mutex_init(&listen_list.sock_mutex, SWITCH_MUTEX_NESTED, pool);
 
+	memset(&listen_index, 0, sizeof(listen_index));
+	switch_core_hash_init(&listen_index.subclasses, pool);
+	switch_core_hash_init(&listen_index.sessions, pool);
+
+	if (switch_event_reserve_subclass(SLOW_CONSUMER_EVENT) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't register subclass %s!\n", SLOW_CONSUMER_EVENT);
+		return SWITCH_STATUS_TERM;
+	}
+
 	if (switch_event_bind_removable(modname, SWITCH_EVENT_ALL, SWITCH_EVENT_SUBCLASS_ANY, event_handler, NULL, &globals.node) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind!\n");
+		switch_event_free_subclass(SLOW_CONSUMER_EVENT);
 		return SWITCH_STATUS_GENERR;
 	}
 
@@ -1084,6 +1742,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 	SWITCH_ADD_APP(app_interface, "socket", "Connect to a socket", "Connect to a socket", socket_function, "<ip>[:<port>]", SAF_SUPPORT_NOMEDIA);
 	SWITCH_ADD_API(api_interface, "event_sink", "event_sink", event_sink_function, "<web data>");
+	SWITCH_ADD_API(api_interface, "event_socket_status", "Show event socket listener output statistics", event_socket_status_function, "");
 
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
@@ -1268,10 +1927,13 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 										strlen(dnode->data),
 										dnode->level, dnode->channel, dnode->file, dnode->func, dnode->line, switch_str_nil(dnode->userdata)
 							);
+						switch_mutex_lock(listener->send_mutex);
+						listener_flush_output(listener, SWITCH_TRUE);
 						len = strlen(buf);
 						switch_socket_send(listener->sock, buf, &len);
 						len = strlen(dnode->data);
 						switch_socket_send(listener->sock, dnode->data, &len);
+						switch_mutex_unlock(listener->send_mutex);
 					}
 
 					switch_log_node_free(&dnode);
@@ -1294,12 +1956,19 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 			}
 
 			if (switch_test_flag(listener, LFLAG_EVENTS)) {
-				while (switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
+				int batch = 0;
+
+				/* serialize into the output buffer until it reaches the high watermark, then write it all at once */
+				while (!listener->out_congested && listener->out_bytes < prefs.out_high && batch < MAX_OUT_EVENTS &&
+					   switch_queue_trypop(listener->event_queue, &pop) == SWITCH_STATUS_SUCCESS) {
 					char hbuf[512];
 					switch_event_t *pevent = (switch_event_t *) pop;
-					char *etype;
+					char *etype, *hdata;
+					switch_size_t hlen;
 
 					do_sleep = 0;
+					batch++;
+
 					if (listener->format == EVENT_FORMAT_PLAIN) {
 						etype = "plain";
 						switch_event_serialize(pevent, &listener->ebuf, SWITCH_TRUE);
@@ -1324,20 +1993,40 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 					len = strlen(listener->ebuf);
 
 					switch_snprintf(hbuf, sizeof(hbuf), "Content-Length: %" SWITCH_SSIZE_T_FMT "\n" "Content-Type: text/event-%s\n" "\n", len, etype);
+					hlen = strlen(hbuf);
+					switch_malloc(hdata, hlen);
+					memcpy(hdata, hbuf, hlen);
 
-					len = strlen(hbuf);
-					switch_socket_send(listener->sock, hbuf, &len);
+					switch_mutex_lock(listener->send_mutex);
+					listener_out_append(listener, hdata, hlen, 1);
+					listener_out_append(listener, listener->ebuf, len, 1);
+					listener->stat_events++;
+					switch_mutex_unlock(listener->send_mutex);
 
-					len = strlen(listener->ebuf);
-					switch_socket_send(listener->sock, listener->ebuf, &len);
-
-					switch_safe_free(listener->ebuf);
+					listener->ebuf = NULL;
 
 				  endloop:
 
 					switch_event_destroy(&pevent);
 				}
 			}
+
+			if (listener->out_head) {
+				switch_size_t before = listener->out_bytes;
+
+				switch_mutex_lock(listener->send_mutex);
+				if (listener_flush_output(listener, SWITCH_FALSE) == SWITCH_STATUS_FALSE) {
+					switch_mutex_unlock(listener->send_mutex);
+					switch_goto_status(SWITCH_STATUS_FALSE, end);
+				}
+				switch_mutex_unlock(listener->send_mutex);
+
+				if (listener->out_bytes < before) {
+					do_sleep = 0;
+				}
+			}
+
+			listener_check_watermarks(listener);
 		}
 
 		if (switch_test_flag(listener, LFLAG_HANDLE_DISCO) && 
@@ -1368,8 +2057,11 @@ static switch_status_t read_packet(listener_t *listener, switch_event_t **event,
 					listener->linger_timeout += switch_epoch_time_now(NULL);
 				}
 				
+				switch_mutex_lock(listener->send_mutex);
+				listener_flush_output(listener, SWITCH_TRUE);
 				len = strlen(disco_buf);
 				switch_socket_send(listener->sock, disco_buf, &len);
+				switch_mutex_unlock(listener->send_mutex);
 			} else {
 				status = SWITCH_STATUS_FALSE;
 				break;
@@ -1396,39 +2088,19 @@ struct api_command_struct {
 	char *arg;
 	listener_t *listener;
 	char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
+	char *request_id;
 	int bg;
 	int ack;
 	int console_execute;
 	switch_memory_pool_t *pool;
 };
 
-static void *SWITCH_THREAD_FUNC api_exec(switch_thread_t *thread, void *obj)
+static void api_command_run(struct api_command_struct *acs)
 {
-
-	struct api_command_struct *acs = (struct api_command_struct *) obj;
 	switch_stream_handle_t stream = { 0 };
 	char *reply, *freply = NULL;
 	switch_status_t status;
 
-	switch_mutex_lock(globals.listener_mutex);
-	prefs.threads++;
-	switch_mutex_unlock(globals.listener_mutex);
-
-
-	if (!acs) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Internal error.\n");
-		goto cleanup;
-	}
-
-	if (!acs->listener || !switch_test_flag(acs->listener, LFLAG_RUNNING) ||
-		!acs->listener->rwlock || switch_thread_rwlock_tryrdlock(acs->listener->rwlock) != SWITCH_STATUS_SUCCESS) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error! cannot get read lock.\n");
-		acs->ack = -1;
-		goto done;
-	}
-
-	acs->ack = 1;
-
 	SWITCH_STANDARD_STREAM(stream);
 
 	if (acs->console_execute) {
@@ -1471,14 +2143,51 @@ static void *SWITCH_THREAD_FUNC api_exec(switch_thread_t *thread, void *obj)
 			rlen = strlen(reply);
 		}
 
-		switch_snprintf(buf, sizeof(buf), "Content-Type: api/response\nContent-Length: %" SWITCH_SSIZE_T_FMT "\n\n", rlen);
+		if (acs->request_id) {
+			switch_snprintf(buf, sizeof(buf), "Content-Type: api/response\nRequest-ID: %s\nContent-Length: %" SWITCH_SSIZE_T_FMT "\n\n",
+							acs->request_id, rlen);
+		} else {
+			switch_snprintf(buf, sizeof(buf), "Content-Type: api/response\nContent-Length: %" SWITCH_SSIZE_T_FMT "\n\n", rlen);
+		}
 		blen = strlen(buf);
+
+		/* replies from the workers and the listener thread may be written at the same time */
+		switch_mutex_lock(acs->listener->send_mutex);
+		listener_flush_output(acs->listener, SWITCH_TRUE);
 		switch_socket_send(acs->listener->sock, buf, &blen);
 		switch_socket_send(acs->listener->sock, reply, &rlen);
+		switch_mutex_unlock(acs->listener->send_mutex);
 	}
 
 	switch_safe_free(stream.data);
 	switch_safe_free(freply);
+}
+
+static void *SWITCH_THREAD_FUNC api_exec(switch_thread_t *thread, void *obj)
+{
+
+	struct api_command_struct *acs = (struct api_command_struct *) obj;
+
+	switch_mutex_lock(globals.listener_mutex);
+	prefs.threads++;
+	switch_mutex_unlock(globals.listener_mutex);
+
+
+	if (!acs) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Internal error.\n");
+		goto cleanup;
+	}
+
+	if (!acs->listener || !switch_test_flag(acs->listener, LFLAG_RUNNING) ||
+		!acs->listener->rwlock || switch_thread_rwlock_tryrdlock(acs->listener->rwlock) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error! cannot get read lock.\n");
+		acs->ack = -1;
+		goto done;
+	}
+
+	acs->ack = 1;
+
+	api_command_run(acs);
 
 	if (acs->listener->rwlock) {
 		switch_thread_rwlock_unlock(acs->listener->rwlock);
@@ -1512,6 +2221,145 @@ static void *SWITCH_THREAD_FUNC api_exec(switch_thread_t *thread, void *obj)
 
 }
 
+/* Jobs for the worker pool are plain heap allocations so queueing one costs no more than a few mallocs */
+static struct api_command_struct *api_job_create(listener_t *listener, const char *api_cmd, const char *arg, const char *request_id)
+{
+	struct api_command_struct *acs;
+
+	switch_zmalloc(acs, sizeof(*acs));
+	acs->listener = listener;
+	acs->api_cmd = strdup(api_cmd);
+	acs->arg = arg ? strdup(arg) : NULL;
+	acs->request_id = request_id ? strdup(request_id) : NULL;
+
+	return acs;
+}
+
+static void api_job_destroy(struct api_command_struct **acs)
+{
+	switch_safe_free((*acs)->api_cmd);
+	switch_safe_free((*acs)->arg);
+	switch_safe_free((*acs)->request_id);
+	switch_safe_free(*acs);
+}
+
+/*
+  Hand a job to the workers.  A job holds a read lock on its listener until it is done so the listener cannot go away
+  under it, and each listener may only have api-max-inflight of those queued at once.  When the listener or the pool
+  is full this blocks the listener thread, which in turn stops reading from the client.
+*/
+static switch_status_t api_job_queue(listener_t *listener, struct api_command_struct *acs)
+{
+	if (switch_thread_rwlock_tryrdlock(listener->rwlock) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(listener->flag_mutex);
+	while (listener->api_inflight >= prefs.api_max_inflight) {
+		if (prefs.done || !switch_test_flag(listener, LFLAG_RUNNING)) {
+			switch_mutex_unlock(listener->flag_mutex);
+			switch_thread_rwlock_unlock(listener->rwlock);
+			return SWITCH_STATUS_FALSE;
+		}
+
+		/* every finished job signals, the timeout only notices the listener being torn down */
+		switch_thread_cond_timedwait(listener->api_cond, listener->flag_mutex, 100000);
+	}
+	listener->api_inflight++;
+	switch_mutex_unlock(listener->flag_mutex);
+
+	/* blocks while the queue is full, the workers keep draining it until every listener is gone */
+	if (prefs.done || !api_pool.running || switch_queue_push(api_pool.queue, acs) != SWITCH_STATUS_SUCCESS) {
+		switch_mutex_lock(listener->flag_mutex);
+		listener->api_inflight--;
+		switch_thread_cond_signal(listener->api_cond);
+		switch_mutex_unlock(listener->flag_mutex);
+		switch_thread_rwlock_unlock(listener->rwlock);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void *SWITCH_THREAD_FUNC api_worker_run(switch_thread_t *thread, void *obj)
+{
+	void *pop;
+
+	while (switch_queue_pop(api_pool.queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		struct api_command_struct *acs = (struct api_command_struct *) pop;
+		listener_t *listener = acs->listener;
+
+		if (!prefs.done && switch_test_flag(listener, LFLAG_RUNNING)) {
+			api_command_run(acs);
+		}
+
+		switch_mutex_lock(listener->flag_mutex);
+		listener->api_inflight--;
+		switch_thread_cond_signal(listener->api_cond);
+		switch_mutex_unlock(listener->flag_mutex);
+		switch_thread_rwlock_unlock(listener->rwlock);
+
+		api_job_destroy(&acs);
+	}
+
+	return NULL;
+}
+
+static void api_pool_start(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	int i;
+
+	if (prefs.api_workers <= 0) {
+		return;
+	}
+
+	if (prefs.api_workers > MAX_API_WORKERS) {
+		prefs.api_workers = MAX_API_WORKERS;
+	}
+
+	switch_core_new_memory_pool(&api_pool.pool);
+	switch_queue_create(&api_pool.queue, prefs.api_queue_size, api_pool.pool);
+
+	switch_threadattr_create(&thd_attr, api_pool.pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	for (i = 0; i < prefs.api_workers; i++) {
+		if (switch_thread_create(&api_pool.threads[i], thd_attr, api_worker_run, NULL, api_pool.pool) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+	}
+
+	api_pool.count = i;
+	api_pool.running = i > 0;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Started %d api worker threads, queue size %d\n", api_pool.count, prefs.api_queue_size);
+}
+
+static void api_pool_stop(void)
+{
+	switch_status_t st;
+	int i;
+
+	if (!api_pool.pool) {
+		return;
+	}
+
+	api_pool.running = 0;
+
+	/* one NULL per worker, queued behind whatever is still pending */
+	for (i = 0; i < api_pool.count; i++) {
+		switch_queue_push(api_pool.queue, NULL);
+	}
+
+	for (i = 0; i < api_pool.count; i++) {
+		switch_thread_join(&st, api_pool.threads[i]);
+	}
+
+	api_pool.count = 0;
+	switch_core_destroy_memory_pool(&api_pool.pool);
+}
+
 static switch_bool_t auth_api_command(listener_t *listener, const char *api_cmd, const char *arg)
 {
 	const char *check_cmd = api_cmd;
@@ -1572,6 +2420,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 	char *cmd = switch_event_get_header(*event, "command");
 	char unload_cheat[] = "api bgapi unload mod_event_socket";
 	char reload_cheat[] = "api bgapi reload mod_event_socket";
+	int reindex = 0;
 
 	*reply = '\0';
 
@@ -1847,6 +2696,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		} else {
 			switch_snprintf(reply, reply_len, "-ERR invalid syntax");
 		}
+		listener_compile_filters(listener);
 		switch_mutex_unlock(listener->filter_mutex);
 
 		goto done;
@@ -1886,7 +2736,10 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			switch_event_serialize(call_event, &event_str, SWITCH_TRUE);
 			switch_assert(event_str);
 			len = strlen(event_str);
+			switch_mutex_lock(listener->send_mutex);
+			listener_flush_output(listener, SWITCH_TRUE);
 			switch_socket_send(listener->sock, event_str, &len);
+			switch_mutex_unlock(listener->send_mutex);
 			switch_safe_free(event_str);
 			switch_event_destroy(&call_event);
 			//switch_snprintf(reply, reply_len, "+OK");
@@ -1907,6 +2760,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			switch_snprintf(reply, reply_len, "%s", val);
 			goto done;
 		} else if (!strncasecmp(cmd, "myevents", 8)) {
+			reindex = 1;
 			if (switch_test_flag(listener, LFLAG_MYEVENTS)) {
 				switch_snprintf(reply, reply_len, "-ERR aready enabled.");
 				goto done;
@@ -2140,6 +2994,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 	} else if (!strncasecmp(cmd, "api ", 4)) {
 		struct api_command_struct acs = { 0 };
 		char *console_execute = switch_event_get_header(*event, "console_execute");
+		char *request_id = switch_event_get_header(*event, "request-id");
 
 		char *api_cmd = cmd + 4;
 		char *arg = NULL;
@@ -2170,9 +3025,24 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			}
 		}
 		
+		if (!zstr(request_id) && api_pool.running) {
+			struct api_command_struct *job = api_job_create(listener, api_cmd, arg, request_id);
+
+			job->console_execute = acs.console_execute;
+
+			/* the reply is sent by a worker once the command has run, tagged with the same Request-ID */
+			if (api_job_queue(listener, job) == SWITCH_STATUS_SUCCESS) {
+				status = SWITCH_STATUS_SUCCESS;
+				goto done_noreply;
+			}
+
+			api_job_destroy(&job);
+		}
+
 		acs.listener = listener;
 		acs.api_cmd = api_cmd;
 		acs.arg = arg;
+		acs.request_id = zstr(request_id) ? NULL : request_id;
 		acs.bg = 0;
 
 
@@ -2311,6 +3181,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 			switch_snprintf(reply, reply_len, "-ERR not loging");
 		}
 	} else if (!strncasecmp(cmd, "event", 5)) {
+		reindex = 1;
 		char *next, *cur;
 		uint32_t count = 0, key_count = 0;
 		uint8_t custom = 0;
@@ -2386,6 +3257,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		switch_snprintf(reply, reply_len, "+OK event listener enabled %s", format2str(listener->format));
 
 	} else if (!strncasecmp(cmd, "nixevent", 8)) {
+		reindex = 1;
 		char *next, *cur;
 		uint32_t count = 0, key_count = 0;
 		uint8_t custom = 0;
@@ -2440,6 +3312,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		switch_snprintf(reply, reply_len, "+OK events nixed");
 
 	} else if (!strncasecmp(cmd, "noevents", 8)) {
+		reindex = 1;
 		flush_listener(listener, SWITCH_FALSE, SWITCH_TRUE);
 
 		if (switch_test_flag(listener, LFLAG_EVENTS)) {
@@ -2465,6 +3338,10 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 
   done_noreply:
 
+	if (reindex) {
+		listener_index_update(listener);
+	}
+
 	if (event) {
 		switch_event_destroy(event);
 	}
@@ -2581,7 +3458,10 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 					switch_snprintf(buf, sizeof(buf), "Content-Type: command/reply\nReply-Text: %s\n\n", reply);
 				}
 				len = strlen(buf);
+				switch_mutex_lock(listener->send_mutex);
+				listener_flush_output(listener, SWITCH_TRUE);
 				switch_socket_send(listener->sock, buf, &len);
+				switch_mutex_unlock(listener->send_mutex);
 			}
 			break;
 		}
@@ -2616,7 +3496,10 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 				switch_snprintf(buf, sizeof(buf), "Content-Type: command/reply\nReply-Text: %s\n\n", reply);
 			}
 			len = strlen(buf);
+			switch_mutex_lock(listener->send_mutex);
+			listener_flush_output(listener, SWITCH_TRUE);
 			switch_socket_send(listener->sock, buf, &len);
+			switch_mutex_unlock(listener->send_mutex);
 		}
 
 	}
@@ -2639,6 +3522,7 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 	if (listener->filters) {
 		switch_event_destroy(&listener->filters);
 	}
+	listener_free_filters(listener);
 	switch_mutex_unlock(listener->filter_mutex);
 
 	if (listener->session) {
@@ -2654,6 +3538,10 @@ static void *SWITCH_THREAD_FUNC listener_run(switch_thread_t *thread, void *obj)
 		close_socket(&listener->sock);
 	}
 
+	switch_mutex_lock(listener->send_mutex);
+	listener_out_free(listener);
+	switch_mutex_unlock(listener->send_mutex);
+
 	switch_thread_rwlock_unlock(listener->rwlock);
 
 	if (globals.debug > 0) {
@@ -2708,6 +3596,12 @@ static int config(void)
 
 	memset(&prefs, 0, sizeof(prefs));
 
+	prefs.api_workers = 8;
+	prefs.api_queue_size = 1024;
+	prefs.api_max_inflight = 256;
+	prefs.out_high = 2 * 1024 * 1024;
+	prefs.out_low = 512 * 1024;
+
 	if (!(xml = switch_xml_open_cfg(cf, &cfg, NULL))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Open of %s failed\n", cf);
 	} else {
@@ -2728,6 +3622,16 @@ static int config(void)
 					prefs.port = (uint16_t) atoi(val);
 				} else if (!strcmp(var, "password")) {
 					set_pref_pass(val);
+				} else if (!strcmp(var, "api-worker-threads")) {
+					prefs.api_workers = atoi(val);
+				} else if (!strcmp(var, "api-queue-size") && atoi(val) > 0) {
+					prefs.api_queue_size = atoi(val);
+				} else if (!strcmp(var, "api-max-inflight") && atoi(val) > 0) {
+					prefs.api_max_inflight = atoi(val);
+				} else if (!strcmp(var, "output-high-watermark") && atoi(val) > 0) {
+					prefs.out_high = (switch_size_t) atoi(val);
+				} else if (!strcmp(var, "output-low-watermark") && atoi(val) >= 0) {
+					prefs.out_low = (switch_size_t) atoi(val);
 				} else if (!strcasecmp(var, "apply-inbound-acl") && ! zstr(val)) {
 					if (prefs.acl_count < MAX_ACL) {
 						prefs.acl[prefs.acl_count++] = strdup(val);
@@ -2760,6 +3664,10 @@ static int config(void)
 		prefs.port = 8021;
 	}
 
+	if (prefs.out_low >= prefs.out_high) {
+		prefs.out_low = prefs.out_high / 2;
+	}
+
 	return 0;
 }
 
@@ -2780,6 +3688,7 @@ SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime)
 	}
 
 	config();
+	api_pool_start();
 
 	while (!prefs.done) {
 		rv = switch_sockaddr_info_get(&sa, prefs.ip, SWITCH_UNSPEC, prefs.port, 0, pool);
@@ -2859,7 +3768,9 @@ SWITCH_MODULE_RUNTIME_FUNCTION(mod_event_socket_runtime)
 		switch_set_flag(listener, LFLAG_ALLOW_LOG);
 
 		switch_mutex_init(&listener->flag_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+		switch_thread_cond_create(&listener->api_cond, listener->pool);
 		switch_mutex_init(&listener->filter_mutex, SWITCH_MUTEX_NESTED, listener->pool);
+		switch_mutex_init(&listener->send_mutex, SWITCH_MUTEX_NESTED, listener->pool);
 
 		switch_core_hash_init(&listener->event_hash, listener->pool);
 		switch_socket_create_pollset(&listener->pollfd, listener->sock, SWITCH_POLLIN | SWITCH_POLLERR, listener->pool);
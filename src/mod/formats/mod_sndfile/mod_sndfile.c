@@ -445,6 +445,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_sndfile_load)
 	file_interface = switch_loadable_module_create_interface(*module_interface, SWITCH_FILE_INTERFACE);
 	file_interface->interface_name = modname;
 	file_interface->extens = supported_formats;
+	file_interface->cacheable = SWITCH_TRUE;
 	file_interface->file_open = sndfile_file_open;
 	file_interface->file_close = sndfile_file_close;
 	file_interface->file_truncate = sndfile_file_truncate;
@@ -46,6 +46,19 @@ static struct {
 	switch_memory_pool_t *pool;
 	char *xml_handler;
 	switch_event_node_t *node;
+	switch_mutex_t *cache_mutex;
+	switch_hash_t *chunks;
+	int chunk_cache;
+	uint32_t chunk_hits;
+	uint32_t chunk_misses;
+	switch_mutex_t *pool_mutex;
+	lua_State **idle;
+	int idle_count;
+	int pool_size;
+	int pool_max_uses;
+	int pool_max_kb;
+	uint32_t pool_hits;
+	uint32_t pool_created;
 } globals;
 
 int luaopen_freeswitch(lua_State * L);
@@ -129,6 +142,338 @@ static lua_State *lua_init(void)
 	return L;
 }
 
+/* Compiled chunks of script files, keyed by path and checked against the file's mtime and size on every load, so a
+   script is only parsed again after it changes. */
+
+typedef struct lua_chunk {
+	time_t mtime;
+	off_t size;
+	char *code;
+	size_t len;
+} lua_chunk_t;
+
+typedef struct lua_dump_buffer {
+	char *data;
+	size_t len;
+	size_t alloc;
+} lua_dump_buffer_t;
+
+static int lua_chunk_writer(lua_State * L, const void *p, size_t sz, void *ud)
+{
+	lua_dump_buffer_t *buf = (lua_dump_buffer_t *) ud;
+
+	if (buf->len + sz > buf->alloc) {
+		size_t alloc = buf->alloc ? buf->alloc : 4096;
+		char *tmp;
+
+		while (alloc < buf->len + sz) {
+			alloc *= 2;
+		}
+
+		if (!(tmp = (char *) realloc(buf->data, alloc))) {
+			return 1;
+		}
+
+		buf->data = tmp;
+		buf->alloc = alloc;
+	}
+
+	memcpy(buf->data + buf->len, p, sz);
+	buf->len += sz;
+
+	return 0;
+}
+
+static void lua_chunk_free(lua_chunk_t *chunk)
+{
+	switch_safe_free(chunk->code);
+	free(chunk);
+}
+
+/* same as luaL_loadfile but served from the chunk cache while the file is unchanged */
+static int lua_load_file(lua_State * L, const char *file)
+{
+	struct stat st;
+	lua_chunk_t *chunk;
+	char *code = NULL;
+	size_t len = 0;
+	char *name;
+	int error;
+
+	if (!globals.chunk_cache || stat(file, &st)) {
+		return luaL_loadfile(L, file);
+	}
+
+	switch_mutex_lock(globals.cache_mutex);
+	if ((chunk = (lua_chunk_t *) switch_core_hash_find(globals.chunks, file)) && chunk->mtime == st.st_mtime && chunk->size == st.st_size) {
+		code = (char *) malloc(chunk->len);
+		switch_assert(code);
+		memcpy(code, chunk->code, chunk->len);
+		len = chunk->len;
+		globals.chunk_hits++;
+	}
+	switch_mutex_unlock(globals.cache_mutex);
+
+	if (code) {
+		/* the same chunk name luaL_loadfile uses so error messages do not change */
+		name = switch_mprintf("@%s", file);
+		error = luaL_loadbuffer(L, code, len, name);
+		free(name);
+		free(code);
+		return error;
+	}
+
+	if (!(error = luaL_loadfile(L, file))) {
+		lua_dump_buffer_t buf = { 0 };
+
+		if (!lua_dump(L, lua_chunk_writer, &buf) && buf.len) {
+			lua_chunk_t *old;
+
+			chunk = (lua_chunk_t *) calloc(1, sizeof(*chunk));
+			switch_assert(chunk);
+			chunk->mtime = st.st_mtime;
+			chunk->size = st.st_size;
+			chunk->code = buf.data;
+			chunk->len = buf.len;
+			buf.data = NULL;
+
+			switch_mutex_lock(globals.cache_mutex);
+			if ((old = (lua_chunk_t *) switch_core_hash_find(globals.chunks, file))) {
+				switch_core_hash_delete(globals.chunks, file);
+				lua_chunk_free(old);
+			}
+			switch_core_hash_insert(globals.chunks, file, chunk);
+			globals.chunk_misses++;
+			switch_mutex_unlock(globals.cache_mutex);
+		}
+
+		switch_safe_free(buf.data);
+	}
+
+	return error;
+}
+
+static void lua_chunk_flush(void)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+
+	switch_mutex_lock(globals.cache_mutex);
+	while ((hi = switch_core_hash_first(globals.chunks))) {
+		switch_core_hash_this(hi, &var, NULL, &val);
+		switch_core_hash_delete(globals.chunks, (const char *) var);
+		lua_chunk_free((lua_chunk_t *) val);
+	}
+	switch_mutex_unlock(globals.cache_mutex);
+}
+
+/* Pool of ready states for the short lived entry points (app, api, dialplan, xml handler, hooks and chat). A state
+   goes back after a clean run once its globals, loaded modules and the contents of every library table (string,
+   table, freeswitch and the rest) are put back as they were when it was made; one that failed, grew too big or was
+   used too often is closed instead. */
+
+#define LUA_POOL_GLOBALS "mod_lua_pool_globals"
+#define LUA_POOL_LOADED "mod_lua_pool_loaded"
+#define LUA_POOL_LIBS "mod_lua_pool_libs"
+#define LUA_POOL_USES "mod_lua_pool_uses"
+
+/* push a shallow copy of the table at idx */
+static void lua_copy_table(lua_State * L, int idx)
+{
+	lua_newtable(L);
+	lua_pushnil(L);
+	while (lua_next(L, idx) != 0) {
+		lua_pushvalue(L, -2);
+		lua_insert(L, -2);
+		lua_rawset(L, -4);
+	}
+}
+
+/* make the table at idx hold exactly what the table at snap holds */
+static void lua_restore_table(lua_State * L, int idx, int snap)
+{
+	int top = lua_gettop(L);
+
+	lua_pushnil(L);
+	while (lua_next(L, idx) != 0) {
+		lua_pop(L, 1);
+		lua_pushvalue(L, -1);
+		lua_rawget(L, snap);
+		if (lua_isnil(L, -1)) {
+			/* clearing a field that exists is allowed while traversing */
+			lua_pushvalue(L, -2);
+			lua_pushnil(L);
+			lua_rawset(L, idx);
+		}
+		lua_pop(L, 1);
+	}
+
+	lua_pushnil(L);
+	while (lua_next(L, snap) != 0) {
+		lua_pushvalue(L, -2);
+		lua_insert(L, -2);
+		lua_rawset(L, idx);
+	}
+
+	lua_settop(L, top);
+}
+
+/* add a copy of every table found in the table at from to the map at libs, keyed by the table itself */
+static void lua_snapshot_libs(lua_State * L, int libs, int from, int loaded)
+{
+	int val;
+
+	lua_pushnil(L);
+	while (lua_next(L, from) != 0) {
+		val = lua_gettop(L);
+		if (lua_istable(L, val) && !lua_rawequal(L, val, LUA_GLOBALSINDEX) && !lua_rawequal(L, val, loaded)) {
+			lua_pushvalue(L, val);
+			lua_copy_table(L, val);
+			lua_rawset(L, libs);
+		}
+		lua_settop(L, val - 1);
+	}
+}
+
+static void lua_snapshot(lua_State * L)
+{
+	int loaded, libs;
+
+	lua_copy_table(L, LUA_GLOBALSINDEX);
+	lua_setfield(L, LUA_REGISTRYINDEX, LUA_POOL_GLOBALS);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+	loaded = lua_gettop(L);
+	lua_copy_table(L, loaded);
+	lua_setfield(L, LUA_REGISTRYINDEX, LUA_POOL_LOADED);
+
+	lua_newtable(L);
+	libs = lua_gettop(L);
+	lua_snapshot_libs(L, libs, LUA_GLOBALSINDEX, loaded);
+	lua_snapshot_libs(L, libs, loaded, loaded);
+	lua_setfield(L, LUA_REGISTRYINDEX, LUA_POOL_LIBS);
+
+	lua_pop(L, 1);
+}
+
+static void lua_restore(lua_State * L)
+{
+	int libs;
+
+	lua_pushnil(L);
+	lua_setmetatable(L, LUA_GLOBALSINDEX);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, LUA_POOL_GLOBALS);
+	lua_restore_table(L, LUA_GLOBALSINDEX, lua_gettop(L));
+	lua_pop(L, 1);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+	lua_getfield(L, LUA_REGISTRYINDEX, LUA_POOL_LOADED);
+	lua_restore_table(L, lua_gettop(L) - 1, lua_gettop(L));
+	lua_pop(L, 2);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, LUA_POOL_LIBS);
+	libs = lua_gettop(L);
+	lua_pushnil(L);
+	while (lua_next(L, libs) != 0) {
+		lua_restore_table(L, lua_gettop(L) - 1, lua_gettop(L));
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+}
+
+static lua_State *lua_acquire(void)
+{
+	lua_State *L = NULL;
+
+	if (globals.pool_size) {
+		switch_mutex_lock(globals.pool_mutex);
+		if (globals.idle_count) {
+			L = globals.idle[--globals.idle_count];
+			globals.pool_hits++;
+		}
+		switch_mutex_unlock(globals.pool_mutex);
+
+		if (!L && (L = lua_init())) {
+			switch_mutex_lock(globals.pool_mutex);
+			globals.pool_created++;
+			switch_mutex_unlock(globals.pool_mutex);
+
+			lua_snapshot(L);
+			lua_pushinteger(L, 0);
+			lua_setfield(L, LUA_REGISTRYINDEX, LUA_POOL_USES);
+		}
+
+		return L;
+	}
+
+	return lua_init();
+}
+
+static void lua_release(lua_State * L, int error)
+{
+	int uses;
+
+	if (!L) {
+		return;
+	}
+
+	lua_getfield(L, LUA_REGISTRYINDEX, LUA_POOL_USES);
+	uses = lua_isnumber(L, -1) ? (int) lua_tointeger(L, -1) + 1 : -1;
+	lua_pop(L, 1);
+
+	if (error || uses < 0 || (globals.pool_max_uses && uses >= globals.pool_max_uses) || !globals.pool_size) {
+		lua_uninit(L);
+		return;
+	}
+
+	lua_settop(L, 0);
+	lua_restore(L);
+
+	lua_pushinteger(L, uses);
+	lua_setfield(L, LUA_REGISTRYINDEX, LUA_POOL_USES);
+
+	/* whatever the script left behind (session, event and stream objects included) is finalized now, not later */
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	if (globals.pool_max_kb && lua_gc(L, LUA_GCCOUNT, 0) > globals.pool_max_kb) {
+		lua_uninit(L);
+		return;
+	}
+
+	switch_mutex_lock(globals.pool_mutex);
+	if (globals.idle_count < globals.pool_size) {
+		globals.idle[globals.idle_count++] = L;
+		L = NULL;
+	}
+	switch_mutex_unlock(globals.pool_mutex);
+
+	if (L) {
+		lua_uninit(L);
+	}
+}
+
+static void lua_pool_flush(void)
+{
+	lua_State *L;
+
+	for (;;) {
+		L = NULL;
+		switch_mutex_lock(globals.pool_mutex);
+		if (globals.idle_count) {
+			L = globals.idle[--globals.idle_count];
+		}
+		switch_mutex_unlock(globals.pool_mutex);
+
+		if (!L) {
+			break;
+		}
+
+		lua_uninit(L);
+	}
+}
+
 
 static int lua_parse_and_execute(lua_State * L, char *input_code)
 {
@@ -189,7 +534,7 @@ static int lua_parse_and_execute(lua_State * L, char *input_code)
 				switch_assert(fdup);
 				file = fdup;
 			}
-			error = luaL_loadfile(L, file) || docall(L, 0, 0, 0);
+			error = lua_load_file(L, file) || docall(L, 0, 0, 0);
 			switch_safe_free(fdup);
 		}
 	}
@@ -235,7 +580,7 @@ static switch_xml_t lua_fetch(const char *section,
 	switch_xml_t xml = NULL;
 
 	if (!zstr(globals.xml_handler)) {
-		lua_State *L = lua_init();
+		lua_State *L = lua_acquire();
 		char *mycmd = strdup(globals.xml_handler);
 		const char *str;
 		int error;
@@ -264,6 +609,8 @@ static switch_xml_t lua_fetch(const char *section,
 
 		if((error = lua_parse_and_execute(L, mycmd))){
 		    switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "LUA script parse/execute error!\n");
+		    lua_release(L, error);
+		    free(mycmd);
 		    return NULL;
 		}
 
@@ -281,7 +628,7 @@ static switch_xml_t lua_fetch(const char *section,
 			}
 		}
 
-		lua_uninit(L);
+		lua_release(L, 0);
 		free(mycmd);
 	}
 
@@ -329,9 +676,24 @@ static switch_status_t do_config(void)
 					path_stream.write_function(&path_stream, ";");
 				}
 				path_stream.write_function(&path_stream, "%s", val);
+			} else if (!strcmp(var, "bytecode-cache")) {
+				globals.chunk_cache = switch_true(val);
+			} else if (!strcmp(var, "state-pool-size") && !zstr(val)) {
+				globals.pool_size = atoi(val);
+				if (globals.pool_size < 0) {
+					globals.pool_size = 0;
+				}
+			} else if (!strcmp(var, "state-pool-max-uses") && !zstr(val)) {
+				globals.pool_max_uses = atoi(val);
+			} else if (!strcmp(var, "state-pool-max-memory") && !zstr(val)) {
+				globals.pool_max_kb = atoi(val);
 			}
 		}
 
+		if (globals.pool_size) {
+			globals.idle = (lua_State **) switch_core_alloc(globals.pool, sizeof(lua_State *) * globals.pool_size);
+		}
+
 		for (hook = switch_xml_child(settings, "hook"); hook; hook = hook->next) {
 			char *event = (char *) switch_xml_attr_soft(hook, "event");
 			char *subclass = (char *) switch_xml_attr_soft(hook, "subclass");
@@ -436,8 +798,9 @@ int lua_thread(const char *text)
 
 static void lua_event_handler(switch_event_t *event)
 {
-	lua_State *L = lua_init();
+	lua_State *L = lua_acquire();
 	char *script = NULL;
+	int error;
 
 	if (event->bind_user_data) {
 		script = strdup((char *)event->bind_user_data);
@@ -445,29 +808,32 @@ static void lua_event_handler(switch_event_t *event)
 
 	mod_lua_conjure_event(L, event, "event", 1);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "lua event hook: execute '%s'\n", (char *)script);
-	lua_parse_and_execute(L, (char *)script);
-	lua_uninit(L);
+	error = lua_parse_and_execute(L, (char *)script);
+	lua_release(L, error);
 
 	switch_safe_free(script);
 }
 
 SWITCH_STANDARD_APP(lua_function)
 {
-	lua_State *L = lua_init();
+	lua_State *L;
 	char *mycmd;
+	int error;
 
 	if (zstr(data)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "no args specified!\n");
 		return;
 	}
 
+	L = lua_acquire();
+
 	mod_lua_conjure_session(L, session, "session", 1);
 
 	mycmd = strdup((char *) data);
 	switch_assert(mycmd);
 
-	lua_parse_and_execute(L, mycmd);
-	lua_uninit(L);
+	error = lua_parse_and_execute(L, mycmd);
+	lua_release(L, error);
 	free(mycmd);
 
 }
@@ -487,16 +853,17 @@ SWITCH_STANDARD_API(luarun_api_function)
 
 SWITCH_STANDARD_CHAT_APP(lua_chat_function)
 {
-	lua_State *L = lua_init();
+	lua_State *L = lua_acquire();
 	char *dup = NULL;
+	int error;
 
 	if (data) {
 		dup = strdup(data);
 	}
 
 	mod_lua_conjure_event(L, message, "message", 1);
-	lua_parse_and_execute(L, (char *)dup);
-	lua_uninit(L);
+	error = lua_parse_and_execute(L, (char *)dup);
+	lua_release(L, error);
 
 	switch_safe_free(dup);
 
@@ -507,13 +874,14 @@ SWITCH_STANDARD_CHAT_APP(lua_chat_function)
 SWITCH_STANDARD_API(lua_api_function)
 {
 
-	lua_State *L = lua_init();
+	lua_State *L;
 	char *mycmd;
 	int error;
 
 	if (zstr(cmd)) {
 		stream->write_function(stream, "");
 	} else {
+		L = lua_acquire();
 
 		mycmd = strdup(cmd);
 		switch_assert(mycmd);
@@ -539,18 +907,49 @@ SWITCH_STANDARD_API(lua_api_function)
 				stream->write_function(stream, "-ERR Cannot execute script\n");
 			}
 		}
-		lua_uninit(L);
+		lua_release(L, error);
 		free(mycmd);
 	}
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define LUA_CACHE_SYNTAX "[status|flush]"
+SWITCH_STANDARD_API(lua_cache_api_function)
+{
+	if (!zstr(cmd) && !strcasecmp(cmd, "flush")) {
+		lua_chunk_flush();
+		lua_pool_flush();
+		stream->write_function(stream, "+OK\n");
+	} else if (zstr(cmd) || !strcasecmp(cmd, "status")) {
+		switch_hash_index_t *hi;
+		int chunks = 0;
+
+		switch_mutex_lock(globals.cache_mutex);
+		for (hi = switch_core_hash_first(globals.chunks); hi; hi = switch_core_hash_next(hi)) {
+			chunks++;
+		}
+		stream->write_function(stream, "bytecode-cache: %s chunks: %d hits: %u misses: %u\n",
+							   globals.chunk_cache ? "on" : "off", chunks, globals.chunk_hits, globals.chunk_misses);
+		switch_mutex_unlock(globals.cache_mutex);
+
+		switch_mutex_lock(globals.pool_mutex);
+		stream->write_function(stream, "state-pool: size: %d idle: %d hits: %u created: %u\n",
+							   globals.pool_size, globals.idle_count, globals.pool_hits, globals.pool_created);
+		switch_mutex_unlock(globals.pool_mutex);
+	} else {
+		stream->write_function(stream, "-USAGE: %s\n", LUA_CACHE_SYNTAX);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_DIALPLAN(lua_dialplan_hunt)
 {
-	lua_State *L = lua_init();
+	lua_State *L = lua_acquire();
 	switch_caller_extension_t *extension = NULL;
 	switch_channel_t *channel = switch_core_session_get_channel(session);
 	char *cmd = NULL;
+	int error = 0;
 
 	if (!caller_profile) {
 		if (!(caller_profile = switch_channel_get_caller_profile(channel))) {
@@ -575,7 +974,7 @@ SWITCH_STANDARD_DIALPLAN(lua_dialplan_hunt)
 	switch_assert(cmd);
 
 	mod_lua_conjure_session(L, session, "session", 1);
-	lua_parse_and_execute(L, cmd);
+	error = lua_parse_and_execute(L, cmd);
 
 	/* expecting ACTIONS = { {"app1", "app_data1"}, { "app2" }, "app3" } -- each of three is valid */
 	lua_getfield(L, LUA_GLOBALSINDEX, "ACTIONS");
@@ -659,7 +1058,7 @@ SWITCH_STANDARD_DIALPLAN(lua_dialplan_hunt)
 
  done:
 	switch_safe_free(cmd);
-	lua_uninit(L);
+	lua_release(L, error);
 	return extension;
 }
 
@@ -675,6 +1074,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_lua_load)
 
 	SWITCH_ADD_API(api_interface, "luarun", "run a script", luarun_api_function, "<script>");
 	SWITCH_ADD_API(api_interface, "lua", "run a script as an api function", lua_api_function, "<script>");
+	SWITCH_ADD_API(api_interface, "lua_cache", "lua state pool and bytecode cache", lua_cache_api_function, LUA_CACHE_SYNTAX);
 	SWITCH_ADD_APP(app_interface, "lua", "Launch LUA ivr", "Run a lua ivr on a channel", lua_function, "<script>", 
 				   SAF_SUPPORT_NOMEDIA | SAF_ROUTING_EXEC | SAF_ZOMBIE_EXEC);
 	SWITCH_ADD_DIALPLAN(dp_interface, "LUA", lua_dialplan_hunt);
@@ -683,6 +1083,12 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_lua_load)
 
 
 	globals.pool = pool;
+	globals.chunk_cache = 1;
+	globals.pool_max_uses = 1000;
+	globals.pool_max_kb = 8192;
+	switch_mutex_init(&globals.cache_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&globals.pool_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&globals.chunks, pool);
 	do_config();
 
 	/* indicate that the module should continue to be loaded */
@@ -693,6 +1099,11 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_lua_shutdown)
 {
 	switch_event_unbind(&globals.node);
 
+	globals.pool_size = 0;
+	lua_pool_flush();
+	lua_chunk_flush();
+	switch_core_hash_destroy(&globals.chunks);
+
 	return SWITCH_STATUS_SUCCESS;
 }
 
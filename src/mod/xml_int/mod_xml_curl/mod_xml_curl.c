@@ -39,7 +39,14 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_curl_shutdown);
 SWITCH_MODULE_DEFINITION(mod_xml_curl, mod_xml_curl_load, mod_xml_curl_shutdown, NULL);
 
 
+#define XML_CURL_LATENCY_BUCKETS 11
+#define XML_CURL_DEFAULT_MAX_IDLE 8
+
+/* upper bound in ms of every latency bucket but the last one, which takes the rest */
+static const uint32_t latency_bucket_ms[XML_CURL_LATENCY_BUCKETS - 1] = { 1, 2, 5, 10, 20, 50, 100, 250, 500, 1000 };
+
 struct xml_binding {
+	char *name;
 	char *method;
 	char *url;
 	char *bindings;
@@ -59,6 +66,19 @@ struct xml_binding {
 	int use_dynamic_url;
 	int auth_scheme;
 	int timeout;
+	int keep_alive;
+	/* idle handles keep their connection, dns and tls session caches between fetches */
+	switch_mutex_t *mutex;
+	switch_CURL **idle;
+	uint32_t idle_count;
+	uint32_t max_idle;
+	uint64_t requests;
+	uint64_t errors;
+	uint64_t reused;
+	switch_time_t total_time;
+	switch_time_t max_time;
+	uint64_t latency[XML_CURL_LATENCY_BUCKETS];
+	struct xml_binding *next;
 };
 
 static int keep_files_around = 0;
@@ -68,9 +88,9 @@ typedef struct xml_binding xml_binding_t;
 #define XML_CURL_MAX_BYTES 1024 * 1024
 
 struct config_data {
-	char *name;
-	int fd;
+	char *data;
 	switch_size_t bytes;
+	switch_size_t alloc;
 	switch_size_t max_bytes;
 	int err;
 };
@@ -84,9 +104,33 @@ static struct {
 	switch_memory_pool_t *pool;
 	hash_node_t *hash_root;
 	hash_node_t *hash_tail;
+	xml_binding_t *bindings;
 } globals;
 
-#define XML_CURL_SYNTAX "[debug_on|debug_off]"
+static void xml_curl_status(switch_stream_handle_t *stream)
+{
+	xml_binding_t *binding;
+	int i;
+
+	for (binding = globals.bindings; binding; binding = binding->next) {
+		switch_mutex_lock(binding->mutex);
+		stream->write_function(stream, "binding %s [%s]\n", binding->name, binding->url);
+		stream->write_function(stream, "  requests %" SWITCH_UINT64_T_FMT " errors %" SWITCH_UINT64_T_FMT " reused %" SWITCH_UINT64_T_FMT
+							   " idle %u/%u avg %" SWITCH_TIME_T_FMT "us max %" SWITCH_TIME_T_FMT "us\n",
+							   binding->requests, binding->errors, binding->reused, binding->idle_count, binding->max_idle,
+							   binding->requests ? binding->total_time / (switch_time_t) binding->requests : 0, binding->max_time);
+		for (i = 0; i < XML_CURL_LATENCY_BUCKETS; i++) {
+			if (i < XML_CURL_LATENCY_BUCKETS - 1) {
+				stream->write_function(stream, "  < %4ums %" SWITCH_UINT64_T_FMT "\n", latency_bucket_ms[i], binding->latency[i]);
+			} else {
+				stream->write_function(stream, "  >=%4ums %" SWITCH_UINT64_T_FMT "\n", latency_bucket_ms[i - 1], binding->latency[i]);
+			}
+		}
+		switch_mutex_unlock(binding->mutex);
+	}
+}
+
+#define XML_CURL_SYNTAX "[debug_on|debug_off|status]"
 SWITCH_STANDARD_API(xml_curl_function)
 {
 	if (session) {
@@ -101,6 +145,9 @@ SWITCH_STANDARD_API(xml_curl_function)
 		keep_files_around = 1;
 	} else if (!strcasecmp(cmd, "debug_off")) {
 		keep_files_around = 0;
+	} else if (!strcasecmp(cmd, "status")) {
+		xml_curl_status(stream);
+		return SWITCH_STATUS_SUCCESS;
 	} else {
 		goto usage;
 	}
@@ -113,25 +160,90 @@ SWITCH_STANDARD_API(xml_curl_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-static size_t file_callback(void *ptr, size_t size, size_t nmemb, void *data)
+static size_t buffer_callback(void *ptr, size_t size, size_t nmemb, void *data)
 {
 	register unsigned int realsize = (unsigned int) (size * nmemb);
 	struct config_data *config_data = data;
-	int x;
-
-	config_data->bytes += realsize;
 
-	if (config_data->bytes > config_data->max_bytes) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Oversized file detected [%d bytes]\n", (int) config_data->bytes);
+	if (config_data->bytes + realsize > config_data->max_bytes) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Oversized file detected [%d bytes]\n", (int) (config_data->bytes + realsize));
 		config_data->err = 1;
 		return 0;
 	}
 
-	x = write(config_data->fd, ptr, realsize);
-	if (x != (int) realsize) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Short write! %d out of %d\n", x, realsize);
+	if (config_data->bytes + realsize + 1 > config_data->alloc) {
+		switch_size_t alloc = config_data->alloc ? config_data->alloc : 16384;
+		char *tmp;
+
+		while (alloc < config_data->bytes + realsize + 1) {
+			alloc *= 2;
+		}
+
+		if (!(tmp = realloc(config_data->data, alloc))) {
+			config_data->err = 1;
+			return 0;
+		}
+
+		config_data->data = tmp;
+		config_data->alloc = alloc;
+	}
+
+	memcpy(config_data->data + config_data->bytes, ptr, realsize);
+	config_data->bytes += realsize;
+	config_data->data[config_data->bytes] = '\0';
+
+	return realsize;
+}
+
+static switch_CURL *xml_curl_get_handle(xml_binding_t *binding)
+{
+	switch_CURL *curl_handle = NULL;
+
+	switch_mutex_lock(binding->mutex);
+	if (binding->idle_count) {
+		curl_handle = binding->idle[--binding->idle_count];
+		binding->reused++;
+	}
+	switch_mutex_unlock(binding->mutex);
+
+	if (!curl_handle) {
+		curl_handle = switch_curl_easy_init();
+	}
+
+	return curl_handle;
+}
+
+static void xml_curl_put_handle(xml_binding_t *binding, switch_CURL *curl_handle, switch_time_t took, int err)
+{
+	int i;
+
+	if (binding->keep_alive) {
+		/* drops the options but not the open connection */
+		curl_easy_reset(curl_handle);
+	}
+
+	switch_mutex_lock(binding->mutex);
+	if (binding->keep_alive && binding->idle_count < binding->max_idle) {
+		binding->idle[binding->idle_count++] = curl_handle;
+		curl_handle = NULL;
+	}
+
+	binding->requests++;
+	if (err) binding->errors++;
+	binding->total_time += took;
+	if (took > binding->max_time) binding->max_time = took;
+
+	for (i = 0; i < XML_CURL_LATENCY_BUCKETS - 1; i++) {
+		if (took < (switch_time_t) latency_bucket_ms[i] * 1000) {
+			break;
+		}
+	}
+	binding->latency[i]++;
+	switch_mutex_unlock(binding->mutex);
+
+	if (curl_handle) {
+		switch_curl_easy_cleanup(curl_handle);
 	}
-	return x;
 }
 
 
@@ -140,13 +252,10 @@ static size_t file_callback(void *ptr, size_t size, size_t nmemb, void *data)
 static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, const char *key_name, const char *key_value, switch_event_t *params,
 								  void *user_data)
 {
-	char filename[512] = "";
 	switch_CURL *curl_handle = NULL;
 	struct config_data config_data;
 	switch_xml_t xml = NULL;
 	char *data = NULL;
-	switch_uuid_t uuid;
-	char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
 	xml_binding_t *binding = (xml_binding_t *) user_data;
 	char *file_url;
 	switch_curl_slist_t *slist = NULL;
@@ -156,6 +265,7 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 	char basic_data[512];
 	char *uri = NULL;
 	char *dynamic_url = NULL;
+	switch_time_t started;
 
     strncpy(hostname, switch_core_get_switchname(), sizeof(hostname));
 
@@ -202,11 +312,8 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 		sprintf(uri, "%s%c%s", dynamic_url, strchr(dynamic_url, '?') != NULL ? '&' : '?', data);
 	}
 
-	switch_uuid_get(&uuid);
-	switch_uuid_format(uuid_str, &uuid);
-
-	switch_snprintf(filename, sizeof(filename), "%s%s%s.tmp.xml", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR, uuid_str);
-	curl_handle = switch_curl_easy_init();
+	started = switch_time_now();
+	curl_handle = xml_curl_get_handle(binding);
 	headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
 
 	if (!strncasecmp(binding->url, "https", 5)) {
@@ -216,10 +323,9 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 
 	memset(&config_data, 0, sizeof(config_data));
 
-	config_data.name = filename;
 	config_data.max_bytes = XML_CURL_MAX_BYTES;
 
-	if ((config_data.fd = open(filename, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
+	if (curl_handle) {
 		if (!zstr(binding->cred)) {
 			switch_curl_easy_setopt(curl_handle, CURLOPT_HTTPAUTH, binding->auth_scheme);
 			switch_curl_easy_setopt(curl_handle, CURLOPT_USERPWD, binding->cred);
@@ -233,7 +339,7 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 		if (!binding->use_get_style)
 			switch_curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, data);
 		switch_curl_easy_setopt(curl_handle, CURLOPT_URL, binding->use_get_style ? uri : dynamic_url);
-		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, file_callback);
+		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, buffer_callback);
 		switch_curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *) &config_data);
 		switch_curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "freeswitch-xml/1.0");
 
@@ -288,14 +394,20 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 			curl_easy_setopt(curl_handle, CURLOPT_INTERFACE, binding->bind_local);
 		}
 
+		if (!binding->keep_alive) {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_FORBID_REUSE, 1);
+		}
+#if LIBCURL_VERSION_NUM >= 0x071900
+		else {
+			switch_curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1);
+		}
+#endif
+
 		switch_curl_easy_perform(curl_handle);
 		switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
-		switch_curl_easy_cleanup(curl_handle);
-		switch_curl_slist_free_all(headers);
-		switch_curl_slist_free_all(slist);
-		close(config_data.fd);
 	} else {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening temp file!\n");
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error creating curl handle!\n");
+		config_data.err = 1;
 	}
 
 	if (config_data.err) {
@@ -303,8 +415,31 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 		xml = NULL;
 	} else {
 		if (httpRes == 200) {
-			if (!(xml = switch_xml_parse_file(filename))) {
+			/* Debug by leaving a copy of the response behind for review */
+			if (keep_files_around && config_data.data) {
+				char filename[512] = "";
+				switch_uuid_t uuid;
+				char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
+				int fd;
+
+				switch_uuid_get(&uuid);
+				switch_uuid_format(uuid_str, &uuid);
+				switch_snprintf(filename, sizeof(filename), "%s%s%s.tmp.xml", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR, uuid_str);
+
+				if ((fd = open(filename, O_CREAT | O_RDWR | O_TRUNC, S_IRUSR | S_IWUSR)) > -1) {
+					if (write(fd, config_data.data, config_data.bytes) != (int) config_data.bytes) {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Short write to %s\n", filename);
+					}
+					close(fd);
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "XML response is in %s\n", filename);
+				}
+			}
+
+			/* the parsed tree takes over the buffer and frees it with the xml */
+			if (!config_data.data || !(xml = switch_xml_parse_str_dynamic(config_data.data, SWITCH_FALSE))) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Parsing Result! [%s]\ndata: [%s]\n", binding->url, data);
+			} else {
+				config_data.data = NULL;
 			}
 		} else {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Received HTTP error %ld trying to fetch %s\ndata: [%s]\n", httpRes, binding->url,
@@ -313,14 +448,12 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 		}
 	}
 
-	/* Debug by leaving the file behind for review */
-	if (keep_files_around) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "XML response is in %s\n", filename);
-	} else {
-		if (unlink(filename) != 0) {
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "XML response file [%s] delete failed\n", filename);
-		}
+	if (curl_handle) {
+		xml_curl_put_handle(binding, curl_handle, switch_time_now() - started, !xml);
 	}
+	switch_curl_slist_free_all(headers);
+	switch_curl_slist_free_all(slist);
+	switch_safe_free(config_data.data);
 
 	switch_safe_free(data);
 	if (binding->use_get_style == 1)
@@ -369,6 +502,8 @@ static switch_status_t do_config(void)
 		char *cookie_file = NULL;
 		hash_node_t *hash_node;
 		int auth_scheme = CURLAUTH_BASIC;
+		int keep_alive = 1;
+		uint32_t max_idle = XML_CURL_DEFAULT_MAX_IDLE;
 		need_vars_map = 0;
 		vars_map = NULL;
 
@@ -447,6 +582,13 @@ static switch_status_t do_config(void)
 				}
 			} else if (!strcasecmp(var, "bind-local")) {
 				bind_local = val;
+			} else if (!strcasecmp(var, "keep-alive")) {
+				keep_alive = switch_true(val);
+			} else if (!strcasecmp(var, "max-idle-connections")) {
+				int tmp = atoi(val);
+				if (tmp >= 0) {
+					max_idle = (uint32_t) tmp;
+				}
 			}
 		}
 
@@ -464,8 +606,15 @@ static switch_status_t do_config(void)
 		}
 		memset(binding, 0, sizeof(*binding));
 
+		binding->name = strdup(zstr(bname) ? "N/A" : bname);
 		binding->auth_scheme = auth_scheme;
 		binding->timeout = timeout;
+		binding->keep_alive = keep_alive && max_idle;
+		binding->max_idle = binding->keep_alive ? max_idle : 0;
+		if (binding->max_idle) {
+			switch_zmalloc(binding->idle, binding->max_idle * sizeof(*binding->idle));
+		}
+		switch_mutex_init(&binding->mutex, SWITCH_MUTEX_NESTED, globals.pool);
 		binding->url = strdup(url);
 		switch_assert(binding->url);
 
@@ -538,6 +687,8 @@ static switch_status_t do_config(void)
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Binding [%s] XML Fetch Function [%s] [%s]\n",
 						  zstr(bname) ? "N/A" : bname, binding->url, binding->bindings ? binding->bindings : "all");
 		switch_xml_bind_search_function(xml_url_fetch, switch_xml_parse_section_string(binding->bindings), binding);
+		binding->next = globals.bindings;
+		globals.bindings = binding;
 		x++;
 		binding = NULL;
 	}
@@ -567,6 +718,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_curl_load)
 	SWITCH_ADD_API(xml_curl_api_interface, "xml_curl", "XML Curl", xml_curl_function, XML_CURL_SYNTAX);
 	switch_console_set_complete("add xml_curl debug_on");
 	switch_console_set_complete("add xml_curl debug_off");
+	switch_console_set_complete("add xml_curl status");
 
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
@@ -575,6 +727,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_curl_load)
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_curl_shutdown)
 {
 	hash_node_t *ptr = NULL;
+	xml_binding_t *binding;
 
 	while (globals.hash_root) {
 		ptr = globals.hash_root;
@@ -585,6 +738,15 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_curl_shutdown)
 
 	switch_xml_unbind_search_function_ptr(xml_url_fetch);
 
+	for (binding = globals.bindings; binding; binding = binding->next) {
+		switch_mutex_lock(binding->mutex);
+		while (binding->idle_count) {
+			switch_curl_easy_cleanup(binding->idle[--binding->idle_count]);
+		}
+		binding->keep_alive = 0;
+		switch_mutex_unlock(binding->mutex);
+	}
+
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -1628,6 +1628,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	switch_thread_rwlock_create(&runtime.global_var_rwlock, runtime.memory_pool);
 	switch_core_set_globals();
 	switch_core_session_init(runtime.memory_pool);
+	switch_core_file_init(runtime.memory_pool);
+	switch_core_codec_pool_init(runtime.memory_pool);
+	switch_core_codec_transcoder_init(runtime.memory_pool);
+	switch_core_codec_offload_init(runtime.memory_pool);
+	switch_core_resample_init(runtime.memory_pool);
+	switch_ivr_record_merge_init(runtime.memory_pool);
 	switch_event_create_plain(&runtime.global_vars, SWITCH_EVENT_CHANNEL_DATA);
 	switch_core_hash_init(&runtime.mime_types, runtime.memory_pool);
 	switch_core_hash_init_case(&runtime.ptimes, runtime.memory_pool, SWITCH_FALSE);
@@ -1776,6 +1782,8 @@ static void switch_load_core_config(const char *file)
 
 	if ((xml = switch_xml_open_cfg(file, &cfg, NULL))) {
 		switch_xml_t settings, param;
+		uint32_t codec_offload_threads = 0, codec_offload_queue = 0;
+		uint32_t xml_cache_ttl = 0, xml_cache_negative_ttl = 0, xml_cache_max = 0;
 
 		if ((settings = switch_xml_child(cfg, "default-ptimes"))) {
 			for (param = switch_xml_child(settings, "codec"); param; param = param->next) {
@@ -1970,6 +1978,36 @@ static void switch_load_core_config(const char *file)
 					} else {
 						runtime.timer_affinity = atoi(val);
 					}
+				} else if (!strcasecmp(var, "file-cache-size") && !zstr(val)) {
+					switch_core_file_cache_set_size((switch_size_t) atoi(val) * 1024 * 1024);
+				} else if (!strcasecmp(var, "file-cache-max-file-size") && !zstr(val)) {
+					switch_core_file_cache_set_max_file_size((switch_size_t) atoi(val) * 1024);
+				} else if (!strcasecmp(var, "file-writer-threads") && !zstr(val)) {
+					switch_core_file_async_set_writers((uint32_t) atoi(val));
+				} else if (!strcasecmp(var, "file-writer-buffer-size") && !zstr(val)) {
+					switch_core_file_async_set_buffer_size((switch_size_t) atoi(val) * 1024);
+				} else if (!strcasecmp(var, "codec-pool-size") && !zstr(val)) {
+					int tmp = atoi(val);
+					switch_core_codec_pool_set_size(tmp > 0 ? (uint32_t) tmp : 0);
+				} else if (!strcasecmp(var, "codec-offload-threads") && !zstr(val)) {
+					int tmp = !strcasecmp(val, "auto") ? (int) switch_core_cpu_count() : atoi(val);
+					codec_offload_threads = tmp > 0 ? (uint32_t) tmp : 0;
+				} else if (!strcasecmp(var, "codec-offload-max-queue") && !zstr(val)) {
+					int tmp = atoi(val);
+					codec_offload_queue = tmp > 0 ? (uint32_t) tmp : 0;
+				} else if (!strcasecmp(var, "codec-offload-codecs")) {
+					switch_core_codec_offload_set_codecs(val);
+				} else if (!strcasecmp(var, "xml-fetch-cache-keys")) {
+					switch_xml_fetch_cache_set_keys(val);
+				} else if (!strcasecmp(var, "xml-fetch-cache-ttl") && !zstr(val)) {
+					int tmp = atoi(val);
+					xml_cache_ttl = tmp > 0 ? (uint32_t) tmp : 0;
+				} else if (!strcasecmp(var, "xml-fetch-cache-negative-ttl") && !zstr(val)) {
+					int tmp = atoi(val);
+					xml_cache_negative_ttl = tmp > 0 ? (uint32_t) tmp : 0;
+				} else if (!strcasecmp(var, "xml-fetch-cache-max-entries") && !zstr(val)) {
+					int tmp = atoi(val);
+					xml_cache_max = tmp > 0 ? (uint32_t) tmp : 0;
 				} else if (!strcasecmp(var, "rtp-start-port") && !zstr(val)) {
 					switch_rtp_set_start_port((switch_port_t) atoi(val));
 				} else if (!strcasecmp(var, "rtp-end-port") && !zstr(val)) {
@@ -2001,6 +2039,9 @@ static void switch_load_core_config(const char *file)
 			}
 		}
 
+		switch_core_codec_offload_start(codec_offload_threads, codec_offload_queue);
+		switch_xml_fetch_cache_set_ttl(xml_cache_ttl, xml_cache_negative_ttl, xml_cache_max);
+
 		if ((settings = switch_xml_child(cfg, "variables"))) {
 			for (param = switch_xml_child(settings, "variable"); param; param = param->next) {
 				const char *var = switch_xml_attr_soft(param, "name");
@@ -2569,7 +2610,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_destroy(void)
 	switch_core_session_hupall(SWITCH_CAUSE_SYSTEM_SHUTDOWN);
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Clean up modules.\n");
 
+	switch_core_codec_pool_set_size(0);
+	switch_ivr_record_merge_shutdown();
+	switch_core_codec_offload_shutdown();
 	switch_loadable_module_shutdown();
+	switch_core_file_shutdown();
 
 	switch_ssl_destroy_ssl_locks();
 
@@ -588,6 +588,825 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_parse_fmtp(const char *codec_n
 	return status;
 }
 
+/* Idle codec instances kept for reuse, keyed by implementation, flags and fmtp. Only codecs initialized
+   with SWITCH_CODEC_FLAG_POOLED take part; they get a memory pool of their own so they can outlive the
+   caller's pool, and are reset in place with switch_core_codec_reset when handed back so the next call
+   gets a fresh instance without paying for the init during setup. Codecs allocate their state from that
+   pool on init, so an instance is retired after CODEC_POOL_MAX_USES resets to keep it from growing. */
+
+#define CODEC_POOL_MAX_PER_KEY 64
+#define CODEC_POOL_MAX_USES 100
+#define CODEC_POOL_DEFAULT_SIZE 256
+
+typedef struct codec_pool_item_s {
+	switch_codec_t codec;
+	struct codec_pool_item_s *next;
+} codec_pool_item_t;
+
+struct switch_codec_pool_slot {
+	char *key;
+	codec_pool_item_t *idle;
+	uint32_t count;
+};
+
+typedef struct codec_pool_stats_s {
+	uint64_t inits;
+	uint64_t hits;
+	uint64_t resets;
+	uint64_t discards;
+	switch_time_t init_time;
+	switch_time_t max_init_time;
+	switch_time_t reset_time;
+} codec_pool_stats_t;
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_hash_t *slots;
+	switch_hash_t *stats;
+	uint32_t max;
+	uint32_t idle;
+} codec_pool;
+
+/* must be called with the codec pool mutex held */
+static codec_pool_stats_t *codec_pool_stats(const char *name)
+{
+	codec_pool_stats_t *stats;
+
+	if (!(stats = switch_core_hash_find(codec_pool.stats, name))) {
+		stats = switch_core_alloc(codec_pool.pool, sizeof(*stats));
+		switch_core_hash_insert(codec_pool.stats, name, stats);
+	}
+
+	return stats;
+}
+
+static switch_codec_pool_slot_t *codec_pool_slot(const switch_codec_implementation_t *implementation, uint32_t flags, const char *fmtp)
+{
+	switch_codec_pool_slot_t *slot = NULL;
+	char key[512];
+
+	if (!codec_pool.mutex || !codec_pool.max || implementation->codec_type != SWITCH_CODEC_TYPE_AUDIO) {
+		return NULL;
+	}
+
+	if (switch_snprintf(key, sizeof(key), "%p|%x|%s", (void *) implementation, flags, switch_str_nil(fmtp)) >= (int) sizeof(key) - 1) {
+		return NULL;
+	}
+
+	switch_mutex_lock(codec_pool.mutex);
+	if (!(slot = switch_core_hash_find(codec_pool.slots, key))) {
+		slot = switch_core_alloc(codec_pool.pool, sizeof(*slot));
+		slot->key = switch_core_strdup(codec_pool.pool, key);
+		switch_core_hash_insert(codec_pool.slots, key, slot);
+	}
+	switch_mutex_unlock(codec_pool.mutex);
+
+	return slot;
+}
+
+static switch_status_t codec_pool_get(switch_codec_t *codec, switch_codec_pool_slot_t *slot)
+{
+	codec_pool_item_t *item;
+
+	switch_mutex_lock(codec_pool.mutex);
+	if ((item = slot->idle)) {
+		slot->idle = item->next;
+		slot->count--;
+		codec_pool.idle--;
+		codec_pool_stats(item->codec.implementation->iananame)->hits++;
+	}
+	switch_mutex_unlock(codec_pool.mutex);
+
+	if (!item) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	*codec = item->codec;
+	free(item);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t codec_pool_put(switch_codec_t *codec)
+{
+	switch_codec_pool_slot_t *slot = codec->pool_slot;
+	codec_pool_item_t *item;
+	switch_time_t started;
+	int ok = 0;
+
+	switch_mutex_lock(codec_pool.mutex);
+	if (codec_pool.idle < codec_pool.max && slot->count < CODEC_POOL_MAX_PER_KEY && codec->pool_uses < CODEC_POOL_MAX_USES) {
+		/* hold the place while the codec is reset outside the lock */
+		codec_pool.idle++;
+		slot->count++;
+		ok = 1;
+	} else {
+		codec_pool_stats(codec->implementation->iananame)->discards++;
+	}
+	switch_mutex_unlock(codec_pool.mutex);
+
+	if (!ok) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	started = switch_time_now();
+
+	switch_zmalloc(item, sizeof(*item));
+	item->codec = *codec;
+	codec = &item->codec;
+
+	codec->session = NULL;
+	codec->cur_frame = NULL;
+	codec->next = NULL;
+	codec->agreed_pt = 0;
+	codec->fmtp_out = NULL;
+	codec->offload = NULL;
+	switch_core_codec_reset(codec);
+	codec->pool_uses++;
+	switch_set_flag(codec, SWITCH_CODEC_FLAG_READY);
+
+	switch_mutex_lock(codec_pool.mutex);
+	item->next = slot->idle;
+	slot->idle = item;
+	codec_pool_stats(codec->implementation->iananame)->resets++;
+	codec_pool_stats(codec->implementation->iananame)->reset_time += switch_time_now() - started;
+	switch_mutex_unlock(codec_pool.mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* only called for pooled codecs, plain inits stay off the pool mutex */
+static void codec_pool_record_init(const switch_codec_implementation_t *implementation, switch_time_t took)
+{
+	codec_pool_stats_t *stats;
+
+	switch_mutex_lock(codec_pool.mutex);
+	stats = codec_pool_stats(implementation->iananame);
+	stats->inits++;
+	stats->init_time += took;
+	if (took > stats->max_init_time) {
+		stats->max_init_time = took;
+	}
+	switch_mutex_unlock(codec_pool.mutex);
+}
+
+static void codec_pool_destroy_item(codec_pool_item_t *item)
+{
+	switch_codec_t *codec = &item->codec;
+	switch_memory_pool_t *pool = codec->memory_pool;
+
+	codec->implementation->destroy(codec);
+	UNPROTECT_INTERFACE(codec->codec_interface);
+	switch_core_destroy_memory_pool(&pool);
+	free(item);
+}
+
+SWITCH_DECLARE(void) switch_core_codec_pool_flush(void)
+{
+	switch_hash_index_t *hi;
+	codec_pool_item_t *list = NULL, *item;
+	void *val;
+
+	if (!codec_pool.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(codec_pool.mutex);
+	for (hi = switch_core_hash_first(codec_pool.slots); hi; hi = switch_core_hash_next(hi)) {
+		switch_codec_pool_slot_t *slot;
+
+		switch_core_hash_this(hi, NULL, NULL, &val);
+		slot = (switch_codec_pool_slot_t *) val;
+
+		while ((item = slot->idle)) {
+			slot->idle = item->next;
+			item->next = list;
+			list = item;
+		}
+
+		codec_pool.idle -= slot->count;
+		slot->count = 0;
+	}
+	switch_mutex_unlock(codec_pool.mutex);
+
+	while ((item = list)) {
+		list = item->next;
+		codec_pool_destroy_item(item);
+	}
+}
+
+SWITCH_DECLARE(void) switch_core_codec_pool_set_size(uint32_t max)
+{
+	codec_pool.max = max;
+
+	if (!max) {
+		switch_core_codec_pool_flush();
+	}
+}
+
+SWITCH_DECLARE(void) switch_core_codec_pool_status(switch_stream_handle_t *stream)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+
+	if (!codec_pool.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(codec_pool.mutex);
+	stream->write_function(stream, "codec pool %u/%u idle\n", codec_pool.idle, codec_pool.max);
+	stream->write_function(stream, "%-16s %10s %10s %8s %10s %10s %10s %10s\n", "codec", "inits", "hits", "hit%", "avg init", "max init", "resets", "discards");
+
+	for (hi = switch_core_hash_first(codec_pool.stats); hi; hi = switch_core_hash_next(hi)) {
+		codec_pool_stats_t *stats;
+		uint64_t total;
+
+		switch_core_hash_this(hi, &var, NULL, &val);
+		stats = (codec_pool_stats_t *) val;
+		total = stats->inits + stats->hits;
+
+		stream->write_function(stream, "%-16s %10" SWITCH_UINT64_T_FMT " %10" SWITCH_UINT64_T_FMT " %7.1f%% %8" SWITCH_TIME_T_FMT "us %8" SWITCH_TIME_T_FMT
+							   "us %10" SWITCH_UINT64_T_FMT " %10" SWITCH_UINT64_T_FMT "\n",
+							   (const char *) var, stats->inits, stats->hits, total ? (double) stats->hits * 100 / total : 0.0,
+							   stats->inits ? stats->init_time / (switch_time_t) stats->inits : 0, stats->max_init_time,
+							   stats->resets, stats->discards);
+	}
+	switch_mutex_unlock(codec_pool.mutex);
+}
+
+void switch_core_codec_pool_init(switch_memory_pool_t *pool)
+{
+	memset(&codec_pool, 0, sizeof(codec_pool));
+	codec_pool.pool = pool;
+	codec_pool.max = CODEC_POOL_DEFAULT_SIZE;
+	switch_mutex_init(&codec_pool.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&codec_pool.slots, pool);
+	switch_core_hash_init(&codec_pool.stats, pool);
+}
+
+/* Direct converters between encodings, keyed by "FROM>TO@rate". Callers look them up when a frame has to change
+   encoding but not rate or packet size, to skip the decode to linear and encode back. */
+
+typedef struct codec_transcoder_s {
+	switch_core_codec_transcode_func_t func;
+} codec_transcoder_t;
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+} transcoders;
+
+SWITCH_DECLARE(switch_status_t) switch_core_codec_add_transcoder(const char *from_iananame, const char *to_iananame, uint32_t rate,
+																 switch_core_codec_transcode_func_t func)
+{
+	codec_transcoder_t *transcoder;
+	char key[256];
+
+	if (!transcoders.mutex || zstr(from_iananame) || zstr(to_iananame) || !func) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_snprintf(key, sizeof(key), "%s>%s@%u", from_iananame, to_iananame, rate);
+
+	switch_mutex_lock(transcoders.mutex);
+	if (!(transcoder = switch_core_hash_find(transcoders.hash, key))) {
+		transcoder = switch_core_alloc(transcoders.pool, sizeof(*transcoder));
+		switch_core_hash_insert(transcoders.hash, key, transcoder);
+	}
+	transcoder->func = func;
+	switch_mutex_unlock(transcoders.mutex);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Adding direct transcoder %s\n", key);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(void) switch_core_codec_remove_transcoder(const char *from_iananame, const char *to_iananame, uint32_t rate)
+{
+	codec_transcoder_t *transcoder;
+	char key[256];
+
+	if (!transcoders.mutex || zstr(from_iananame) || zstr(to_iananame)) {
+		return;
+	}
+
+	switch_snprintf(key, sizeof(key), "%s>%s@%u", from_iananame, to_iananame, rate);
+
+	switch_mutex_lock(transcoders.mutex);
+	if ((transcoder = switch_core_hash_find(transcoders.hash, key))) {
+		/* the entry stays allocated so a stale lookup never sees freed memory */
+		transcoder->func = NULL;
+	}
+	switch_mutex_unlock(transcoders.mutex);
+}
+
+SWITCH_DECLARE(switch_core_codec_transcode_func_t) switch_core_codec_find_transcoder(const switch_codec_implementation_t *from,
+																					 const switch_codec_implementation_t *to)
+{
+	switch_core_codec_transcode_func_t func = NULL;
+	codec_transcoder_t *transcoder;
+	char key[256];
+
+	if (!transcoders.mutex || !from || !to || !from->iananame || !to->iananame) {
+		return NULL;
+	}
+
+	if (from->codec_type != SWITCH_CODEC_TYPE_AUDIO || to->codec_type != SWITCH_CODEC_TYPE_AUDIO ||
+		from->actual_samples_per_second != to->actual_samples_per_second ||
+		from->microseconds_per_packet != to->microseconds_per_packet ||
+		from->number_of_channels != to->number_of_channels) {
+		return NULL;
+	}
+
+	switch_snprintf(key, sizeof(key), "%s>%s@%u", from->iananame, to->iananame, from->actual_samples_per_second);
+
+	switch_mutex_lock(transcoders.mutex);
+	if ((transcoder = switch_core_hash_find(transcoders.hash, key))) {
+		func = transcoder->func;
+	}
+	switch_mutex_unlock(transcoders.mutex);
+
+	return func;
+}
+
+void switch_core_codec_transcoder_init(switch_memory_pool_t *pool)
+{
+	memset(&transcoders, 0, sizeof(transcoders));
+	transcoders.pool = pool;
+	switch_mutex_init(&transcoders.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&transcoders.hash, pool);
+}
+
+/* Encode/decode offload for heavy codecs. Codecs named in codec-offload-codecs are handed to a fixed set of
+   workers, one per core, so a burst of channels competes for a few threads instead of every session thread at
+   once. A codec sticks to the worker it was first given, which keeps its frames in order and its state in one
+   cache. When a worker is backed up the frame is run inline so the added latency stays bounded. While offload is
+   running every codec handle also counts the time spent in its encoder and decoder, folded into per codec totals
+   now and then; with it off the codec calls go straight to the implementation and nothing is allocated. */
+
+#define CODEC_OFFLOAD_MAX_THREADS 64
+#define CODEC_OFFLOAD_DEFAULT_QUEUE 4
+#define CODEC_OFFLOAD_FLUSH_FRAMES 500
+#define CODEC_OFFLOAD_DEFAULT_CODECS "opus,G729,iLBC,SILK"
+
+typedef struct codec_cpu_stats_s {
+	uint64_t encode_frames;
+	uint64_t decode_frames;
+	switch_time_t encode_time;
+	switch_time_t decode_time;
+	switch_time_t max_encode_time;
+	switch_time_t max_decode_time;
+	uint64_t offloaded;
+	uint64_t inlined;
+} codec_cpu_stats_t;
+
+struct switch_codec_offload {
+	/* worker index plus one, 0 when the codec always runs inline */
+	uint32_t worker;
+	codec_cpu_stats_t *total;
+	codec_cpu_stats_t local;
+	uint32_t pending;
+};
+
+typedef struct codec_offload_worker_s {
+	switch_thread_t *thread;
+	switch_queue_t *queue;
+	/* encode and decode calls waiting on this worker share these, each checks its own job */
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	uint32_t index;
+} codec_offload_worker_t;
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_thread_rwlock_t *rwlock;
+	switch_hash_t *stats;
+	switch_hash_t *codecs;
+	codec_offload_worker_t workers[CODEC_OFFLOAD_MAX_THREADS];
+	uint32_t threads;
+	uint32_t next;
+	uint32_t max_queue;
+	int running;
+} codec_offload;
+
+/* must be called with the offload mutex held */
+static codec_cpu_stats_t *codec_offload_stats(const char *name)
+{
+	codec_cpu_stats_t *stats;
+
+	if (!(stats = switch_core_hash_find(codec_offload.stats, name))) {
+		stats = switch_core_alloc(codec_offload.pool, sizeof(*stats));
+		switch_core_hash_insert(codec_offload.stats, name, stats);
+	}
+
+	return stats;
+}
+
+static void codec_offload_fold(switch_codec_offload_t *offload)
+{
+	codec_cpu_stats_t *total = offload->total, *local = &offload->local;
+
+	if (!offload->pending) {
+		return;
+	}
+
+	switch_mutex_lock(codec_offload.mutex);
+	total->encode_frames += local->encode_frames;
+	total->decode_frames += local->decode_frames;
+	total->encode_time += local->encode_time;
+	total->decode_time += local->decode_time;
+	total->offloaded += local->offloaded;
+	total->inlined += local->inlined;
+	if (local->max_encode_time > total->max_encode_time) {
+		total->max_encode_time = local->max_encode_time;
+	}
+	if (local->max_decode_time > total->max_decode_time) {
+		total->max_decode_time = local->max_decode_time;
+	}
+	switch_mutex_unlock(codec_offload.mutex);
+
+	memset(local, 0, sizeof(*local));
+	offload->pending = 0;
+}
+
+/* must be called with the codec mutex held */
+static switch_codec_offload_t *codec_offload_get(switch_codec_t *codec)
+{
+	switch_codec_offload_t *offload;
+
+	if ((offload = codec->offload) || !codec_offload.running) {
+		return offload;
+	}
+
+	switch_zmalloc(offload, sizeof(*offload));
+
+	switch_mutex_lock(codec_offload.mutex);
+	offload->total = codec_offload_stats(codec->implementation->iananame);
+	if (codec_offload.threads && switch_core_hash_find(codec_offload.codecs, codec->implementation->iananame)) {
+		offload->worker = (codec_offload.next++ % codec_offload.threads) + 1;
+	}
+	switch_mutex_unlock(codec_offload.mutex);
+
+	codec->offload = offload;
+
+	return offload;
+}
+
+static void codec_offload_run(switch_codec_offload_job_t *job, int offloaded)
+{
+	switch_codec_t *codec = job->codec;
+	switch_codec_offload_t *offload;
+	switch_time_t started, took;
+
+	if (codec->mutex) switch_mutex_lock(codec->mutex);
+
+	if (!codec->implementation || !switch_core_codec_ready(codec)) {
+		job->status = SWITCH_STATUS_NOT_INITALIZED;
+		if (codec->mutex) switch_mutex_unlock(codec->mutex);
+		return;
+	}
+
+	started = switch_time_now();
+
+	if (job->encode) {
+		job->status = codec->implementation->encode(codec, job->other_codec, job->in_data, job->in_data_len, job->in_rate,
+													job->out_data, &job->out_data_len, &job->out_rate, &job->flag);
+	} else {
+		job->status = codec->implementation->decode(codec, job->other_codec, job->in_data, job->in_data_len, job->in_rate,
+													job->out_data, &job->out_data_len, &job->out_rate, &job->flag);
+	}
+
+	took = switch_time_now() - started;
+
+	if ((offload = codec->offload)) {
+		codec_cpu_stats_t *local = &offload->local;
+
+		if (job->encode) {
+			local->encode_frames++;
+			local->encode_time += took;
+			if (took > local->max_encode_time) local->max_encode_time = took;
+		} else {
+			local->decode_frames++;
+			local->decode_time += took;
+			if (took > local->max_decode_time) local->max_decode_time = took;
+		}
+
+		if (offloaded) {
+			local->offloaded++;
+		} else if (offload->worker) {
+			local->inlined++;
+		}
+
+		if (++offload->pending >= CODEC_OFFLOAD_FLUSH_FRAMES) {
+			codec_offload_fold(offload);
+		}
+	}
+
+	if (codec->mutex) switch_mutex_unlock(codec->mutex);
+}
+
+static void codec_offload_complete(switch_codec_offload_job_t *job)
+{
+	switch_mutex_lock(job->mutex);
+	job->done = 1;
+	switch_thread_cond_broadcast(job->cond);
+	switch_mutex_unlock(job->mutex);
+}
+
+static void *SWITCH_THREAD_FUNC codec_offload_thread(switch_thread_t *thread, void *obj)
+{
+	codec_offload_worker_t *worker = (codec_offload_worker_t *) obj;
+	void *pop;
+
+	switch_core_thread_set_cpu_affinity((int) (worker->index % switch_core_cpu_count()));
+
+	while (switch_queue_pop(worker->queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		switch_codec_offload_job_t *job = (switch_codec_offload_job_t *) pop;
+
+		codec_offload_run(job, 1);
+		codec_offload_complete(job);
+	}
+
+	return NULL;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_codec_offload_job_init(switch_codec_offload_job_t *job, switch_memory_pool_t *pool)
+{
+	memset(job, 0, sizeof(*job));
+	switch_mutex_init(&job->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_thread_cond_create(&job->cond, pool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_codec_offload_submit(switch_codec_offload_job_t *job)
+{
+	switch_codec_t *codec = job->codec;
+	switch_codec_offload_t *offload = NULL;
+	uint32_t flag = job->encode ? SWITCH_CODEC_FLAG_ENCODE : SWITCH_CODEC_FLAG_DECODE;
+	int queued = 0;
+
+	switch_assert(codec != NULL);
+
+	job->done = 0;
+
+	if (!codec->implementation || !switch_core_codec_ready(codec) || !switch_test_flag(codec, flag)) {
+		job->status = SWITCH_STATUS_NOT_INITALIZED;
+		job->done = 1;
+		return job->status;
+	}
+
+	if (codec->mutex) switch_mutex_lock(codec->mutex);
+	offload = codec_offload_get(codec);
+	if (codec->mutex) switch_mutex_unlock(codec->mutex);
+
+	if (offload && offload->worker) {
+		switch_thread_rwlock_rdlock(codec_offload.rwlock);
+		if (codec_offload.running && offload->worker <= codec_offload.threads) {
+			codec_offload_worker_t *worker = &codec_offload.workers[offload->worker - 1];
+
+			if (switch_queue_size(worker->queue) < codec_offload.max_queue && switch_queue_trypush(worker->queue, job) == SWITCH_STATUS_SUCCESS) {
+				queued = 1;
+			}
+		}
+		switch_thread_rwlock_unlock(codec_offload.rwlock);
+	}
+
+	if (!queued) {
+		codec_offload_run(job, 0);
+		job->done = 1;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_codec_offload_wait(switch_codec_offload_job_t *job)
+{
+	switch_mutex_lock(job->mutex);
+	while (!job->done) {
+		switch_thread_cond_wait(job->cond, job->mutex);
+	}
+	switch_mutex_unlock(job->mutex);
+
+	return job->status;
+}
+
+/* run a call from switch_core_codec_encode or _decode, through the worker the codec belongs to when it has one */
+static switch_status_t codec_offload_call(switch_codec_t *codec, switch_codec_t *other_codec, switch_bool_t encode,
+										  void *in_data, uint32_t in_data_len, uint32_t in_rate,
+										  void *out_data, uint32_t *out_data_len, uint32_t *out_rate, unsigned int *flag)
+{
+	switch_codec_offload_t *offload = NULL;
+	switch_codec_offload_job_t job = { 0 };
+
+	if (codec_offload.running) {
+		if (codec->mutex) switch_mutex_lock(codec->mutex);
+		offload = codec_offload_get(codec);
+		if (codec->mutex) switch_mutex_unlock(codec->mutex);
+	}
+
+	job.codec = codec;
+	job.other_codec = other_codec;
+	job.encode = encode;
+	job.in_data = in_data;
+	job.in_data_len = in_data_len;
+	job.in_rate = in_rate;
+	job.out_data = out_data;
+	job.out_data_len = *out_data_len;
+	job.out_rate = out_rate ? *out_rate : 0;
+	job.flag = flag ? *flag : 0;
+
+	if (offload && offload->worker) {
+		codec_offload_worker_t *worker = &codec_offload.workers[offload->worker - 1];
+
+		job.mutex = worker->mutex;
+		job.cond = worker->cond;
+		switch_core_codec_offload_submit(&job);
+		switch_core_codec_offload_wait(&job);
+	} else {
+		codec_offload_run(&job, 0);
+	}
+
+	*out_data_len = job.out_data_len;
+	if (out_rate) *out_rate = job.out_rate;
+	if (flag) *flag = job.flag;
+
+	return job.status;
+}
+
+/* fold what is left of the counters before the handle goes away */
+static void codec_offload_release(switch_codec_t *codec)
+{
+	if (codec->offload) {
+		codec_offload_fold(codec->offload);
+		free(codec->offload);
+		codec->offload = NULL;
+	}
+}
+
+SWITCH_DECLARE(void) switch_core_codec_offload_set_codecs(const char *codecs)
+{
+	char *dup, *argv[64] = { 0 };
+	int argc, i;
+
+	if (!codec_offload.mutex) {
+		return;
+	}
+
+	dup = strdup(zstr(codecs) ? "" : codecs);
+	argc = switch_separate_string(dup, ',', argv, (sizeof(argv) / sizeof(argv[0])));
+
+	switch_mutex_lock(codec_offload.mutex);
+	switch_core_hash_destroy(&codec_offload.codecs);
+	switch_core_hash_init_nocase(&codec_offload.codecs, codec_offload.pool);
+	for (i = 0; i < argc; i++) {
+		if (!zstr(argv[i])) {
+			switch_core_hash_insert(codec_offload.codecs, switch_strip_spaces(argv[i], SWITCH_FALSE), codec_offload.pool);
+		}
+	}
+	switch_mutex_unlock(codec_offload.mutex);
+
+	free(dup);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_codec_offload_start(uint32_t threads, uint32_t max_queue)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	uint32_t i;
+
+	if (!codec_offload.mutex) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (max_queue) {
+		codec_offload.max_queue = max_queue;
+	}
+
+	if (codec_offload.running) {
+		if (threads != codec_offload.threads) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Codec offload already running with %u threads, restart to change it\n",
+							  codec_offload.threads);
+		}
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!threads) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (threads > CODEC_OFFLOAD_MAX_THREADS) {
+		threads = CODEC_OFFLOAD_MAX_THREADS;
+	}
+
+	switch_threadattr_create(&thd_attr, codec_offload.pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_threadattr_priority_set(thd_attr, SWITCH_PRI_REALTIME);
+
+	for (i = 0; i < threads; i++) {
+		codec_offload_worker_t *worker = &codec_offload.workers[i];
+
+		worker->index = i;
+		switch_queue_create(&worker->queue, SWITCH_CORE_QUEUE_LEN, codec_offload.pool);
+		if (!worker->mutex) {
+			switch_mutex_init(&worker->mutex, SWITCH_MUTEX_NESTED, codec_offload.pool);
+			switch_thread_cond_create(&worker->cond, codec_offload.pool);
+		}
+
+		if (switch_thread_create(&worker->thread, thd_attr, codec_offload_thread, worker, codec_offload.pool) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error starting codec offload thread %u\n", i);
+			break;
+		}
+	}
+
+	switch_thread_rwlock_wrlock(codec_offload.rwlock);
+	codec_offload.threads = i;
+	codec_offload.running = i ? 1 : 0;
+	switch_thread_rwlock_unlock(codec_offload.rwlock);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Started %u codec offload threads\n", i);
+
+	return i ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
+SWITCH_DECLARE(void) switch_core_codec_offload_status(switch_stream_handle_t *stream)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+	uint32_t i;
+
+	if (!codec_offload.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(codec_offload.mutex);
+	stream->write_function(stream, "codec offload %s, %u threads, max queue %u\n", codec_offload.running ? "running" : "off",
+						   codec_offload.threads, codec_offload.max_queue);
+
+	for (i = 0; i < codec_offload.threads; i++) {
+		stream->write_function(stream, "worker %u queue %u\n", i, switch_queue_size(codec_offload.workers[i].queue));
+	}
+
+	stream->write_function(stream, "%-16s %12s %10s %10s %12s %10s %10s %12s %12s\n", "codec", "encodes", "avg enc", "max enc",
+						   "decodes", "avg dec", "max dec", "offloaded", "inline");
+
+	for (hi = switch_core_hash_first(codec_offload.stats); hi; hi = switch_core_hash_next(hi)) {
+		codec_cpu_stats_t *stats;
+
+		switch_core_hash_this(hi, &var, NULL, &val);
+		stats = (codec_cpu_stats_t *) val;
+
+		stream->write_function(stream, "%-16s %12" SWITCH_UINT64_T_FMT " %8" SWITCH_TIME_T_FMT "us %8" SWITCH_TIME_T_FMT "us %12" SWITCH_UINT64_T_FMT
+							   " %8" SWITCH_TIME_T_FMT "us %8" SWITCH_TIME_T_FMT "us %12" SWITCH_UINT64_T_FMT " %12" SWITCH_UINT64_T_FMT "\n",
+							   (const char *) var,
+							   stats->encode_frames, stats->encode_frames ? stats->encode_time / (switch_time_t) stats->encode_frames : 0,
+							   stats->max_encode_time,
+							   stats->decode_frames, stats->decode_frames ? stats->decode_time / (switch_time_t) stats->decode_frames : 0,
+							   stats->max_decode_time, stats->offloaded, stats->inlined);
+	}
+	switch_mutex_unlock(codec_offload.mutex);
+}
+
+void switch_core_codec_offload_init(switch_memory_pool_t *pool)
+{
+	memset(&codec_offload, 0, sizeof(codec_offload));
+	codec_offload.pool = pool;
+	codec_offload.max_queue = CODEC_OFFLOAD_DEFAULT_QUEUE;
+	switch_mutex_init(&codec_offload.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_thread_rwlock_create(&codec_offload.rwlock, pool);
+	switch_core_hash_init(&codec_offload.stats, pool);
+	switch_core_hash_init_nocase(&codec_offload.codecs, pool);
+	switch_core_codec_offload_set_codecs(CODEC_OFFLOAD_DEFAULT_CODECS);
+}
+
+void switch_core_codec_offload_shutdown(void)
+{
+	switch_status_t st;
+	uint32_t i, threads;
+
+	if (!codec_offload.mutex) {
+		return;
+	}
+
+	/* nothing gets queued once running is cleared, so the workers drain what they have and exit */
+	switch_thread_rwlock_wrlock(codec_offload.rwlock);
+	codec_offload.running = 0;
+	threads = codec_offload.threads;
+	switch_thread_rwlock_unlock(codec_offload.rwlock);
+
+	for (i = 0; i < threads; i++) {
+		switch_queue_push(codec_offload.workers[i].queue, NULL);
+	}
+
+	for (i = 0; i < threads; i++) {
+		switch_thread_join(&st, codec_offload.workers[i].thread);
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_codec_reset(switch_codec_t *codec)
 {
 	switch_assert(codec != NULL);
@@ -616,7 +1435,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_copy(switch_codec_t *codec, sw
 
 	new_codec->codec_interface = codec->codec_interface;
 	new_codec->implementation = codec->implementation;
-	new_codec->flags = codec->flags;
+	new_codec->flags = codec->flags & ~SWITCH_CODEC_FLAG_POOLED;
+	new_codec->pool_slot = NULL;
+	new_codec->offload = NULL;
 
 	if (!pool) {
 		switch_set_flag(new_codec, SWITCH_CODEC_FLAG_FREE_POOL);
@@ -674,9 +1495,27 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_init_with_bitrate(switch_codec
 
 	if (implementation) {
 		switch_status_t status;
+		switch_codec_pool_slot_t *slot = NULL;
+		switch_time_t started = 0;
+
+		if ((flags & SWITCH_CODEC_FLAG_POOLED) && !codec_settings && (slot = codec_pool_slot(implementation, flags, fmtp))) {
+			if (codec_pool_get(codec, slot) == SWITCH_STATUS_SUCCESS) {
+				/* the pooled instance still holds its own reference on the interface */
+				UNPROTECT_INTERFACE(codec_interface);
+				return SWITCH_STATUS_SUCCESS;
+			}
+			/* pooled codecs must outlive the caller's pool */
+			pool = NULL;
+		}
+
+		if (slot) {
+			started = switch_time_now();
+		}
+
 		codec->codec_interface = codec_interface;
 		codec->implementation = implementation;
 		codec->flags = flags;
+		codec->pool_slot = slot;
 
 		if (pool) {
 			codec->memory_pool = pool;
@@ -694,6 +1533,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_init_with_bitrate(switch_codec
 		implementation->init(codec, flags, codec_settings);
 		switch_mutex_init(&codec->mutex, SWITCH_MUTEX_NESTED, codec->memory_pool);
 		switch_set_flag(codec, SWITCH_CODEC_FLAG_READY);
+		if (slot) {
+			codec_pool_record_init(implementation, switch_time_now() - started);
+		}
 		return SWITCH_STATUS_SUCCESS;
 	} else {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Codec %s Exists but not at the desired implementation. %dhz %dms\n", codec_name, rate,
@@ -712,8 +1554,6 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_encode(switch_codec_t *codec,
 														 uint32_t decoded_rate,
 														 void *encoded_data, uint32_t *encoded_data_len, uint32_t *encoded_rate, unsigned int *flag)
 {
-	switch_status_t status;
-
 	switch_assert(codec != NULL);
 	switch_assert(encoded_data != NULL);
 	switch_assert(decoded_data != NULL);
@@ -728,13 +1568,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_encode(switch_codec_t *codec,
 		return SWITCH_STATUS_NOT_INITALIZED;
 	}
 
-	if (codec->mutex) switch_mutex_lock(codec->mutex);
-	status = codec->implementation->encode(codec, other_codec, decoded_data, decoded_data_len,
-										   decoded_rate, encoded_data, encoded_data_len, encoded_rate, flag);
-	if (codec->mutex) switch_mutex_unlock(codec->mutex);
-
-	return status;
-
+	return codec_offload_call(codec, other_codec, SWITCH_TRUE, decoded_data, decoded_data_len, decoded_rate,
+							  encoded_data, encoded_data_len, encoded_rate, flag);
 }
 
 SWITCH_DECLARE(switch_status_t) switch_core_codec_decode(switch_codec_t *codec,
@@ -744,8 +1579,6 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_decode(switch_codec_t *codec,
 														 uint32_t encoded_rate,
 														 void *decoded_data, uint32_t *decoded_data_len, uint32_t *decoded_rate, unsigned int *flag)
 {
-	switch_status_t status;
-
 	switch_assert(codec != NULL);
 	switch_assert(encoded_data != NULL);
 	switch_assert(decoded_data != NULL);
@@ -772,12 +1605,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_decode(switch_codec_t *codec,
 		}
 	}
 	
-	if (codec->mutex) switch_mutex_lock(codec->mutex);
-	status = codec->implementation->decode(codec, other_codec, encoded_data, encoded_data_len, encoded_rate,
-										   decoded_data, decoded_data_len, decoded_rate, flag);
-	if (codec->mutex) switch_mutex_unlock(codec->mutex);
-
-	return status;
+	return codec_offload_call(codec, other_codec, SWITCH_FALSE, encoded_data, encoded_data_len, encoded_rate,
+							  decoded_data, decoded_data_len, decoded_rate, flag);
 }
 
 SWITCH_DECLARE(switch_status_t) switch_core_codec_destroy(switch_codec_t *codec)
@@ -802,6 +1631,19 @@ SWITCH_DECLARE(switch_status_t) switch_core_codec_destroy(switch_codec_t *codec)
 		free_pool = 1;
 	}
 
+	codec_offload_release(codec);
+
+	if (codec->pool_slot) {
+		if (mutex) switch_mutex_unlock(mutex);
+
+		if (codec_pool_put(codec) == SWITCH_STATUS_SUCCESS) {
+			memset(codec, 0, sizeof(*codec));
+			return SWITCH_STATUS_SUCCESS;
+		}
+
+		if (mutex) switch_mutex_lock(mutex);
+	}
+
 	codec->implementation->destroy(codec);
 	
 	UNPROTECT_INTERFACE(codec->codec_interface);
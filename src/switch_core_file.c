@@ -36,6 +36,1069 @@
 #include <switch.h>
 #include "private/switch_core_pvt.h"
 
+/* Process wide cache of prompts already decoded to mono SLIN at the rate they are played at.
+   Entries are shared read-only between handles and refcounted; an entry that is flushed, evicted
+   or found stale while in use is detached from the cache and freed by its last user. */
+
+#define FILE_CACHE_READ_SAMPLES 8192
+#define FILE_CACHE_CHECK_INTERVAL 1000000
+#define FILE_CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+#define FILE_CACHE_DEFAULT_FILE_SIZE (2 * 1024 * 1024)
+
+/* the same audio run through one codec implementation, frame i is data[offsets[i]..offsets[i + 1]]
+   and one more frame of encoded silence is kept at the end for pausing */
+struct switch_file_cache_encoded {
+	char *key;
+	const switch_codec_implementation_t *implementation;
+	uint32_t samples_per_frame;
+	uint32_t frames;
+	uint32_t *offsets;
+	uint8_t *data;
+	switch_size_t bytes;
+	struct switch_file_cache_encoded *next;
+};
+
+struct switch_file_cache_entry {
+	char *key;
+	uint32_t rate;
+	time_t mtime;
+	int64_t size;
+	int16_t *data;
+	switch_size_t samples;
+	switch_size_t bytes;
+	char *strings[SWITCH_AUDIO_COL_STR_DATE + 1];
+	switch_file_cache_encoded_t *encoded;
+	uint32_t refs;
+	uint8_t loading;
+	uint8_t detached;
+	uint8_t oversize;
+	/* the module hands out something other than plain audio for it */
+	uint8_t uncacheable;
+	switch_time_t last_check;
+	struct switch_file_cache_entry *prev;
+	struct switch_file_cache_entry *next;
+};
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	switch_file_cache_entry_t *head;
+	switch_file_cache_entry_t *tail;
+	switch_size_t max_bytes;
+	switch_size_t max_file_bytes;
+	switch_size_t bytes;
+	uint32_t entries;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t invalidations;
+	uint64_t encoded_hits;
+	uint64_t encodes;
+	int ready;
+} file_cache;
+
+static void file_cache_free_encoded(switch_file_cache_encoded_t *enc)
+{
+	switch_safe_free(enc->offsets);
+	switch_safe_free(enc->data);
+	switch_safe_free(enc->key);
+	free(enc);
+}
+
+static void file_cache_free(switch_file_cache_entry_t *entry)
+{
+	switch_file_cache_encoded_t *enc;
+	int i;
+
+	for (i = 0; i <= SWITCH_AUDIO_COL_STR_DATE; i++) {
+		switch_safe_free(entry->strings[i]);
+	}
+
+	while ((enc = entry->encoded)) {
+		entry->encoded = enc->next;
+		file_cache_free_encoded(enc);
+	}
+
+	switch_safe_free(entry->data);
+	switch_safe_free(entry->key);
+	free(entry);
+}
+
+static void file_cache_unlink(switch_file_cache_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		file_cache.head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		file_cache.tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+}
+
+static void file_cache_link(switch_file_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = file_cache.head;
+
+	if (file_cache.head) {
+		file_cache.head->prev = entry;
+	}
+
+	file_cache.head = entry;
+
+	if (!file_cache.tail) {
+		file_cache.tail = entry;
+	}
+}
+
+/* must be called with the cache mutex held */
+static void file_cache_detach(switch_file_cache_entry_t *entry)
+{
+	if (entry->detached) {
+		return;
+	}
+
+	switch_core_hash_delete(file_cache.hash, entry->key);
+
+	if (!entry->loading) {
+		file_cache_unlink(entry);
+		file_cache.bytes -= entry->bytes;
+		file_cache.entries--;
+	}
+
+	entry->detached = 1;
+
+	if (!entry->refs && !entry->loading) {
+		file_cache_free(entry);
+	}
+}
+
+/* must be called with the cache mutex held */
+static switch_bool_t file_cache_make_room(switch_size_t bytes)
+{
+	switch_file_cache_entry_t *entry, *prev;
+
+	for (entry = file_cache.tail; entry && file_cache.bytes + bytes > file_cache.max_bytes; entry = prev) {
+		prev = entry->prev;
+
+		if (!entry->refs) {
+			file_cache.evictions++;
+			file_cache_detach(entry);
+		}
+	}
+
+	return file_cache.bytes + bytes <= file_cache.max_bytes ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/* mod_sndfile looks in a <rate> sub directory before the path itself so the same has to be done
+   here to find out which file is actually being played */
+static switch_bool_t file_cache_stat(const char *path, uint32_t rate, time_t *mtime, int64_t *size)
+{
+	char alt_path[1024];
+	const char *last = NULL, *p;
+	struct stat st;
+	int ok = 0;
+
+	for (p = path; *p; p++) {
+		if (*p == '/' || *p == '\\') {
+			last = p + 1;
+		}
+	}
+
+	if (last && switch_snprintf(alt_path, sizeof(alt_path), "%.*s%d%s%s", (int) (last - path), path, rate, SWITCH_PATH_SEPARATOR, last) < (int) sizeof(alt_path) - 1) {
+		ok = !stat(alt_path, &st);
+	}
+
+	if (!ok) {
+		ok = !stat(path, &st);
+	}
+
+	if (!ok || (st.st_mode & S_IFMT) != S_IFREG) {
+		return SWITCH_FALSE;
+	}
+
+	*mtime = st.st_mtime;
+	*size = (int64_t) st.st_size;
+
+	return SWITCH_TRUE;
+}
+
+static switch_status_t file_cache_load(switch_file_cache_entry_t *entry, const char *path)
+{
+	switch_file_handle_t lfh = { 0 };
+	switch_size_t len, alloced = 0;
+	const char *str;
+	int i;
+
+	if (switch_core_file_open(&lfh, path, 1, entry->rate, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT | SWITCH_FILE_NO_CACHE, NULL) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* a module may still turn the handle into passthrough of encoded frames or unmixed channels on its own */
+	if (switch_test_flag(&lfh, SWITCH_FILE_NATIVE) || switch_test_flag(&lfh, SWITCH_FILE_NOMUX)) {
+		entry->uncacheable = 1;
+		switch_core_file_close(&lfh);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* most formats know their length up front, don't decode what would be thrown away */
+	if (lfh.samples && lfh.native_rate &&
+		(uint64_t) lfh.samples * entry->rate / lfh.native_rate * sizeof(int16_t) > file_cache.max_file_bytes) {
+		entry->oversize = 1;
+		switch_core_file_close(&lfh);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (;;) {
+		if (alloced - entry->samples < FILE_CACHE_READ_SAMPLES) {
+			int16_t *mem;
+
+			alloced = alloced ? alloced * 2 : FILE_CACHE_READ_SAMPLES * 4;
+
+			mem = realloc(entry->data, alloced * sizeof(int16_t));
+			switch_assert(mem);
+			entry->data = mem;
+		}
+
+		len = FILE_CACHE_READ_SAMPLES;
+
+		if (switch_core_file_read(&lfh, entry->data + entry->samples, &len) != SWITCH_STATUS_SUCCESS || !len) {
+			break;
+		}
+
+		entry->samples += len;
+
+		if (entry->samples * sizeof(int16_t) > file_cache.max_file_bytes) {
+			entry->oversize = 1;
+			switch_core_file_close(&lfh);
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	for (i = SWITCH_AUDIO_COL_STR_TITLE; i <= SWITCH_AUDIO_COL_STR_DATE; i++) {
+		if (switch_core_file_get_string(&lfh, (switch_audio_col_t) i, &str) == SWITCH_STATUS_SUCCESS && str) {
+			entry->strings[i] = strdup(str);
+		}
+	}
+
+	switch_core_file_close(&lfh);
+
+	if (!entry->samples) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (entry->samples < alloced) {
+		int16_t *mem;
+
+		if ((mem = realloc(entry->data, entry->samples * sizeof(int16_t)))) {
+			entry->data = mem;
+		}
+	}
+
+	entry->bytes = entry->samples * sizeof(int16_t) + sizeof(*entry);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_file_cache_entry_t *file_cache_get(const char *path, uint32_t rate)
+{
+	switch_file_cache_entry_t *entry;
+	char key[1024];
+	time_t mtime;
+	int64_t size;
+	switch_time_t now = switch_micro_time_now();
+
+	if (switch_snprintf(key, sizeof(key), "%u|%s", rate, path) >= (int) sizeof(key) - 1) {
+		return NULL;
+	}
+
+	switch_mutex_lock(file_cache.mutex);
+
+	if ((entry = switch_core_hash_find(file_cache.hash, key))) {
+		if (entry->loading) {
+			/* someone else is decoding it right now, don't wait for them */
+			switch_mutex_unlock(file_cache.mutex);
+			return NULL;
+		}
+
+		if (now - entry->last_check > FILE_CACHE_CHECK_INTERVAL) {
+			entry->last_check = now;
+
+			if (!file_cache_stat(path, rate, &mtime, &size) || mtime != entry->mtime || size != entry->size) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "File cache entry [%s] at %uhz changed on disk\n", path, rate);
+				file_cache.invalidations++;
+				file_cache_detach(entry);
+				entry = NULL;
+			}
+		}
+
+		if (entry && (entry->oversize || entry->uncacheable)) {
+			/* known to be too big or not plain audio, play it uncached without trying again */
+			switch_mutex_unlock(file_cache.mutex);
+			return NULL;
+		}
+
+		if (entry) {
+			entry->refs++;
+			file_cache.hits++;
+			file_cache_unlink(entry);
+			file_cache_link(entry);
+			switch_mutex_unlock(file_cache.mutex);
+			return entry;
+		}
+	}
+
+	file_cache.misses++;
+	switch_mutex_unlock(file_cache.mutex);
+
+	if (!file_cache_stat(path, rate, &mtime, &size)) {
+		return NULL;
+	}
+
+	switch_zmalloc(entry, sizeof(*entry));
+	entry->key = strdup(key);
+	entry->rate = rate;
+	entry->mtime = mtime;
+	entry->size = size;
+	entry->last_check = now;
+	entry->loading = 1;
+
+	switch_mutex_lock(file_cache.mutex);
+	if (switch_core_hash_find(file_cache.hash, key)) {
+		switch_mutex_unlock(file_cache.mutex);
+		file_cache_free(entry);
+		return NULL;
+	}
+	switch_core_hash_insert(file_cache.hash, key, entry);
+	switch_mutex_unlock(file_cache.mutex);
+
+	if (file_cache_load(entry, path) != SWITCH_STATUS_SUCCESS) {
+		switch_mutex_lock(file_cache.mutex);
+		entry->loading = 0;
+
+		if ((entry->oversize || entry->uncacheable) && !entry->detached) {
+			/* keep the key as a negative entry so later opens skip the decode until the file changes */
+			switch_safe_free(entry->data);
+			entry->samples = 0;
+			entry->bytes = sizeof(*entry);
+
+			if (file_cache_make_room(entry->bytes)) {
+				file_cache_link(entry);
+				file_cache.bytes += entry->bytes;
+				file_cache.entries++;
+				entry = NULL;
+			}
+		}
+
+		if (entry) {
+			if (!entry->detached) {
+				switch_core_hash_delete(file_cache.hash, key);
+			}
+			file_cache_free(entry);
+		}
+		switch_mutex_unlock(file_cache.mutex);
+		return NULL;
+	}
+
+	switch_mutex_lock(file_cache.mutex);
+	entry->loading = 0;
+	entry->refs = 1;
+
+	if (!entry->detached) {
+		if (file_cache_make_room(entry->bytes)) {
+			file_cache_link(entry);
+			file_cache.bytes += entry->bytes;
+			file_cache.entries++;
+		} else {
+			/* no room, this handle gets a private copy that goes away when it is closed */
+			switch_core_hash_delete(file_cache.hash, key);
+			entry->detached = 1;
+		}
+	}
+	switch_mutex_unlock(file_cache.mutex);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "File cache loaded [%s] at %uhz %" SWITCH_SIZE_T_FMT " samples%s\n",
+					  path, rate, entry->samples, entry->detached ? " (uncached)" : "");
+
+	return entry;
+}
+
+static void file_cache_release(switch_file_cache_entry_t *entry)
+{
+	switch_mutex_lock(file_cache.mutex);
+	if (!--entry->refs && entry->detached) {
+		file_cache_free(entry);
+	}
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+static switch_status_t file_cache_open(switch_file_handle_t *fh, unsigned int flags, uint32_t rate)
+{
+	switch_file_cache_entry_t *entry;
+
+	if (!file_cache.ready || !file_cache.max_bytes || !rate || !(flags & SWITCH_FILE_FLAG_READ) || !fh->file_interface->cacheable ||
+		(flags & (SWITCH_FILE_FLAG_WRITE | SWITCH_FILE_NATIVE | SWITCH_FILE_NOMUX | SWITCH_FILE_NO_CACHE)) ||
+		fh->params || fh->pre_buffer_datalen || fh->prebuf) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!(entry = file_cache_get(fh->file_path, rate))) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	fh->cache_entry = entry;
+	fh->channels = 1;
+	fh->samplerate = fh->native_rate = rate;
+	fh->sample_count = entry->samples;
+	fh->seekable = 1;
+	fh->pos = 0;
+	fh->handler = NULL;
+	fh->spool_path = NULL;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t file_cache_read(switch_file_handle_t *fh, void *data, switch_size_t *len)
+{
+	switch_file_cache_entry_t *entry = fh->cache_entry;
+	switch_size_t left = entry->samples - (switch_size_t) fh->pos;
+
+	if (*len > left) {
+		*len = left;
+	}
+
+	if (!*len) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memcpy(data, entry->data + fh->pos, *len * sizeof(int16_t));
+	fh->pos += *len;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t file_cache_seek(switch_file_handle_t *fh, unsigned int *cur_pos, int64_t samples, int whence)
+{
+	int64_t pos;
+
+	switch (whence) {
+	case SEEK_CUR:
+		pos = fh->pos + samples;
+		break;
+	case SEEK_END:
+		pos = (int64_t) fh->cache_entry->samples + samples;
+		break;
+	default:
+		pos = samples;
+		break;
+	}
+
+	if (pos < 0) {
+		pos = 0;
+	} else if (pos > (int64_t) fh->cache_entry->samples) {
+		pos = (int64_t) fh->cache_entry->samples;
+	}
+
+	fh->pos = pos;
+	*cur_pos = (unsigned int) pos;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_file_cache_encoded_t *file_cache_encode(switch_file_cache_entry_t *entry, const char *key, switch_codec_t *codec)
+{
+	const switch_codec_implementation_t *impl = codec->implementation;
+	switch_file_cache_encoded_t *enc;
+	switch_codec_t enc_codec = { 0 };
+	int16_t *frame;
+	uint8_t out[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	switch_size_t pos, alloced;
+	uint32_t spf = impl->samples_per_packet, i, nframes;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	if (switch_core_codec_init(&enc_codec, impl->iananame, codec->fmtp_in, impl->samples_per_second, impl->microseconds_per_packet / 1000,
+							   impl->number_of_channels, SWITCH_CODEC_FLAG_ENCODE, NULL, NULL) != SWITCH_STATUS_SUCCESS) {
+		return NULL;
+	}
+
+	if (enc_codec.implementation != impl) {
+		switch_core_codec_destroy(&enc_codec);
+		return NULL;
+	}
+
+	nframes = (uint32_t) ((entry->samples + spf - 1) / spf);
+
+	switch_zmalloc(enc, sizeof(*enc));
+	enc->key = strdup(key);
+	enc->implementation = impl;
+	enc->samples_per_frame = spf;
+	enc->frames = nframes;
+	switch_zmalloc(enc->offsets, (nframes + 2) * sizeof(uint32_t));
+	switch_zmalloc(frame, spf * sizeof(int16_t));
+	alloced = 0;
+
+	/* the last frame is padded out with silence and one frame of pure silence is added after it */
+	for (i = 0, pos = 0; i <= nframes; i++, pos += spf) {
+		uint32_t rate = impl->actual_samples_per_second;
+		uint32_t outlen = sizeof(out);
+		unsigned int flag = 0;
+		switch_size_t n = 0;
+
+		memset(frame, 0, spf * sizeof(int16_t));
+
+		if (i < nframes) {
+			n = entry->samples - pos < spf ? entry->samples - pos : spf;
+			memcpy(frame, entry->data + pos, n * sizeof(int16_t));
+		}
+
+		if (switch_core_codec_encode(&enc_codec, NULL, frame, spf * sizeof(int16_t), impl->actual_samples_per_second,
+									 out, &outlen, &rate, &flag) != SWITCH_STATUS_SUCCESS || !outlen) {
+			status = SWITCH_STATUS_FALSE;
+			break;
+		}
+
+		if (enc->bytes + outlen > alloced) {
+			uint8_t *mem;
+
+			alloced = alloced ? alloced * 2 : outlen * (nframes + 1);
+
+			if (alloced < enc->bytes + outlen) {
+				alloced = enc->bytes + outlen;
+			}
+
+			mem = realloc(enc->data, alloced);
+			switch_assert(mem);
+			enc->data = mem;
+		}
+
+		memcpy(enc->data + enc->bytes, out, outlen);
+		enc->bytes += outlen;
+		enc->offsets[i + 1] = (uint32_t) enc->bytes;
+	}
+
+	free(frame);
+	switch_core_codec_destroy(&enc_codec);
+
+	if (status != SWITCH_STATUS_SUCCESS) {
+		file_cache_free_encoded(enc);
+		return NULL;
+	}
+
+	enc->bytes += (nframes + 2) * sizeof(uint32_t) + sizeof(*enc);
+
+	return enc;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_file_cache_encode(switch_file_handle_t *fh, switch_codec_t *codec)
+{
+	switch_file_cache_entry_t *entry = fh->cache_entry;
+	switch_file_cache_encoded_t *enc, *np;
+	const switch_codec_implementation_t *impl;
+	char key[512];
+
+	if (!entry || !switch_core_codec_ready(codec)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	impl = codec->implementation;
+
+	if (impl->codec_type != SWITCH_CODEC_TYPE_AUDIO || impl->actual_samples_per_second != entry->rate || impl->number_of_channels != 1 ||
+		!impl->samples_per_packet || impl->samples_per_packet * sizeof(int16_t) > SWITCH_RECOMMENDED_BUFFER_SIZE || !strcasecmp(impl->iananame, "L16")) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_snprintf(key, sizeof(key), "%s@%uh@%ui|%s", impl->iananame, impl->samples_per_second, impl->microseconds_per_packet,
+					switch_str_nil(codec->fmtp_in));
+
+	switch_mutex_lock(file_cache.mutex);
+	for (enc = entry->encoded; enc; enc = enc->next) {
+		if (enc->implementation == impl && !strcmp(enc->key, key)) {
+			break;
+		}
+	}
+	if (enc) {
+		file_cache.encoded_hits++;
+	}
+	switch_mutex_unlock(file_cache.mutex);
+
+	if (!enc) {
+		if (!(np = file_cache_encode(entry, key, codec))) {
+			return SWITCH_STATUS_FALSE;
+		}
+
+		switch_mutex_lock(file_cache.mutex);
+		for (enc = entry->encoded; enc; enc = enc->next) {
+			if (enc->implementation == impl && !strcmp(enc->key, key)) {
+				break;
+			}
+		}
+
+		if (enc) {
+			/* lost the race to another handle encoding the same thing */
+			file_cache_free_encoded(np);
+		} else {
+			enc = np;
+			enc->next = entry->encoded;
+			entry->encoded = enc;
+			entry->bytes += enc->bytes;
+			file_cache.encodes++;
+
+			if (!entry->detached) {
+				file_cache.bytes += enc->bytes;
+				file_cache_make_room(0);
+			}
+		}
+		switch_mutex_unlock(file_cache.mutex);
+	}
+
+	fh->cache_encoded = enc;
+	switch_set_flag(fh, SWITCH_FILE_NATIVE);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_file_cache_read_encoded(switch_file_handle_t *fh, void *data, switch_size_t *datalen, uint32_t *samples)
+{
+	switch_file_cache_encoded_t *enc = fh->cache_encoded;
+	uint32_t idx, len;
+
+	if (!enc || !switch_test_flag(fh, SWITCH_FILE_OPEN)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (switch_test_flag(fh, SWITCH_FILE_PAUSE)) {
+		idx = enc->frames;
+	} else {
+		if ((idx = (uint32_t) (fh->pos / enc->samples_per_frame)) >= enc->frames) {
+			*datalen = 0;
+			return SWITCH_STATUS_FALSE;
+		}
+
+		fh->pos = (int64_t) (idx + 1) * enc->samples_per_frame;
+		if (fh->pos > (int64_t) fh->cache_entry->samples) {
+			fh->pos = (int64_t) fh->cache_entry->samples;
+		}
+		fh->offset_pos = (uint32_t) fh->pos;
+		fh->samples_in += enc->samples_per_frame;
+	}
+
+	len = enc->offsets[idx + 1] - enc->offsets[idx];
+
+	if (len > *datalen) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memcpy(data, enc->data + enc->offsets[idx], len);
+	*datalen = len;
+	*samples = enc->samples_per_frame;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_decode(switch_file_handle_t *fh)
+{
+	if (fh->cache_encoded) {
+		fh->cache_encoded = NULL;
+		switch_clear_flag(fh, SWITCH_FILE_NATIVE);
+	}
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_set_size(switch_size_t bytes)
+{
+	switch_mutex_lock(file_cache.mutex);
+	file_cache.max_bytes = bytes;
+	file_cache_make_room(0);
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_set_max_file_size(switch_size_t bytes)
+{
+	switch_file_cache_entry_t *entry, *next;
+
+	switch_mutex_lock(file_cache.mutex);
+	file_cache.max_file_bytes = bytes;
+
+	/* files that were too big may fit now */
+	for (entry = file_cache.head; entry; entry = next) {
+		next = entry->next;
+		if (entry->oversize) {
+			file_cache_detach(entry);
+		}
+	}
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_flush(void)
+{
+	switch_file_cache_entry_t *entry, *next;
+
+	if (!file_cache.ready) {
+		return;
+	}
+
+	switch_mutex_lock(file_cache.mutex);
+	for (entry = file_cache.head; entry; entry = next) {
+		next = entry->next;
+		file_cache_detach(entry);
+	}
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_status(switch_stream_handle_t *stream)
+{
+	switch_mutex_lock(file_cache.mutex);
+	stream->write_function(stream, "file cache %u entries %" SWITCH_SIZE_T_FMT "K/%" SWITCH_SIZE_T_FMT "K hits %" SWITCH_UINT64_T_FMT
+						   " misses %" SWITCH_UINT64_T_FMT " evictions %" SWITCH_UINT64_T_FMT " invalidations %" SWITCH_UINT64_T_FMT
+						   " encoded hits %" SWITCH_UINT64_T_FMT " encodes %" SWITCH_UINT64_T_FMT "\n",
+						   file_cache.entries, file_cache.bytes / 1024, file_cache.max_bytes / 1024,
+						   file_cache.hits, file_cache.misses, file_cache.evictions, file_cache.invalidations,
+						   file_cache.encoded_hits, file_cache.encodes);
+	switch_mutex_unlock(file_cache.mutex);
+}
+
+/* Asynchronous writing for handles opened with SWITCH_FILE_WRITE_ASYNC: switch_core_file_write only appends
+   to a per-handle buffer and a small pool of writer threads pass it to the format module in large chunks.
+   When a handle can't be queued or its buffer is full the caller falls back to writing synchronously. */
+
+#define FILE_ASYNC_MAX_WRITERS 32
+#define FILE_ASYNC_CHUNK (64 * 1024)
+#define FILE_ASYNC_THRESHOLD (16 * 1024)
+#define FILE_ASYNC_DEFAULT_WRITERS 2
+#define FILE_ASYNC_DEFAULT_BUFFER_SIZE (1024 * 1024)
+
+struct switch_file_async {
+	switch_memory_pool_t *pool;
+	/* protects the buffer and the flags */
+	switch_mutex_t *mutex;
+	/* held while calling into the format module so writes stay in order */
+	switch_mutex_t *io_mutex;
+	switch_buffer_t *buffer;
+	switch_file_handle_t *fh;
+	uint8_t *chunk;
+	uint32_t sample_bytes;
+	uint8_t queued;
+	uint8_t closed;
+	uint8_t error;
+	switch_size_t peak;
+	uint32_t overflows;
+};
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_queue_t *queue;
+	switch_thread_t *threads[FILE_ASYNC_MAX_WRITERS];
+	uint32_t writers;
+	uint32_t running;
+	switch_size_t buffer_size;
+	uint64_t bytes;
+	uint64_t writes;
+	uint64_t overflows;
+	uint64_t errors;
+	switch_size_t peak;
+	switch_time_t slowest_write;
+} file_async;
+
+static void file_async_destroy(switch_file_async_t *async)
+{
+	switch_memory_pool_t *pool = async->pool;
+
+	switch_buffer_destroy(&async->buffer);
+	switch_core_destroy_memory_pool(&pool);
+}
+
+/* must be called with the io mutex held */
+static void file_async_drain(switch_file_async_t *async)
+{
+	switch_file_handle_t *fh = async->fh;
+	switch_size_t bytes, len;
+	switch_time_t started, took;
+
+	for (;;) {
+		switch_mutex_lock(async->mutex);
+		bytes = switch_buffer_read(async->buffer, async->chunk, FILE_ASYNC_CHUNK - (FILE_ASYNC_CHUNK % async->sample_bytes));
+		switch_mutex_unlock(async->mutex);
+
+		if (!bytes) {
+			break;
+		}
+
+		if (async->error) {
+			continue;
+		}
+
+		len = bytes / async->sample_bytes;
+		started = switch_time_now();
+
+		if (fh->file_interface->file_write(fh, async->chunk, &len) != SWITCH_STATUS_SUCCESS) {
+			async->error = 1;
+		}
+
+		took = switch_time_now() - started;
+
+		switch_mutex_lock(file_async.mutex);
+		file_async.bytes += bytes;
+		file_async.writes++;
+		if (async->error) {
+			file_async.errors++;
+		}
+		if (took > file_async.slowest_write) {
+			file_async.slowest_write = took;
+		}
+		switch_mutex_unlock(file_async.mutex);
+	}
+}
+
+static void *SWITCH_THREAD_FUNC file_async_thread(switch_thread_t *thread, void *obj)
+{
+	void *pop = NULL;
+
+	while (switch_queue_pop(file_async.queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		switch_file_async_t *async = (switch_file_async_t *) pop;
+		int destroy;
+
+		switch_mutex_lock(async->io_mutex);
+
+		if (!async->closed) {
+			file_async_drain(async);
+		}
+
+		switch_mutex_lock(async->mutex);
+		async->queued = 0;
+		destroy = async->closed;
+		switch_mutex_unlock(async->mutex);
+
+		switch_mutex_unlock(async->io_mutex);
+
+		if (destroy) {
+			file_async_destroy(async);
+		}
+	}
+
+	return NULL;
+}
+
+static void file_async_start_writers(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+
+	switch_mutex_lock(file_async.mutex);
+	if (file_async.running < file_async.writers) {
+		switch_threadattr_create(&thd_attr, file_async.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+		for (; file_async.running < file_async.writers; file_async.running++) {
+			switch_thread_create(&file_async.threads[file_async.running], thd_attr, file_async_thread, NULL, file_async.pool);
+		}
+	}
+	switch_mutex_unlock(file_async.mutex);
+}
+
+static void file_async_create(switch_file_handle_t *fh)
+{
+	switch_memory_pool_t *pool;
+	switch_file_async_t *async;
+
+	if (!file_async.writers || switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	file_async_start_writers();
+
+	async = switch_core_alloc(pool, sizeof(*async));
+	async->pool = pool;
+	async->fh = fh;
+	async->sample_bytes = (switch_test_flag(fh, SWITCH_FILE_NATIVE) ? 1 : 2) * (fh->channels ? fh->channels : 1);
+	async->chunk = switch_core_alloc(pool, FILE_ASYNC_CHUNK);
+	switch_mutex_init(&async->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&async->io_mutex, SWITCH_MUTEX_NESTED, pool);
+
+	if (switch_buffer_create_dynamic(&async->buffer, FILE_ASYNC_THRESHOLD, FILE_ASYNC_THRESHOLD * 2, file_async.buffer_size) != SWITCH_STATUS_SUCCESS) {
+		switch_core_destroy_memory_pool(&pool);
+		return;
+	}
+
+	fh->async = async;
+}
+
+static switch_status_t file_async_write(switch_file_handle_t *fh, void *data, switch_size_t *len)
+{
+	switch_file_async_t *async = fh->async;
+	switch_size_t bytes = *len * async->sample_bytes, inuse;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+
+	if (async->error) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(async->mutex);
+
+	if (!switch_buffer_write(async->buffer, data, bytes)) {
+		switch_mutex_unlock(async->mutex);
+
+		/* the writers are not keeping up, write it ourselves behind whatever is already buffered */
+		switch_mutex_lock(async->io_mutex);
+		file_async_drain(async);
+		if (async->error || fh->file_interface->file_write(fh, data, len) != SWITCH_STATUS_SUCCESS) {
+			async->error = 1;
+			status = SWITCH_STATUS_FALSE;
+		}
+		switch_mutex_unlock(async->io_mutex);
+
+		async->overflows++;
+		switch_mutex_lock(file_async.mutex);
+		file_async.overflows++;
+		switch_mutex_unlock(file_async.mutex);
+
+		return status;
+	}
+
+	inuse = switch_buffer_inuse(async->buffer);
+
+	if (inuse > async->peak) {
+		async->peak = inuse;
+	}
+
+	if (inuse >= FILE_ASYNC_THRESHOLD && !async->queued && switch_queue_trypush(file_async.queue, async) == SWITCH_STATUS_SUCCESS) {
+		async->queued = 1;
+	}
+
+	switch_mutex_unlock(async->mutex);
+
+	return status;
+}
+
+/* flush what is buffered and keep the writers away from the format module until file_async_unlock */
+static void file_async_lock(switch_file_handle_t *fh)
+{
+	if (fh->async) {
+		switch_mutex_lock(fh->async->io_mutex);
+		file_async_drain(fh->async);
+	}
+}
+
+static void file_async_unlock(switch_file_handle_t *fh)
+{
+	if (fh->async) {
+		switch_mutex_unlock(fh->async->io_mutex);
+	}
+}
+
+static switch_status_t file_async_close(switch_file_handle_t *fh)
+{
+	switch_file_async_t *async = fh->async;
+	switch_status_t status;
+	int destroy;
+
+	switch_mutex_lock(async->io_mutex);
+	file_async_drain(async);
+	status = async->error ? SWITCH_STATUS_FALSE : SWITCH_STATUS_SUCCESS;
+
+	switch_mutex_lock(async->mutex);
+	async->closed = 1;
+	destroy = !async->queued;
+	switch_mutex_unlock(async->mutex);
+
+	switch_mutex_unlock(async->io_mutex);
+
+	switch_mutex_lock(file_async.mutex);
+	if (async->peak > file_async.peak) {
+		file_async.peak = async->peak;
+	}
+	switch_mutex_unlock(file_async.mutex);
+
+	if (async->overflows) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "File [%s] fell back to synchronous writes %u time(s), peak buffered %" SWITCH_SIZE_T_FMT " bytes\n",
+						  fh->file_path, async->overflows, async->peak);
+	}
+
+	fh->async = NULL;
+
+	if (destroy) {
+		file_async_destroy(async);
+	}
+
+	return status;
+}
+
+SWITCH_DECLARE(void) switch_core_file_async_set_writers(uint32_t writers)
+{
+	if (writers > FILE_ASYNC_MAX_WRITERS) {
+		writers = FILE_ASYNC_MAX_WRITERS;
+	}
+
+	/* threads are started on first use and never stopped, 0 only stops new handles from being written asynchronously */
+	switch_mutex_lock(file_async.mutex);
+	file_async.writers = writers;
+	switch_mutex_unlock(file_async.mutex);
+}
+
+SWITCH_DECLARE(void) switch_core_file_async_set_buffer_size(switch_size_t bytes)
+{
+	if (bytes < FILE_ASYNC_THRESHOLD * 2) {
+		bytes = FILE_ASYNC_THRESHOLD * 2;
+	}
+
+	file_async.buffer_size = bytes;
+}
+
+SWITCH_DECLARE(void) switch_core_file_async_status(switch_stream_handle_t *stream)
+{
+	switch_mutex_lock(file_async.mutex);
+	stream->write_function(stream, "file writers %u/%u queued %u written %" SWITCH_UINT64_T_FMT "K in %" SWITCH_UINT64_T_FMT " writes slowest %" SWITCH_TIME_T_FMT
+						   "us peak buffered %" SWITCH_SIZE_T_FMT "K/%" SWITCH_SIZE_T_FMT "K sync fallbacks %" SWITCH_UINT64_T_FMT " errors %" SWITCH_UINT64_T_FMT "\n",
+						   file_async.running, file_async.writers, file_async.queue ? switch_queue_size(file_async.queue) : 0, file_async.bytes / 1024, file_async.writes,
+						   file_async.slowest_write, file_async.peak / 1024, file_async.buffer_size / 1024, file_async.overflows, file_async.errors);
+	switch_mutex_unlock(file_async.mutex);
+}
+
+void switch_core_file_init(switch_memory_pool_t *pool)
+{
+	memset(&file_cache, 0, sizeof(file_cache));
+	switch_mutex_init(&file_cache.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&file_cache.hash, pool);
+	file_cache.max_bytes = FILE_CACHE_DEFAULT_SIZE;
+	file_cache.max_file_bytes = FILE_CACHE_DEFAULT_FILE_SIZE;
+	file_cache.ready = 1;
+
+	memset(&file_async, 0, sizeof(file_async));
+	file_async.pool = pool;
+	file_async.buffer_size = FILE_ASYNC_DEFAULT_BUFFER_SIZE;
+	switch_mutex_init(&file_async.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_queue_create(&file_async.queue, SWITCH_CORE_QUEUE_LEN, pool);
+	file_async.writers = FILE_ASYNC_DEFAULT_WRITERS;
+}
+
+void switch_core_file_shutdown(void)
+{
+	switch_status_t st;
+	uint32_t i;
+
+	switch_mutex_lock(file_async.mutex);
+	file_async.writers = 0;
+	switch_mutex_unlock(file_async.mutex);
+
+	for (i = 0; i < file_async.running; i++) {
+		switch_queue_push(file_async.queue, NULL);
+	}
+
+	for (i = 0; i < file_async.running; i++) {
+		switch_thread_join(&st, file_async.threads[i]);
+	}
+
+	file_async.running = 0;
+
+	switch_core_file_cache_flush();
+	file_cache.ready = 0;
+	switch_core_hash_destroy(&file_cache.hash);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file, const char *func, int line,
 															  switch_file_handle_t *fh,
 															  const char *file_path,
@@ -155,6 +1218,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file,
 	fh->func = func;
 	fh->line = line;
 
+	if (!is_stream && file_cache_open(fh, flags, rate) == SWITCH_STATUS_SUCCESS) {
+		switch_set_flag(fh, SWITCH_FILE_OPEN);
+		return SWITCH_STATUS_SUCCESS;
+	}
 
 	if (spool_path) {
 		char uuid_str[SWITCH_UUID_FORMATTED_LENGTH + 1];
@@ -219,7 +1286,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file,
 		}
 	}
 
-	if (fh->pre_buffer_datalen) {
+	if ((flags & SWITCH_FILE_FLAG_WRITE) && (flags & SWITCH_FILE_WRITE_ASYNC) && fh->file_interface->file_write) {
+		file_async_create(fh);
+	}
+
+	if (fh->pre_buffer_datalen && !fh->async) {
 		//switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Prebuffering %d bytes\n", (int)fh->pre_buffer_datalen);
 		switch_buffer_create_dynamic(&fh->pre_buffer, fh->pre_buffer_datalen * fh->channels, fh->pre_buffer_datalen * fh->channels / 2, 0);
 		fh->pre_buffer_data = switch_core_alloc(fh->memory_pool, fh->pre_buffer_datalen * fh->channels);
@@ -316,7 +1387,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 
 	} else {
 
-		if ((status = fh->file_interface->file_read(fh, data, len)) != SWITCH_STATUS_SUCCESS || !*len) {
+		if (fh->cache_entry) {
+			status = file_cache_read(fh, data, len);
+		} else {
+			status = fh->file_interface->file_read(fh, data, len);
+		}
+
+		if (status != SWITCH_STATUS_SUCCESS || !*len) {
 			switch_set_flag(fh, SWITCH_FILE_DONE);
 			goto top;
 		}
@@ -386,7 +1463,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_write(switch_file_handle_t *fh,
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if (!fh->file_interface->file_write) {
+	if (fh->cache_entry || !fh->file_interface->file_write) {
 		return SWITCH_STATUS_FALSE;
 	}
 
@@ -449,7 +1526,14 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_write(switch_file_handle_t *fh,
 		return status;
 	} else {
 		switch_status_t status;
-		if ((status = fh->file_interface->file_write(fh, data, len)) == SWITCH_STATUS_SUCCESS) {
+
+		if (fh->async) {
+			status = file_async_write(fh, data, len);
+		} else {
+			status = fh->file_interface->file_write(fh, data, len);
+		}
+
+		if (status == SWITCH_STATUS_SUCCESS) {
 			fh->samples_out += orig_len;
 		}
 		return status;
@@ -465,7 +1549,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_write_video(switch_file_handle_
 		return SWITCH_STATUS_GENERR;
 	}
 
-	if (!fh->file_interface->file_write_video) {
+	if (fh->cache_entry || !fh->file_interface->file_write_video) {
 		return SWITCH_STATUS_FALSE;
 	}
 
@@ -480,7 +1564,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_seek(switch_file_handle_t *fh,
 	
 	switch_assert(fh != NULL);
 
-	if (!switch_test_flag(fh, SWITCH_FILE_OPEN) || !fh->file_interface->file_seek) {
+	if (!switch_test_flag(fh, SWITCH_FILE_OPEN) || (!fh->cache_entry && !fh->file_interface->file_seek)) {
 		ok = 0;
 	} else if (switch_test_flag(fh, SWITCH_FILE_FLAG_WRITE)) {
 		if (!(switch_test_flag(fh, SWITCH_FILE_WRITE_APPEND) || switch_test_flag(fh, SWITCH_FILE_WRITE_OVER))) {
@@ -502,18 +1586,27 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_seek(switch_file_handle_t *fh,
 		switch_buffer_zero(fh->pre_buffer);
 	}
 
+	file_async_lock(fh);
+
 	if (whence == SWITCH_SEEK_CUR) {
 		unsigned int cur = 0;
 
 		if (switch_test_flag(fh, SWITCH_FILE_FLAG_WRITE)) {
 			fh->file_interface->file_seek(fh, &cur, fh->samples_out, SEEK_SET);
+		} else if (fh->cache_entry) {
+			file_cache_seek(fh, &cur, fh->offset_pos, SEEK_SET);
 		} else {
 			fh->file_interface->file_seek(fh, &cur, fh->offset_pos, SEEK_SET);
 		}
 	}
 
 	switch_set_flag(fh, SWITCH_FILE_SEEK);
-	status = fh->file_interface->file_seek(fh, cur_pos, samples, whence);
+
+	if (fh->cache_entry) {
+		status = file_cache_seek(fh, cur_pos, samples, whence);
+	} else {
+		status = fh->file_interface->file_seek(fh, cur_pos, samples, whence);
+	}
 
 	fh->offset_pos = *cur_pos;
 
@@ -521,6 +1614,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_seek(switch_file_handle_t *fh,
 		fh->samples_out = *cur_pos;
 	}
 
+	file_async_unlock(fh);
+
 	return status;
 }
 
@@ -533,10 +1628,20 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_set_string(switch_file_handle_t
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if (!fh->file_interface->file_set_string) {
+	if (fh->cache_entry || !fh->file_interface->file_set_string) {
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->async) {
+		switch_status_t status;
+
+		file_async_lock(fh);
+		status = fh->file_interface->file_set_string(fh, col, string);
+		file_async_unlock(fh);
+
+		return status;
+	}
+
 	return fh->file_interface->file_set_string(fh, col, string);
 }
 
@@ -549,6 +1654,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_get_string(switch_file_handle_t
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->cache_entry) {
+		if (col > SWITCH_AUDIO_COL_STR_DATE || !(*string = fh->cache_entry->strings[col])) {
+			return SWITCH_STATUS_FALSE;
+		}
+		return SWITCH_STATUS_SUCCESS;
+	}
+
 	if (!fh->file_interface->file_get_string) {
 		return SWITCH_STATUS_FALSE;
 	}
@@ -571,7 +1683,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_truncate(switch_file_handle_t *
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if ((status = fh->file_interface->file_truncate(fh, offset)) == SWITCH_STATUS_SUCCESS) {
+	file_async_lock(fh);
+	status = fh->file_interface->file_truncate(fh, offset);
+	file_async_unlock(fh);
+
+	if (status == SWITCH_STATUS_SUCCESS) {
 		if (fh->buffer) {
 			switch_buffer_zero(fh->buffer);
 		}
@@ -630,8 +1746,20 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(switch_file_handle_t *fh)
 		switch_buffer_destroy(&fh->pre_buffer);
 	}
 
+	if (fh->async) {
+		file_async_close(fh);
+	}
+
 	switch_clear_flag(fh, SWITCH_FILE_OPEN);
-	status = fh->file_interface->file_close(fh);
+
+	if (fh->cache_entry) {
+		file_cache_release(fh->cache_entry);
+		fh->cache_entry = NULL;
+		fh->cache_encoded = NULL;
+		status = SWITCH_STATUS_SUCCESS;
+	} else {
+		status = fh->file_interface->file_close(fh);
+	}
 
 	switch_resample_destroy(&fh->resampler);
 
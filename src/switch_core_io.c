@@ -687,16 +687,22 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 			int prune = 0;
 			switch_thread_rwlock_rdlock(session->bug_rwlock);
 
+			/* one copy of the frame for every bug, each one reads it back at its own pace */
+			switch_core_media_bug_ring_write(session, session->bug_read_ring, read_frame->data, read_frame->datalen, 0);
+
 			for (bp = session->bugs; bp; bp = bp->next) {
 				if (switch_channel_test_flag(session->channel, CF_PAUSE_BUGS) && !switch_core_media_bug_test_flag(bp, SMBF_NO_PAUSE)) {
+					switch_core_media_bug_ring_skip(session->bug_read_ring, &bp->read_pos);
 					continue;
 				}
 
 				if (!switch_channel_test_flag(session->channel, CF_ANSWERED) && switch_core_media_bug_test_flag(bp, SMBF_ANSWER_REQ)) {
+					switch_core_media_bug_ring_skip(session->bug_read_ring, &bp->read_pos);
 					continue;
 				}
 
 				if (!switch_channel_test_flag(session->channel, CF_BRIDGED) && switch_core_media_bug_test_flag(bp, SMBF_BRIDGE_REQ)) {
+					switch_core_media_bug_ring_skip(session->bug_read_ring, &bp->read_pos);
 					continue;
 				}
 
@@ -707,16 +713,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 
 				if (ok && bp->ready && switch_test_flag(bp, SMBF_READ_STREAM)) {
 					switch_mutex_lock(bp->read_mutex);
-					if (bp->read_demux_frame) {
-						uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
-						int bytes = read_frame->datalen / 2;
-
-						memcpy(data, read_frame->data, read_frame->datalen);
-						switch_unmerge_sln((int16_t *)data, bytes, bp->read_demux_frame->data, bytes);
-						switch_buffer_write(bp->raw_read_buffer, data, read_frame->datalen);
-					} else {
-						switch_buffer_write(bp->raw_read_buffer, read_frame->data, read_frame->datalen);
-					}
+					switch_core_media_bug_feed_read(bp, read_frame);
 
 					if (bp->callback) {
 						ok = bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_READ);
@@ -972,6 +969,68 @@ static switch_status_t perform_write(switch_core_session_t *session, switch_fram
 	return status;
 }
 
+/* byte granularity an encoded stream can be cut at when only the ptime differs, 0 when it can't */
+static uint32_t repack_unit(const switch_codec_implementation_t *from, const switch_codec_implementation_t *to)
+{
+	if (!from->iananame || !to->iananame || strcasecmp(from->iananame, to->iananame) ||
+		from->actual_samples_per_second != to->actual_samples_per_second || from->number_of_channels != to->number_of_channels ||
+		from->microseconds_per_packet == to->microseconds_per_packet || !to->encoded_bytes_per_packet) {
+		return 0;
+	}
+
+	if (!strcasecmp(from->iananame, "PCMU") || !strcasecmp(from->iananame, "PCMA") || !strcasecmp(from->iananame, "G722")) {
+		return 1;
+	}
+
+	if (!strcasecmp(from->iananame, "G729")) {
+		return 10;
+	}
+
+	return 0;
+}
+
+static switch_status_t repack_write(switch_core_session_t *session, switch_frame_t *frame, switch_io_flag_t flags, int stream_id)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	uint32_t bytes = session->write_impl.encoded_bytes_per_packet;
+	switch_bool_t m = frame->m;
+
+	if (!session->write_repack_buffer) {
+		uint32_t len = bytes > frame->datalen ? bytes : frame->datalen;
+
+		if ((status = switch_buffer_create_dynamic(&session->write_repack_buffer, len * 2, len * 4, 0)) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Repacketize Buffer Failed!\n");
+			return status;
+		}
+
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Repacketizing %s %dms->%dms\n",
+						  session->write_impl.iananame, frame->codec->implementation->microseconds_per_packet / 1000,
+						  session->write_impl.microseconds_per_packet / 1000);
+	}
+
+	if (!switch_buffer_write(session->write_repack_buffer, frame->data, frame->datalen)) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	while (status == SWITCH_STATUS_SUCCESS && switch_buffer_inuse(session->write_repack_buffer) >= bytes) {
+		session->enc_write_frame.datalen = (uint32_t) switch_buffer_read(session->write_repack_buffer, session->enc_write_frame.data, bytes);
+		session->enc_write_frame.codec = session->write_codec;
+		session->enc_write_frame.samples = session->write_impl.samples_per_packet;
+		session->enc_write_frame.rate = session->write_impl.actual_samples_per_second;
+		/* the packets no longer line up with the source timestamps, let the endpoint stamp them */
+		session->enc_write_frame.timestamp = 0;
+		session->enc_write_frame.payload = session->write_impl.ianacode;
+		session->enc_write_frame.m = m;
+		session->enc_write_frame.ssrc = frame->ssrc;
+		session->enc_write_frame.seq = frame->seq;
+		session->enc_write_frame.flags = 0;
+		status = perform_write(session, &session->enc_write_frame, flags, stream_id);
+		m = SWITCH_FALSE;
+	}
+
+	return status;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_session_t *session, switch_frame_t *frame, switch_io_flag_t flags,
 																int stream_id)
 {
@@ -1104,6 +1163,28 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 		goto done;
 	}
 
+	if (session->write_transcode_from != frame->codec->implementation || session->write_transcode_to != session->write_codec->implementation) {
+		session->write_transcode_from = frame->codec->implementation;
+		session->write_transcode_to = session->write_codec->implementation;
+		session->write_transcode = switch_core_codec_find_transcoder(session->write_transcode_from, session->write_transcode_to);
+		session->write_repack_unit = repack_unit(session->write_transcode_from, session->write_transcode_to);
+		if (session->write_repack_buffer) {
+			switch_buffer_zero(session->write_repack_buffer);
+		}
+	}
+
+	/* same codec at another ptime: split or join the encoded frames instead of decoding them */
+	if (session->write_repack_unit && ptime_mismatch && !do_resample && !session->bugs && !switch_test_flag(frame, SFF_PLC)) {
+		if (frame->datalen == frame->codec->implementation->encoded_bytes_per_packet && !(frame->datalen % session->write_repack_unit)) {
+			status = repack_write(session, frame, flags, stream_id);
+			goto error;
+		}
+
+		if (session->write_repack_buffer) {
+			switch_buffer_zero(session->write_repack_buffer);
+		}
+	}
+
 	if (!switch_test_flag(session, SSF_WARN_TRANSCODE)) {
 		switch_core_session_message_t msg = { 0 };
 
@@ -1112,6 +1193,27 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 		switch_set_flag(session, SSF_WARN_TRANSCODE);
 	}
 
+	/* whole frames that only change encoding go straight across when there is nothing that needs the linear audio */
+	if (session->write_transcode && !ptime_mismatch && !do_resample && !session->bugs && !session->write_resampler &&
+		!switch_test_flag(frame, SFF_PLC) && frame->datalen == frame->codec->implementation->encoded_bytes_per_packet) {
+		session->enc_write_frame.datalen = session->enc_write_frame.buflen;
+
+		if (session->write_transcode(frame->data, frame->datalen, session->enc_write_frame.data, &session->enc_write_frame.datalen) == SWITCH_STATUS_SUCCESS) {
+			session->enc_write_frame.codec = session->write_codec;
+			session->enc_write_frame.samples = session->write_impl.samples_per_packet;
+			session->enc_write_frame.rate = session->write_impl.actual_samples_per_second;
+			session->enc_write_frame.timestamp = frame->timestamp;
+			session->enc_write_frame.payload = session->write_impl.ianacode;
+			session->enc_write_frame.m = frame->m;
+			session->enc_write_frame.ssrc = frame->ssrc;
+			session->enc_write_frame.seq = frame->seq;
+			session->enc_write_frame.flags = 0;
+			write_frame = &session->enc_write_frame;
+			do_write = TRUE;
+			goto done;
+		}
+	}
+
 	if (frame->codec) {
 		session->raw_write_frame.datalen = session->raw_write_frame.buflen;
 		frame->codec->cur_frame = frame;
@@ -1223,6 +1325,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 		int prune = 0;
 
 		switch_thread_rwlock_rdlock(session->bug_rwlock);
+
+		switch_core_media_bug_ring_write(session, session->bug_write_ring, write_frame->data, write_frame->datalen, 1);
+
 		for (bp = session->bugs; bp; bp = bp->next) {
 			switch_bool_t ok = SWITCH_TRUE;
 			if (!bp->ready) {
@@ -1230,10 +1335,12 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 			}
 
 			if (switch_channel_test_flag(session->channel, CF_PAUSE_BUGS) && !switch_core_media_bug_test_flag(bp, SMBF_NO_PAUSE)) {
+				switch_core_media_bug_ring_skip(session->bug_write_ring, &bp->write_pos);
 				continue;
 			}
 
 			if (!switch_channel_test_flag(session->channel, CF_ANSWERED) && switch_core_media_bug_test_flag(bp, SMBF_ANSWER_REQ)) {
+				switch_core_media_bug_ring_skip(session->bug_write_ring, &bp->write_pos);
 				continue;
 			}
 
@@ -1243,10 +1350,6 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 			}
 
 			if (switch_test_flag(bp, SMBF_WRITE_STREAM)) {
-				switch_mutex_lock(bp->write_mutex);
-				switch_buffer_write(bp->raw_write_buffer, write_frame->data, write_frame->datalen);
-				switch_mutex_unlock(bp->write_mutex);
-				
 				if (bp->callback) {
 					ok = bp->callback(bp, bp->user_data, SWITCH_ABC_TYPE_WRITE);
 				}
@@ -145,6 +145,7 @@ typedef struct switch_rtp_engine_s {
 	ice_t ice_out;
 
 	int8_t rtcp_mux;
+	uint8_t nack;
 
 	dtls_fingerprint_t local_dtls_fingerprint;
 	dtls_fingerprint_t remote_dtls_fingerprint;
@@ -192,6 +193,200 @@ struct switch_media_handle_s {
 
 };
 
+/* Both caches hold pointers to codec implementations so they are flushed whenever a codec module comes or goes */
+#define MEDIA_CACHE_MAX_ENTRIES 1024
+#define AUDIO_MATCH_KEY_LEN 4096
+
+typedef struct codec_table_s {
+	int num_codecs;
+	const switch_codec_implementation_t *codecs[SWITCH_MAX_CODECS];
+} codec_table_t;
+
+typedef struct audio_match_s {
+	uint8_t match;
+	int map_index;
+	const switch_codec_implementation_t *mimp;
+} audio_match_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *codec_tables;
+	switch_hash_t *audio_matches;
+	uint32_t codec_table_count;
+	uint32_t audio_match_count;
+	uint64_t audio_match_hits;
+	uint64_t audio_match_misses;
+} media_cache;
+
+static void media_cache_clear_hash(switch_hash_t **hash)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+
+	if (!*hash) {
+		return;
+	}
+
+	for (hi = switch_core_hash_first(*hash); hi; hi = switch_core_hash_next(hi)) {
+		switch_core_hash_this(hi, &var, NULL, &val);
+		free(val);
+	}
+
+	switch_core_hash_destroy(hash);
+	switch_core_hash_init(hash, NULL);
+}
+
+SWITCH_DECLARE(void) switch_core_media_flush_codec_cache(void)
+{
+	if (!media_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(media_cache.mutex);
+	media_cache_clear_hash(&media_cache.codec_tables);
+	media_cache_clear_hash(&media_cache.audio_matches);
+	media_cache.codec_table_count = 0;
+	media_cache.audio_match_count = 0;
+	switch_mutex_unlock(media_cache.mutex);
+}
+
+static int get_codecs_sorted_cached(const char *codec_string, const switch_codec_implementation_t **array, int arraylen, char **prefs, int preflen)
+{
+	codec_table_t *table;
+	int num = -1;
+
+	if (!media_cache.mutex) {
+		return switch_loadable_module_get_codecs_sorted(array, arraylen, prefs, preflen);
+	}
+
+	switch_mutex_lock(media_cache.mutex);
+	if ((table = switch_core_hash_find(media_cache.codec_tables, codec_string))) {
+		num = table->num_codecs < arraylen ? table->num_codecs : arraylen;
+		memcpy(array, table->codecs, sizeof(*array) * num);
+	}
+	switch_mutex_unlock(media_cache.mutex);
+
+	if (num > -1) {
+		return num;
+	}
+
+	num = switch_loadable_module_get_codecs_sorted(array, arraylen, prefs, preflen);
+
+	switch_zmalloc(table, sizeof(*table));
+	table->num_codecs = num < SWITCH_MAX_CODECS ? num : SWITCH_MAX_CODECS;
+	memcpy(table->codecs, array, sizeof(*array) * table->num_codecs);
+
+	switch_mutex_lock(media_cache.mutex);
+	if (media_cache.codec_table_count >= MEDIA_CACHE_MAX_ENTRIES) {
+		media_cache_clear_hash(&media_cache.codec_tables);
+		media_cache.codec_table_count = 0;
+	}
+
+	if (switch_core_hash_find(media_cache.codec_tables, codec_string)) {
+		free(table);
+	} else {
+		switch_core_hash_insert(media_cache.codec_tables, codec_string, table);
+		media_cache.codec_table_count++;
+	}
+	switch_mutex_unlock(media_cache.mutex);
+
+	return num;
+}
+
+/* Everything the audio codec match loop in switch_core_media_negotiate_sdp() depends on, normalized into one string */
+static int build_audio_match_key(char *buf, switch_size_t buflen, sdp_media_t *m, const switch_codec_implementation_t **codec_array, int num_codecs,
+								 int ptime, int maxptime, int scrooge, int bad_iananame, int near)
+{
+	sdp_rtpmap_t *map;
+	switch_size_t len;
+	int i;
+
+	len = switch_snprintf(buf, buflen, "%d:%d:%d:%d:%d|", ptime, maxptime, scrooge, bad_iananame, near);
+
+	for (i = 0; i < num_codecs && len < buflen - 1; i++) {
+		len += switch_snprintf(buf + len, buflen - len, "%p,", (void *) codec_array[i]);
+	}
+
+	for (map = m->m_rtpmaps; map && len < buflen - 1; map = map->rm_next) {
+		len += switch_snprintf(buf + len, buflen - len, "|%u %s/%lu/%s/%s", map->rm_pt, switch_str_nil(map->rm_encoding), map->rm_rate,
+							   switch_str_nil(map->rm_params), switch_str_nil(map->rm_fmtp));
+	}
+
+	return len < buflen - 1;
+}
+
+static switch_status_t find_audio_match(const char *key, sdp_media_t *m, uint8_t *match, const switch_codec_implementation_t **mimp, sdp_rtpmap_t **mmap)
+{
+	audio_match_t *am;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	if (!media_cache.mutex) {
+		return status;
+	}
+
+	switch_mutex_lock(media_cache.mutex);
+	if ((am = switch_core_hash_find(media_cache.audio_matches, key))) {
+		sdp_rtpmap_t *map = NULL;
+		int i = 0;
+
+		if (am->map_index > -1) {
+			for (map = m->m_rtpmaps; map && i < am->map_index; map = map->rm_next) {
+				i++;
+			}
+		}
+
+		*match = am->match;
+		*mimp = am->mimp;
+		*mmap = map;
+		media_cache.audio_match_hits++;
+		status = SWITCH_STATUS_SUCCESS;
+	} else {
+		media_cache.audio_match_misses++;
+	}
+	switch_mutex_unlock(media_cache.mutex);
+
+	return status;
+}
+
+static void store_audio_match(const char *key, sdp_media_t *m, uint8_t match, const switch_codec_implementation_t *mimp, sdp_rtpmap_t *mmap)
+{
+	audio_match_t *am;
+	sdp_rtpmap_t *map;
+	int i = 0;
+
+	if (!media_cache.mutex) {
+		return;
+	}
+
+	switch_zmalloc(am, sizeof(*am));
+	am->match = match;
+	am->mimp = mimp;
+	am->map_index = -1;
+
+	for (map = m->m_rtpmaps; mmap && map; map = map->rm_next) {
+		if (map == mmap) {
+			am->map_index = i;
+			break;
+		}
+		i++;
+	}
+
+	switch_mutex_lock(media_cache.mutex);
+	if (media_cache.audio_match_count >= MEDIA_CACHE_MAX_ENTRIES) {
+		media_cache_clear_hash(&media_cache.audio_matches);
+		media_cache.audio_match_count = 0;
+	}
+
+	if (switch_core_hash_find(media_cache.audio_matches, key)) {
+		free(am);
+	} else {
+		switch_core_hash_insert(media_cache.audio_matches, key, am);
+		media_cache.audio_match_count++;
+	}
+	switch_mutex_unlock(media_cache.mutex);
+}
+
 static int get_channels(const switch_codec_implementation_t *imp)
 {
 	if (!strcasecmp(imp->iananame, "opus")) {
@@ -952,6 +1147,13 @@ static void set_stats(switch_core_session_t *session, switch_media_type_t type,
 		add_stat(stats->inbound.cng_packet_count, "in_cng_packet_count");
 		add_stat(stats->inbound.flush_packet_count, "in_flush_packet_count");
 		add_stat(stats->inbound.largest_jb_size, "in_largest_jb_size");
+		add_stat(stats->inbound.jb_size, "in_jb_size");
+		add_stat(stats->inbound.jb_jitter_ms, "in_jb_jitter_ms");
+		add_stat(stats->inbound.jb_late_packet_count, "in_jb_late_packet_count");
+		add_stat(stats->inbound.jb_missing_packet_count, "in_jb_missing_packet_count");
+		add_stat(stats->inbound.jb_drop_packet_count, "in_jb_drop_packet_count");
+		add_stat(stats->inbound.jb_reset_count, "in_jb_reset_count");
+		add_stat(stats->inbound.nack_packet_count, "in_nack_packet_count");
 
 		add_stat(stats->outbound.raw_bytes, "out_raw_bytes");
 		add_stat(stats->outbound.media_bytes, "out_media_bytes");
@@ -960,6 +1162,8 @@ static void set_stats(switch_core_session_t *session, switch_media_type_t type,
 		add_stat(stats->outbound.skip_packet_count, "out_skip_packet_count");
 		add_stat(stats->outbound.dtmf_packet_count, "out_dtmf_packet_count");
 		add_stat(stats->outbound.cng_packet_count, "out_cng_packet_count");
+		add_stat(stats->outbound.nack_packet_count, "out_nack_packet_count");
+		add_stat(stats->outbound.retransmit_packet_count, "out_retransmit_packet_count");
 
 		add_stat(stats->rtcp.packet_count, "rtcp_packet_count");
 		add_stat(stats->rtcp.octet_count, "rtcp_octet_count");
@@ -1180,7 +1384,7 @@ SWITCH_DECLARE(void) switch_core_media_prepare_codecs(switch_core_session_t *ses
 		char *tmp_codec_string = switch_core_session_strdup(smh->session, codec_string);
 		switch_channel_set_variable(session->channel, "rtp_use_codec_string", codec_string);
 		smh->codec_order_last = switch_separate_string(tmp_codec_string, ',', smh->codec_order, SWITCH_MAX_CODECS);
-		smh->mparams->num_codecs = switch_loadable_module_get_codecs_sorted(smh->codecs, SWITCH_MAX_CODECS, smh->codec_order, smh->codec_order_last);
+		smh->mparams->num_codecs = get_codecs_sorted_cached(codec_string, smh->codecs, SWITCH_MAX_CODECS, smh->codec_order, smh->codec_order_last);
 	} else {
 		smh->mparams->num_codecs = switch_loadable_module_get_codecs(smh->codecs, sizeof(smh->codecs) / sizeof(smh->codecs[0]));
 	}
@@ -1760,7 +1964,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_set_codec(switch_core_session_
 											a_engine->codec_params.codec_ms,
 											a_engine->codec_params.channels,
 											a_engine->codec_params.bitrate,
-											SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE | codec_flags,
+											SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE | SWITCH_CODEC_FLAG_POOLED | codec_flags,
 											NULL, switch_core_session_get_pool(session)) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Can't load codec?\n");
 		switch_channel_hangup(session->channel, SWITCH_CAUSE_INCOMPATIBLE_DESTINATION);
@@ -1777,7 +1981,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_set_codec(switch_core_session_
 											a_engine->codec_params.codec_ms,
 											a_engine->codec_params.channels,
 											a_engine->codec_params.bitrate,
-											SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE | codec_flags,
+											SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE | SWITCH_CODEC_FLAG_POOLED | codec_flags,
 											NULL, switch_core_session_get_pool(session)) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Can't load codec?\n");
 		switch_channel_hangup(session->channel, SWITCH_CAUSE_INCOMPATIBLE_DESTINATION);
@@ -2284,6 +2488,8 @@ SWITCH_DECLARE(uint8_t) switch_core_media_negotiate_sdp(switch_core_session_t *s
 	sdp_rtpmap_t *mmap = NULL, *near_map = NULL;
 	int codec_ms = 0;
 	const char *tmp;
+	char match_key[AUDIO_MATCH_KEY_LEN];
+	int use_match_cache = 0;
 
 	switch_assert(session);
 
@@ -2714,6 +2920,24 @@ SWITCH_DECLARE(uint8_t) switch_core_media_negotiate_sdp(switch_core_session_t *s
 
 			}
 
+			use_match_cache = 0;
+
+			if (!greedy && !match && !mimp && !near_match) {
+				int num = smh->mparams->num_codecs < total_codecs ? smh->mparams->num_codecs : total_codecs;
+				int near = switch_true(switch_channel_get_variable_dup(channel, "rtp_negotiate_near_match", SWITCH_FALSE, -1));
+
+				if (build_audio_match_key(match_key, sizeof(match_key), m, codec_array, num, ptime, maxptime, scrooge,
+										  !!(smh->mparams->ndlb & SM_NDLB_ALLOW_BAD_IANANAME), near)) {
+					use_match_cache = 1;
+
+					if (find_audio_match(match_key, m, &match, &mimp, &mmap) == SWITCH_STATUS_SUCCESS) {
+						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Audio Codec Compare cached result [%s]\n",
+										  mimp ? mimp->iananame : "no match");
+						goto audio_matched;
+					}
+				}
+			}
+
 			for (map = m->m_rtpmaps; map; map = map->rm_next) {
 				int32_t i;
 				const char *rm_encoding;
@@ -2875,6 +3099,12 @@ SWITCH_DECLARE(uint8_t) switch_core_media_negotiate_sdp(switch_core_session_t *s
 					match = 0;
 				}
 			}
+
+			if (use_match_cache) {
+				store_audio_match(match_key, m, match, mimp, mmap);
+			}
+
+		audio_matched:
 			
 			if (mimp && mmap) {
 				char tmp[50];
@@ -3021,6 +3251,13 @@ SWITCH_DECLARE(uint8_t) switch_core_media_negotiate_sdp(switch_core_session_t *s
 					if (!strcasecmp(attr->a_name, "rtcp") && attr->a_value && !strcmp(attr->a_value, "1")) {
 						switch_channel_set_variable(session->channel, "rtp_remote_video_rtcp_port", attr->a_value);
 						v_engine->remote_rtcp_port = (switch_port_t)atoi(attr->a_value);
+					} else if (!strcasecmp(attr->a_name, "rtcp-fb") && !zstr(attr->a_value)) {
+						const char *fb = strchr(attr->a_value, ' ');
+
+						/* a bare "nack" is generic NACK, "nack pli" and friends are something else */
+						if (fb && !strcasecmp(fb + 1, "nack")) {
+							v_engine->nack = 1;
+						}
 					} else if (!got_video_crypto && !strcasecmp(attr->a_name, "crypto") && !zstr(attr->a_value)) {
 						int crypto_tag;
 						
@@ -4644,6 +4881,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_activate_rtp(switch_core_sessi
 					}
 				}
 				
+				if (v_engine->nack && !switch_false(switch_channel_get_variable(session->channel, "rtp_video_nack"))) {
+					switch_rtp_activate_nack(v_engine->rtp_session);
+				}
+
 				if (!zstr(v_engine->local_dtls_fingerprint.str) && switch_rtp_has_dtls() && dtls_ok(smh->session)) {
 					dtls_type_t xtype, 
 						dtype = switch_channel_direction(smh->session->channel) == SWITCH_CALL_DIRECTION_INBOUND ? DTLS_TYPE_CLIENT : DTLS_TYPE_SERVER;
@@ -5795,6 +6036,8 @@ SWITCH_DECLARE(void) switch_core_media_gen_local_sdp(switch_core_session_t *sess
 				if (vp8) {
 					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), 
 									"a=rtcp-fb:%d ccm fir\n", vp8);
+					switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), 
+									"a=rtcp-fb:%d nack\n", vp8);
 				}
 				
 				switch_snprintf(buf + strlen(buf), SDPBUFLEN - strlen(buf), "a=ssrc:%u cname:%s\n", v_engine->ssrc, smh->cname);
@@ -7631,11 +7874,22 @@ SWITCH_DECLARE (void) switch_core_media_recover_session(switch_core_session_t *s
 SWITCH_DECLARE(void) switch_core_media_init(void)
 {
 	switch_core_gen_certs(DTLS_SRTP_FNAME);	
+
+	switch_mutex_init(&media_cache.mutex, SWITCH_MUTEX_NESTED, runtime.memory_pool);
+	switch_core_hash_init(&media_cache.codec_tables, NULL);
+	switch_core_hash_init(&media_cache.audio_matches, NULL);
 }
 
 SWITCH_DECLARE(void) switch_core_media_deinit(void)
 {
-	
+	if (media_cache.mutex) {
+		switch_core_media_flush_codec_cache();
+		switch_mutex_lock(media_cache.mutex);
+		switch_core_hash_destroy(&media_cache.codec_tables);
+		switch_core_hash_destroy(&media_cache.audio_matches);
+		switch_mutex_unlock(media_cache.mutex);
+		media_cache.mutex = NULL;
+	}
 }
 
 
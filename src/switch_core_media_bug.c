@@ -35,6 +35,151 @@
 #include "switch.h"
 #include "private/switch_core_pvt.h"
 
+#define MAX_BUG_BUFFER 1024 * 512
+
+static switch_media_bug_ring_t *media_bug_ring_create(switch_core_session_t *session)
+{
+	switch_media_bug_ring_t *ring = switch_core_session_alloc(session, sizeof(*ring));
+
+	switch_mutex_init(&ring->mutex, SWITCH_MUTEX_NESTED, session->pool);
+
+	return ring;
+}
+
+/* must be called with the ring mutex held */
+static switch_size_t media_bug_ring_inuse(switch_media_bug_ring_t *ring, uint64_t *pos)
+{
+	if (*pos > ring->head) {
+		*pos = ring->head;
+	}
+
+	/* a reader that fell a whole ring behind loses the oldest audio */
+	if (ring->head - *pos > ring->size) {
+		*pos = ring->head - ring->size;
+	}
+
+	return (switch_size_t) (ring->head - *pos);
+}
+
+static switch_size_t media_bug_ring_read(switch_media_bug_ring_t *ring, uint64_t *pos, void *data, switch_size_t len)
+{
+	switch_size_t inuse, off, chunk;
+
+	switch_mutex_lock(ring->mutex);
+	inuse = media_bug_ring_inuse(ring, pos);
+
+	if (len > inuse) {
+		len = inuse;
+	}
+
+	if (len) {
+		off = (switch_size_t) (*pos % ring->size);
+		chunk = ring->size - off < len ? ring->size - off : len;
+		memcpy(data, ring->data + off, chunk);
+		if (chunk < len) {
+			memcpy((uint8_t *) data + chunk, ring->data, len - chunk);
+		}
+		*pos += len;
+	}
+	switch_mutex_unlock(ring->mutex);
+
+	return len;
+}
+
+/* must be called with the ring mutex held */
+static switch_status_t media_bug_ring_grow(switch_media_bug_ring_t *ring, switch_size_t size)
+{
+	uint8_t *data;
+	uint64_t pos;
+	switch_size_t keep = ring->head < ring->size ? (switch_size_t) ring->head : ring->size;
+
+	if (!(data = malloc(size))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	for (pos = ring->head - keep; pos < ring->head; pos++) {
+		data[pos % size] = ring->data[pos % ring->size];
+	}
+
+	switch_safe_free(ring->data);
+	ring->data = data;
+	ring->size = size;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_core_media_bug_ring_write(switch_core_session_t *session, switch_media_bug_ring_t *ring, const void *data, switch_size_t len, int write_stream)
+{
+	switch_media_bug_t *bp;
+	uint64_t oldest;
+	switch_size_t off, chunk, need;
+	uint32_t flag = write_stream ? SMBF_WRITE_STREAM : SMBF_READ_STREAM;
+
+	if (!ring || !len) {
+		return;
+	}
+
+	switch_mutex_lock(ring->mutex);
+
+	/* grow until the slowest reader still fits, up to the per bug limit the private buffers used to have */
+	oldest = ring->head;
+	for (bp = session->bugs; bp; bp = bp->next) {
+		uint64_t pos = write_stream ? bp->write_pos : bp->read_pos;
+
+		if (bp->ready && switch_test_flag(bp, flag) && pos < oldest) {
+			oldest = pos;
+		}
+	}
+
+	need = (switch_size_t) (ring->head - oldest) + len;
+
+	if (need > ring->size && ring->size < MAX_BUG_BUFFER) {
+		switch_size_t size = ring->size ? ring->size : len * SWITCH_BUFFER_START_FRAMES;
+
+		while (size < need && size < MAX_BUG_BUFFER) {
+			size *= 2;
+		}
+
+		if (size > MAX_BUG_BUFFER) {
+			size = MAX_BUG_BUFFER;
+		}
+
+		if (size < len || media_bug_ring_grow(ring, size) != SWITCH_STATUS_SUCCESS) {
+			switch_mutex_unlock(ring->mutex);
+			return;
+		}
+	}
+
+	off = (switch_size_t) (ring->head % ring->size);
+	chunk = ring->size - off < len ? ring->size - off : len;
+	memcpy(ring->data + off, data, chunk);
+	if (chunk < len) {
+		memcpy(ring->data, (const uint8_t *) data + chunk, len - chunk);
+	}
+	ring->head += len;
+
+	switch_mutex_unlock(ring->mutex);
+}
+
+void switch_core_media_bug_ring_skip(switch_media_bug_ring_t *ring, uint64_t *pos)
+{
+	if (ring) {
+		switch_mutex_lock(ring->mutex);
+		*pos = ring->head;
+		switch_mutex_unlock(ring->mutex);
+	}
+}
+
+void switch_core_media_bug_ring_destroy(switch_media_bug_ring_t *ring)
+{
+	if (ring) {
+		switch_mutex_lock(ring->mutex);
+		switch_safe_free(ring->data);
+		ring->size = 0;
+		switch_mutex_unlock(ring->mutex);
+	}
+}
+
 static void switch_core_media_bug_destroy(switch_media_bug_t *bug)
 {
 	switch_event_t *event = NULL;
@@ -43,10 +188,6 @@ static void switch_core_media_bug_destroy(switch_media_bug_t *bug)
 		switch_buffer_destroy(&bug->raw_read_buffer);
 	}
 
-	if (bug->raw_write_buffer) {
-		switch_buffer_destroy(&bug->raw_write_buffer);
-	}
-
 	if (switch_event_create(&event, SWITCH_EVENT_MEDIA_BUG_STOP) == SWITCH_STATUS_SUCCESS) {
 		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Media-Bug-Function", "%s", bug->function);
 		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Media-Bug-Target", "%s", bug->target);
@@ -133,15 +274,18 @@ SWITCH_DECLARE(void) switch_core_media_bug_flush(switch_media_bug_t *bug)
 
 	bug->record_pre_buffer_count = 0;
 
-	if (bug->raw_read_buffer) {
+	if (bug->read_mutex) {
 		switch_mutex_lock(bug->read_mutex);
-		switch_buffer_zero(bug->raw_read_buffer);
+		if (bug->raw_read_buffer) {
+			switch_buffer_zero(bug->raw_read_buffer);
+		}
+		switch_core_media_bug_ring_skip(bug->session->bug_read_ring, &bug->read_pos);
 		switch_mutex_unlock(bug->read_mutex);
 	}
 
-	if (bug->raw_write_buffer) {
+	if (bug->write_mutex) {
 		switch_mutex_lock(bug->write_mutex);
-		switch_buffer_zero(bug->raw_write_buffer);
+		switch_core_media_bug_ring_skip(bug->session->bug_write_ring, &bug->write_pos);
 		switch_mutex_unlock(bug->write_mutex);
 	}
 
@@ -149,11 +293,67 @@ SWITCH_DECLARE(void) switch_core_media_bug_flush(switch_media_bug_t *bug)
 	bug->record_pre_buffer_count = 0;
 }
 
+SWITCH_DECLARE(void) switch_core_media_bug_feed_read(switch_media_bug_t *bug, const switch_frame_t *frame)
+{
+	switch_media_bug_ring_t *ring = bug->session->bug_read_ring;
+
+	if (bug->read_demux_frame) {
+		uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+		int bytes = frame->datalen / 2;
+
+		if (!bug->raw_read_buffer) {
+			switch_size_t len = bug->read_impl.decoded_bytes_per_packet;
+			switch_buffer_create_dynamic(&bug->raw_read_buffer, len * SWITCH_BUFFER_BLOCK_FRAMES, len * SWITCH_BUFFER_START_FRAMES, MAX_BUG_BUFFER);
+		}
+
+		memcpy(data, frame->data, frame->datalen);
+		switch_unmerge_sln((int16_t *) data, bytes, bug->read_demux_frame->data, bytes);
+		switch_buffer_write(bug->raw_read_buffer, data, frame->datalen);
+		switch_core_media_bug_ring_skip(ring, &bug->read_pos);
+	} else if (bug->raw_read_buffer) {
+		/* once the bug has its own buffer it never reads the ring again, frames with nothing whispered in still go there */
+		switch_buffer_write(bug->raw_read_buffer, frame->data, frame->datalen);
+		switch_core_media_bug_ring_skip(ring, &bug->read_pos);
+	}
+}
+
+static switch_size_t media_bug_read_inuse(switch_media_bug_t *bug)
+{
+	switch_media_bug_ring_t *ring = bug->session->bug_read_ring;
+	switch_size_t inuse = 0;
+
+	if (bug->raw_read_buffer) {
+		return switch_buffer_inuse(bug->raw_read_buffer);
+	}
+
+	if (ring) {
+		switch_mutex_lock(ring->mutex);
+		inuse = media_bug_ring_inuse(ring, &bug->read_pos);
+		switch_mutex_unlock(ring->mutex);
+	}
+
+	return inuse;
+}
+
+static switch_size_t media_bug_write_inuse(switch_media_bug_t *bug)
+{
+	switch_media_bug_ring_t *ring = bug->session->bug_write_ring;
+	switch_size_t inuse = 0;
+
+	if (ring) {
+		switch_mutex_lock(ring->mutex);
+		inuse = media_bug_ring_inuse(ring, &bug->write_pos);
+		switch_mutex_unlock(ring->mutex);
+	}
+
+	return inuse;
+}
+
 SWITCH_DECLARE(void) switch_core_media_bug_inuse(switch_media_bug_t *bug, switch_size_t *readp, switch_size_t *writep)
 {
 	if (switch_test_flag(bug, SMBF_READ_STREAM)) {
 		switch_mutex_lock(bug->read_mutex);
-		*readp = bug->raw_read_buffer ? switch_buffer_inuse(bug->raw_read_buffer) : 0;
+		*readp = media_bug_read_inuse(bug);
 		switch_mutex_unlock(bug->read_mutex);
 	} else {
 		*readp = 0;
@@ -161,13 +361,55 @@ SWITCH_DECLARE(void) switch_core_media_bug_inuse(switch_media_bug_t *bug, switch
 
 	if (switch_test_flag(bug, SMBF_WRITE_STREAM)) {
 		switch_mutex_lock(bug->write_mutex);
-		*writep = bug->raw_write_buffer ? switch_buffer_inuse(bug->raw_write_buffer) : 0;
+		*writep = media_bug_write_inuse(bug);
 		switch_mutex_unlock(bug->write_mutex);
 	} else {
 		*writep = 0;
 	}
 }
 
+SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read_stream(switch_media_bug_t *bug, switch_frame_t *frame, switch_bool_t write_stream)
+{
+	switch_mutex_t *mutex = write_stream ? bug->write_mutex : bug->read_mutex;
+	uint32_t flag = write_stream ? SMBF_WRITE_STREAM : SMBF_READ_STREAM;
+	switch_size_t inuse;
+
+	frame->datalen = 0;
+
+	if (!mutex || !switch_test_flag(bug, flag)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_mutex_lock(mutex);
+
+	inuse = write_stream ? media_bug_write_inuse(bug) : media_bug_read_inuse(bug);
+
+	if (inuse > frame->buflen) {
+		inuse = frame->buflen;
+	}
+
+	inuse &= ~(switch_size_t) 1;
+
+	if (inuse) {
+		if (write_stream) {
+			frame->datalen = (uint32_t) media_bug_ring_read(bug->session->bug_write_ring, &bug->write_pos, frame->data, inuse);
+		} else if (bug->raw_read_buffer) {
+			frame->datalen = (uint32_t) switch_buffer_read(bug->raw_read_buffer, frame->data, inuse);
+		} else {
+			frame->datalen = (uint32_t) media_bug_ring_read(bug->session->bug_read_ring, &bug->read_pos, frame->data, inuse);
+		}
+	}
+
+	switch_mutex_unlock(mutex);
+
+	frame->samples = frame->datalen / sizeof(int16_t);
+	frame->rate = write_stream ? bug->write_impl.actual_samples_per_second : bug->read_impl.actual_samples_per_second;
+	frame->codec = NULL;
+	frame->flags = 0;
+
+	return frame->datalen ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_set_pre_buffer_framecount(switch_media_bug_t *bug, uint32_t framecount)
 {
 	bug->record_pre_buffer_max = framecount;
@@ -199,13 +441,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 		return SWITCH_STATUS_FALSE;
 	}
 
-	if ((!bug->raw_read_buffer && (!bug->raw_write_buffer || !switch_test_flag(bug, SMBF_WRITE_STREAM)))) {
+	if (!switch_test_flag(bug, SMBF_READ_STREAM) && !switch_test_flag(bug, SMBF_WRITE_STREAM)) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(switch_core_media_bug_get_session(bug)), SWITCH_LOG_ERROR, 
-				"%s Buffer Error (raw_read_buffer=%p, raw_write_buffer=%p, read=%s, write=%s)\n",
-			        switch_channel_get_name(bug->session->channel),
-				(void *)bug->raw_read_buffer, (void *)bug->raw_write_buffer, 
-				switch_test_flag(bug, SMBF_READ_STREAM) ? "yes" : "no",
-				switch_test_flag(bug, SMBF_WRITE_STREAM) ? "yes" : "no");
+				"%s Buffer Error (read=no, write=no)\n", switch_channel_get_name(bug->session->channel));
 		return SWITCH_STATUS_FALSE;
 	}
 
@@ -214,13 +452,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 
 	if (switch_test_flag(bug, SMBF_READ_STREAM)) {
 		switch_mutex_lock(bug->read_mutex);
-		do_read = switch_buffer_inuse(bug->raw_read_buffer);
+		do_read = media_bug_read_inuse(bug);
 		switch_mutex_unlock(bug->read_mutex);
 	}
 
 	if (switch_test_flag(bug, SMBF_WRITE_STREAM)) {
 		switch_mutex_lock(bug->write_mutex);
-		do_write = switch_buffer_inuse(bug->raw_write_buffer);
+		do_write = media_bug_write_inuse(bug);
 		switch_mutex_unlock(bug->write_mutex);
 	}
 
@@ -292,7 +530,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	
 	if (do_read) {
 		switch_mutex_lock(bug->read_mutex);
-		frame->datalen = (uint32_t) switch_buffer_read(bug->raw_read_buffer, frame->data, do_read);
+		if (bug->raw_read_buffer) {
+			frame->datalen = (uint32_t) switch_buffer_read(bug->raw_read_buffer, frame->data, do_read);
+		} else {
+			frame->datalen = (uint32_t) media_bug_ring_read(bug->session->bug_read_ring, &bug->read_pos, frame->data, do_read);
+		}
 		if (frame->datalen != do_read) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(switch_core_media_bug_get_session(bug)), SWITCH_LOG_ERROR, "Framing Error Reading!\n");
 			switch_core_media_bug_flush(bug);
@@ -306,9 +548,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	}
 
 	if (do_write) {
-		switch_assert(bug->raw_write_buffer);
+		switch_assert(bug->session->bug_write_ring);
 		switch_mutex_lock(bug->write_mutex);
-		datalen = (uint32_t) switch_buffer_read(bug->raw_write_buffer, bug->data, do_write);
+		datalen = (uint32_t) media_bug_ring_read(bug->session->bug_write_ring, &bug->write_pos, bug->data, do_write);
 		if (datalen != do_write) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(switch_core_media_bug_get_session(bug)), SWITCH_LOG_ERROR, "Framing Error Writing!\n");
 			switch_core_media_bug_flush(bug);
@@ -399,7 +641,6 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_read(switch_media_bug_t *b
 	return SWITCH_STATUS_SUCCESS;
 }
 
-#define MAX_BUG_BUFFER 1024 * 512
 SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t *session,
 														  const char *function,
 														  const char *target,
@@ -409,7 +650,6 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 														  switch_media_bug_t **new_bug)
 {
 	switch_media_bug_t *bug, *bp;
-	switch_size_t bytes;
 	switch_event_t *event;
 	int tap_only = 1, punt = 0;
 
@@ -497,21 +737,17 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 	}
 	
 	bug->stop_time = stop_time;
-	bytes = bug->read_impl.decoded_bytes_per_packet;
 
 	if (!bug->flags) {
 		bug->flags = (SMBF_READ_STREAM | SMBF_WRITE_STREAM);
 	}
 
+	/* audio is shared through one ring per direction, the bug only keeps its position in it */
 	if (switch_test_flag(bug, SMBF_READ_STREAM) || switch_test_flag(bug, SMBF_READ_PING)) {
-		switch_buffer_create_dynamic(&bug->raw_read_buffer, bytes * SWITCH_BUFFER_BLOCK_FRAMES, bytes * SWITCH_BUFFER_START_FRAMES, MAX_BUG_BUFFER);
 		switch_mutex_init(&bug->read_mutex, SWITCH_MUTEX_NESTED, session->pool);
 	}
 
-	bytes = bug->write_impl.decoded_bytes_per_packet;
-
 	if (switch_test_flag(bug, SMBF_WRITE_STREAM)) {
-		switch_buffer_create_dynamic(&bug->raw_write_buffer, bytes * SWITCH_BUFFER_BLOCK_FRAMES, bytes * SWITCH_BUFFER_START_FRAMES, MAX_BUG_BUFFER);
 		switch_mutex_init(&bug->write_mutex, SWITCH_MUTEX_NESTED, session->pool);
 	}
 
@@ -530,8 +766,23 @@ SWITCH_DECLARE(switch_status_t) switch_core_media_bug_add(switch_core_session_t
 	}
 
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Attaching BUG to %s\n", switch_channel_get_name(session->channel));
-	bug->ready = 1;
 	switch_thread_rwlock_wrlock(session->bug_rwlock);
+
+	if (switch_test_flag(bug, SMBF_READ_STREAM)) {
+		if (!session->bug_read_ring) {
+			session->bug_read_ring = media_bug_ring_create(session);
+		}
+		switch_core_media_bug_ring_skip(session->bug_read_ring, &bug->read_pos);
+	}
+
+	if (switch_test_flag(bug, SMBF_WRITE_STREAM)) {
+		if (!session->bug_write_ring) {
+			session->bug_write_ring = media_bug_ring_create(session);
+		}
+		switch_core_media_bug_ring_skip(session->bug_write_ring, &bug->write_pos);
+	}
+
+	bug->ready = 1;
 	bug->next = session->bugs;
 	session->bugs = bug;
 
@@ -1256,6 +1256,7 @@ SWITCH_DECLARE(void) switch_core_session_reset(switch_core_session_t *session, s
 	/* wipe these, they will be recreated if need be */
 	switch_mutex_lock(session->codec_write_mutex);
 	switch_buffer_destroy(&session->raw_write_buffer);
+	switch_buffer_destroy(&session->write_repack_buffer);
 	switch_mutex_unlock(session->codec_write_mutex);
 
 	switch_mutex_lock(session->codec_read_mutex);
@@ -1424,6 +1425,9 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 
 	switch_buffer_destroy(&(*session)->raw_read_buffer);
 	switch_buffer_destroy(&(*session)->raw_write_buffer);
+	switch_buffer_destroy(&(*session)->write_repack_buffer);
+	switch_core_media_bug_ring_destroy((*session)->bug_read_ring);
+	switch_core_media_bug_ring_destroy((*session)->bug_write_ring);
 	switch_ivr_clear_speech_cache(*session);
 	switch_channel_uninit((*session)->channel);
 
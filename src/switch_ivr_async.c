@@ -34,6 +34,7 @@
  */
 
 #include <switch.h>
+#include "private/switch_core_pvt.h"
 #include <speex/speex_preprocess.h>
 #include <speex/speex_echo.h>
 
@@ -1014,6 +1015,387 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_displace_session(switch_core_session_
 }
 
 
+/* Deferred recordings: the media thread only appends each direction to a raw spool file, with where every frame
+   ends on a sample timeline, and a low priority worker rebuilds the mixed (or stereo) file from the spools once the
+   recording stops.  The read direction gets a frame every packet so its sample count is the clock, audio of the write
+   direction that shows up after a gap is placed at the read position it arrived at. */
+
+#define RECORD_MERGE_MAX_THREADS 2
+
+typedef struct {
+	uint64_t pos;
+	uint32_t samples;
+} record_spool_frame_t;
+
+typedef struct {
+	char *path;
+	switch_file_t *fd;
+	switch_size_t samples;
+	uint64_t pos;
+	int enabled;
+} record_spool_t;
+
+typedef struct {
+	switch_memory_pool_t *pool;
+	char *file;
+	char *uuid;
+	record_spool_t read;
+	record_spool_t write;
+	uint32_t rate;
+	uint32_t samplerate;
+	uint32_t channels;
+	uint32_t packet_samples;
+	int stereo;
+	int swap;
+	int file_flags;
+	switch_size_t pre_buffer_datalen;
+	int min_sec;
+	char *strings[SWITCH_AUDIO_COL_STR_DATE + 1];
+	char *post_api;
+	char *post_api_data;
+} record_merge_job_t;
+
+typedef struct {
+	switch_file_t *fd;
+	record_spool_frame_t next;
+	int have_next;
+	int16_t data[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	uint32_t have;
+	uint32_t off;
+	switch_size_t silence;
+	uint64_t pos;
+	uint32_t packet;
+} record_spool_reader_t;
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_queue_t *queue;
+	switch_thread_t *threads[RECORD_MERGE_MAX_THREADS];
+	uint32_t thread_count;
+	int running;
+} record_merge;
+
+static switch_status_t record_spool_open(record_merge_job_t *job, record_spool_t *spool, const char *name)
+{
+	spool->path = switch_core_sprintf(job->pool, "%s%srecord-%s-%p-%s.spool", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR,
+									  job->uuid, (void *) job, name);
+
+	if (switch_file_open(&spool->fd, spool->path, SWITCH_FOPEN_WRITE | SWITCH_FOPEN_CREATE | SWITCH_FOPEN_TRUNCATE | SWITCH_FOPEN_BUFFERED,
+						 SWITCH_FPROT_UREAD | SWITCH_FPROT_UWRITE, job->pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error opening spool %s\n", spool->path);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	spool->enabled = 1;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void record_spool_append(record_merge_job_t *job, record_spool_t *spool, switch_frame_t *frame, int mask)
+{
+	record_spool_frame_t hdr;
+	switch_size_t len = sizeof(hdr);
+
+	if (!spool->fd || !frame->datalen) {
+		return;
+	}
+
+	hdr.samples = frame->datalen / sizeof(int16_t);
+
+	/* write audio after a gap starts where the read clock is now, anything else follows on from the last frame */
+	if (spool == &job->write && job->read.enabled && job->read.pos > spool->pos + hdr.samples + job->packet_samples) {
+		spool->pos = job->read.pos - hdr.samples;
+	}
+
+	spool->pos += hdr.samples;
+	hdr.pos = spool->pos;
+
+	if (mask) {
+		memset(frame->data, 0, frame->datalen);
+	}
+
+	switch_file_write(spool->fd, &hdr, &len);
+	len = frame->datalen;
+	switch_file_write(spool->fd, frame->data, &len);
+	spool->samples += hdr.samples;
+}
+
+static void record_merge_job_destroy(record_merge_job_t *job)
+{
+	switch_memory_pool_t *pool = job->pool;
+
+	if (job->read.fd) switch_file_close(job->read.fd);
+	if (job->write.fd) switch_file_close(job->write.fd);
+	if (job->read.path) switch_file_remove(job->read.path, pool);
+	if (job->write.path) switch_file_remove(job->write.path, pool);
+
+	switch_core_destroy_memory_pool(&pool);
+}
+
+static int record_spool_reader_peek(record_spool_reader_t *r)
+{
+	switch_size_t len = sizeof(r->next);
+
+	if (!r->have_next && r->fd && switch_file_read(r->fd, &r->next, &len) == SWITCH_STATUS_SUCCESS && len == sizeof(r->next)) {
+		r->have_next = 1;
+	}
+
+	return r->have_next;
+}
+
+/* the next n samples of this direction on the shared timeline, gaps longer than a packet come back as silence */
+static switch_size_t record_spool_reader_get(record_spool_reader_t *r, int16_t *out, switch_size_t n)
+{
+	switch_size_t got = 0, k;
+
+	while (got < n) {
+		if (r->silence) {
+			k = r->silence < n - got ? r->silence : n - got;
+			memset(out + got, 0, k * sizeof(int16_t));
+			r->silence -= k;
+			r->pos += k;
+			got += k;
+		} else if (r->off < r->have) {
+			k = r->have - r->off < n - got ? r->have - r->off : n - got;
+			memcpy(out + got, r->data + r->off, k * sizeof(int16_t));
+			r->off += (uint32_t) k;
+			r->pos += k;
+			got += k;
+		} else if (record_spool_reader_peek(r)) {
+			switch_size_t len = r->next.samples * sizeof(int16_t);
+			uint64_t start = r->next.pos - r->next.samples;
+
+			r->have_next = 0;
+
+			if (len > sizeof(r->data) || switch_file_read(r->fd, r->data, &len) != SWITCH_STATUS_SUCCESS) {
+				r->fd = NULL;
+				break;
+			}
+
+			r->have = (uint32_t) (len / sizeof(int16_t));
+			r->off = 0;
+
+			if (start > r->pos + r->packet) {
+				r->silence = (switch_size_t) ((start - r->pos) / r->packet) * r->packet;
+			}
+		} else {
+			break;
+		}
+	}
+
+	return got;
+}
+
+static switch_status_t record_spool_reader_open(record_merge_job_t *job, record_spool_t *spool, record_spool_reader_t *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->packet = job->packet_samples;
+
+	if (!spool->enabled || switch_file_open(&r->fd, spool->path, SWITCH_FOPEN_READ | SWITCH_FOPEN_BUFFERED, SWITCH_FPROT_OS_DEFAULT, job->pool) != SWITCH_STATUS_SUCCESS) {
+		r->fd = NULL;
+		return SWITCH_STATUS_FALSE;
+	}
+
+	record_spool_reader_peek(r);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void record_merge_run(record_merge_job_t *job)
+{
+	switch_file_handle_t fh = { 0 };
+	record_spool_reader_t rr, wr;
+	int16_t rbuf[SWITCH_RECOMMENDED_BUFFER_SIZE / 2], wbuf[SWITCH_RECOMMENDED_BUFFER_SIZE / 2], obuf[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	switch_size_t packet, x;
+	switch_event_t *event;
+	int i;
+
+	if (job->read.fd) {
+		switch_file_close(job->read.fd);
+		job->read.fd = NULL;
+	}
+
+	if (job->write.fd) {
+		switch_file_close(job->write.fd);
+		job->write.fd = NULL;
+	}
+
+	if (!job->packet_samples || job->packet_samples > SWITCH_RECOMMENDED_BUFFER_SIZE / 2) {
+		job->packet_samples = 160;
+	}
+	packet = job->packet_samples;
+
+	record_spool_reader_open(job, &job->read, &rr);
+	record_spool_reader_open(job, &job->write, &wr);
+
+	fh.samplerate = job->samplerate;
+	fh.channels = job->channels;
+	fh.pre_buffer_datalen = job->pre_buffer_datalen;
+
+	if (switch_core_file_open(&fh, job->file, (uint8_t) job->channels, job->rate, job->file_flags, job->pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_UUID_LOG(job->uuid), SWITCH_LOG_ERROR, "Error opening %s\n", job->file);
+		goto end;
+	}
+
+	for (i = 0; i <= SWITCH_AUDIO_COL_STR_DATE; i++) {
+		if (job->strings[i]) {
+			switch_core_file_set_string(&fh, (switch_audio_col_t) i, job->strings[i]);
+		}
+	}
+
+	for (;;) {
+		switch_size_t rlen = 0, wlen = 0, len;
+
+		if (rr.fd || rr.silence || rr.off < rr.have) {
+			rlen = record_spool_reader_get(&rr, rbuf, packet);
+		}
+
+		if (wr.fd || wr.silence || wr.off < wr.have) {
+			wlen = record_spool_reader_get(&wr, wbuf, packet);
+		}
+
+		if (!(len = rlen > wlen ? rlen : wlen)) {
+			break;
+		}
+
+		if (rlen < len) memset(rbuf + rlen, 0, (len - rlen) * sizeof(int16_t));
+		if (wlen < len) memset(wbuf + wlen, 0, (len - wlen) * sizeof(int16_t));
+
+		if (job->stereo) {
+			int16_t *left = job->swap ? wbuf : rbuf, *right = job->swap ? rbuf : wbuf;
+
+			for (x = 0; x < len; x++) {
+				obuf[x * 2] = left[x];
+				obuf[x * 2 + 1] = right[x];
+			}
+		} else {
+			/* same mix as switch_core_media_bug_read */
+			for (x = 0; x < len; x++) {
+				int32_t r = rbuf[x], w = wbuf[x], z = r + w;
+
+				if (z > SWITCH_SMAX || z < SWITCH_SMIN) {
+					if (r) z += (r / 2);
+					if (w) z += (w / 2);
+				}
+
+				switch_normalize_to_16bit(z);
+				obuf[x] = (int16_t) z;
+			}
+		}
+
+		if (switch_core_file_write(&fh, obuf, &len) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_UUID_LOG(job->uuid), SWITCH_LOG_ERROR, "Error writing %s\n", job->file);
+			break;
+		}
+	}
+
+	switch_core_file_close(&fh);
+
+	if (fh.samples_out < fh.samplerate * job->min_sec) {
+		switch_log_printf(SWITCH_CHANNEL_UUID_LOG(job->uuid), SWITCH_LOG_DEBUG, "Discarding short file %s\n", job->file);
+		switch_file_remove(job->file, job->pool);
+	}
+
+	if (switch_event_create(&event, SWITCH_EVENT_RECORD_STOP) == SWITCH_STATUS_SUCCESS) {
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Unique-ID", job->uuid);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Record-File-Path", job->file);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Record-Merge-Complete", "true");
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Record-Samples", "%" SWITCH_SIZE_T_FMT, (switch_size_t) fh.samples_out);
+		switch_event_fire(&event);
+	}
+
+	if (job->post_api) {
+		switch_stream_handle_t stream = { 0 };
+
+		SWITCH_STANDARD_STREAM(stream);
+		switch_api_execute(job->post_api, job->post_api_data, NULL, &stream);
+		switch_safe_free(stream.data);
+	}
+
+  end:
+
+	if (rr.fd) switch_file_close(rr.fd);
+	if (wr.fd) switch_file_close(wr.fd);
+	record_merge_job_destroy(job);
+}
+
+static void *SWITCH_THREAD_FUNC record_merge_thread(switch_thread_t *thread, void *obj)
+{
+	void *pop;
+
+	while (switch_queue_pop(record_merge.queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		record_merge_run((record_merge_job_t *) pop);
+	}
+
+	return NULL;
+}
+
+static void record_merge_push(record_merge_job_t *job)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	int sync = 0;
+
+	switch_mutex_lock(record_merge.mutex);
+	if (!record_merge.running) {
+		sync = 1;
+	} else {
+		if (record_merge.thread_count < RECORD_MERGE_MAX_THREADS && (!record_merge.thread_count || switch_queue_size(record_merge.queue))) {
+			switch_threadattr_create(&thd_attr, record_merge.pool);
+			switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+			switch_threadattr_priority_set(thd_attr, SWITCH_PRI_LOW);
+			if (switch_thread_create(&record_merge.threads[record_merge.thread_count], thd_attr, record_merge_thread, NULL,
+									 record_merge.pool) == SWITCH_STATUS_SUCCESS) {
+				record_merge.thread_count++;
+			}
+		}
+
+		if (!record_merge.thread_count || switch_queue_trypush(record_merge.queue, job) != SWITCH_STATUS_SUCCESS) {
+			sync = 1;
+		}
+	}
+	switch_mutex_unlock(record_merge.mutex);
+
+	if (sync) {
+		record_merge_run(job);
+	}
+}
+
+void switch_ivr_record_merge_init(switch_memory_pool_t *pool)
+{
+	memset(&record_merge, 0, sizeof(record_merge));
+	record_merge.pool = pool;
+	switch_mutex_init(&record_merge.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_queue_create(&record_merge.queue, SWITCH_CORE_QUEUE_LEN, pool);
+	record_merge.running = 1;
+}
+
+void switch_ivr_record_merge_shutdown(void)
+{
+	switch_status_t st;
+	uint32_t i, count;
+
+	if (!record_merge.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(record_merge.mutex);
+	record_merge.running = 0;
+	count = record_merge.thread_count;
+	switch_mutex_unlock(record_merge.mutex);
+
+	/* let the queued merges finish so no recording is lost */
+	for (i = 0; i < count; i++) {
+		switch_queue_push(record_merge.queue, NULL);
+	}
+
+	for (i = 0; i < count; i++) {
+		switch_thread_join(&st, record_merge.threads[i]);
+	}
+
+	record_merge.thread_count = 0;
+}
+
 struct record_helper {
 	char *file;
 	switch_file_handle_t *fh;
@@ -1033,6 +1415,7 @@ struct record_helper {
 	switch_time_t last_write_time;
 	switch_bool_t hangup_on_error;
 	switch_codec_implementation_t read_impl;
+	record_merge_job_t *merge;
 };
 
 
@@ -1175,6 +1558,66 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Stop recording file %s\n", rh->file);
 			switch_channel_set_private(channel, rh->file, NULL);
 
+			if (rh->merge) {
+				record_merge_job_t *job = rh->merge;
+				uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+				switch_frame_t frame = { 0 };
+				switch_size_t samples;
+
+				frame.data = data;
+				frame.buflen = sizeof(data);
+
+				while (switch_core_media_bug_read_stream(bug, &frame, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS) {
+					record_spool_append(job, &job->read, &frame, mask);
+				}
+
+				while (switch_core_media_bug_read_stream(bug, &frame, SWITCH_TRUE) == SWITCH_STATUS_SUCCESS) {
+					record_spool_append(job, &job->write, &frame, mask);
+				}
+
+				samples = job->read.samples > job->write.samples ? job->read.samples : job->write.samples;
+				rh->merge = NULL;
+
+				if (read_impl.actual_samples_per_second) {
+					switch_channel_set_variable_printf(channel, "record_seconds", "%d", (int) (samples / read_impl.actual_samples_per_second));
+					switch_channel_set_variable_printf(channel, "record_ms", "%d", (int) (samples / (read_impl.actual_samples_per_second / 1000)));
+				}
+				switch_channel_set_variable_printf(channel, "record_samples", "%d", (int) samples);
+
+				if (samples < (switch_size_t) job->rate * job->min_sec) {
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Discarding short file %s\n", rh->file);
+					switch_channel_set_variable(channel, "RECORD_DISCARDED", "true");
+				}
+
+				if ((var = switch_channel_get_variable(channel, SWITCH_RECORD_POST_PROCESS_EXEC_API_VARIABLE))) {
+					char *cmd = switch_core_strdup(job->pool, var);
+					char *data, *expanded = NULL;
+
+					if ((data = strchr(cmd, ':'))) {
+						*data++ = '\0';
+						expanded = switch_channel_expand_variables(channel, data);
+						job->post_api_data = switch_core_strdup(job->pool, expanded);
+						if (expanded != data) {
+							free(expanded);
+						}
+					}
+					job->post_api = cmd;
+				}
+
+				if (switch_event_create(&event, SWITCH_EVENT_RECORD_STOP) == SWITCH_STATUS_SUCCESS) {
+					switch_channel_event_set_data(channel, event);
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Record-File-Path", rh->file);
+					switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Record-Merge-Pending", "true");
+					switch_event_fire(&event);
+				}
+
+				switch_channel_execute_on(channel, SWITCH_RECORD_POST_PROCESS_EXEC_APP_VARIABLE);
+
+				/* the file is only complete once the merge is done, the api hook runs from there */
+				record_merge_push(job);
+				break;
+			}
+
 			if (rh->native) {
 				switch_core_file_close(&rh->in_fh);
 				switch_core_file_close(&rh->out_fh);
@@ -1299,7 +1742,21 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 			}
 		}
 		break;
+	case SWITCH_ABC_TYPE_READ:
 	case SWITCH_ABC_TYPE_WRITE:
+		if (rh->merge) {
+			uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
+			switch_frame_t frame = { 0 };
+			switch_bool_t write_stream = type == SWITCH_ABC_TYPE_WRITE ? SWITCH_TRUE : SWITCH_FALSE;
+
+			frame.data = data;
+			frame.buflen = sizeof(data);
+
+			while (switch_core_media_bug_read_stream(bug, &frame, write_stream) == SWITCH_STATUS_SUCCESS) {
+				record_spool_append(rh->merge, write_stream ? &rh->merge->write : &rh->merge->read, &frame, mask);
+			}
+		}
+		break;
 	default:
 		break;
 	}
@@ -1344,8 +1801,11 @@ static void* switch_ivr_record_user_data_dup(switch_core_session_t *session, voi
 	dup = switch_core_session_alloc(session, sizeof(*dup));
 	memcpy(dup, rh, sizeof(*rh));
 	dup->file = switch_core_session_strdup(session, rh->file);
-	dup->fh = switch_core_session_alloc(session, sizeof(switch_file_handle_t));
-	memcpy(dup->fh, rh->fh, sizeof(switch_file_handle_t));
+	if (rh->fh) {
+		dup->fh = switch_core_session_alloc(session, sizeof(switch_file_handle_t));
+		memcpy(dup->fh, rh->fh, sizeof(switch_file_handle_t));
+	}
+	/* a deferred recording keeps appending to the same spools from the new session */
 
 	return dup;
 }
@@ -1886,11 +2346,18 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_record_session(switch_core_session_t
 	char *file_path = NULL;
 	char *ext;
 	char *in_file = NULL, *out_file = NULL;
+	record_merge_job_t *merge = NULL;
+	int deferred = 0;
 	
 	if ((p = switch_channel_get_variable(channel, "RECORD_HANGUP_ON_ERROR"))) {
 		hangup_on_error = switch_true(p);
 	}
 
+	/* leave the disk writes to the core writer threads unless asked not to */
+	if (!switch_false(switch_channel_get_variable(channel, "RECORD_ASYNC"))) {
+		file_flags |= SWITCH_FILE_WRITE_ASYNC;
+	}
+
 	if ((status = switch_channel_pre_answer(channel)) != SWITCH_STATUS_SUCCESS) {
 		return SWITCH_STATUS_FALSE;
 	}
@@ -1936,6 +2403,13 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_record_session(switch_core_session_t
 		}
 	}
 
+	/* spool each direction and build the file after the call, unless the caller wants the handle or the silence detection needs it live */
+	if (!fh && switch_true(switch_channel_get_variable(channel, "RECORD_DEFERRED")) &&
+		!switch_channel_get_variable(channel, "RECORD_INITIAL_TIMEOUT_MS") && !switch_channel_get_variable(channel, "RECORD_FINAL_TIMEOUT_MS") &&
+		!switch_channel_get_variable(channel, "RECORD_SILENCE_THRESHOLD")) {
+		deferred = 1;
+	}
+
 	if (!fh) {
 		if (!(fh = switch_core_session_alloc(session, sizeof(*fh)))) {
 			return SWITCH_STATUS_MEMERR;
@@ -2055,7 +2529,45 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_record_session(switch_core_session_t
 	
 	rh = switch_core_session_alloc(session, sizeof(*rh));
 
-	if ((ext = strrchr(file, '.'))) {
+	ext = strrchr(file, '.');
+
+	/* the merge picks the file format from the extension, without one the directions go to native files as always */
+	if (deferred && !ext) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Not deferring %s, it has no extension\n", file);
+		deferred = 0;
+	}
+
+	if (deferred) {
+		switch_memory_pool_t *pool = NULL;
+
+		ext++;
+		switch_core_new_memory_pool(&pool);
+		merge = switch_core_alloc(pool, sizeof(*merge));
+		merge->pool = pool;
+		merge->file = switch_core_strdup(pool, file);
+		merge->uuid = switch_core_strdup(pool, switch_core_session_get_uuid(session));
+		merge->rate = read_impl.actual_samples_per_second;
+		merge->samplerate = fh->samplerate;
+		merge->channels = channels;
+		merge->packet_samples = read_impl.samples_per_packet;
+		merge->stereo = (flags & SMBF_STEREO) ? 1 : 0;
+		merge->swap = (flags & SMBF_STEREO_SWAP) ? 1 : 0;
+		merge->file_flags = file_flags & ~SWITCH_FILE_WRITE_ASYNC;
+		merge->pre_buffer_datalen = fh->pre_buffer_datalen;
+
+		if (((flags & SMBF_READ_STREAM) && record_spool_open(merge, &merge->read, "read") != SWITCH_STATUS_SUCCESS) ||
+			((flags & SMBF_WRITE_STREAM) && record_spool_open(merge, &merge->write, "write") != SWITCH_STATUS_SUCCESS)) {
+			record_merge_job_destroy(merge);
+			if (hangup_on_error) {
+				switch_channel_hangup(channel, SWITCH_CAUSE_DESTINATION_OUT_OF_ORDER);
+				switch_core_session_reset(session, SWITCH_TRUE, SWITCH_TRUE);
+			}
+			return SWITCH_STATUS_GENERR;
+		}
+
+		flags &= ~SMBF_READ_PING;
+		fh = NULL;
+	} else if (ext) {
 		ext++;
 		if (switch_core_file_open(fh, file, channels, read_impl.actual_samples_per_second, file_flags, NULL) != SWITCH_STATUS_SUCCESS) {
 			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error opening %s\n", file);
@@ -2112,36 +2624,42 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_record_session(switch_core_session_t
 	if ((p = switch_channel_get_variable(channel, "RECORD_TITLE"))) {
 		vval = (const char *) switch_core_session_strdup(session, p);
 		if (fh) switch_core_file_set_string(fh, SWITCH_AUDIO_COL_STR_TITLE, vval);
+		if (merge) merge->strings[SWITCH_AUDIO_COL_STR_TITLE] = switch_core_strdup(merge->pool, vval);
 		switch_channel_set_variable(channel, "RECORD_TITLE", NULL);
 	}
 
 	if ((p = switch_channel_get_variable(channel, "RECORD_COPYRIGHT"))) {
 		vval = (const char *) switch_core_session_strdup(session, p);
 		if (fh) switch_core_file_set_string(fh, SWITCH_AUDIO_COL_STR_COPYRIGHT, vval);
+		if (merge) merge->strings[SWITCH_AUDIO_COL_STR_COPYRIGHT] = switch_core_strdup(merge->pool, vval);
 		switch_channel_set_variable(channel, "RECORD_COPYRIGHT", NULL);
 	}
 
 	if ((p = switch_channel_get_variable(channel, "RECORD_SOFTWARE"))) {
 		vval = (const char *) switch_core_session_strdup(session, p);
 		if (fh) switch_core_file_set_string(fh, SWITCH_AUDIO_COL_STR_SOFTWARE, vval);
+		if (merge) merge->strings[SWITCH_AUDIO_COL_STR_SOFTWARE] = switch_core_strdup(merge->pool, vval);
 		switch_channel_set_variable(channel, "RECORD_SOFTWARE", NULL);
 	}
 
 	if ((p = switch_channel_get_variable(channel, "RECORD_ARTIST"))) {
 		vval = (const char *) switch_core_session_strdup(session, p);
 		if (fh) switch_core_file_set_string(fh, SWITCH_AUDIO_COL_STR_ARTIST, vval);
+		if (merge) merge->strings[SWITCH_AUDIO_COL_STR_ARTIST] = switch_core_strdup(merge->pool, vval);
 		switch_channel_set_variable(channel, "RECORD_ARTIST", NULL);
 	}
 
 	if ((p = switch_channel_get_variable(channel, "RECORD_COMMENT"))) {
 		vval = (const char *) switch_core_session_strdup(session, p);
 		if (fh) switch_core_file_set_string(fh, SWITCH_AUDIO_COL_STR_COMMENT, vval);
+		if (merge) merge->strings[SWITCH_AUDIO_COL_STR_COMMENT] = switch_core_strdup(merge->pool, vval);
 		switch_channel_set_variable(channel, "RECORD_COMMENT", NULL);
 	}
 
 	if ((p = switch_channel_get_variable(channel, "RECORD_DATE"))) {
 		vval = (const char *) switch_core_session_strdup(session, p);
 		if (fh) switch_core_file_set_string(fh, SWITCH_AUDIO_COL_STR_DATE, vval);
+		if (merge) merge->strings[SWITCH_AUDIO_COL_STR_DATE] = switch_core_strdup(merge->pool, vval);
 		switch_channel_set_variable(channel, "RECORD_DATE", NULL);
 	}
 
@@ -2188,11 +2706,20 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_record_session(switch_core_session_t
 	}
 
 	rh->hangup_on_error = hangup_on_error;
+
+	if (merge) {
+		merge->min_sec = rh->min_sec;
+		rh->merge = merge;
+	}
 	
 	if ((status = switch_core_media_bug_add(session, "session_record", file,
 											record_callback, rh, to, flags, &bug)) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Error adding media bug for file %s\n", file);
-		switch_core_file_close(fh);
+		if (merge) {
+			record_merge_job_destroy(merge);
+		} else {
+			switch_core_file_close(fh);
+		}
 		return status;
 	}
 
@@ -1049,6 +1049,8 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 	int more_data = 0;
 	switch_event_t *event;
 	uint32_t test_native = 0, last_native = 0;
+	uint32_t enc_samples = 0;
+	const switch_codec_implementation_t *enc_impl = NULL;
 
 	if (switch_channel_pre_answer(channel) != SWITCH_STATUS_SUCCESS) {
 		return SWITCH_STATUS_FALSE;
@@ -1342,7 +1344,21 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 			samples = codec.implementation->samples_per_packet;
 			framelen = codec.implementation->decoded_bytes_per_packet;
 		}
-		
+
+		if (!test_native && fh->cache_entry && !fh->vol && !fh->speed) {
+			switch_codec_t *write_codec = switch_core_session_get_write_codec(session);
+
+			/* the prompt is already in the file cache, send it as frames encoded once for every call using this codec */
+			if (write_codec && write_codec->implementation && write_codec->implementation->microseconds_per_packet == read_impl.microseconds_per_packet &&
+				switch_core_file_cache_encode(fh, write_codec) == SWITCH_STATUS_SUCCESS) {
+				write_frame.codec = write_codec;
+				enc_impl = write_codec->implementation;
+				samples = write_codec->implementation->samples_per_packet;
+				framelen = write_codec->implementation->encoded_bytes_per_packet;
+				test_native = 1;
+			}
+		}
+
 		last_native = test_native;
 
 		if (timer_name && !timer.samplecount) {
@@ -1454,7 +1470,28 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 				}
 			}
 
-			if (switch_test_flag(fh, SWITCH_FILE_PAUSE)) {
+			if (fh->cache_encoded) {
+				switch_codec_t *write_codec = switch_core_session_get_write_codec(session);
+
+				/* the frames only fit the codec they were encoded with and can't take a volume or speed change */
+				if (!write_codec || write_codec->implementation != enc_impl || fh->vol || fh->speed) {
+					switch_core_file_cache_decode(fh);
+					write_frame.codec = &codec;
+					samples = codec.implementation->samples_per_packet;
+					framelen = codec.implementation->decoded_bytes_per_packet;
+					test_native = last_native = 0;
+					switch_buffer_zero(fh->audio_buffer);
+				}
+			}
+
+			if (fh->cache_encoded) {
+				olen = FILE_STARTSAMPLES * sizeof(*abuf);
+				if (switch_core_file_cache_read_encoded(fh, abuf, &olen, &enc_samples) != SWITCH_STATUS_SUCCESS) {
+					break;
+				}
+				switch_clear_flag(fh, SWITCH_FILE_SEEK);
+				do_speed = 0;
+			} else if (switch_test_flag(fh, SWITCH_FILE_PAUSE)) {
 				if (framelen > FILE_STARTSAMPLES) {
 					framelen = FILE_STARTSAMPLES;
 				}
@@ -1598,7 +1635,7 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 				continue;
 			}
 			
-			if (olen < llen) {
+			if (olen < llen && !fh->cache_encoded) {
 				uint8_t *dp = (uint8_t *) write_frame.data;
 				memset(dp + (int) olen, 255, (int) (llen - olen));
 				olen = llen;
@@ -1648,7 +1685,10 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 			more_data = 0;
 			write_frame.samples = (uint32_t) olen;
 
-			if (switch_test_flag(fh, SWITCH_FILE_NATIVE)) {
+			if (fh->cache_encoded) {
+				write_frame.samples = enc_samples;
+				write_frame.datalen = (uint32_t) olen;
+			} else if (switch_test_flag(fh, SWITCH_FILE_NATIVE)) {
 				write_frame.datalen = (uint32_t) olen;
 			} else {
 				write_frame.datalen = write_frame.samples * 2;
@@ -194,6 +194,7 @@ static switch_status_t switch_loadable_module_process(char *key, switch_loadable
 							switch_core_hash_insert(loadable_modules.codec_hash, impl->iananame, (const void *) ptr);
 						}
 					}
+					switch_core_media_flush_codec_cache();
 					if (switch_event_create(&event, SWITCH_EVENT_MODULE_LOAD) == SWITCH_STATUS_SUCCESS) {
 						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "type", "codec");
 						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "name", ptr->interface_name);
@@ -918,6 +919,7 @@ static switch_status_t switch_loadable_module_unprocess(switch_loadable_module_t
 							switch_core_hash_delete(loadable_modules.codec_hash, impl->iananame);
 						}
 					}
+					switch_core_media_flush_codec_cache();
 					if (switch_event_create(&event, SWITCH_EVENT_MODULE_UNLOAD) == SWITCH_STATUS_SUCCESS) {
 						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "type", "codec");
 						switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "name", ptr->interface_name);
@@ -1851,6 +1853,9 @@ static switch_status_t do_shutdown(switch_loadable_module_t *module, switch_bool
 	int32_t flags = switch_core_flags();
 	switch_assert(module != NULL);
 
+	/* idle pooled codecs hold references on their interfaces */
+	switch_core_codec_pool_flush();
+
 	if (fail_if_busy && module->module_interface->rwlock && switch_thread_rwlock_trywrlock(module->module_interface->rwlock) != SWITCH_STATUS_SUCCESS) {
 		if (err) {
 			*err = "Module in use.";
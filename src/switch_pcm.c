@@ -267,6 +267,29 @@ static switch_status_t switch_g711a_destroy(switch_codec_t *codec)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+static switch_status_t switch_g711u_to_g711a(const void *in_data, uint32_t in_data_len, void *out_data, uint32_t *out_data_len)
+{
+	if (*out_data_len < in_data_len) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	ulaw_to_alaw_block(out_data, in_data, in_data_len);
+	*out_data_len = in_data_len;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static switch_status_t switch_g711a_to_g711u(const void *in_data, uint32_t in_data_len, void *out_data, uint32_t *out_data_len)
+{
+	if (*out_data_len < in_data_len) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	alaw_to_ulaw_block(out_data, in_data, in_data_len);
+	*out_data_len = in_data_len;
+
+	return SWITCH_STATUS_SUCCESS;
+}
 
 static void mod_g711_load(switch_loadable_module_interface_t ** module_interface, switch_memory_pool_t *pool)
 {
@@ -314,6 +337,9 @@ static void mod_g711_load(switch_loadable_module_interface_t ** module_interface
 											 switch_g711a_decode,	/* function to decode encoded data into raw data */
 											 switch_g711a_destroy);	/* deinitalize a codec handle using this implementation */
 	}
+
+	switch_core_codec_add_transcoder("PCMU", "PCMA", 8000, switch_g711u_to_g711a);
+	switch_core_codec_add_transcoder("PCMA", "PCMU", 8000, switch_g711a_to_g711u);
 }
 
 SWITCH_MODULE_LOAD_FUNCTION(core_pcm_load)
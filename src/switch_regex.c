@@ -125,6 +125,68 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 	return match_count;
 }
 
+SWITCH_DECLARE(switch_regex_t *) switch_regex_compile_expression(const char *expression)
+{
+	const char *error = NULL;
+	int erroffset = 0;
+	pcre *re = NULL;
+	char *tmp = NULL;
+	uint32_t flags = 0;
+	char abuf[256] = "";
+
+	if (!expression) {
+		return NULL;
+	}
+
+	if (*expression == '_') {
+		if (switch_ast2regex(expression + 1, abuf, sizeof(abuf))) {
+			expression = abuf;
+		}
+	}
+
+	if (*expression == '/') {
+		char *opts = NULL;
+		tmp = strdup(expression + 1);
+		assert(tmp);
+		if ((opts = strrchr(tmp, '/'))) {
+			*opts++ = '\0';
+		} else {
+			goto end;
+		}
+		expression = tmp;
+		if (strchr(opts, 'i')) {
+			flags |= PCRE_CASELESS;
+		}
+		if (strchr(opts, 's')) {
+			flags |= PCRE_DOTALL;
+		}
+	}
+
+	re = pcre_compile(expression, flags, &error, &erroffset, NULL);
+
+	if (error) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "COMPILE ERROR: %d [%s][%s]\n", erroffset, error, expression);
+		switch_regex_safe_free(re);
+	}
+
+  end:
+	switch_safe_free(tmp);
+	return (switch_regex_t *) re;
+}
+
+SWITCH_DECLARE(int) switch_regex_exec(switch_regex_t *re, const char *field, int *ovector, uint32_t olen)
+{
+	int match_count;
+
+	if (!(re && field)) {
+		return 0;
+	}
+
+	match_count = pcre_exec((pcre *) re, NULL, field, (int) strlen(field), 0, 0, ovector, olen);
+
+	return match_count > 0 ? match_count : 0;
+}
+
 SWITCH_DECLARE(void) switch_perform_substitution(switch_regex_t *re, int match_count, const char *data, const char *field_data,
 												 char *substituted, switch_size_t len, int *ovector)
 {
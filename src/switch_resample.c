@@ -36,6 +36,12 @@
 #include <switch_private.h>
 #endif
 #include <speex/speex_resampler.h>
+#include "private/switch_core_pvt.h"
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 #define NORMFACT (float)0x8000
 #define MAXSAMPLE (float)0x7FFF
@@ -52,6 +58,217 @@
 
 #define resample_buffer(a, b, c) a > b ? ((a / 1000) / 2) * c : ((b / 1000) / 2) * c
 
+/* Mono conversions between rates that are whole multiples of each other (8k, 16k, 48k ...) run through a polyphase
+   FIR whose coefficients are built once at startup and shared by every handle with the same quality and ratio; each
+   handle only keeps its sample history. The filters follow the speex quality table (length, pass band and Kaiser
+   window) so taking this path does not change what gets through. Everything else goes to speex. */
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define RESAMPLE_MAX_RATIO 6
+#define RESAMPLE_MAX_QUALITY 10
+#define RESAMPLE_TAP_ALIGN 8
+
+typedef struct {
+	uint32_t ratio;
+	int up;
+	/* real window length in input samples */
+	uint32_t window;
+	/* window length padded for the vector loops, coefficients past the real window are zero */
+	uint32_t taps;
+	/* phases * taps coefficients, each phase stored reversed so it lines up with the input */
+	float *coef;
+} resample_filter_t;
+
+typedef struct {
+	const resample_filter_t *filter;
+	float *work;
+	uint32_t work_size;
+	/* down sampling: where the next output lands in the next input block */
+	uint32_t skip;
+} fast_resampler_t;
+
+/* mirrors quality_map in libs/speex/libspeex/resample.c: filter length in samples at the lower rate, pass band as a
+   fraction of the lower nyquist when going down and up, and the Kaiser window beta */
+static const struct {
+	uint32_t base_length;
+	double down_bandwidth;
+	double up_bandwidth;
+	double beta;
+} resample_quality[RESAMPLE_MAX_QUALITY + 1] = {
+	{8, 0.830, 0.860, 6},
+	{16, 0.850, 0.880, 6},
+	{32, 0.882, 0.910, 6},
+	{48, 0.895, 0.917, 8},
+	{64, 0.921, 0.940, 8},
+	{80, 0.922, 0.940, 10},
+	{96, 0.940, 0.945, 10},
+	{128, 0.950, 0.950, 10},
+	{160, 0.960, 0.960, 10},
+	{192, 0.968, 0.968, 12},
+	{256, 0.975, 0.975, 12}
+};
+
+static resample_filter_t *resample_filters[RESAMPLE_MAX_QUALITY + 1][2][RESAMPLE_MAX_RATIO + 1];
+
+static double resample_bessel_i0(double x)
+{
+	double sum = 1, term = 1;
+	int k;
+
+	for (k = 1; term > sum * 1e-12; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+static void resample_build_filter(switch_memory_pool_t *pool, int quality, uint32_t ratio, int up)
+{
+	resample_filter_t *filter;
+	uint32_t base = resample_quality[quality].base_length, len = base * ratio, phases = up ? ratio : 1, n, p, j;
+	double bandwidth = up ? resample_quality[quality].up_bandwidth : resample_quality[quality].down_bandwidth;
+	double beta = resample_quality[quality].beta, i0_beta = resample_bessel_i0(beta);
+	double *h, fc = bandwidth / (2.0 * ratio), center = (len - 1) / 2.0, sum = 0, gain;
+
+	filter = switch_core_alloc(pool, sizeof(*filter));
+	filter->ratio = ratio;
+	filter->up = up;
+	filter->window = up ? base : len;
+	filter->taps = (filter->window + RESAMPLE_TAP_ALIGN - 1) / RESAMPLE_TAP_ALIGN * RESAMPLE_TAP_ALIGN;
+	filter->coef = switch_core_alloc(pool, phases * filter->taps * sizeof(float));
+
+	switch_malloc(h, len * sizeof(double));
+
+	/* kaiser windowed sinc low pass at the speex pass band, fc is in cycles per sample at the higher rate */
+	for (n = 0; n < len; n++) {
+		double x = n - center, r = x / center, w;
+
+		w = resample_bessel_i0(beta * sqrt(1 - r * r)) / i0_beta;
+		h[n] = (x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x)) * w;
+		sum += h[n];
+	}
+
+	/* unity gain at DC, up sampling spreads each input over ratio outputs */
+	gain = (up ? ratio : 1) / sum;
+
+	for (p = 0; p < phases; p++) {
+		for (j = 0; j < filter->window; j++) {
+			uint32_t k = up ? p + (filter->window - 1 - j) * ratio : len - 1 - j;
+			filter->coef[p * filter->taps + j] = (float) (h[k] * gain);
+		}
+	}
+
+	free(h);
+
+	resample_filters[quality][up][ratio] = filter;
+}
+
+void switch_core_resample_init(switch_memory_pool_t *pool)
+{
+	uint32_t ratio;
+	int quality;
+
+	for (quality = 0; quality <= RESAMPLE_MAX_QUALITY; quality++) {
+		for (ratio = 2; ratio <= RESAMPLE_MAX_RATIO; ratio++) {
+			resample_build_filter(pool, quality, ratio, 1);
+			resample_build_filter(pool, quality, ratio, 0);
+		}
+	}
+}
+
+static inline float resample_dot(const float *coef, const float *in, uint32_t taps)
+{
+	uint32_t i;
+#if defined(__AVX__)
+	__m256 acc = _mm256_setzero_ps();
+	float v[8];
+
+	for (i = 0; i < taps; i += 8) {
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(coef + i), _mm256_loadu_ps(in + i)));
+	}
+
+	_mm256_storeu_ps(v, acc);
+	return v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+#elif defined(__SSE__)
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	float v[4];
+
+	for (i = 0; i < taps; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(coef + i), _mm_loadu_ps(in + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(coef + i + 4), _mm_loadu_ps(in + i + 4)));
+	}
+
+	_mm_storeu_ps(v, _mm_add_ps(acc0, acc1));
+	return v[0] + v[1] + v[2] + v[3];
+#else
+	float a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+
+	for (i = 0; i < taps; i += 4) {
+		a0 += coef[i] * in[i];
+		a1 += coef[i + 1] * in[i + 1];
+		a2 += coef[i + 2] * in[i + 2];
+		a3 += coef[i + 3] * in[i + 3];
+	}
+
+	return a0 + a1 + a2 + a3;
+#endif
+}
+
+static inline int16_t resample_clip(float f)
+{
+	if (f >= 32767.0f) return 32767;
+	if (f <= -32768.0f) return -32768;
+	return (int16_t) (f >= 0 ? f + 0.5f : f - 0.5f);
+}
+
+static uint32_t fast_resample_process(fast_resampler_t *fast, int16_t *src, uint32_t srclen, int16_t *dst, uint32_t dstlen)
+{
+	const resample_filter_t *filter = fast->filter;
+	uint32_t hist = filter->window - 1, need = hist + srclen + filter->taps, i, p, out = 0;
+	float *work;
+
+	if (need > fast->work_size) {
+		float *tmp;
+
+		if (!(tmp = realloc(fast->work, need * sizeof(float)))) {
+			return 0;
+		}
+		memset(tmp + fast->work_size, 0, (need - fast->work_size) * sizeof(float));
+		fast->work = tmp;
+		fast->work_size = need;
+	}
+
+	work = fast->work;
+
+	for (i = 0; i < srclen; i++) {
+		work[hist + i] = (float) src[i];
+	}
+	memset(work + hist + srclen, 0, filter->taps * sizeof(float));
+
+	if (filter->up) {
+		for (i = 0; i < srclen && out + filter->ratio <= dstlen; i++) {
+			for (p = 0; p < filter->ratio; p++) {
+				dst[out++] = resample_clip(resample_dot(filter->coef + p * filter->taps, work + i, filter->taps));
+			}
+		}
+	} else {
+		for (i = fast->skip; i < srclen; i += filter->ratio) {
+			if (out < dstlen) {
+				dst[out++] = resample_clip(resample_dot(filter->coef, work + i, filter->taps));
+			}
+		}
+		fast->skip = i - srclen;
+	}
+
+	memmove(work, work + srclen, hist * sizeof(float));
+
+	return out;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
 															   uint32_t from_rate, uint32_t to_rate,
 															   uint32_t to_size,
@@ -60,12 +277,30 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 	int err = 0;
 	switch_audio_resampler_t *resampler;
 	double lto_rate, lfrom_rate;
+	const resample_filter_t *filter = NULL;
 
 	switch_zmalloc(resampler, sizeof(*resampler));
 
-	resampler->resampler = speex_resampler_init(channels ? channels : 1, from_rate, to_rate, quality, &err);
+	/* only when there is a table built for the quality asked for, anything else is left to speex */
+	if (channels <= 1 && from_rate && to_rate && quality >= 0 && quality <= RESAMPLE_MAX_QUALITY) {
+		if (to_rate > from_rate && !(to_rate % from_rate) && to_rate / from_rate <= RESAMPLE_MAX_RATIO) {
+			filter = resample_filters[quality][1][to_rate / from_rate];
+		} else if (from_rate > to_rate && !(from_rate % to_rate) && from_rate / to_rate <= RESAMPLE_MAX_RATIO) {
+			filter = resample_filters[quality][0][from_rate / to_rate];
+		}
+	}
 
-	if (!resampler->resampler) {
+	if (filter) {
+		fast_resampler_t *fast;
+
+		switch_zmalloc(fast, sizeof(*fast));
+		fast->filter = filter;
+		resampler->fast = fast;
+	} else {
+		resampler->resampler = speex_resampler_init(channels ? channels : 1, from_rate, to_rate, quality, &err);
+	}
+
+	if (!resampler->resampler && !resampler->fast) {
 		free(resampler);
 		return SWITCH_STATUS_GENERR;
 	}
@@ -87,6 +322,12 @@ SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resa
 SWITCH_DECLARE(uint32_t) switch_resample_process(switch_audio_resampler_t *resampler, int16_t *src, uint32_t srclen)
 {
 	resampler->to_len = resampler->to_size;
+
+	if (resampler->fast) {
+		resampler->to_len = fast_resample_process(resampler->fast, src, srclen, resampler->to, resampler->to_size);
+		return resampler->to_len;
+	}
+
 	speex_resampler_process_interleaved_int(resampler->resampler, src, &srclen, resampler->to, &resampler->to_len);
 	return resampler->to_len;
 }
@@ -98,6 +339,11 @@ SWITCH_DECLARE(void) switch_resample_destroy(switch_audio_resampler_t **resample
 		if ((*resampler)->resampler) {
 			speex_resampler_destroy((*resampler)->resampler);
 		}
+		if ((*resampler)->fast) {
+			fast_resampler_t *fast = (fast_resampler_t *) (*resampler)->fast;
+			free(fast->work);
+			free(fast);
+		}
 		free((*resampler)->to);
 		free(*resampler);
 		*resampler = NULL;
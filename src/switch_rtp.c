@@ -56,6 +56,17 @@
 
 #define FIR_COUNTDOWN 50
 
+/* sent video packets kept for RTCP generic NACK (RFC 4585) retransmission */
+#define RTP_NACK_RING_SIZE 512
+#define RTP_NACK_MAX_PACKET 1500
+#define RTP_NACK_MAX_RESEND 2
+/* losses bigger than this are not worth repairing a packet at a time, it is also the width of the pending loss bitmap */
+#define RTP_NACK_MAX_GAP 64
+/* a missing packet is only asked for once it is this many packets behind the newest or has been missing this long,
+   anything arriving out of order within that window costs nothing */
+#define RTP_NACK_REORDER_PACKETS 3
+#define RTP_NACK_REORDER_MS 20
+
 #define READ_INC(rtp_session) switch_mutex_lock(rtp_session->read_mutex); rtp_session->reading++
 #define READ_DEC(rtp_session)  switch_mutex_unlock(rtp_session->read_mutex); rtp_session->reading--
 #define WRITE_INC(rtp_session)  switch_mutex_lock(rtp_session->write_mutex); rtp_session->writing++
@@ -118,6 +129,18 @@ typedef struct {
 	uint8_t r3;
 } rtcp_fir_t;
 
+typedef struct {
+	uint16_t pid;
+	uint16_t blp;
+} rtcp_nack_t;
+
+typedef struct {
+	uint16_t seq;
+	uint16_t len;
+	uint8_t resends;
+	char data[RTP_NACK_MAX_PACKET];
+} rtp_sent_packet_t;
+
 #ifdef _MSC_VER
 #pragma pack(push, r1, 1)
 #endif
@@ -295,6 +318,13 @@ struct switch_rtp {
 	rtcp_ext_msg_t rtcp_ext_send_msg;
 	uint8_t fir_seq;
 	uint16_t fir_countdown;
+	rtp_sent_packet_t *sent_ring;
+	switch_mutex_t *nack_mutex;
+	uint16_t nack_seq;
+	uint8_t nack_seq_valid;
+	/* bit i set while packet nack_seq - 1 - i is missing and not asked for yet */
+	uint64_t nack_lost;
+	switch_time_t nack_lost_time;
 	ts_normalize_t ts_norm;
 	switch_sockaddr_t *remote_addr, *rtcp_remote_addr;
 	rtp_msg_t recv_msg;
@@ -1338,6 +1368,66 @@ static uint8_t get_next_write_ts(switch_rtp_t *rtp_session, uint32_t timestamp)
 	return m;
 }
 
+static void send_rtcp_ext_msg(switch_rtp_t *rtp_session, switch_size_t rtcp_bytes)
+{
+
+#ifdef ENABLE_SRTP
+	if (rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND]) {
+		int sbytes = (int) rtcp_bytes;
+		int stat = srtp_protect_rtcp(rtp_session->send_ctx[rtp_session->srtp_idx_rtcp], &rtp_session->rtcp_ext_send_msg.header, &sbytes);
+		
+		if (stat) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "Error: SRTP RTCP protection failed with code %d\n", stat);
+			goto end;
+		} else {
+			rtcp_bytes = sbytes;
+		}
+
+	}
+#endif
+
+#ifdef ENABLE_ZRTP
+	/* ZRTP Send */
+	if (zrtp_on && !rtp_session->flags[SWITCH_RTP_FLAG_PROXY_MEDIA]) {
+		unsigned int sbytes = (int) rtcp_bytes;
+		zrtp_status_t stat = zrtp_status_fail;
+
+		stat = zrtp_process_rtcp(rtp_session->zrtp_stream, (void *) &rtp_session->rtcp_ext_send_msg, &sbytes);
+
+		switch (stat) {
+		case zrtp_status_ok:
+			break;
+		case zrtp_status_drop:
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error: zRTP protection drop with code %d\n", stat);
+			goto end;
+			break;
+		case zrtp_status_fail:
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error: zRTP protection fail with code %d\n", stat);
+			break;
+		default:
+			break;
+		}
+
+		rtcp_bytes = sbytes;
+	}
+#endif
+
+#ifdef DEBUG_EXTRA
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_CRIT, "%s SEND %s RTCP %ld\n", 
+					  switch_core_session_get_name(rtp_session->session),
+					  rtp_session->flags[SWITCH_RTP_FLAG_VIDEO] ? "video" : "audio", rtcp_bytes);
+#endif
+	if (switch_socket_sendto(rtp_session->rtcp_sock_output, rtp_session->rtcp_remote_addr, 0, (void *)&rtp_session->rtcp_ext_send_msg, &rtcp_bytes ) != SWITCH_STATUS_SUCCESS) {			
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG,"RTCP packet not written\n");
+	} else {
+		rtp_session->stats.inbound.period_packet_count = 0;
+	}
+
+ end:
+
+	return;
+}
+
 static void send_fir(switch_rtp_t *rtp_session)
 {
 
@@ -1377,63 +1467,213 @@ static void send_fir(switch_rtp_t *rtp_session)
 		rtp_session->rtcp_ext_send_msg.header.length = htons((u_short)(rtcp_bytes / 4) - 1); 
 		
 
-#ifdef ENABLE_SRTP
-		if (rtp_session->flags[SWITCH_RTP_FLAG_SECURE_SEND]) {
-			int sbytes = (int) rtcp_bytes;
-			int stat = srtp_protect_rtcp(rtp_session->send_ctx[rtp_session->srtp_idx_rtcp], &rtp_session->rtcp_ext_send_msg.header, &sbytes);
-			
-			if (stat) {
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_ERROR, "Error: SRTP RTCP protection failed with code %d\n", stat);
-				goto end;
-			} else {
-				rtcp_bytes = sbytes;
-			}
+		send_rtcp_ext_msg(rtp_session, rtcp_bytes);
+	}
+}
+
+
+/* ask for every packet in lost, bit i is packet newest - 1 - i; returns how many were asked for */
+static uint32_t send_nack(switch_rtp_t *rtp_session, uint32_t ssrc, uint16_t newest, uint64_t lost)
+{
+	rtcp_nack_t *nack = (rtcp_nack_t *) rtp_session->rtcp_ext_send_msg.body;
+	switch_size_t rtcp_bytes;
+	uint32_t count = 0;
+	int i, j, n = 0;
+
+	if (!lost || !rtp_session->rtcp_sock_output || !rtp_session->flags[SWITCH_RTP_FLAG_ENABLE_RTCP]) {
+		return 0;
+	}
+
+	rtp_session->rtcp_ext_send_msg.header.version = 2;
+	rtp_session->rtcp_ext_send_msg.header.p = 0;
+	rtp_session->rtcp_ext_send_msg.header.fmt = 1;
+	rtp_session->rtcp_ext_send_msg.header.pt = 205;
+
+	rtp_session->rtcp_ext_send_msg.header.send_ssrc = htonl(rtp_session->ssrc);
+	rtp_session->rtcp_ext_send_msg.header.recv_ssrc = htonl(ssrc);
 
+	/* each entry covers a packet id and a bitmask of the 16 after it, oldest first */
+	for (i = RTP_NACK_MAX_GAP - 1; i >= 0; i--) {
+		uint16_t blp = 0;
+
+		if (!(lost & ((uint64_t) 1 << i))) {
+			continue;
 		}
-#endif
 
-#ifdef ENABLE_ZRTP
-		/* ZRTP Send */
-		if (zrtp_on && !rtp_session->flags[SWITCH_RTP_FLAG_PROXY_MEDIA]) {
-			unsigned int sbytes = (int) rtcp_bytes;
-			zrtp_status_t stat = zrtp_status_fail;
+		count++;
 
-			stat = zrtp_process_rtcp(rtp_session->zrtp_stream, (void *) &rtp_session->rtcp_ext_send_msg, &sbytes);
+		for (j = 1; j <= 16 && i - j >= 0; j++) {
+			if (lost & ((uint64_t) 1 << (i - j))) {
+				blp |= (uint16_t) (1 << (j - 1));
+				lost &= ~((uint64_t) 1 << (i - j));
+				count++;
+			}
+		}
 
-			switch (stat) {
-			case zrtp_status_ok:
-				break;
-			case zrtp_status_drop:
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error: zRTP protection drop with code %d\n", stat);
-				goto end;
-				break;
-			case zrtp_status_fail:
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error: zRTP protection fail with code %d\n", stat);
-				break;
-			default:
-				break;
+		nack[n].pid = htons((uint16_t) (newest - 1 - i));
+		nack[n].blp = htons(blp);
+		n++;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG1, "Sending RTCP NACK for %u packet(s) before seq %u\n", count, newest);
+
+	rtcp_bytes = sizeof(switch_rtcp_ext_hdr_t) + n * sizeof(rtcp_nack_t);
+	rtp_session->rtcp_ext_send_msg.header.length = htons((u_short)(rtcp_bytes / 4) - 1);
+
+	send_rtcp_ext_msg(rtp_session, rtcp_bytes);
+
+	return count;
+}
+
+/* remember what went out so it can be sent again if the peer NACKs it */
+static void store_sent_packet(switch_rtp_t *rtp_session, void *packet, switch_size_t bytes)
+{
+	rtp_sent_packet_t *sent = &rtp_session->sent_ring[rtp_session->seq & (RTP_NACK_RING_SIZE - 1)];
+
+	switch_mutex_lock(rtp_session->nack_mutex);
+	if (bytes > RTP_NACK_MAX_PACKET) {
+		sent->len = 0;
+	} else {
+		memcpy(sent->data, packet, bytes);
+		sent->len = (uint16_t) bytes;
+		sent->seq = rtp_session->seq;
+		sent->resends = 0;
+	}
+	switch_mutex_unlock(rtp_session->nack_mutex);
+}
+
+static void resend_packet(switch_rtp_t *rtp_session, uint16_t seq)
+{
+	rtp_sent_packet_t *sent = &rtp_session->sent_ring[seq & (RTP_NACK_RING_SIZE - 1)];
+	switch_size_t bytes;
+
+	rtp_session->stats.outbound.nack_packet_count++;
+
+	if (!sent->len || sent->seq != seq || sent->resends >= RTP_NACK_MAX_RESEND) {
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG1, "NACK for seq %u cannot be served\n", seq);
+		return;
+	}
+
+	bytes = sent->len;
+
+	if (switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, (void *) sent->data, &bytes) == SWITCH_STATUS_SUCCESS) {
+		sent->resends++;
+		rtp_session->stats.outbound.retransmit_packet_count++;
+	}
+}
+
+static void handle_nack(switch_rtp_t *rtp_session, rtcp_nack_t *nack, switch_size_t count)
+{
+	switch_size_t n;
+	uint16_t pid, blp;
+	int i;
+
+	switch_mutex_lock(rtp_session->nack_mutex);
+	for (n = 0; n < count; n++) {
+		pid = ntohs(nack[n].pid);
+		blp = ntohs(nack[n].blp);
+
+		resend_packet(rtp_session, pid);
+
+		for (i = 0; i < 16; i++) {
+			if (blp & (1 << i)) {
+				resend_packet(rtp_session, (uint16_t) (pid + i + 1));
 			}
+		}
+	}
+	switch_mutex_unlock(rtp_session->nack_mutex);
+}
 
-			rtcp_bytes = sbytes;
+/* walk a (possibly compound) RTCP packet looking for generic NACKs */
+static void process_rtcp_nack(switch_rtp_t *rtp_session, switch_size_t bytes)
+{
+	uint8_t *p = (uint8_t *) rtp_session->rtcp_recv_msg_p, *end = p + bytes;
+	switch_rtcp_ext_hdr_t *hdr;
+	switch_size_t len;
+
+	while (p + sizeof(*hdr) <= end) {
+		hdr = (switch_rtcp_ext_hdr_t *) p;
+		len = (ntohs((uint16_t) hdr->length) + 1) * 4;
+
+		if (hdr->version != 2 || p + len > end) {
+			break;
 		}
-#endif
 
-#ifdef DEBUG_EXTRA
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_CRIT, "%s SEND %s RTCP %ld\n", 
-						  switch_core_session_get_name(rtp_session->session),
-						  rtp_session->flags[SWITCH_RTP_FLAG_VIDEO] ? "video" : "audio", rtcp_bytes);
-#endif
-		if (switch_socket_sendto(rtp_session->rtcp_sock_output, rtp_session->rtcp_remote_addr, 0, (void *)&rtp_session->rtcp_ext_send_msg, &rtcp_bytes ) != SWITCH_STATUS_SUCCESS) {			
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG,"RTCP packet not written\n");
-		} else {
-			rtp_session->stats.inbound.period_packet_count = 0;
+		if (hdr->pt == 205 && hdr->fmt == 1 && len > sizeof(*hdr)) {
+			handle_nack(rtp_session, (rtcp_nack_t *) (p + sizeof(*hdr)), (len - sizeof(*hdr)) / sizeof(rtcp_nack_t));
 		}
+
+		p += len;
 	}
+}
 
+/* ask for the pending losses in due and forget about them */
+static void nack_flush(switch_rtp_t *rtp_session, uint64_t due)
+{
+	if (due) {
+		rtp_session->stats.inbound.nack_packet_count += send_nack(rtp_session, ntohl(rtp_session->recv_msg.header.ssrc), rtp_session->nack_seq, due);
+		rtp_session->nack_lost &= ~due;
+	}
+}
 
- end:
+/* called for every video packet received, keeps track of the holes in the sequence and asks for the ones that
+   are still open once the reorder window has passed */
+static void check_nack(switch_rtp_t *rtp_session, uint16_t seq, switch_time_t now)
+{
+	int16_t gap;
 
-	return;
+	if (!rtp_session->nack_seq_valid) {
+		rtp_session->nack_seq = seq;
+		rtp_session->nack_seq_valid = 1;
+		rtp_session->nack_lost = 0;
+		return;
+	}
+
+	gap = (int16_t) (seq - rtp_session->nack_seq);
+
+	if (gap < 0) {
+		/* reordered or a retransmission we asked for, either way it is not missing any more */
+		if (-gap <= RTP_NACK_MAX_GAP) {
+			rtp_session->nack_lost &= ~((uint64_t) 1 << (-gap - 1));
+		}
+	} else if (gap > 0) {
+		uint16_t missing = (uint16_t) (gap - 1);
+
+		if (missing > RTP_NACK_MAX_GAP) {
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG1, "Lost %u video packets, asking for a key frame\n", missing);
+			send_fir(rtp_session);
+			rtp_session->nack_lost = 0;
+			rtp_session->nack_seq = seq;
+			return;
+		}
+
+		/* whatever this packet pushes out of the reorder window is asked for now, before the bitmap moves */
+		if (gap >= RTP_NACK_REORDER_PACKETS - 1) {
+			nack_flush(rtp_session, rtp_session->nack_lost);
+		} else {
+			nack_flush(rtp_session, rtp_session->nack_lost & ~(((uint64_t) 1 << (RTP_NACK_REORDER_PACKETS - 1 - gap)) - 1));
+		}
+
+		rtp_session->nack_lost = gap < RTP_NACK_MAX_GAP ? rtp_session->nack_lost << gap : 0;
+		rtp_session->nack_seq = seq;
+
+		if (missing) {
+			if (!rtp_session->nack_lost) {
+				rtp_session->nack_lost_time = now;
+			}
+
+			rtp_session->nack_lost |= missing < RTP_NACK_MAX_GAP ? ((uint64_t) 1 << missing) - 1 : ~(uint64_t) 0;
+
+			/* the older end of a long hole is already out of the window */
+			if (missing > RTP_NACK_REORDER_PACKETS - 1) {
+				nack_flush(rtp_session, rtp_session->nack_lost & ~(((uint64_t) 1 << (RTP_NACK_REORDER_PACKETS - 1)) - 1));
+			}
+		}
+	}
+
+	if (rtp_session->nack_lost && now - rtp_session->nack_lost_time >= RTP_NACK_REORDER_MS * 1000) {
+		nack_flush(rtp_session, rtp_session->nack_lost);
+	}
 }
 
 
@@ -3090,6 +3330,29 @@ static void jb_callback(stfu_instance_t *i, void *udata)
 
 }
 
+SWITCH_DECLARE(switch_status_t) switch_rtp_activate_nack(switch_rtp_t *rtp_session)
+{
+	if (!switch_rtp_ready(rtp_session) || !rtp_session->flags[SWITCH_RTP_FLAG_VIDEO]) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (rtp_session->sent_ring) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_mutex_init(&rtp_session->nack_mutex, SWITCH_MUTEX_NESTED, rtp_session->pool);
+	rtp_session->nack_seq_valid = 0;
+	rtp_session->nack_lost = 0;
+
+	WRITE_INC(rtp_session);
+	rtp_session->sent_ring = switch_core_alloc(rtp_session->pool, sizeof(rtp_sent_packet_t) * RTP_NACK_RING_SIZE);
+	WRITE_DEC(rtp_session);
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(rtp_session->session), SWITCH_LOG_DEBUG, "Video NACK enabled, keeping %d sent packets\n", RTP_NACK_RING_SIZE);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_DECLARE(stfu_instance_t *) switch_rtp_get_jitter_buffer(switch_rtp_t *rtp_session)
 {
 	if (!switch_rtp_ready(rtp_session) || !rtp_session->jb) {
@@ -4141,6 +4404,10 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 		}
 #endif
 		rtp_session->last_seq = seq;
+
+		if (rtp_session->sent_ring && rtp_session->recv_msg.header.version == 2) {
+			check_nack(rtp_session, seq, now);
+		}
 	
 
 		rtp_session->last_flush_packet_count = rtp_session->stats.inbound.flush_packet_count;
@@ -4347,6 +4614,10 @@ static switch_status_t process_rtcp_packet(switch_rtp_t *rtp_session, switch_siz
 							  ntohl(sr->pc),
 							  ntohl(sr->oc));
 		}
+
+		if (rtp_session->sent_ring) {
+			process_rtcp_nack(rtp_session, *bytes);
+		}
 	} else {
 		if (rtp_session->rtcp_recv_msg_p->header.version != 2) {
 			if (rtp_session->rtcp_recv_msg_p->header.version == 0) {
@@ -5782,6 +6053,10 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 			goto end;
 		}
 
+		if (rtp_session->sent_ring) {
+			store_sent_packet(rtp_session, send_msg, bytes);
+		}
+
 		rtp_session->last_write_ts = this_ts;
 
 		if (rtp_session->queue_delay) {
@@ -6054,7 +6329,16 @@ SWITCH_DECLARE(switch_rtp_stats_t *) switch_rtp_get_stats(switch_rtp_t *rtp_sess
 	}
 
 	if (rtp_session->jb) {
-		s->inbound.largest_jb_size = stfu_n_get_most_qlen(rtp_session->jb);
+		stfu_stats_t jb_stats = { 0 };
+
+		stfu_n_get_stats(rtp_session->jb, &jb_stats);
+		s->inbound.largest_jb_size = jb_stats.most_qlen;
+		s->inbound.jb_size = jb_stats.qlen;
+		s->inbound.jb_jitter_ms = jb_stats.jitter_ms;
+		s->inbound.jb_late_packet_count = jb_stats.late_count;
+		s->inbound.jb_missing_packet_count = jb_stats.missing_count;
+		s->inbound.jb_drop_packet_count = jb_stats.drop_count;
+		s->inbound.jb_reset_count = jb_stats.reset_count;
 	}
 	switch_mutex_unlock(rtp_session->flag_mutex);
 
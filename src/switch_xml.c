@@ -1665,6 +1665,329 @@ SWITCH_DECLARE(switch_xml_t) switch_xml_parse_file(const char *file)
 	return xml;
 }
 
+/* Cache of what the bound search functions return, so the same lookup does not go out to the web tier for every
+   call. Only sections given a key list with switch_xml_fetch_cache_set_keys take part, the key being the section,
+   tag, key name and value plus the listed request params. An answer is kept for the cache-ttl attribute on the
+   returned document, or the default ttl when it has none; a miss (nothing found by any binding) is kept for the
+   negative ttl. A full cache drops the least recently used entry. A hit hands out the cached document itself with a
+   reference taken, the same way switch_xml_root shares the main tree, so it must be treated as read only and given
+   back with switch_xml_free like any other located document. */
+
+#define XML_FETCH_CACHE_KEY_MAX 2048
+#define XML_FETCH_CACHE_MAX_PARAMS 32
+
+typedef struct xml_fetch_cache_keys_s {
+	char *params[XML_FETCH_CACHE_MAX_PARAMS];
+	int count;
+} xml_fetch_cache_keys_t;
+
+typedef struct xml_fetch_cache_entry_s {
+	char *key;
+	/* NULL for a cached miss */
+	switch_xml_t xml;
+	switch_time_t expires;
+	/* most recently used first */
+	struct xml_fetch_cache_entry_s *prev;
+	struct xml_fetch_cache_entry_s *next;
+} xml_fetch_cache_entry_t;
+
+static struct {
+	switch_mutex_t *mutex;
+	switch_memory_pool_t *pool;
+	switch_hash_t *sections;
+	switch_hash_t *entries;
+	xml_fetch_cache_entry_t *head;
+	xml_fetch_cache_entry_t *tail;
+	uint32_t count;
+	uint32_t max;
+	uint32_t ttl;
+	uint32_t negative_ttl;
+	uint64_t hits;
+	uint64_t negative_hits;
+	uint64_t misses;
+	uint64_t stores;
+	uint64_t evictions;
+} fetch_cache;
+
+static void xml_fetch_cache_entry_free(xml_fetch_cache_entry_t *entry)
+{
+	if (entry->xml) {
+		switch_xml_free(entry->xml);
+	}
+	switch_safe_free(entry->key);
+	free(entry);
+}
+
+/* must be called with the cache mutex held */
+static void xml_fetch_cache_unlink(xml_fetch_cache_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		fetch_cache.head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		fetch_cache.tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+}
+
+/* must be called with the cache mutex held */
+static void xml_fetch_cache_link(xml_fetch_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = fetch_cache.head;
+
+	if (fetch_cache.head) {
+		fetch_cache.head->prev = entry;
+	} else {
+		fetch_cache.tail = entry;
+	}
+
+	fetch_cache.head = entry;
+}
+
+/* must be called with the cache mutex held */
+static void xml_fetch_cache_remove(xml_fetch_cache_entry_t *entry)
+{
+	switch_core_hash_delete(fetch_cache.entries, entry->key);
+	xml_fetch_cache_unlink(entry);
+	fetch_cache.count--;
+	xml_fetch_cache_entry_free(entry);
+}
+
+/* builds the key for a lookup, 0 when the section is not cached */
+static int xml_fetch_cache_key(char *buf, switch_size_t len, const char *section, const char *tag_name, const char *key_name,
+							   const char *key_value, switch_event_t *params)
+{
+	xml_fetch_cache_keys_t *keys;
+	switch_size_t used;
+	int i, r = 0;
+
+	if (!fetch_cache.mutex || zstr(section)) {
+		return 0;
+	}
+
+	switch_mutex_lock(fetch_cache.mutex);
+	if ((keys = switch_core_hash_find(fetch_cache.sections, section))) {
+		switch_snprintf(buf, len, "%s|%s|%s|%s", section, switch_str_nil(tag_name), switch_str_nil(key_name), switch_str_nil(key_value));
+		used = strlen(buf);
+
+		for (i = 0; i < keys->count && used < len - 1; i++) {
+			const char *val = params ? switch_event_get_header(params, keys->params[i]) : NULL;
+
+			switch_snprintf(buf + used, len - used, "|%s=%s", keys->params[i], switch_str_nil(val));
+			used += strlen(buf + used);
+		}
+
+		/* a key that did not fit could collide with another lookup */
+		r = used < len - 1;
+	}
+	switch_mutex_unlock(fetch_cache.mutex);
+
+	return r;
+}
+
+/* SWITCH_STATUS_SUCCESS with *xml set to a reference to the cached document on a hit, SWITCH_STATUS_NOTFOUND on a cached miss */
+static switch_status_t xml_fetch_cache_find(const char *key, switch_xml_t *xml)
+{
+	xml_fetch_cache_entry_t *entry;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	switch_mutex_lock(fetch_cache.mutex);
+	if ((entry = switch_core_hash_find(fetch_cache.entries, key))) {
+		if (entry->expires < switch_micro_time_now()) {
+			xml_fetch_cache_remove(entry);
+		} else if (entry->xml) {
+			switch_mutex_lock(REFLOCK);
+			entry->xml->refs++;
+			switch_mutex_unlock(REFLOCK);
+			*xml = entry->xml;
+			xml_fetch_cache_unlink(entry);
+			xml_fetch_cache_link(entry);
+			fetch_cache.hits++;
+			status = SWITCH_STATUS_SUCCESS;
+		} else {
+			fetch_cache.negative_hits++;
+			status = SWITCH_STATUS_NOTFOUND;
+		}
+	}
+
+	if (status == SWITCH_STATUS_FALSE) {
+		fetch_cache.misses++;
+	}
+	switch_mutex_unlock(fetch_cache.mutex);
+
+	return status;
+}
+
+static void xml_fetch_cache_store(const char *key, switch_xml_t xml, uint32_t ttl)
+{
+	xml_fetch_cache_entry_t *entry, *old;
+
+	if (!ttl) {
+		return;
+	}
+
+	switch_zmalloc(entry, sizeof(*entry));
+	entry->key = strdup(key);
+	entry->expires = switch_micro_time_now() + (switch_time_t) ttl * 1000000;
+
+	/* the cache holds one reference, every hit takes another and switch_xml_free gives it back */
+	if (xml && (entry->xml = switch_xml_dup(xml))) {
+		switch_set_flag(entry->xml, SWITCH_XML_ROOT);
+		entry->xml->refs = 1;
+	}
+
+	switch_mutex_lock(fetch_cache.mutex);
+	if ((old = switch_core_hash_find(fetch_cache.entries, key))) {
+		xml_fetch_cache_remove(old);
+	}
+
+	while (fetch_cache.count >= fetch_cache.max && fetch_cache.tail) {
+		xml_fetch_cache_remove(fetch_cache.tail);
+		fetch_cache.evictions++;
+	}
+
+	switch_core_hash_insert(fetch_cache.entries, entry->key, entry);
+	xml_fetch_cache_link(entry);
+	fetch_cache.count++;
+	fetch_cache.stores++;
+	switch_mutex_unlock(fetch_cache.mutex);
+}
+
+static uint32_t xml_fetch_cache_ttl(switch_xml_t node, uint32_t def)
+{
+	const char *ttl;
+
+	if (node && (ttl = switch_xml_attr(node, "cache-ttl"))) {
+		int tmp = atoi(ttl);
+		return tmp > 0 ? (uint32_t) tmp : 0;
+	}
+
+	return def;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_xml_fetch_cache_set_keys(const char *spec)
+{
+	char *dup, *sections[64] = { 0 };
+	int argc, i;
+
+	if (!fetch_cache.mutex) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	dup = strdup(switch_str_nil(spec));
+	argc = switch_separate_string(dup, ';', sections, (sizeof(sections) / sizeof(sections[0])));
+
+	switch_mutex_lock(fetch_cache.mutex);
+	switch_core_hash_destroy(&fetch_cache.sections);
+	switch_core_hash_init(&fetch_cache.sections, fetch_cache.pool);
+
+	for (i = 0; i < argc; i++) {
+		char *name = switch_strip_spaces(sections[i], SWITCH_FALSE), *list;
+		char *params[XML_FETCH_CACHE_MAX_PARAMS] = { 0 };
+		xml_fetch_cache_keys_t *keys;
+		int j, n = 0;
+
+		if (zstr(name)) {
+			continue;
+		}
+
+		if ((list = strchr(name, ':'))) {
+			*list++ = '\0';
+			n = switch_separate_string(list, ',', params, XML_FETCH_CACHE_MAX_PARAMS);
+		}
+
+		keys = switch_core_alloc(fetch_cache.pool, sizeof(*keys));
+		for (j = 0; j < n; j++) {
+			if (!zstr(params[j])) {
+				keys->params[keys->count++] = switch_core_strdup(fetch_cache.pool, switch_strip_spaces(params[j], SWITCH_FALSE));
+			}
+		}
+
+		switch_core_hash_insert(fetch_cache.sections, name, keys);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Caching fetches of section %s keyed on %d params\n", name, keys->count);
+	}
+	switch_mutex_unlock(fetch_cache.mutex);
+
+	free(dup);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(void) switch_xml_fetch_cache_set_ttl(uint32_t ttl, uint32_t negative_ttl, uint32_t max_entries)
+{
+	fetch_cache.ttl = ttl;
+	fetch_cache.negative_ttl = negative_ttl;
+	if (max_entries) {
+		fetch_cache.max = max_entries;
+	}
+}
+
+SWITCH_DECLARE(uint32_t) switch_xml_fetch_cache_flush(const char *section)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+	uint32_t r = 0;
+	switch_size_t len = section ? strlen(section) : 0;
+
+	if (!fetch_cache.mutex) {
+		return 0;
+	}
+
+	switch_mutex_lock(fetch_cache.mutex);
+	for (hi = switch_core_hash_first(fetch_cache.entries); hi;) {
+		switch_core_hash_this(hi, &var, NULL, &val);
+		hi = switch_core_hash_next(hi);
+
+		if (!len || (!strncmp((const char *) var, section, len) && ((const char *) var)[len] == '|')) {
+			xml_fetch_cache_remove((xml_fetch_cache_entry_t *) val);
+			r++;
+		}
+	}
+	switch_mutex_unlock(fetch_cache.mutex);
+
+	return r;
+}
+
+SWITCH_DECLARE(void) switch_xml_fetch_cache_status(switch_stream_handle_t *stream)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+
+	if (!fetch_cache.mutex) {
+		return;
+	}
+
+	switch_mutex_lock(fetch_cache.mutex);
+	stream->write_function(stream, "xml fetch cache %u/%u entries, ttl %us, negative ttl %us\n", fetch_cache.count, fetch_cache.max,
+						   fetch_cache.ttl, fetch_cache.negative_ttl);
+	stream->write_function(stream, "hits %" SWITCH_UINT64_T_FMT " negative hits %" SWITCH_UINT64_T_FMT " misses %" SWITCH_UINT64_T_FMT
+						   " stored %" SWITCH_UINT64_T_FMT " evicted %" SWITCH_UINT64_T_FMT "\n", fetch_cache.hits, fetch_cache.negative_hits,
+						   fetch_cache.misses, fetch_cache.stores, fetch_cache.evictions);
+
+	for (hi = switch_core_hash_first(fetch_cache.sections); hi; hi = switch_core_hash_next(hi)) {
+		xml_fetch_cache_keys_t *keys;
+		int i;
+
+		switch_core_hash_this(hi, &var, NULL, &val);
+		keys = (xml_fetch_cache_keys_t *) val;
+		stream->write_function(stream, "section %s:", (const char *) var);
+		for (i = 0; i < keys->count; i++) {
+			stream->write_function(stream, "%s%s", i ? "," : "", keys->params[i]);
+		}
+		stream->write_function(stream, "\n");
+	}
+	switch_mutex_unlock(fetch_cache.mutex);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 												  const char *tag_name,
 												  const char *key_name,
@@ -1677,6 +2000,18 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 	switch_xml_binding_t *binding;
 	uint8_t loops = 0;
 	switch_xml_section_t sections = BINDINGS ? switch_xml_parse_section_string(section) : 0;
+	char cache_key[XML_FETCH_CACHE_KEY_MAX];
+	int cached = BINDINGS ? xml_fetch_cache_key(cache_key, sizeof(cache_key), section, tag_name, key_name, key_value, params) : 0;
+	uint32_t negative_ttl = fetch_cache.negative_ttl;
+	int not_found = 0;
+
+	if (cached) {
+		switch_status_t cstatus = xml_fetch_cache_find(cache_key, &xml);
+
+		if (cstatus == SWITCH_STATUS_SUCCESS || cstatus == SWITCH_STATUS_NOTFOUND) {
+			goto found;
+		}
+	}
 
 	switch_thread_rwlock_rdlock(B_RWLOCK);
 
@@ -1697,6 +2032,8 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 					if ((p = switch_xml_child(conf, "result"))) {
 						aname = switch_xml_attr(p, "status");
 						if (aname && !strcasecmp(aname, "not found")) {
+							negative_ttl = xml_fetch_cache_ttl(p, negative_ttl);
+							not_found = 1;
 							switch_xml_free(xml);
 							xml = NULL;
 							continue;
@@ -1713,6 +2050,17 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 	}
 	switch_thread_rwlock_unlock(B_RWLOCK);
 
+	if (cached) {
+		if (xml) {
+			xml_fetch_cache_store(cache_key, xml, xml_fetch_cache_ttl(xml, fetch_cache.ttl));
+		} else if (not_found) {
+			/* only an explicit "not found" is remembered, a binding that failed is asked again next time */
+			xml_fetch_cache_store(cache_key, NULL, negative_ttl);
+		}
+	}
+
+  found:
+
 	for (;;) {
 		if (!xml) {
 			if (!(xml = switch_xml_root())) {
@@ -2252,6 +2600,10 @@ SWITCH_DECLARE(switch_xml_t) switch_xml_open_root(uint8_t reload, const char **e
 	}
 	switch_mutex_unlock(XML_LOCK);
 
+	if (reload && root) {
+		switch_xml_fetch_cache_flush(NULL);
+	}
+
 	return root;
 }
 
@@ -2328,6 +2680,13 @@ SWITCH_DECLARE(switch_status_t) switch_xml_init(switch_memory_pool_t *pool, cons
 	switch_core_hash_init(&CACHE_HASH, XML_MEMORY_POOL);
 	switch_core_hash_init(&CACHE_EXPIRES_HASH, XML_MEMORY_POOL);
 
+	memset(&fetch_cache, 0, sizeof(fetch_cache));
+	fetch_cache.pool = XML_MEMORY_POOL;
+	fetch_cache.max = 10000;
+	switch_mutex_init(&fetch_cache.mutex, SWITCH_MUTEX_NESTED, XML_MEMORY_POOL);
+	switch_core_hash_init(&fetch_cache.sections, XML_MEMORY_POOL);
+	switch_core_hash_init(&fetch_cache.entries, XML_MEMORY_POOL);
+
 	switch_thread_rwlock_create(&B_RWLOCK, XML_MEMORY_POOL);
 
 	assert(pool != NULL);
@@ -2359,6 +2718,7 @@ SWITCH_DECLARE(switch_status_t) switch_xml_destroy(void)
 	switch_mutex_unlock(REFLOCK);
 
 	switch_xml_clear_user_cache(NULL, NULL, NULL);
+	switch_xml_fetch_cache_flush(NULL);
 
 	switch_core_hash_destroy(&CACHE_HASH);
 
@@ -0,0 +1,344 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ *
+ *
+ * test_media_bug.c -- shared media bug ring checks
+ *
+ */
+
+#include <switch.h>
+#include "private/switch_core_pvt.h"
+
+#define check(expr) if (!(expr)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #expr); return 1; }
+
+#define SAMPLES 160
+#define FRAME_BYTES (SAMPLES * sizeof(int16_t))
+/* what switch_core_media_bug.c lets the ring grow to */
+#define RING_MAX (1024 * 512)
+
+static switch_memory_pool_t *pool;
+
+/* a bare session with a read ring, the way switch_core_media_bug_add leaves it */
+static switch_core_session_t *new_session(void)
+{
+	switch_core_session_t *session = switch_core_alloc(pool, sizeof(*session));
+
+	session->pool = pool;
+	switch_thread_rwlock_create(&session->bug_rwlock, pool);
+	session->bug_read_ring = switch_core_alloc(pool, sizeof(*session->bug_read_ring));
+	switch_mutex_init(&session->bug_read_ring->mutex, SWITCH_MUTEX_NESTED, pool);
+
+	return session;
+}
+
+static switch_media_bug_t *attach(switch_core_session_t *session)
+{
+	switch_media_bug_t *bug = switch_core_alloc(pool, sizeof(*bug));
+
+	bug->session = session;
+	switch_set_flag(bug, SMBF_READ_STREAM);
+	bug->read_impl.decoded_bytes_per_packet = FRAME_BYTES;
+	bug->read_impl.actual_samples_per_second = 8000;
+	switch_mutex_init(&bug->read_mutex, SWITCH_MUTEX_NESTED, pool);
+
+	switch_thread_rwlock_wrlock(session->bug_rwlock);
+	switch_core_media_bug_ring_skip(session->bug_read_ring, &bug->read_pos);
+	bug->ready = 1;
+	bug->next = session->bugs;
+	session->bugs = bug;
+	switch_thread_rwlock_unlock(session->bug_rwlock);
+
+	return bug;
+}
+
+/* unlink it the way switch_core_media_bug_remove does */
+static void detach(switch_core_session_t *session, switch_media_bug_t *bug)
+{
+	switch_media_bug_t *bp, *last = NULL;
+
+	switch_thread_rwlock_wrlock(session->bug_rwlock);
+	for (bp = session->bugs; bp; last = bp, bp = bp->next) {
+		if (bp == bug) {
+			if (last) {
+				last->next = bp->next;
+			} else {
+				session->bugs = bp->next;
+			}
+			break;
+		}
+	}
+	bug->ready = 0;
+	switch_thread_rwlock_unlock(session->bug_rwlock);
+}
+
+/* every sample is its own index in the stream so a reader can tell exactly where it is */
+static void write_frames(switch_core_session_t *session, uint32_t frames, uint32_t *next)
+{
+	int16_t data[SAMPLES];
+	uint32_t i, j;
+
+	for (i = 0; i < frames; i++) {
+		for (j = 0; j < SAMPLES; j++) {
+			data[j] = (int16_t) (*next)++;
+		}
+		switch_core_media_bug_ring_write(session, session->bug_read_ring, data, sizeof(data), 0);
+	}
+}
+
+/* read up to frames frames and check they continue the stream at *expect */
+static int read_frames(switch_media_bug_t *bug, uint32_t frames, uint32_t *expect)
+{
+	int16_t data[SAMPLES * 4];
+	switch_frame_t frame = { 0 };
+	uint32_t i, got = 0;
+
+	frame.data = data;
+	frame.buflen = FRAME_BYTES;
+
+	while (got < frames && switch_core_media_bug_read_stream(bug, &frame, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS) {
+		for (i = 0; i < frame.samples; i++) {
+			if (data[i] != (int16_t) (*expect)++) {
+				printf("sample %u is %d\n", *expect - 1, data[i]);
+				return -1;
+			}
+		}
+		got++;
+	}
+
+	return (int) got;
+}
+
+static switch_size_t read_inuse(switch_media_bug_t *bug)
+{
+	switch_size_t readp = 0, writep = 0;
+
+	switch_core_media_bug_inuse(bug, &readp, &writep);
+
+	return readp;
+}
+
+/**
+ * Bugs attached at different times share one ring and each reads from where it joined
+ */
+static int test_reader_offsets(void)
+{
+	switch_core_session_t *session = new_session();
+	switch_media_bug_t *a, *b, *c;
+	uint32_t next = 0, expect_a = 0, expect_b, expect_c;
+
+	a = attach(session);
+	write_frames(session, 2, &next);
+
+	b = attach(session);
+	expect_b = next;
+	write_frames(session, 2, &next);
+
+	c = attach(session);
+	expect_c = next;
+	write_frames(session, 1, &next);
+
+	check(read_inuse(a) == 5 * FRAME_BYTES);
+	check(read_inuse(b) == 3 * FRAME_BYTES);
+	check(read_inuse(c) == 1 * FRAME_BYTES);
+
+	/* readers move independently */
+	check(read_frames(a, 2, &expect_a) == 2);
+	check(read_frames(c, 1, &expect_c) == 1);
+	check(read_inuse(a) == 3 * FRAME_BYTES);
+	check(read_inuse(b) == 3 * FRAME_BYTES);
+	check(read_inuse(c) == 0);
+
+	write_frames(session, 1, &next);
+
+	check(read_frames(a, 10, &expect_a) == 4);
+	check(read_frames(b, 10, &expect_b) == 4);
+	check(read_frames(c, 10, &expect_c) == 1);
+	check(expect_a == next && expect_b == next && expect_c == next);
+
+	switch_core_media_bug_ring_destroy(session->bug_read_ring);
+
+	return 0;
+}
+
+/**
+ * The ring grows for the slowest reader up to the limit, past that the slow reader loses the oldest audio
+ */
+static int test_ring_growth(void)
+{
+	switch_core_session_t *session = new_session();
+	switch_media_bug_t *slow, *fast;
+	uint32_t next = 0, expect_fast = 0, expect_slow, i;
+	switch_size_t size;
+
+	slow = attach(session);
+	fast = attach(session);
+
+	write_frames(session, 1, &next);
+	size = session->bug_read_ring->size;
+	check(size == FRAME_BYTES * SWITCH_BUFFER_START_FRAMES);
+
+	for (i = 0; i < SWITCH_BUFFER_START_FRAMES * 2; i++) {
+		write_frames(session, 1, &next);
+		check(read_frames(fast, 2, &expect_fast) >= 1);
+	}
+
+	check(session->bug_read_ring->size > size);
+	check(read_inuse(slow) == next * sizeof(int16_t));
+
+	for (i = 0; i < RING_MAX / FRAME_BYTES * 2; i++) {
+		write_frames(session, 1, &next);
+		check(read_frames(fast, 1, &expect_fast) == 1);
+	}
+
+	check(session->bug_read_ring->size == RING_MAX);
+	check(expect_fast == next);
+
+	/* only the newest ring full is left for the slow one */
+	check(read_inuse(slow) == RING_MAX);
+	expect_slow = next - RING_MAX / sizeof(int16_t);
+	check(read_frames(slow, RING_MAX / FRAME_BYTES + 1, &expect_slow) == RING_MAX / FRAME_BYTES + 1);
+	check(expect_slow == next);
+
+	switch_core_media_bug_ring_destroy(session->bug_read_ring);
+
+	return 0;
+}
+
+/**
+ * A bug removed mid stream stops holding the ring, the others carry on untouched
+ */
+static int test_remove_mid_stream(void)
+{
+	switch_core_session_t *session = new_session();
+	switch_media_bug_t *gone, *stays;
+	uint32_t next = 0, expect = 0, i;
+	switch_size_t size;
+
+	gone = attach(session);
+	stays = attach(session);
+
+	for (i = 0; i < SWITCH_BUFFER_START_FRAMES * 2; i++) {
+		write_frames(session, 1, &next);
+		check(read_frames(stays, 1, &expect) == 1);
+	}
+
+	size = session->bug_read_ring->size;
+	check(size > FRAME_BYTES * SWITCH_BUFFER_START_FRAMES);
+
+	detach(session, gone);
+
+	/* enough to have grown it to the limit had the removed bug still been counted */
+	for (i = 0; i < RING_MAX / FRAME_BYTES * 2; i++) {
+		write_frames(session, 1, &next);
+		check(read_frames(stays, 1, &expect) == 1);
+	}
+
+	check(session->bug_read_ring->size == size);
+	check(expect == next);
+	check(read_inuse(stays) == 0);
+
+	switch_core_media_bug_ring_destroy(session->bug_read_ring);
+
+	return 0;
+}
+
+/**
+ * A bug something is whispered into reads the channel without it from its own buffer, also on frames with
+ * nothing whispered, and never touches the ring again
+ */
+static int test_whisper(void)
+{
+	switch_core_session_t *session = new_session();
+	switch_media_bug_t *bug = attach(session), *other = attach(session);
+	int16_t whisper[SAMPLES], merged[SAMPLES], plain[SAMPLES], out[SAMPLES];
+	switch_frame_t demux_frame = { 0 }, read_frame = { 0 }, frame = { 0 };
+	uint32_t i;
+
+	for (i = 0; i < SAMPLES; i++) {
+		whisper[i] = 1000;
+		merged[i] = 1500;
+		plain[i] = 700;
+	}
+
+	demux_frame.data = whisper;
+	demux_frame.datalen = sizeof(whisper);
+	demux_frame.samples = SAMPLES;
+
+	read_frame.data = merged;
+	read_frame.datalen = sizeof(merged);
+	read_frame.samples = SAMPLES;
+
+	frame.data = out;
+	frame.buflen = sizeof(out);
+
+	switch_core_media_bug_ring_write(session, session->bug_read_ring, merged, sizeof(merged), 0);
+	switch_core_media_bug_set_read_demux_frame(bug, &demux_frame);
+	switch_core_media_bug_feed_read(bug, &read_frame);
+	check(bug->raw_read_buffer != NULL);
+	check(switch_core_media_bug_read_stream(bug, &frame, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS);
+	check(frame.samples == SAMPLES && out[0] == 500 && out[SAMPLES - 1] == 500);
+
+	/* nothing whispered this frame */
+	bug->read_demux_frame = NULL;
+	read_frame.data = plain;
+	switch_core_media_bug_ring_write(session, session->bug_read_ring, plain, sizeof(plain), 0);
+	switch_core_media_bug_feed_read(bug, &read_frame);
+	check(switch_core_media_bug_read_stream(bug, &frame, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS);
+	check(frame.samples == SAMPLES && out[0] == 700);
+
+	/* the other bug still hears what went over the wire, from the ring */
+	check(read_inuse(other) == 2 * FRAME_BYTES);
+	check(switch_core_media_bug_read_stream(other, &frame, SWITCH_FALSE) == SWITCH_STATUS_SUCCESS);
+	check(out[0] == 1500);
+
+	switch_buffer_destroy(&bug->raw_read_buffer);
+	switch_core_media_bug_ring_destroy(session->bug_read_ring);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *err = NULL;
+
+	if (switch_core_init(SCF_MINIMAL, SWITCH_FALSE, &err) != SWITCH_STATUS_SUCCESS) {
+		printf("Cannot init core [%s]\n", err);
+		return 255;
+	}
+
+	switch_core_new_memory_pool(&pool);
+
+	if (test_reader_offsets() || test_ring_growth() || test_remove_mid_stream() || test_whisper()) {
+		return 1;
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+
+	printf("PASS\n");
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ * Copyright (C) 2005-2014, Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Version: MPL 1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License Version
+ * 1.1 (the "License"); you may not use this file except in compliance with
+ * the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS" basis,
+ * WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+ * for the specific language governing rights and limitations under the
+ * License.
+ *
+ * The Original Code is FreeSWITCH Modular Media Switching Software Library / Soft-Switch Application
+ *
+ * The Initial Developer of the Original Code is
+ * Anthony Minessale II <anthm@freeswitch.org>
+ * Portions created by the Initial Developer are Copyright (C)
+ * the Initial Developer. All Rights Reserved.
+ *
+ * Contributor(s):
+ *
+ * Anthony Minessale II <anthm@freeswitch.org>
+ *
+ *
+ * test_resample.c -- integer ratio resampler checks
+ *
+ */
+
+#include <switch.h>
+
+#define check(expr) if (!(expr)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #expr); return 1; }
+
+#define AMPLITUDE 10000.0
+#define SECONDS 2
+
+/* Push SECONDS of a tone through in 20ms frames, return the output level against the input in dB and the sample count */
+static double tone_level(uint32_t from, uint32_t to, double freq, uint32_t *samples)
+{
+	switch_audio_resampler_t *resampler = NULL;
+	uint32_t frame = from / 50, total = from * SECONDS, i, j, out = 0, counted = 0;
+	int16_t data[960];
+	double sum = 0;
+
+	if (switch_resample_create(&resampler, from, to, frame * 2, SWITCH_RESAMPLE_QUALITY, 1) != SWITCH_STATUS_SUCCESS) {
+		return 0;
+	}
+
+	for (i = 0; i < total; i += frame) {
+		for (j = 0; j < frame; j++) {
+			data[j] = (int16_t) (AMPLITUDE * sin(2 * M_PI * freq * (i + j) / from));
+		}
+
+		switch_resample_process(resampler, data, frame);
+
+		/* skip the first half second while the filter fills up */
+		for (j = 0; j < resampler->to_len; j++, out++) {
+			if (out >= to / 2) {
+				sum += (double) resampler->to[j] * resampler->to[j];
+				counted++;
+			}
+		}
+	}
+
+	switch_resample_destroy(&resampler);
+
+	if (samples) {
+		*samples = out;
+	}
+
+	return counted && sum ? 20 * log10(sqrt(sum / counted) / (AMPLITUDE / sqrt(2))) : -200;
+}
+
+static int test_shared_tables(void)
+{
+	switch_audio_resampler_t *resampler = NULL;
+
+	check(switch_resample_create(&resampler, 16000, 8000, 640, SWITCH_RESAMPLE_QUALITY, 1) == SWITCH_STATUS_SUCCESS);
+	check(resampler->fast != NULL);
+	switch_resample_destroy(&resampler);
+
+	/* no table for more than one channel or an uneven ratio, those stay on speex */
+	check(switch_resample_create(&resampler, 16000, 8000, 640, SWITCH_RESAMPLE_QUALITY, 2) == SWITCH_STATUS_SUCCESS);
+	check(resampler->fast == NULL && resampler->resampler != NULL);
+	switch_resample_destroy(&resampler);
+
+	check(switch_resample_create(&resampler, 44100, 8000, 640, SWITCH_RESAMPLE_QUALITY, 1) == SWITCH_STATUS_SUCCESS);
+	check(resampler->fast == NULL && resampler->resampler != NULL);
+	switch_resample_destroy(&resampler);
+
+	return 0;
+}
+
+static int test_pass_band(void)
+{
+	uint32_t samples;
+
+	/* every sample accounted for and a 1k tone through untouched */
+	check(fabs(tone_level(16000, 8000, 1000, &samples)) < 0.1);
+	check(samples == 8000 * SECONDS);
+	check(fabs(tone_level(8000, 48000, 1000, &samples)) < 0.1);
+	check(samples == 48000 * SECONDS);
+
+	/* the top of the narrow band survives going up */
+	check(tone_level(8000, 16000, 3400, NULL) > -1.5);
+	check(tone_level(8000, 48000, 3400, NULL) > -1.5);
+
+	return 0;
+}
+
+static int test_stop_band(void)
+{
+	/* tones above the new nyquist would fold back into the narrow band, they have to be gone */
+	check(tone_level(16000, 8000, 4200, NULL) < -60);
+	check(tone_level(16000, 8000, 4500, NULL) < -60);
+	check(tone_level(48000, 8000, 4500, NULL) < -60);
+	check(tone_level(48000, 16000, 8500, NULL) < -60);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *err = NULL;
+
+	if (switch_core_init(SCF_MINIMAL, SWITCH_FALSE, &err) != SWITCH_STATUS_SUCCESS) {
+		printf("Cannot init core [%s]\n", err);
+		return 255;
+	}
+
+	if (test_shared_tables() || test_pass_band() || test_stop_band()) {
+		return 1;
+	}
+
+	printf("PASS\n");
+
+	return 0;
+}